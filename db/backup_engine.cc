@@ -0,0 +1,674 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/backup_engine.h"
+
+#include <map>
+#include <set>
+#include "db/filename.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "leveldb/table.h"
+#include "port/port.h"
+#include "util/crc32c.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/rate_limiter.h"
+
+namespace leveldb {
+
+BackupEngineOptions::BackupEngineOptions()
+    : env(Env::Default()),
+      rate_limiter(NULL),
+      max_background_operations(1) {
+}
+
+BackupEngine::~BackupEngine() {
+}
+
+namespace {
+
+// A file of a backup
+struct BackupFile {
+  std::string db_name;      // Name in the DB directory, e.g. "000005.sst"
+  std::string path;         // Relative to the backup directory
+  uint32_t crc;             // crc32c of the contents
+  uint64_t size;
+};
+
+struct Backup {
+  uint64_t timestamp;
+  std::vector<BackupFile> files;
+};
+
+// Copies the first "max_size" bytes of "src" to "dst", or only reads
+// them if "dst" is empty, and stores their checksum and size.  If
+// "check" is set, the checksum and size must match the ones already
+// stored.  "shared" files are kept under shared/, named by contents.
+struct FileJob {
+  std::string src;
+  std::string dst;
+  uint64_t max_size;
+  bool shared;
+  bool is_table;
+  bool check;
+  uint32_t crc;
+  uint64_t size;
+  Status status;
+
+  FileJob()
+      : max_size(~static_cast<uint64_t>(0)),
+        shared(false),
+        is_table(false),
+        check(false),
+        crc(0),
+        size(0) {
+  }
+};
+
+// Read all of the blocks of table "fname", checking the footer and the
+// block checksums.
+Status CheckTable(Env* env, const std::string& fname, uint64_t size) {
+  RandomAccessFile* file;
+  Status s = env->NewRandomAccessFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  Table* table;
+  s = Table::Open(Options(), file, size, &table);
+  if (!s.ok()) {
+    s = Status::Corruption(fname, s.ToString());   // E.g. a bad footer
+  } else {
+    ReadOptions options;
+    options.verify_checksums = true;
+    options.fill_cache = false;
+    Iterator* iter = table->NewIterator(options);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) { }
+    s = iter->status();
+    delete iter;
+    iter = table->NewRangeDeletionIterator();
+    if (s.ok() && iter != NULL) {
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) { }
+      s = iter->status();
+    }
+    delete iter;
+    delete table;
+  }
+  delete file;
+  return s;
+}
+
+void RunJob(Env* env, RateLimiter* limiter, FileJob* job) {
+  SequentialFile* src = NULL;
+  WritableFile* dst = NULL;
+  Status s = env->NewSequentialFile(job->src, &src);
+  if (s.ok() && !job->dst.empty()) {
+    s = env->NewWritableFile(job->dst, &dst);
+    if (s.ok()) {
+      dst = NewRateLimitedFile(dst, limiter, RateLimiter::IO_LOW);
+    }
+  }
+
+  uint32_t crc = 0;
+  uint64_t size = 0;
+  if (s.ok()) {
+    static const uint64_t kBufferSize = 65536;
+    char* space = new char[kBufferSize];
+    while (size < job->max_size) {
+      const uint64_t left = job->max_size - size;
+      Slice fragment;
+      s = src->Read((left < kBufferSize) ? left : kBufferSize,
+                    &fragment, space);
+      if (!s.ok() || fragment.empty()) {
+        break;
+      }
+      crc = crc32c::Extend(crc, fragment.data(), fragment.size());
+      size += fragment.size();
+      if (dst != NULL) {
+        s = dst->Append(fragment);
+        if (!s.ok()) {
+          break;
+        }
+      }
+    }
+    delete[] space;
+  }
+  if (s.ok() && dst != NULL) {
+    s = dst->Sync();
+    if (s.ok()) {
+      s = dst->Close();
+    }
+  }
+  delete dst;
+  delete src;
+
+  if (s.ok() && job->check && (crc != job->crc || size != job->size)) {
+    s = Status::Corruption("checksum mismatch", job->src);
+  }
+  if (s.ok() && job->is_table) {
+    s = CheckTable(env, job->dst.empty() ? job->src : job->dst, size);
+  }
+  if (!s.ok() && !job->dst.empty()) {
+    env->DeleteFile(job->dst);
+  }
+  job->crc = crc;
+  job->size = size;
+  job->status = s;
+}
+
+// Jobs shared by the threads running them
+struct JobQueue {
+  Env* env;
+  RateLimiter* limiter;
+  std::vector<FileJob>* jobs;
+  port::Mutex mu;
+  port::CondVar cv;         // Signalled when a helper thread is done
+  size_t next;              // Index of the next job to run
+  int helpers;              // Number of helper threads still running
+
+  JobQueue() : cv(&mu), next(0), helpers(0) { }
+};
+
+void RunQueuedJobs(JobQueue* queue) {
+  MutexLock l(&queue->mu);
+  while (queue->next < queue->jobs->size()) {
+    FileJob* job = &(*queue->jobs)[queue->next++];
+    queue->mu.Unlock();
+    RunJob(queue->env, queue->limiter, job);
+    queue->mu.Lock();
+  }
+}
+
+void HelperThread(void* arg) {
+  JobQueue* queue = reinterpret_cast<JobQueue*>(arg);
+  RunQueuedJobs(queue);
+  MutexLock l(&queue->mu);
+  queue->helpers--;
+  queue->cv.SignalAll();
+}
+
+// Delete the directory "dir" and the files in it, ignoring errors
+void RemoveDir(Env* env, const std::string& dir) {
+  std::vector<std::string> children;
+  env->GetChildren(dir, &children);
+  for (size_t i = 0; i < children.size(); i++) {
+    if (children[i] != "." && children[i] != "..") {
+      env->DeleteFile(dir + "/" + children[i]);
+    }
+  }
+  env->DeleteDir(dir);
+}
+
+// Parse "name" as a backup id
+bool ParseBackupID(const std::string& name, BackupID* id) {
+  Slice in(name);
+  uint64_t n;
+  if (!ConsumeDecimalNumber(&in, &n) || !in.empty() ||
+      n == 0 || n > 0xffffffffu) {
+    return false;
+  }
+  *id = static_cast<BackupID>(n);
+  return true;
+}
+
+// Split "in" at the first occurrence of "c"
+Slice NextToken(Slice* in, char c) {
+  size_t n = 0;
+  while (n < in->size() && (*in)[n] != c) {
+    n++;
+  }
+  Slice token(in->data(), n);
+  in->remove_prefix((n < in->size()) ? n + 1 : n);
+  return token;
+}
+
+class BackupEngineImpl : public BackupEngine {
+ public:
+  explicit BackupEngineImpl(const BackupEngineOptions& options);
+  virtual ~BackupEngineImpl();
+
+  Status Init();
+
+  virtual Status CreateNewBackup(DB* db);
+  virtual void GetBackupInfo(std::vector<BackupInfo>* backups);
+  virtual Status DeleteBackup(BackupID id);
+  virtual Status PurgeOldBackups(uint32_t num_backups_to_keep);
+  virtual Status VerifyBackup(BackupID id);
+  virtual Status RestoreDBFromBackup(BackupID id, const std::string& db_dir);
+  virtual Status RestoreDBFromLatestBackup(const std::string& db_dir);
+
+ private:
+  std::string MetaFileName(BackupID id) const {
+    return options_.backup_dir + "/meta/" + NumberToString(id);
+  }
+  std::string PrivateDir(BackupID id) const {
+    return "private/" + NumberToString(id);
+  }
+  std::string AbsolutePath(const std::string& path) const {
+    return options_.backup_dir + "/" + path;
+  }
+
+  Status ReadBackup(BackupID id, Backup* backup);
+  Status WriteBackup(BackupID id, const Backup& backup);
+
+  // Run "jobs", options_.max_background_operations at a time, and
+  // return the first error.
+  Status RunJobs(std::vector<FileJob>* jobs);
+
+  // Delete the files of the backup directory no backup uses
+  void GarbageCollect();
+
+  const BackupEngineOptions options_;
+  Env* const env_;
+  FileLock* lock_;
+  std::map<BackupID, Backup> backups_;
+};
+
+BackupEngineImpl::BackupEngineImpl(const BackupEngineOptions& options)
+    : options_(options),
+      env_(options.env),
+      lock_(NULL) {
+}
+
+BackupEngineImpl::~BackupEngineImpl() {
+  if (lock_ != NULL) {
+    env_->UnlockFile(lock_);
+  }
+}
+
+Status BackupEngineImpl::Init() {
+  // Ignore errors from CreateDir; the directories may already exist
+  env_->CreateDir(options_.backup_dir);
+  env_->CreateDir(AbsolutePath("meta"));
+  env_->CreateDir(AbsolutePath("private"));
+  env_->CreateDir(AbsolutePath("shared"));
+  Status s = env_->LockFile(AbsolutePath("LOCK"), &lock_);
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::vector<std::string> children;
+  s = env_->GetChildren(AbsolutePath("meta"), &children);
+  for (size_t i = 0; s.ok() && i < children.size(); i++) {
+    BackupID id;
+    if (ParseBackupID(children[i], &id)) {
+      s = ReadBackup(id, &backups_[id]);
+    } else if (children[i] != "." && children[i] != "..") {
+      // Left over from a backup that did not complete
+      env_->DeleteFile(AbsolutePath("meta/" + children[i]));
+    }
+  }
+  if (s.ok()) {
+    GarbageCollect();
+  }
+  return s;
+}
+
+// The file of a backup holds its timestamp, then one line per file:
+//    <name in the DB> <path in the backup directory> <crc32c> <size>
+Status BackupEngineImpl::ReadBackup(BackupID id, Backup* backup) {
+  const std::string fname = MetaFileName(id);
+  std::string contents;
+  Status s = ReadFileToString(env_, fname, &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  Slice in(contents);
+  Slice line = NextToken(&in, '\n');
+  if (!ConsumeDecimalNumber(&line, &backup->timestamp) || !line.empty()) {
+    return Status::Corruption("bad backup timestamp", fname);
+  }
+  backup->files.clear();
+  while (!in.empty()) {
+    line = NextToken(&in, '\n');
+    BackupFile f;
+    f.db_name = NextToken(&line, ' ').ToString();
+    f.path = NextToken(&line, ' ').ToString();
+    uint64_t crc;
+    if (f.db_name.empty() || f.path.empty() ||
+        !ConsumeDecimalNumber(&line, &crc) || !ConsumeChar(&line, ' ') ||
+        !ConsumeDecimalNumber(&line, &f.size) || !line.empty()) {
+      return Status::Corruption("bad backup file entry", fname);
+    }
+    f.crc = static_cast<uint32_t>(crc);
+    backup->files.push_back(f);
+  }
+  return Status::OK();
+}
+
+Status BackupEngineImpl::WriteBackup(BackupID id, const Backup& backup) {
+  std::string contents;
+  AppendNumberTo(&contents, backup.timestamp);
+  contents.push_back('\n');
+  for (size_t i = 0; i < backup.files.size(); i++) {
+    const BackupFile& f = backup.files[i];
+    contents.append(f.db_name);
+    contents.push_back(' ');
+    contents.append(f.path);
+    contents.push_back(' ');
+    AppendNumberTo(&contents, f.crc);
+    contents.push_back(' ');
+    AppendNumberTo(&contents, f.size);
+    contents.push_back('\n');
+  }
+
+  // The backup exists once its file is in place
+  const std::string tmp = MetaFileName(id) + ".tmp";
+  Status s = WriteStringToFile(env_, contents, tmp);
+  if (s.ok()) {
+    s = env_->RenameFile(tmp, MetaFileName(id));
+  }
+  if (!s.ok()) {
+    env_->DeleteFile(tmp);
+  }
+  return s;
+}
+
+Status BackupEngineImpl::RunJobs(std::vector<FileJob>* jobs) {
+  JobQueue queue;
+  queue.env = env_;
+  queue.limiter = options_.rate_limiter;
+  queue.jobs = jobs;
+  int threads = options_.max_background_operations;
+  if (threads > static_cast<int>(jobs->size())) {
+    threads = jobs->size();
+  }
+  // Finished helpers decrement queue.helpers, so count on a copy
+  const int n = (threads > 1) ? threads - 1 : 0;
+  queue.helpers = n;
+  for (int i = 0; i < n; i++) {
+    env_->StartThread(&HelperThread, &queue);
+  }
+  RunQueuedJobs(&queue);
+  {
+    MutexLock l(&queue.mu);
+    while (queue.helpers > 0) {
+      queue.cv.Wait();
+    }
+  }
+
+  for (size_t i = 0; i < jobs->size(); i++) {
+    if (!(*jobs)[i].status.ok()) {
+      return (*jobs)[i].status;
+    }
+  }
+  return Status::OK();
+}
+
+void BackupEngineImpl::GarbageCollect() {
+  std::set<std::string> live;
+  for (std::map<BackupID, Backup>::const_iterator it = backups_.begin();
+       it != backups_.end();
+       ++it) {
+    for (size_t i = 0; i < it->second.files.size(); i++) {
+      live.insert(it->second.files[i].path);
+    }
+  }
+
+  std::vector<std::string> children;
+  env_->GetChildren(AbsolutePath("shared"), &children);
+  for (size_t i = 0; i < children.size(); i++) {
+    const std::string path = "shared/" + children[i];
+    if (children[i] != "." && children[i] != ".." &&
+        live.count(path) == 0) {
+      env_->DeleteFile(AbsolutePath(path));
+    }
+  }
+
+  env_->GetChildren(AbsolutePath("private"), &children);
+  for (size_t i = 0; i < children.size(); i++) {
+    BackupID id;
+    if (children[i] != "." && children[i] != ".." &&
+        (!ParseBackupID(children[i], &id) || backups_.count(id) == 0)) {
+      RemoveDir(env_, AbsolutePath("private/" + children[i]));
+    }
+  }
+}
+
+Status BackupEngineImpl::CreateNewBackup(DB* db) {
+  const BackupID id = backups_.empty() ? 1 : backups_.rbegin()->first + 1;
+
+  // Table files that are already in the backup directory, by their name
+  // and size in the DB.  Table files are never rewritten under the same
+  // number, so these need not be copied again.
+  std::map<std::string, const BackupFile*> shared;
+  for (std::map<BackupID, Backup>::const_iterator it = backups_.begin();
+       it != backups_.end();
+       ++it) {
+    for (size_t i = 0; i < it->second.files.size(); i++) {
+      const BackupFile& f = it->second.files[i];
+      if (Slice(f.path).starts_with("shared/")) {
+        std::string key = f.db_name;
+        key.push_back(' ');
+        AppendNumberTo(&key, f.size);
+        shared[key] = &f;
+      }
+    }
+  }
+
+  // Keep the live files from being compacted away while they are copied
+  Status s = db->DisableFileDeletions();
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<std::string> live;
+  uint64_t manifest_file_size;
+  s = db->GetLiveFiles(&live, &manifest_file_size, true);
+
+  Backup backup;
+  backup.timestamp = env_->NowMicros() / 1000000;
+  std::vector<FileJob> jobs;
+  std::vector<size_t> job_files;    // Index in backup.files of each job
+  if (s.ok()) {
+    s = env_->CreateDir(AbsolutePath(PrivateDir(id)));
+  }
+  for (size_t i = 0; s.ok() && i < live.size(); i++) {
+    BackupFile f;
+    f.db_name = live[i].substr(live[i].rfind('/') + 1);
+    uint64_t number;
+    FileType type;
+    if (!ParseFileName(f.db_name, &number, &type)) {
+      s = Status::Corruption("unexpected live file", live[i]);
+      break;
+    }
+
+    FileJob job;
+    job.src = live[i];
+    if (type == kCurrentFile) {
+      // Written by the restore, once the descriptor is in place
+      continue;
+    } else if (type == kTableFile || type == kBlobFile) {
+      s = env_->GetFileSize(live[i], &f.size);
+      if (!s.ok()) {
+        break;
+      }
+      std::string key = f.db_name;
+      key.push_back(' ');
+      AppendNumberTo(&key, f.size);
+      if (shared.count(key) > 0) {
+        backup.files.push_back(*shared[key]);
+        continue;
+      }
+      // Renamed once its checksum is known
+      job.dst = AbsolutePath("shared/" + f.db_name + ".tmp");
+      job.shared = true;
+      job.is_table = (type == kTableFile);
+    } else if (type == kDescriptorFile) {
+      // The descriptor keeps growing; later edits are not ours
+      f.path = PrivateDir(id) + "/" + f.db_name;
+      job.dst = AbsolutePath(f.path);
+      job.max_size = manifest_file_size;
+    } else {
+      s = Status::Corruption("unexpected live file", live[i]);
+      break;
+    }
+    job_files.push_back(backup.files.size());
+    backup.files.push_back(f);
+    jobs.push_back(job);
+  }
+  if (s.ok()) {
+    s = RunJobs(&jobs);
+  }
+  Status enable = db->EnableFileDeletions();
+  if (s.ok()) {
+    s = enable;
+  }
+
+  for (size_t i = 0; s.ok() && i < jobs.size(); i++) {
+    BackupFile* f = &backup.files[job_files[i]];
+    f->crc = jobs[i].crc;
+    f->size = jobs[i].size;
+    if (jobs[i].shared) {
+      const std::string& name = f->db_name;
+      const size_t dot = name.rfind('.');
+      f->path = "shared/" + name.substr(0, dot) + "_";
+      AppendNumberTo(&f->path, f->crc);
+      f->path.push_back('_');
+      AppendNumberTo(&f->path, f->size);
+      f->path.append(name.substr(dot));
+      s = env_->RenameFile(jobs[i].dst, AbsolutePath(f->path));
+    }
+  }
+  if (s.ok()) {
+    s = WriteBackup(id, backup);
+  }
+  if (s.ok()) {
+    backups_[id] = backup;
+  } else {
+    GarbageCollect();
+  }
+  return s;
+}
+
+void BackupEngineImpl::GetBackupInfo(std::vector<BackupInfo>* backups) {
+  backups->clear();
+  for (std::map<BackupID, Backup>::const_iterator it = backups_.begin();
+       it != backups_.end();
+       ++it) {
+    BackupInfo info;
+    info.backup_id = it->first;
+    info.timestamp = it->second.timestamp;
+    info.number_files = it->second.files.size();
+    for (size_t i = 0; i < it->second.files.size(); i++) {
+      info.size += it->second.files[i].size;
+    }
+    backups->push_back(info);
+  }
+}
+
+Status BackupEngineImpl::DeleteBackup(BackupID id) {
+  if (backups_.count(id) == 0) {
+    return Status::NotFound("no such backup", NumberToString(id));
+  }
+  Status s = env_->DeleteFile(MetaFileName(id));
+  if (s.ok()) {
+    backups_.erase(id);
+    GarbageCollect();
+  }
+  return s;
+}
+
+Status BackupEngineImpl::PurgeOldBackups(uint32_t num_backups_to_keep) {
+  Status s;
+  while (s.ok() && backups_.size() > num_backups_to_keep) {
+    s = DeleteBackup(backups_.begin()->first);
+  }
+  return s;
+}
+
+Status BackupEngineImpl::VerifyBackup(BackupID id) {
+  if (backups_.count(id) == 0) {
+    return Status::NotFound("no such backup", NumberToString(id));
+  }
+  const Backup& backup = backups_[id];
+  std::vector<FileJob> jobs(backup.files.size());
+  for (size_t i = 0; i < backup.files.size(); i++) {
+    const BackupFile& f = backup.files[i];
+    uint64_t number;
+    FileType type;
+    jobs[i].src = AbsolutePath(f.path);
+    jobs[i].is_table = (ParseFileName(f.db_name, &number, &type) &&
+                        type == kTableFile);
+    jobs[i].check = true;
+    jobs[i].crc = f.crc;
+    jobs[i].size = f.size;
+  }
+  return RunJobs(&jobs);
+}
+
+Status BackupEngineImpl::RestoreDBFromBackup(BackupID id,
+                                             const std::string& db_dir) {
+  if (backups_.count(id) == 0) {
+    return Status::NotFound("no such backup", NumberToString(id));
+  }
+  const Backup& backup = backups_[id];
+
+  // Remove the files of the DB being replaced, CURRENT first
+  env_->CreateDir(db_dir);
+  env_->DeleteFile(CurrentFileName(db_dir));
+  std::vector<std::string> children;
+  env_->GetChildren(db_dir, &children);
+  for (size_t i = 0; i < children.size(); i++) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(children[i], &number, &type) &&
+        type != kDBLockFile && type != kInfoLogFile) {
+      env_->DeleteFile(db_dir + "/" + children[i]);
+    }
+  }
+
+  uint64_t manifest_number = 0;
+  std::vector<FileJob> jobs(backup.files.size());
+  for (size_t i = 0; i < backup.files.size(); i++) {
+    const BackupFile& f = backup.files[i];
+    uint64_t number;
+    FileType type;
+    if (!ParseFileName(f.db_name, &number, &type)) {
+      return Status::Corruption("bad file name in backup", f.db_name);
+    }
+    if (type == kDescriptorFile) {
+      manifest_number = number;
+    }
+    jobs[i].src = AbsolutePath(f.path);
+    jobs[i].dst = db_dir + "/" + f.db_name;
+    jobs[i].is_table = (type == kTableFile);
+    jobs[i].check = true;
+    jobs[i].crc = f.crc;
+    jobs[i].size = f.size;
+  }
+  if (manifest_number == 0) {
+    return Status::Corruption("no descriptor in backup", NumberToString(id));
+  }
+  Status s = RunJobs(&jobs);
+  if (s.ok()) {
+    s = SetCurrentFile(env_, db_dir, manifest_number);
+  }
+  return s;
+}
+
+Status BackupEngineImpl::RestoreDBFromLatestBackup(const std::string& db_dir) {
+  if (backups_.empty()) {
+    return Status::NotFound("no backups");
+  }
+  return RestoreDBFromBackup(backups_.rbegin()->first, db_dir);
+}
+
+}
+
+Status BackupEngine::Open(const BackupEngineOptions& options,
+                          BackupEngine** result) {
+  *result = NULL;
+  BackupEngineImpl* impl = new BackupEngineImpl(options);
+  Status s = impl->Init();
+  if (s.ok()) {
+    *result = impl;
+  } else {
+    delete impl;
+  }
+  return s;
+}
+
+}
@@ -0,0 +1,175 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/backup_engine.h"
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/rate_limiter.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class BackupEngineTest {
+ public:
+  Env* env_;
+  std::string dbname_;
+  std::string restore_dir_;
+  Options options_;
+  DB* db_;
+  BackupEngineOptions backup_options_;
+  BackupEngine* engine_;
+
+  BackupEngineTest() : env_(Env::Default()), db_(NULL), engine_(NULL) {
+    dbname_ = test::TmpDir() + "/backup_engine_db";
+    restore_dir_ = test::TmpDir() + "/backup_engine_restore";
+    backup_options_.backup_dir = test::TmpDir() + "/backup_engine_backups";
+    DestroyDB(dbname_, Options());
+    DestroyDB(restore_dir_, Options());
+    DestroyBackups();
+    options_.create_if_missing = true;
+    ASSERT_OK(DB::Open(options_, dbname_, &db_));
+    OpenEngine();
+  }
+
+  ~BackupEngineTest() {
+    delete engine_;
+    delete db_;
+    DestroyDB(dbname_, Options());
+    DestroyDB(restore_dir_, Options());
+    DestroyBackups();
+  }
+
+  void OpenEngine() {
+    delete engine_;
+    engine_ = NULL;
+    ASSERT_OK(BackupEngine::Open(backup_options_, &engine_));
+  }
+
+  void DestroyBackups() {
+    const std::string& dir = backup_options_.backup_dir;
+    const char* subdirs[] = { "/meta", "/shared", "/private/1",
+                              "/private/2", "/private/3", "/private", "" };
+    for (size_t i = 0; i < sizeof(subdirs) / sizeof(subdirs[0]); i++) {
+      std::vector<std::string> children;
+      env_->GetChildren(dir + subdirs[i], &children);
+      for (size_t j = 0; j < children.size(); j++) {
+        env_->DeleteFile(dir + subdirs[i] + "/" + children[j]);
+      }
+      env_->DeleteDir(dir + subdirs[i]);
+    }
+  }
+
+  // Return the names of the shared table files
+  std::vector<std::string> SharedFiles() {
+    std::vector<std::string> children, result;
+    env_->GetChildren(backup_options_.backup_dir + "/shared", &children);
+    for (size_t i = 0; i < children.size(); i++) {
+      if (children[i] != "." && children[i] != "..") {
+        result.push_back(children[i]);
+      }
+    }
+    return result;
+  }
+
+  // Write "n" keys with the prefix "p"
+  void Fill(const std::string& p, int n) {
+    for (int i = 0; i < n; i++) {
+      char key[20];
+      snprintf(key, sizeof(key), "%s%06d", p.c_str(), i);
+      ASSERT_OK(db_->Put(WriteOptions(), key, std::string(100, 'v')));
+    }
+  }
+
+  // Return the number of keys in the DB restored to restore_dir_
+  int RestoredKeys() {
+    DB* db;
+    Status s = DB::Open(options_, restore_dir_, &db);
+    if (!s.ok()) {
+      return -1;
+    }
+    int count = 0;
+    Iterator* iter = db->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+    delete iter;
+    delete db;
+    return count;
+  }
+};
+
+TEST(BackupEngineTest, IncrementalBackups) {
+  RateLimiter* limiter = NewGenericRateLimiter(100 << 20);
+  backup_options_.rate_limiter = limiter;
+  backup_options_.max_background_operations = 4;
+  OpenEngine();
+
+  Fill("a", 1000);
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+  const size_t first_tables = SharedFiles().size();
+  ASSERT_GT(first_tables, 0);
+
+  // The second backup only copies the new table
+  Fill("b", 1000);
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+  ASSERT_EQ(first_tables + 1, SharedFiles().size());
+  ASSERT_GT(limiter->GetTotalBytesThrough(), 0);
+
+  std::vector<BackupInfo> backups;
+  engine_->GetBackupInfo(&backups);
+  ASSERT_EQ(2, backups.size());
+  ASSERT_EQ(1, backups[0].backup_id);
+  ASSERT_EQ(2, backups[1].backup_id);
+  ASSERT_LT(backups[0].size, backups[1].size);
+  ASSERT_EQ(first_tables + 1, backups[0].number_files);  // With a MANIFEST
+  ASSERT_OK(engine_->VerifyBackup(1));
+  ASSERT_OK(engine_->VerifyBackup(2));
+
+  // Backups survive reopening the engine, and restore what they saw
+  OpenEngine();
+  ASSERT_OK(engine_->RestoreDBFromBackup(1, restore_dir_));
+  ASSERT_EQ(1000, RestoredKeys());
+  ASSERT_OK(engine_->RestoreDBFromLatestBackup(restore_dir_));
+  ASSERT_EQ(2000, RestoredKeys());
+
+  // Deleting a backup keeps the files a later one uses
+  ASSERT_OK(engine_->PurgeOldBackups(1));
+  engine_->GetBackupInfo(&backups);
+  ASSERT_EQ(1, backups.size());
+  ASSERT_EQ(2, backups[0].backup_id);
+  ASSERT_OK(engine_->VerifyBackup(2));
+  ASSERT_TRUE(engine_->VerifyBackup(1).IsNotFound());
+  ASSERT_OK(engine_->DeleteBackup(2));
+  ASSERT_EQ(0, SharedFiles().size());
+
+  delete engine_;
+  engine_ = NULL;
+  delete limiter;
+}
+
+TEST(BackupEngineTest, DetectsCorruption) {
+  Fill("a", 1000);
+  ASSERT_OK(engine_->CreateNewBackup(db_));
+  std::vector<std::string> tables = SharedFiles();
+  ASSERT_EQ(1, tables.size());
+
+  // Flip a byte in the middle of the table
+  const std::string fname = backup_options_.backup_dir + "/shared/" +
+                            tables[0];
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname, &contents));
+  contents[contents.size() / 2] ^= 0x80;
+  ASSERT_OK(WriteStringToFile(env_, contents, fname));
+
+  ASSERT_TRUE(!engine_->VerifyBackup(1).ok());
+  ASSERT_TRUE(!engine_->RestoreDBFromBackup(1, restore_dir_).ok());
+  ASSERT_TRUE(!env_->FileExists(restore_dir_ + "/CURRENT"));
+}
+
+}
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
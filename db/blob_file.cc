@@ -0,0 +1,162 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/blob_file.h"
+
+#include "db/filename.h"
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/rate_limiter.h"
+
+namespace leveldb {
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, file_number);
+  PutVarint64(dst, offset);
+  PutVarint64(dst, size);
+}
+
+Status BlobIndex::DecodeFrom(const Slice& src) {
+  Slice input = src;
+  if (GetVarint64(&input, &file_number) &&
+      GetVarint64(&input, &offset) &&
+      GetVarint64(&input, &size) &&
+      input.empty() &&
+      file_number != 0 &&
+      offset >= kBlobRecordHeaderSize) {
+    return Status::OK();
+  }
+  return Status::Corruption("bad blob index");
+}
+
+BlobFileBuilder::BlobFileBuilder(const Options& options,
+                                 const std::string& dbname,
+                                 uint64_t number,
+                                 RateLimiter::IOPriority pri)
+    : options_(options),
+      dbname_(dbname),
+      number_(number),
+      pri_(pri),
+      file_(NULL),
+      offset_(0) {
+}
+
+BlobFileBuilder::~BlobFileBuilder() {
+  delete file_;
+}
+
+Status BlobFileBuilder::Add(const Slice& value, std::string* index) {
+  if (file_ == NULL) {
+    Status s = options_.env->NewWritableFile(BlobFileName(dbname_, number_),
+                                             &file_);
+    if (!s.ok()) {
+      return s;
+    }
+    file_ = NewRateLimitedFile(file_, options_.rate_limiter, pri_);
+  }
+
+  char header[kBlobRecordHeaderSize];
+  EncodeFixed32(header, crc32c::Mask(crc32c::Value(value.data(),
+                                                   value.size())));
+  Status s = file_->Append(Slice(header, sizeof(header)));
+  if (s.ok()) {
+    s = file_->Append(value);
+  }
+  if (s.ok()) {
+    BlobIndex handle;
+    handle.file_number = number_;
+    handle.offset = offset_ + kBlobRecordHeaderSize;
+    handle.size = value.size();
+    offset_ += handle.record_size();
+    index->clear();
+    handle.EncodeTo(index);
+  }
+  return s;
+}
+
+Status BlobFileBuilder::Finish() {
+  Status s;
+  if (file_ != NULL) {
+    s = file_->Sync();
+    if (s.ok()) {
+      s = file_->Close();
+    }
+    delete file_;
+    file_ = NULL;
+  }
+  return s;
+}
+
+static void DeleteEntry(const Slice& key, void* value) {
+  RandomAccessFile* file = reinterpret_cast<RandomAccessFile*>(value);
+  delete file;
+}
+
+BlobFileCache::BlobFileCache(const std::string& dbname,
+                             const Options* options,
+                             int entries)
+    : dbname_(dbname),
+      options_(options),
+      cache_(NewLRUCache(entries)) {
+}
+
+BlobFileCache::~BlobFileCache() {
+  delete cache_;
+}
+
+Status BlobFileCache::Get(const Slice& index, std::string* value) {
+  BlobIndex handle;
+  Status s = handle.DecodeFrom(index);
+  if (!s.ok()) {
+    return s;
+  }
+
+  char buf[sizeof(handle.file_number)];
+  EncodeFixed64(buf, handle.file_number);
+  Slice key(buf, sizeof(buf));
+  Cache::Handle* h = cache_->Lookup(key);
+  if (h == NULL) {
+    RandomAccessFile* file;
+    s = options_->env->NewRandomAccessFile(
+        BlobFileName(dbname_, handle.file_number), &file);
+    if (!s.ok()) {
+      return s;
+    }
+    h = cache_->Insert(key, file, 1, &DeleteEntry);
+  }
+  RandomAccessFile* file =
+      reinterpret_cast<RandomAccessFile*>(cache_->Value(h));
+
+  // Read the checksum along with the value
+  const size_t n = static_cast<size_t>(handle.record_size());
+  std::string scratch;
+  scratch.resize(n);
+  Slice record;
+  s = file->Read(handle.offset - kBlobRecordHeaderSize, n, &record,
+                 &scratch[0]);
+  cache_->Release(h);
+  if (s.ok()) {
+    if (record.size() != n) {
+      s = Status::Corruption("truncated blob record");
+    } else {
+      const uint32_t crc = crc32c::Unmask(DecodeFixed32(record.data()));
+      record.remove_prefix(kBlobRecordHeaderSize);
+      if (crc32c::Value(record.data(), record.size()) != crc) {
+        s = Status::Corruption("blob checksum mismatch");
+      } else {
+        value->assign(record.data(), record.size());
+      }
+    }
+  }
+  return s;
+}
+
+void BlobFileCache::Evict(uint64_t file_number) {
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  cache_->Erase(Slice(buf, sizeof(buf)));
+}
+
+}
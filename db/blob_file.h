@@ -0,0 +1,109 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A blob file holds values that are kept out of the tables (see
+// Options::min_blob_size).  It is a sequence of records, each made of
+// the masked crc32c of a value followed by the value.  Tables refer to a
+// value with an entry of type kTypeBlobIndex, whose value is the encoded
+// BlobIndex of the record.  A blob file is never modified once written,
+// and is deleted once no table refers to any of its values.
+
+#ifndef STORAGE_LEVELDB_DB_BLOB_FILE_H_
+#define STORAGE_LEVELDB_DB_BLOB_FILE_H_
+
+#include <string>
+#include <stdint.h>
+#include "leveldb/cache.h"
+#include "leveldb/options.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+class WritableFile;
+
+// Bytes of a record that precede its value
+static const uint64_t kBlobRecordHeaderSize = 4;
+
+struct BlobIndex {
+  uint64_t file_number;
+  uint64_t offset;          // Of the value in the file
+  uint64_t size;            // Of the value
+
+  BlobIndex() : file_number(0), offset(0), size(0) { }
+
+  void EncodeTo(std::string* dst) const;
+  Status DecodeFrom(const Slice& input);
+
+  // Return the number of bytes of the record of the value.
+  uint64_t record_size() const { return kBlobRecordHeaderSize + size; }
+};
+
+// Writes values to a new blob file, which is only created once the first
+// value is added.  Not thread-safe.
+class BlobFileBuilder {
+ public:
+  // Write to the blob file "number" of the db named by "dbname", at
+  // priority "pri" of options.rate_limiter.
+  BlobFileBuilder(const Options& options, const std::string& dbname,
+                  uint64_t number, RateLimiter::IOPriority pri);
+
+  // Closes the file if Finish() was not called.  The caller deletes the
+  // file if it is not to be kept.
+  ~BlobFileBuilder();
+
+  // Append "value" to the file and store its encoded BlobIndex in *index.
+  Status Add(const Slice& value, std::string* index);
+
+  // Sync and close the file, if it was created.
+  Status Finish();
+
+  uint64_t number() const { return number_; }
+
+  // Size of the file, or zero if no value was added.
+  uint64_t FileSize() const { return offset_; }
+
+ private:
+  const Options& options_;
+  const std::string dbname_;
+  const uint64_t number_;
+  const RateLimiter::IOPriority pri_;
+  WritableFile* file_;
+  uint64_t offset_;
+
+  // No copying allowed
+  BlobFileBuilder(const BlobFileBuilder&);
+  void operator=(const BlobFileBuilder&);
+};
+
+// Reads values from blob files, keeping the most recently used ones open.
+// Thread-safe (provides internal synchronization)
+class BlobFileCache {
+ public:
+  // The blob files are looked for in the directory "dbname".
+  BlobFileCache(const std::string& dbname, const Options* options,
+                int entries);
+  ~BlobFileCache();
+
+  // Store in *value the value that the encoded BlobIndex "index" refers
+  // to.  Returns a Corruption status if its checksum does not match.
+  Status Get(const Slice& index, std::string* value);
+
+  // Evict any entry for the specified file number
+  void Evict(uint64_t file_number);
+
+ private:
+  const std::string dbname_;
+  const Options* options_;
+  Cache* cache_;
+
+  // No copying allowed
+  BlobFileCache(const BlobFileCache&);
+  void operator=(const BlobFileCache&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_DB_BLOB_FILE_H_
@@ -4,6 +4,7 @@
 
 #include "db/builder.h"
 
+#include "db/blob_file.h"
 #include "db/filename.h"
 #include "db/dbformat.h"
 #include "db/table_cache.h"
@@ -11,33 +12,115 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 
-Status BuildTable(const std::string& dbname,
-                  Env* env,
+// Account in *meta for the entry "internal_key".
+static void AddEntry(FileMetaData* meta, const Slice& internal_key) {
+  const SequenceNumber sequence = ExtractSequence(internal_key);
+  if (sequence < meta->smallest_seqno) {
+    meta->smallest_seqno = sequence;
+  }
+  if (sequence > meta->largest_seqno) {
+    meta->largest_seqno = sequence;
+  }
+  const ValueType type = ExtractValueType(internal_key);
+  meta->num_entries++;
+  if (type == kTypeDeletion || type == kTypeRangeDeletion) {
+    meta->num_deletions++;
+  }
+}
+
+Status BuildTable(Env* env,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
-                  FileMetaData* meta) {
+                  Iterator* range_del_iter,
+                  FileMetaData* meta,
+                  BlobFileBuilder* blobs) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
+  meta->smallest_seqno = kMaxSequenceNumber;
+  meta->largest_seqno = 0;
+  meta->num_entries = 0;
+  meta->num_deletions = 0;
+  meta->oldest_blob_file = 0;
   iter->SeekToFirst();
+  if (range_del_iter != NULL) {
+    range_del_iter->SeekToFirst();
+    meta->has_range_deletions = range_del_iter->Valid();
+  }
 
-  std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  std::string fname = TableFileName(options.db_paths, meta->number,
+                                    meta->path_id);
+  if (iter->Valid() || meta->has_range_deletions) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
       return s;
     }
+    file = NewRateLimitedFile(file, options.rate_limiter,
+                              RateLimiter::IO_HIGH);
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    std::string blob_key, blob_index;
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
+      Slice value = iter->value();
+      if (blobs != NULL && ExtractValueType(key) == kTypeValue &&
+          value.size() >= options.min_blob_size) {
+        // Keep the value in the blob file, and a reference to it here
+        s = blobs->Add(value, &blob_index);
+        if (!s.ok()) {
+          break;
+        }
+        blob_key.clear();
+        AppendInternalKey(&blob_key, ParsedInternalKey(
+            ExtractUserKey(key), ExtractSequence(key), kTypeBlobIndex));
+        key = blob_key;
+        value = blob_index;
+        meta->oldest_blob_file = blobs->number();
+      }
+      if (builder->NumEntries() == 0) {
+        meta->smallest.DecodeFrom(key);
+      }
       meta->largest.DecodeFrom(key);
-      builder->Add(key, iter->value());
+      AddEntry(meta, key);
+      builder->Add(key, value);
+    }
+
+    if (meta->has_range_deletions) {
+      // The range deletions come sorted by their begin keys.  The table
+      // must cover them up to their end keys so that reads of the keys
+      // they delete look at it.
+      const Comparator* icmp = options.comparator;
+      const Comparator* ucmp =
+          static_cast<const InternalKeyComparator*>(icmp)->user_comparator();
+      InternalKey smallest;
+      smallest.DecodeFrom(range_del_iter->key());
+      if (builder->NumEntries() == 0 ||
+          icmp->Compare(smallest.Encode(), meta->smallest.Encode()) < 0) {
+        meta->smallest = smallest;
+      }
+      std::string end;
+      for (; range_del_iter->Valid(); range_del_iter->Next()) {
+        builder->AddRangeDeletion(range_del_iter->key(),
+                                  range_del_iter->value());
+        AddEntry(meta, range_del_iter->key());
+        if (end.empty() || ucmp->Compare(range_del_iter->value(), end) > 0) {
+          end = range_del_iter->value().ToString();
+        }
+      }
+      InternalKey largest(end, kMaxSequenceNumber, kTypeRangeDeletion);
+      if (builder->NumEntries() == 0 ||
+          icmp->Compare(largest.Encode(), meta->largest.Encode()) > 0) {
+        meta->largest = largest;
+      }
+      if (!range_del_iter->status().ok()) {
+        s = range_del_iter->status();
+      }
     }
 
     // Finish and check for builder errors
@@ -66,7 +149,8 @@ Status BuildTable(const std::string& dbname,
       // Verify that the table is usable
       Iterator* it = table_cache->NewIterator(ReadOptions(),
                                               meta->number,
-                                              meta->file_size);
+                                              meta->file_size,
+                                              meta->path_id);
       s = it->status();
       delete it;
     }
@@ -77,6 +161,9 @@ Status BuildTable(const std::string& dbname,
     s = iter->status();
   }
 
+  if (meta->smallest_seqno > meta->largest_seqno) {
+    meta->smallest_seqno = 0;  // No entries
+  }
   if (s.ok() && meta->file_size > 0) {
     // Keep it
   } else {
@@ -12,22 +12,28 @@ namespace leveldb {
 struct Options;
 struct FileMetaData;
 
+class BlobFileBuilder;
 class Env;
 class Iterator;
 class TableCache;
 class VersionEdit;
 
-// Build a Table file from the contents of *iter.  The generated file
-// will be named according to meta->number.  On success, the rest of
+// Build a Table file from the contents of *iter and the range deletions
+// yielded by *range_del_iter, which may be NULL.  The generated file
+// will be named according to meta->number, in the directory
+// meta->path_id of options.db_paths.  On success, the rest of
 // *meta will be filled with metadata about the generated table.
-// If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
-extern Status BuildTable(const std::string& dbname,
-                         Env* env,
+// If no data is present in either iterator, meta->file_size will be set
+// to zero, and no Table file will be produced.  If "blobs" is non-NULL,
+// values of at least options.min_blob_size bytes are added to it, and
+// the table refers to them; the caller finishes the blob file.
+extern Status BuildTable(Env* env,
                          const Options& options,
                          TableCache* table_cache,
                          Iterator* iter,
-                         FileMetaData* meta);
+                         Iterator* range_del_iter,
+                         FileMetaData* meta,
+                         BlobFileBuilder* blobs);
 
 }
 
@@ -0,0 +1,118 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/checkpoint.h"
+
+#include <vector>
+#include "db/filename.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+namespace {
+
+// Delete the directory "dir" and the files in it, ignoring errors
+void RemoveDir(Env* env, const std::string& dir) {
+  std::vector<std::string> children;
+  env->GetChildren(dir, &children);
+  for (size_t i = 0; i < children.size(); i++) {
+    if (children[i] != "." && children[i] != "..") {
+      env->DeleteFile(dir + "/" + children[i]);
+    }
+  }
+  env->DeleteDir(dir);
+}
+
+// Copy the files named by db->GetLiveFiles() into "dir"
+Status CopyLiveFiles(Env* env, const std::vector<std::string>& files,
+                     uint64_t manifest_file_size, const std::string& dir) {
+  Status s;
+  uint64_t manifest_number = 0;
+  for (size_t i = 0; s.ok() && i < files.size(); i++) {
+    const std::string& src = files[i];
+    const std::string base = src.substr(src.rfind('/') + 1);
+    const std::string target = dir + "/" + base;
+    uint64_t number;
+    FileType type;
+    if (!ParseFileName(base, &number, &type)) {
+      s = Status::Corruption("unexpected live file", src);
+      break;
+    }
+    switch (type) {
+      case kTableFile:
+      case kBlobFile:
+        // Table and blob files are never modified, so the checkpoint can
+        // share them
+        s = env->LinkFile(src, target);
+        if (s.IsNotSupported()) {
+          s = CopyFile(env, src, target);
+        }
+        break;
+      case kDescriptorFile:
+        // The descriptor keeps growing; later edits are not ours
+        manifest_number = number;
+        s = CopyFilePrefix(env, src, target, manifest_file_size);
+        break;
+      case kCurrentFile:
+        // Written below, once the descriptor is in place
+        break;
+      default:
+        s = Status::Corruption("unexpected live file", src);
+        break;
+    }
+  }
+  if (s.ok() && manifest_number == 0) {
+    s = Status::Corruption("no descriptor among the live files");
+  }
+  if (s.ok()) {
+    s = SetCurrentFile(env, dir, manifest_number);
+  }
+  return s;
+}
+
+}
+
+Status Checkpoint::Create(DB* db, const std::string& checkpoint_dir) {
+  Env* env = db->GetEnv();
+  if (env->FileExists(checkpoint_dir)) {
+    return Status::InvalidArgument(checkpoint_dir, "exists");
+  }
+
+  // Keep the live files from being compacted away while they are linked
+  Status s = db->DisableFileDeletions();
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<std::string> files;
+  uint64_t manifest_file_size;
+  s = db->GetLiveFiles(&files, &manifest_file_size, true);
+
+  // Build the checkpoint under a temporary name so that a crash never
+  // leaves a partial checkpoint behind under the final one.
+  const std::string tmp_dir = checkpoint_dir + ".tmp";
+  if (s.ok()) {
+    if (env->FileExists(tmp_dir)) {
+      RemoveDir(env, tmp_dir);  // Left over from an earlier failure
+    }
+    s = env->CreateDir(tmp_dir);
+    if (s.ok()) {
+      s = CopyLiveFiles(env, files, manifest_file_size, tmp_dir);
+      if (s.ok()) {
+        s = env->RenameFile(tmp_dir, checkpoint_dir);
+      }
+      if (!s.ok()) {
+        RemoveDir(env, tmp_dir);
+      }
+    }
+  }
+
+  Status enable = db->EnableFileDeletions();
+  if (s.ok()) {
+    s = enable;
+  }
+  return s;
+}
+
+}
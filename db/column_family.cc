@@ -0,0 +1,165 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/column_family.h"
+
+#include "leveldb/iterator.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+const char kDefaultColumnFamilyName[] = "default";
+
+ColumnFamilyHandle::~ColumnFamilyHandle() { }
+
+ColumnFamilyHandleImpl::~ColumnFamilyHandleImpl() { }
+
+void AppendColumnFamilyKey(std::string* dst, uint32_t id, const Slice& key) {
+  PutVarint32(dst, id);
+  dst->append(key.data(), key.size());
+}
+
+bool ParseColumnFamilyKey(const Slice& key, uint32_t* id, Slice* user_key) {
+  *user_key = key;
+  return GetVarint32(user_key, id);
+}
+
+ColumnFamilyComparator::ColumnFamilyComparator(const Comparator* c)
+    : user_comparator_(c),
+      name_(std::string("leveldb.ColumnFamilyComparator:") + c->Name()) {
+}
+
+const char* ColumnFamilyComparator::Name() const {
+  return name_.c_str();
+}
+
+int ColumnFamilyComparator::Compare(const Slice& a, const Slice& b) const {
+  uint32_t id_a, id_b;
+  Slice key_a, key_b;
+  if (!ParseColumnFamilyKey(a, &id_a, &key_a) ||
+      !ParseColumnFamilyKey(b, &id_b, &key_b)) {
+    // Malformed keys are only ever produced by corruption; keep the
+    // order total by falling back to a bytewise comparison.
+    return a.compare(b);
+  }
+  if (id_a < id_b) {
+    return -1;
+  } else if (id_a > id_b) {
+    return +1;
+  }
+  return user_comparator_->Compare(key_a, key_b);
+}
+
+void ColumnFamilyComparator::FindShortestSeparator(
+    std::string* start,
+    const Slice& limit) const {
+  uint32_t id_start, id_limit;
+  Slice key_start, key_limit;
+  if (!ParseColumnFamilyKey(*start, &id_start, &key_start) ||
+      !ParseColumnFamilyKey(limit, &id_limit, &key_limit) ||
+      id_start != id_limit) {
+    // Leave keys of different families alone
+    return;
+  }
+  std::string tmp(key_start.data(), key_start.size());
+  user_comparator_->FindShortestSeparator(&tmp, key_limit);
+  if (tmp.size() < key_start.size()) {
+    start->clear();
+    AppendColumnFamilyKey(start, id_start, tmp);
+  }
+}
+
+void ColumnFamilyComparator::FindShortSuccessor(std::string* key) const {
+  uint32_t id;
+  Slice user_key;
+  if (!ParseColumnFamilyKey(*key, &id, &user_key)) {
+    return;
+  }
+  std::string tmp(user_key.data(), user_key.size());
+  user_comparator_->FindShortSuccessor(&tmp);
+  if (tmp.size() < user_key.size()) {
+    key->clear();
+    AppendColumnFamilyKey(key, id, tmp);
+  }
+}
+
+namespace {
+
+// Restricts an iterator over stored keys to a single column family.
+class ColumnFamilyIterator : public Iterator {
+ public:
+  ColumnFamilyIterator(uint32_t id, Iterator* iter)
+      : id_(id), iter_(iter) {
+    PutVarint32(&prefix_, id);
+  }
+  virtual ~ColumnFamilyIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const {
+    uint32_t id;
+    Slice user_key;
+    return iter_->Valid() &&
+        ParseColumnFamilyKey(iter_->key(), &id, &user_key) &&
+        id == id_;
+  }
+  virtual Slice key() const {
+    assert(Valid());
+    Slice result = iter_->key();
+    result.remove_prefix(prefix_.size());
+    return result;
+  }
+  virtual Slice value() const {
+    assert(Valid());
+    return iter_->value();
+  }
+  virtual Status status() const {
+    return iter_->status();
+  }
+
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+
+  virtual void Seek(const Slice& target) {
+    std::string k = prefix_;
+    k.append(target.data(), target.size());
+    iter_->Seek(k);
+  }
+  virtual void SeekToFirst() {
+    iter_->Seek(prefix_);
+  }
+  virtual void SeekToLast() {
+    // Position at the first entry of the next family and step back.
+    if (id_ == 0xffffffffu) {
+      iter_->SeekToLast();
+      return;
+    }
+    std::string next;
+    PutVarint32(&next, id_ + 1);
+    iter_->Seek(next);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  }
+
+ private:
+  const uint32_t id_;
+  std::string prefix_;
+  Iterator* iter_;
+
+  // No copying allowed
+  ColumnFamilyIterator(const ColumnFamilyIterator&);
+  void operator=(const ColumnFamilyIterator&);
+};
+
+}  // namespace
+
+Iterator* NewColumnFamilyIterator(uint32_t id, Iterator* iter) {
+  return new ColumnFamilyIterator(id, iter);
+}
+
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Column families partition the key space of a single DB.  When
+// Options::use_column_families is set, every user key is stored as
+//
+//    column family id: varint32
+//    key:              uint8[]
+//
+// so that all families share one write-ahead log, memtable and set of
+// table files, and a WriteBatch that touches several families is
+// applied atomically.  The id of the default family is zero.
+
+#ifndef STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
+#define STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/comparator.h"
+#include "leveldb/db.h"
+
+namespace leveldb {
+
+class Iterator;
+
+// Orders keys first by column family id and then by the user supplied
+// comparator applied to the remainder of the key.
+class ColumnFamilyComparator : public Comparator {
+ public:
+  explicit ColumnFamilyComparator(const Comparator* c);
+
+  virtual const char* Name() const;
+  virtual int Compare(const Slice& a, const Slice& b) const;
+  virtual void FindShortestSeparator(
+      std::string* start,
+      const Slice& limit) const;
+  virtual void FindShortSuccessor(std::string* key) const;
+
+  const Comparator* user_comparator() const { return user_comparator_; }
+
+ private:
+  const Comparator* user_comparator_;
+  std::string name_;
+};
+
+class ColumnFamilyHandleImpl : public ColumnFamilyHandle {
+ public:
+  ColumnFamilyHandleImpl(const std::string& name, uint32_t id)
+      : name_(name), id_(id) { }
+  virtual ~ColumnFamilyHandleImpl();
+
+  virtual const std::string& GetName() const { return name_; }
+  virtual uint32_t GetID() const { return id_; }
+
+ private:
+  const std::string name_;
+  const uint32_t id_;
+};
+
+// The id of the default column family.
+static const uint32_t kDefaultColumnFamilyId = 0;
+extern const char kDefaultColumnFamilyName[];
+
+// Append the stored form of "key" in column family "id" to *dst.
+extern void AppendColumnFamilyKey(std::string* dst, uint32_t id,
+                                  const Slice& key);
+
+// Split a stored key into its column family id and user key.  Returns
+// false if "key" does not start with a valid id.
+extern bool ParseColumnFamilyKey(const Slice& key, uint32_t* id,
+                                 Slice* user_key);
+
+// Return a new iterator that yields only the entries of "*iter" that
+// belong to column family "id", with the family prefix removed from
+// their keys.  Takes ownership of "iter".
+extern Iterator* NewColumnFamilyIterator(uint32_t id, Iterator* iter);
+
+}
+
+#endif  // STORAGE_LEVELDB_DB_COLUMN_FAMILY_H_
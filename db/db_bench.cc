@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <sys/types.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "db/db_impl.h"
@@ -29,12 +30,23 @@
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
 //      readhot       -- read N times in random order from 1% section of DB
+//      readrandomwriterandom -- N random reads or overwrites per thread, in
+//                       the ratio given by --read_percent
+//      ycsba         -- YCSB workload A: 50% reads, 50% updates
+//      ycsbb         -- YCSB workload B: 95% reads, 5% updates
+//      ycsbc         -- YCSB workload C: 100% reads
+//      ycsbd         -- YCSB workload D: 95% reads of recent keys, 5% inserts
+//      ycsbe         -- YCSB workload E: 95% short range scans, 5% inserts
+//      ycsbf         -- YCSB workload F: 50% reads, 50% read-modify-writes
 //      crc32c        -- repeated crc32c of 4K of data
 //      acquireload   -- load N*1000 times
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      heapprofile -- Dump a heap profile (if supported by this port)
+//
+// The ycsb* benchmarks expect the keys 0..N-1 to be present, e.g. from a
+// preceding fillseq, and do N operations per thread.
 static const char* FLAGS_benchmarks =
     "fillseq,"
     "fillsync,"
@@ -85,6 +97,17 @@ static int FLAGS_cache_size = -1;
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
+// If true, open the DB with Options::PrepareForBulkLoad(), which
+// overrides --write_buffer_size.  Follow the fill benchmarks with
+// "compact".
+static bool FLAGS_bulk_load = false;
+
+// If true, writes are not recorded in the log
+static bool FLAGS_disable_wal = false;
+
+// If true, use kCompactionStyleUniversal
+static bool FLAGS_universal = false;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -93,6 +116,37 @@ static bool FLAGS_use_existing_db = false;
 // Use the db with the following name.
 static const char* FLAGS_db = "/tmp/dbbench";
 
+// Key distribution of the ycsb* and readrandomwriterandom benchmarks:
+// "zipfian", "latest" or "uniform".  If empty, the ycsb* benchmarks use
+// the distribution of their YCSB workload and readrandomwriterandom
+// uses "uniform".
+static const char* FLAGS_ycsb_distribution = "";
+
+// Skew of the zipfian and latest distributions
+static double FLAGS_zipfian_constant = 0.99;
+
+// Range scans of ycsbe read between 1 and this many entries
+static int FLAGS_ycsb_max_scan_length = 100;
+
+// Percentage of reads done by readrandomwriterandom, the rest being
+// writes.  A comma-separated list gives each thread its own ratio, e.g.
+// "100,0" alternates pure readers and pure writers.
+static const char* FLAGS_read_percent = "90";
+
+// If positive, the ycsb* and readrandomwriterandom benchmarks issue this
+// many operations per second, spread evenly over the threads, instead of
+// running as fast as possible.  Latencies are then also reported from
+// the time each operation was scheduled to start, so that operations
+// held up behind a slow one are not left out of the percentiles.
+static int FLAGS_target_ops_per_sec = 0;
+
+// If positive, print the throughput and latencies of the running
+// benchmark every this many seconds.
+static int FLAGS_report_interval_seconds = 0;
+
+// If set, also write the results of all benchmarks to this file as JSON.
+static const char* FLAGS_json = NULL;
+
 namespace leveldb {
 
 namespace {
@@ -149,6 +203,203 @@ static void AppendWithSpace(std::string* str, Slice msg) {
   str->append(msg.data(), msg.size());
 }
 
+// Return a random value in [0,1).
+static double RandomDouble(Random* rnd) {
+  return (rnd->Next() - 1) / 2147483646.0;
+}
+
+// Return a random value in [0,n).
+static int64_t RandomInt64(Random* rnd, int64_t n) {
+  const uint64_t r = (static_cast<uint64_t>(rnd->Next()) << 31) | rnd->Next();
+  return static_cast<int64_t>(r % static_cast<uint64_t>(n));
+}
+
+// 64-bit FNV-1a hash, used to scatter the popular zipfian items over the
+// key space as YCSB does.
+static uint64_t FNVHash64(uint64_t v) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (int i = 0; i < 8; i++) {
+    h ^= v & 0xff;
+    h *= 1099511628211ull;
+    v >>= 8;
+  }
+  return h;
+}
+
+// Picks items in [0,n) following a Zipfian distribution, item 0 being
+// the most popular one, with the algorithm of Gray et al., "Quickly
+// Generating Billion-Record Synthetic Databases" that YCSB uses.  n may
+// grow from one call to the next, in which case the zeta constant is
+// extended incrementally.
+class ZipfianGenerator {
+ private:
+  const double theta_;
+  const double alpha_;
+  const double zeta2_;
+  int64_t items_;
+  double zetan_;
+  double eta_;
+
+  static double Zeta(int64_t from, int64_t to, double theta, double sum) {
+    for (int64_t i = from; i < to; i++) {
+      sum += 1.0 / pow(static_cast<double>(i + 1), theta);
+    }
+    return sum;
+  }
+
+  void ComputeEta() {
+    eta_ = (1.0 - pow(2.0 / items_, 1.0 - theta_)) / (1.0 - zeta2_ / zetan_);
+  }
+
+ public:
+  ZipfianGenerator(int64_t items, double theta)
+      : theta_(theta),
+        alpha_(1.0 / (1.0 - theta)),
+        zeta2_(Zeta(0, 2, theta, 0)),
+        items_(items),
+        zetan_(Zeta(0, items, theta, 0)) {
+    ComputeEta();
+  }
+
+  int64_t Next(Random* rnd, int64_t items) {
+    if (items > items_) {
+      zetan_ = Zeta(items_, items, theta_, zetan_);
+      items_ = items;
+      ComputeEta();
+    }
+    const double u = RandomDouble(rnd);
+    const double uz = u * zetan_;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + pow(0.5, theta_)) return 1;
+    int64_t r = static_cast<int64_t>(
+        items_ * pow(eta_ * u - eta_ + 1.0, alpha_));
+    return (r < items_) ? r : items_ - 1;
+  }
+};
+
+// Picks the keys of the ycsb* and readrandomwriterandom benchmarks.
+class KeyChooser {
+ private:
+  enum Kind { kUniform, kZipfian, kLatest };
+  Kind kind_;
+  ZipfianGenerator* zipf_;
+
+ public:
+  // REQUIRES: distribution is "uniform", "zipfian" or "latest".
+  KeyChooser(const Slice& distribution, int64_t records)
+      : kind_(distribution == Slice("zipfian") ? kZipfian :
+              distribution == Slice("latest") ? kLatest : kUniform),
+        zipf_(kind_ == kUniform ? NULL :
+              new ZipfianGenerator(records, FLAGS_zipfian_constant)) {
+  }
+
+  ~KeyChooser() { delete zipf_; }
+
+  // Return a key in [0,records).  With "latest", the most recently
+  // inserted keys, i.e. the largest ones, are the most popular.
+  int64_t Next(Random* rnd, int64_t records) {
+    switch (kind_) {
+      case kZipfian:
+        return FNVHash64(zipf_->Next(rnd, records)) % records;
+      case kLatest:
+        return records - 1 - zipf_->Next(rnd, records);
+      default:
+        return RandomInt64(rnd, records);
+    }
+  }
+
+ private:
+  // No copying allowed
+  KeyChooser(const KeyChooser&);
+  void operator=(const KeyChooser&);
+};
+
+static void AppendLatencyJson(std::string* json, const char* name,
+                              const Histogram& hist) {
+  char buf[300];
+  snprintf(buf, sizeof(buf),
+           "\"%s\": {\"p50\": %.1f, \"p99\": %.1f, \"p99.9\": %.1f, "
+           "\"avg\": %.1f, \"max\": %.1f}",
+           name, hist.Percentile(50), hist.Percentile(99),
+           hist.Percentile(99.9), hist.Average(), hist.Max());
+  json->append(buf);
+}
+
+// Collects the progress of all threads of a benchmark and prints it
+// every --report_interval_seconds.
+class IntervalReporter {
+ private:
+  port::Mutex mu_;
+  std::string name_;
+  double start_;
+  double last_report_;
+  int64_t done_;
+  int64_t last_done_;
+  Histogram hist_;           // Latencies since the last report
+  std::string json_;         // The reports so far, as JSON objects
+
+ public:
+  void Start(const Slice& name) {
+    MutexLock l(&mu_);
+    name_ = name.ToString();
+    start_ = Env::Default()->NowMicros();
+    last_report_ = start_;
+    done_ = 0;
+    last_done_ = 0;
+    hist_.Clear();
+    json_.clear();
+  }
+
+  // Record that "ops" more operations were done, with the given latencies
+  // (which may be empty if they are not measured).
+  void Add(int64_t ops, const Histogram& latencies) {
+    MutexLock l(&mu_);
+    done_ += ops;
+    hist_.Merge(latencies);
+    const double now = Env::Default()->NowMicros();
+    if (now - last_report_ < FLAGS_report_interval_seconds * 1e6) {
+      return;
+    }
+
+    const double elapsed = (now - start_) * 1e-6;
+    const double rate = (done_ - last_done_) / ((now - last_report_) * 1e-6);
+    std::string latency;
+    if (hist_.Count() > 0) {
+      char buf[100];
+      snprintf(buf, sizeof(buf), "; p50 %.1f p99 %.1f p99.9 %.1f micros",
+               hist_.Percentile(50), hist_.Percentile(99),
+               hist_.Percentile(99.9));
+      latency = buf;
+    }
+    fprintf(stdout, "%-12s : %8.1f s %12.1f ops/sec; %12.1f ops/sec total%s\n",
+            name_.c_str(), elapsed, rate, done_ / elapsed, latency.c_str());
+    fflush(stdout);
+
+    if (FLAGS_json != NULL) {
+      char buf[100];
+      snprintf(buf, sizeof(buf),
+               "{\"seconds\": %.1f, \"ops\": %lld, \"ops_per_sec\": %.1f",
+               elapsed, static_cast<long long>(done_ - last_done_), rate);
+      if (!json_.empty()) json_.append(", ");
+      json_.append(buf);
+      if (hist_.Count() > 0) {
+        json_.append(", ");
+        AppendLatencyJson(&json_, "latency_micros", hist_);
+      }
+      json_.append("}");
+    }
+
+    last_report_ = now;
+    last_done_ = done_;
+    hist_.Clear();
+  }
+
+  std::string Json() {
+    MutexLock l(&mu_);
+    return "[" + json_ + "]";
+  }
+};
+
 class Stats {
  private:
   double start_;
@@ -159,15 +410,54 @@ class Stats {
   int64_t bytes_;
   double last_op_finish_;
   Histogram hist_;
+  bool timed_;                 // FinishedTimedOp() was used
+  Histogram corrected_hist_;   // Latencies from the scheduled start times
+  IntervalReporter* reporter_;
+  int pending_ops_;            // Not yet passed to reporter_
+  Histogram pending_hist_;
   std::string message_;
 
+  void FlushToReporter() {
+    reporter_->Add(pending_ops_, pending_hist_);
+    pending_ops_ = 0;
+    pending_hist_.Clear();
+  }
+
+  void CountOp() {
+    if (reporter_ != NULL && ++pending_ops_ >= 64) {
+      FlushToReporter();
+    }
+
+    done_++;
+    if (done_ >= next_report_) {
+      if      (next_report_ < 1000)   next_report_ += 100;
+      else if (next_report_ < 5000)   next_report_ += 500;
+      else if (next_report_ < 10000)  next_report_ += 1000;
+      else if (next_report_ < 50000)  next_report_ += 5000;
+      else if (next_report_ < 100000) next_report_ += 10000;
+      else if (next_report_ < 500000) next_report_ += 50000;
+      else                            next_report_ += 100000;
+      fprintf(stderr, "... finished %d ops%30s\r", done_, "");
+      fflush(stderr);
+    }
+  }
+
  public:
-  Stats() { Start(); }
+  Stats() : reporter_(NULL) { Start(); }
+
+  // Pass the progress of this thread to "reporter" as it goes.
+  void SetReporter(IntervalReporter* reporter) {
+    reporter_ = reporter;
+  }
 
   void Start() {
     next_report_ = 100;
     last_op_finish_ = start_;
     hist_.Clear();
+    timed_ = false;
+    corrected_hist_.Clear();
+    pending_ops_ = 0;
+    pending_hist_.Clear();
     done_ = 0;
     bytes_ = 0;
     seconds_ = 0;
@@ -178,6 +468,8 @@ class Stats {
 
   void Merge(const Stats& other) {
     hist_.Merge(other.hist_);
+    timed_ = timed_ || other.timed_;
+    corrected_hist_.Merge(other.corrected_hist_);
     done_ += other.done_;
     bytes_ += other.bytes_;
     seconds_ += other.seconds_;
@@ -191,6 +483,9 @@ class Stats {
   void Stop() {
     finish_ = Env::Default()->NowMicros();
     seconds_ = (finish_ - start_) * 1e-6;
+    if (reporter_ != NULL && pending_ops_ > 0) {
+      FlushToReporter();
+    }
   }
 
   void AddMessage(Slice msg) {
@@ -202,25 +497,27 @@ class Stats {
       double now = Env::Default()->NowMicros();
       double micros = now - last_op_finish_;
       hist_.Add(micros);
+      if (reporter_ != NULL) pending_hist_.Add(micros);
       if (micros > 20000) {
         fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
         fflush(stderr);
       }
       last_op_finish_ = now;
     }
+    CountOp();
+  }
 
-    done_++;
-    if (done_ >= next_report_) {
-      if      (next_report_ < 1000)   next_report_ += 100;
-      else if (next_report_ < 5000)   next_report_ += 500;
-      else if (next_report_ < 10000)  next_report_ += 1000;
-      else if (next_report_ < 50000)  next_report_ += 5000;
-      else if (next_report_ < 100000) next_report_ += 10000;
-      else if (next_report_ < 500000) next_report_ += 50000;
-      else                            next_report_ += 100000;
-      fprintf(stderr, "... finished %d ops%30s\r", done_, "");
-      fflush(stderr);
-    }
+  // Like FinishedSingleOp(), for an operation that was scheduled to start
+  // at "intended_start" and actually started at "start" (both from
+  // Env::NowMicros()).  Its latency is always recorded.
+  void FinishedTimedOp(double intended_start, double start) {
+    const double now = Env::Default()->NowMicros();
+    timed_ = true;
+    hist_.Add(now - start);
+    corrected_hist_.Add(now - intended_start);
+    if (reporter_ != NULL) pending_hist_.Add(now - intended_start);
+    last_op_finish_ = now;
+    CountOp();
   }
 
   void AddBytes(int64_t n) {
@@ -249,11 +546,64 @@ class Stats {
             seconds_ * 1e6 / done_,
             (extra.empty() ? "" : " "),
             extra.c_str());
+    if (timed_) {
+      fprintf(stdout, "%-12s   latency p50 %.1f p99 %.1f p99.9 %.1f micros\n",
+              "", hist_.Percentile(50), hist_.Percentile(99),
+              hist_.Percentile(99.9));
+      if (FLAGS_target_ops_per_sec > 0) {
+        // Also count the time operations spent waiting for their
+        // predecessors, as a client issuing requests at this rate would.
+        fprintf(stdout, "%-12s   corrected p50 %.1f p99 %.1f p99.9 %.1f micros\n",
+                "", corrected_hist_.Percentile(50),
+                corrected_hist_.Percentile(99),
+                corrected_hist_.Percentile(99.9));
+      }
+    }
     if (FLAGS_histogram) {
       fprintf(stdout, "Microseconds per op:\n%s\n", hist_.ToString().c_str());
+      if (timed_ && FLAGS_target_ops_per_sec > 0) {
+        fprintf(stdout, "Microseconds per op from scheduled start:\n%s\n",
+                corrected_hist_.ToString().c_str());
+      }
     }
     fflush(stdout);
   }
+
+  // Append the results to *json as a JSON object.  "intervals" is the
+  // JSON array of the periodic reports.
+  void AppendJson(const Slice& name, int threads, const std::string& intervals,
+                  std::string* json) {
+    if (done_ < 1) done_ = 1;
+    const double elapsed = (finish_ - start_) * 1e-6;
+    char buf[300];
+    snprintf(buf, sizeof(buf),
+             "{\"name\": \"%s\", \"threads\": %d, \"ops\": %d, "
+             "\"micros_per_op\": %.3f, \"ops_per_sec\": %.1f, "
+             "\"mb_per_sec\": %.1f",
+             name.ToString().c_str(), threads, done_,
+             seconds_ * 1e6 / done_,
+             (elapsed > 0 ? done_ / elapsed : 0.0),
+             (elapsed > 0 ? (bytes_ / 1048576.0) / elapsed : 0.0));
+    json->append(buf);
+    if (FLAGS_target_ops_per_sec > 0) {
+      snprintf(buf, sizeof(buf), ", \"target_ops_per_sec\": %d",
+               FLAGS_target_ops_per_sec);
+      json->append(buf);
+    }
+    if (timed_ || FLAGS_histogram) {
+      json->append(", ");
+      AppendLatencyJson(json, "latency_micros", hist_);
+      if (timed_ && FLAGS_target_ops_per_sec > 0) {
+        json->append(", ");
+        AppendLatencyJson(json, "corrected_latency_micros", corrected_hist_);
+      }
+    }
+    if (FLAGS_report_interval_seconds > 0) {
+      json->append(", \"intervals\": ");
+      json->append(intervals);
+    }
+    json->append("}");
+  }
 };
 
 // State shared by all concurrent executions of the same benchmark.
@@ -272,7 +622,10 @@ struct SharedState {
   int num_done;
   bool start;
 
-  SharedState() : cv(&mu) { }
+  IntervalReporter reporter;
+  int64_t inserts;     // Keys added by the ycsb* benchmarks
+
+  SharedState() : cv(&mu), inserts(0) { }
 };
 
 // Per-thread state for concurrent executions of the same benchmark.
@@ -288,6 +641,51 @@ struct ThreadState {
   }
 };
 
+// The operation mix of a ycsb* or readrandomwriterandom benchmark, in
+// percent of all operations.
+struct YcsbWorkload {
+  const char* name;
+  int read;
+  int update;
+  int insert;
+  int scan;
+  int read_modify_write;
+  const char* distribution;   // Unless --ycsb_distribution is set
+};
+
+// The core workloads of YCSB.
+static const YcsbWorkload kYcsbWorkloads[] = {
+  { "ycsba", 50, 50, 0, 0, 0, "zipfian" },
+  { "ycsbb", 95, 5, 0, 0, 0, "zipfian" },
+  { "ycsbc", 100, 0, 0, 0, 0, "zipfian" },
+  { "ycsbd", 95, 0, 5, 0, 0, "latest" },
+  { "ycsbe", 0, 0, 5, 95, 0, "zipfian" },
+  { "ycsbf", 50, 0, 0, 0, 50, "zipfian" },
+};
+
+static const YcsbWorkload* FindYcsbWorkload(const Slice& name) {
+  for (size_t i = 0; i < sizeof(kYcsbWorkloads) / sizeof(kYcsbWorkloads[0]);
+       i++) {
+    if (name == Slice(kYcsbWorkloads[i].name)) {
+      return &kYcsbWorkloads[i];
+    }
+  }
+  return NULL;
+}
+
+// Return the read percentage of --read_percent for thread "tid".
+static int ReadPercentForThread(int tid) {
+  std::vector<int> percents;
+  const char* p = FLAGS_read_percent;
+  while (p != NULL && *p != '\0') {
+    percents.push_back(atoi(p));
+    p = strchr(p, ',');
+    if (p != NULL) p++;
+  }
+  if (percents.empty()) return 0;
+  return percents[tid % percents.size()];
+}
+
 }
 
 class Benchmark {
@@ -300,6 +698,9 @@ class Benchmark {
   WriteOptions write_options_;
   int reads_;
   int heap_counter_;
+  const YcsbWorkload* ycsb_workload_;
+  int64_t ycsb_records_;      // Keys [0,ycsb_records_) are in the DB
+  std::string json_;          // Results for --json
 
   void PrintHeader() {
     const int kKeySize = 16;
@@ -383,7 +784,9 @@ class Benchmark {
     value_size_(FLAGS_value_size),
     entries_per_batch_(1),
     reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-    heap_counter_(0) {
+    heap_counter_(0),
+    ycsb_workload_(NULL),
+    ycsb_records_(FLAGS_num) {
     std::vector<std::string> files;
     Env::Default()->GetChildren(FLAGS_db, &files);
     for (int i = 0; i < files.size(); i++) {
@@ -423,6 +826,7 @@ class Benchmark {
       value_size_ = FLAGS_value_size;
       entries_per_batch_ = 1;
       write_options_ = WriteOptions();
+      write_options_.disable_wal = FLAGS_disable_wal;
 
       void (Benchmark::*method)(ThreadState*) = NULL;
       bool fresh_db = false;
@@ -465,6 +869,11 @@ class Benchmark {
       } else if (name == Slice("readwhilewriting")) {
         num_threads++;  // Add extra thread for writing
         method = &Benchmark::ReadWhileWriting;
+      } else if (name == Slice("readrandomwriterandom")) {
+        method = &Benchmark::ReadRandomWriteRandom;
+      } else if (FindYcsbWorkload(name) != NULL) {
+        ycsb_workload_ = FindYcsbWorkload(name);
+        method = &Benchmark::Ycsb;
       } else if (name == Slice("compact")) {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
@@ -495,6 +904,7 @@ class Benchmark {
           db_ = NULL;
           DestroyDB(FLAGS_db, Options());
           Open();
+          ycsb_records_ = FLAGS_num;
         }
       }
 
@@ -502,6 +912,10 @@ class Benchmark {
         RunBenchmark(num_threads, name, method);
       }
     }
+
+    if (FLAGS_json != NULL) {
+      WriteJson();
+    }
   }
 
  private:
@@ -527,6 +941,9 @@ class Benchmark {
       }
     }
 
+    if (FLAGS_report_interval_seconds > 0) {
+      thread->stats.SetReporter(&shared->reporter);
+    }
     thread->stats.Start();
     (arg->bm->*(arg->method))(thread);
     thread->stats.Stop();
@@ -563,6 +980,7 @@ class Benchmark {
       shared.cv.Wait();
     }
 
+    shared.reporter.Start(name);
     shared.start = true;
     shared.cv.SignalAll();
     while (shared.num_done < n) {
@@ -574,6 +992,12 @@ class Benchmark {
       arg[0].thread->stats.Merge(arg[i].thread->stats);
     }
     arg[0].thread->stats.Report(name);
+    if (FLAGS_json != NULL) {
+      if (!json_.empty()) json_.append(",\n");
+      json_.append("  ");
+      arg[0].thread->stats.AppendJson(name, n, shared.reporter.Json(), &json_);
+    }
+    ycsb_records_ += shared.inserts;
 
     for (int i = 0; i < n; i++) {
       delete arg[i].thread;
@@ -669,6 +1093,12 @@ class Benchmark {
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    if (FLAGS_universal) {
+      options.compaction_style = kCompactionStyleUniversal;
+    }
+    if (FLAGS_bulk_load) {
+      options.PrepareForBulkLoad();
+    }
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -795,6 +1225,137 @@ class Benchmark {
     }
   }
 
+  void ReadRandomWriteRandom(ThreadState* thread) {
+    YcsbWorkload workload = { "readrandomwriterandom", 0, 0, 0, 0, 0,
+                              "uniform" };
+    workload.read = ReadPercentForThread(thread->tid);
+    workload.update = 100 - workload.read;
+    DoMixed(thread, workload);
+  }
+
+  void Ycsb(ThreadState* thread) {
+    DoMixed(thread, *ycsb_workload_);
+  }
+
+  void DoMixed(ThreadState* thread, const YcsbWorkload& workload) {
+    if (ycsb_records_ <= 0) {
+      fprintf(stderr, "%s needs a non-empty database\n", workload.name);
+      exit(1);
+    }
+    const char* distribution = (FLAGS_ycsb_distribution[0] != '\0' ?
+                                FLAGS_ycsb_distribution :
+                                workload.distribution);
+    KeyChooser chooser(distribution, ycsb_records_);
+
+    // Inserted keys follow the loaded ones.  Other keys are picked among
+    // those that existed when this thread last inserted one.
+    int64_t records = ycsb_records_;
+
+    // With --target_ops_per_sec, operation i is scheduled to start at
+    // i * interval after the thread started, whether or not the previous
+    // operations have finished by then.
+    const double interval = (FLAGS_target_ops_per_sec > 0 ?
+                             1e6 * thread->shared->total /
+                             FLAGS_target_ops_per_sec : 0);
+    double next_start = Env::Default()->NowMicros();
+
+    RandomGenerator gen;
+    ReadOptions options;
+    std::string value;
+    int64_t bytes = 0;
+    int reads = 0;
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      double intended_start = next_start;
+      if (interval > 0) {
+        // Sleeps can overshoot by tens of microseconds, which would show
+        // up as latency, so spin for the last part of the wait.
+        double now = Env::Default()->NowMicros();
+        if (next_start - now > 200) {
+          Env::Default()->SleepForMicroseconds(
+              static_cast<int>(next_start - now - 200));
+        }
+        while (now < next_start) {
+          now = Env::Default()->NowMicros();
+        }
+        next_start += interval;
+      }
+      const double start = Env::Default()->NowMicros();
+      if (interval == 0) intended_start = start;
+
+      int op = thread->rand.Uniform(100);
+      char key[100];
+      if (op < workload.insert) {
+        {
+          MutexLock l(&thread->shared->mu);
+          records = ycsb_records_ + thread->shared->inserts++;
+        }
+        snprintf(key, sizeof(key), "%016lld", static_cast<long long>(records));
+        records++;
+        Put(key, gen.Generate(value_size_));
+        bytes += value_size_ + strlen(key);
+        thread->stats.FinishedTimedOp(intended_start, start);
+        continue;
+      }
+      op -= workload.insert;
+
+      snprintf(key, sizeof(key), "%016lld",
+               static_cast<long long>(chooser.Next(&thread->rand, records)));
+      if (op < workload.scan) {
+        const int length = 1 + thread->rand.Uniform(FLAGS_ycsb_max_scan_length);
+        Iterator* iter = db_->NewIterator(options);
+        iter->Seek(key);
+        for (int j = 0; j < length && iter->Valid(); j++) {
+          bytes += iter->key().size() + iter->value().size();
+          iter->Next();
+        }
+        delete iter;
+      } else if (op < workload.scan + workload.update) {
+        Put(key, gen.Generate(value_size_));
+        bytes += value_size_ + strlen(key);
+      } else {
+        // A read, or the read of a read-modify-write
+        reads++;
+        if (db_->Get(options, key, &value).ok()) {
+          found++;
+          bytes += value.size() + strlen(key);
+        }
+        if (op >= workload.scan + workload.update + workload.read) {
+          Put(key, gen.Generate(value_size_));
+          bytes += value_size_ + strlen(key);
+        }
+      }
+      thread->stats.FinishedTimedOp(intended_start, start);
+    }
+
+    if (reads > 0) {
+      char msg[100];
+      snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads);
+      thread->stats.AddMessage(msg);
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  void Put(const Slice& key, const Slice& value) {
+    Status s = db_->Put(write_options_, key, value);
+    if (!s.ok()) {
+      fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+      exit(1);
+    }
+  }
+
+  void WriteJson() {
+    FILE* f = fopen(FLAGS_json, "w");
+    if (f == NULL) {
+      fprintf(stderr, "cannot write %s\n", FLAGS_json);
+      return;
+    }
+    fprintf(f, "{\"db\": \"%s\", \"num\": %d, \"value_size\": %d, "
+            "\"benchmarks\": [\n%s\n]}\n",
+            FLAGS_db, FLAGS_num, FLAGS_value_size, json_.c_str());
+    fclose(f);
+  }
+
   void Compact(ThreadState* thread) {
     db_->CompactRange(NULL, NULL);
   }
@@ -849,6 +1410,15 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_existing_db = n;
+    } else if (sscanf(argv[i], "--bulk_load=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_bulk_load = n;
+    } else if (sscanf(argv[i], "--disable_wal=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_disable_wal = n;
+    } else if (sscanf(argv[i], "--universal=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_universal = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -865,6 +1435,30 @@ int main(int argc, char** argv) {
       FLAGS_open_files = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
+    } else if (leveldb::Slice(argv[i]).starts_with("--ycsb_distribution=")) {
+      FLAGS_ycsb_distribution = argv[i] + strlen("--ycsb_distribution=");
+      if (FLAGS_ycsb_distribution[0] != '\0' &&
+          strcmp(FLAGS_ycsb_distribution, "zipfian") != 0 &&
+          strcmp(FLAGS_ycsb_distribution, "latest") != 0 &&
+          strcmp(FLAGS_ycsb_distribution, "uniform") != 0) {
+        fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+        exit(1);
+      }
+    } else if (sscanf(argv[i], "--zipfian_constant=%lf%c", &d, &junk) == 1 &&
+               d > 0 && d < 1) {
+      FLAGS_zipfian_constant = d;
+    } else if (sscanf(argv[i], "--ycsb_max_scan_length=%d%c",
+                      &n, &junk) == 1 && n > 0) {
+      FLAGS_ycsb_max_scan_length = n;
+    } else if (leveldb::Slice(argv[i]).starts_with("--read_percent=")) {
+      FLAGS_read_percent = argv[i] + strlen("--read_percent=");
+    } else if (sscanf(argv[i], "--target_ops_per_sec=%d%c", &n, &junk) == 1) {
+      FLAGS_target_ops_per_sec = n;
+    } else if (sscanf(argv[i], "--report_interval_seconds=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_report_interval_seconds = n;
+    } else if (strncmp(argv[i], "--json=", 7) == 0) {
+      FLAGS_json = argv[i] + 7;
     } else {
       fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       exit(1);
@@ -5,11 +5,14 @@
 #include "db/db_impl.h"
 
 #include <algorithm>
+#include <deque>
+#include <map>
 #include <set>
 #include <string>
 #include <stdint.h>
 #include <stdio.h>
 #include <vector>
+#include "db/blob_file.h"
 #include "db/builder.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
@@ -17,6 +20,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -32,6 +36,9 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context.h"
+#include "util/rate_limiter.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
@@ -48,23 +55,73 @@ struct DBImpl::CompactionState {
   struct Output {
     uint64_t number;
     uint64_t file_size;
+    uint32_t path_id;
     InternalKey smallest, largest;
+    bool has_range_deletions;
+    SequenceNumber smallest_seqno, largest_seqno;
+    uint64_t num_entries, num_deletions;
+    uint64_t oldest_blob_file;  // Zero if it refers to no blob file
+
+    void AddEntry(SequenceNumber sequence, ValueType type) {
+      if (sequence < smallest_seqno) smallest_seqno = sequence;
+      if (sequence > largest_seqno) largest_seqno = sequence;
+      num_entries++;
+      if (type == kTypeDeletion || type == kTypeRangeDeletion) {
+        num_deletions++;
+      }
+    }
   };
   std::vector<Output> outputs;
 
+  // Range deletions of the inputs, or NULL if there are none.  The
+  // current output keeps those at or after output_lower_bound, which is
+  // where the previous output stopped.
+  RangeDeletions* range_deletions;
+  std::string output_lower_bound;
+  bool has_output_lower_bound;
+
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
 
   uint64_t total_bytes;
 
+  // Blob file that receives the large values of the compaction and those
+  // moved out of blob files in need of garbage collection, or NULL if
+  // there are neither.  blob_garbage holds the bytes of the values that
+  // the compaction dropped or moved, per blob file.
+  BlobFileBuilder* blobs;
+  std::map<uint64_t, uint64_t> blob_garbage;
+  std::string blob_key, blob_index, blob_value;
+
+  // Receives the outputs and stats of the compaction for the listeners
+  CompactionJobInfo* job_info;
+
   Output* current_output() { return &outputs[outputs.size()-1]; }
 
+  // Count the value that the encoded BlobIndex "index" refers to as
+  // garbage of its blob file.
+  void AddBlobGarbage(const Slice& index) {
+    BlobIndex handle;
+    if (handle.DecodeFrom(index).ok()) {
+      blob_garbage[handle.file_number] += handle.record_size();
+    }
+  }
+
   explicit CompactionState(Compaction* c)
       : compaction(c),
+        range_deletions(NULL),
+        has_output_lower_bound(false),
         outfile(NULL),
         builder(NULL),
-        total_bytes(0) {
+        total_bytes(0),
+        blobs(NULL),
+        job_info(NULL) {
+  }
+
+  ~CompactionState() {
+    delete range_deletions;
+    delete blobs;
   }
 };
 
@@ -74,6 +131,23 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
   if (static_cast<V>(*ptr) > maxvalue) *ptr = maxvalue;
   if (static_cast<V>(*ptr) < minvalue) *ptr = minvalue;
 }
+// Number of open files reserved for uses other than the table and blob
+// file caches
+static const int kNumNonTableCacheFiles = 10;
+
+// The blob file cache gets a quarter of the files left to the caches
+// when values are separated, and one file otherwise, for reading the
+// blob files written by earlier opens.
+static int BlobCacheSize(const Options& sanitized_options) {
+  const int files = sanitized_options.max_open_files - kNumNonTableCacheFiles;
+  return (sanitized_options.min_blob_size > 0) ? std::max(1, files / 4) : 1;
+}
+
+static int TableCacheSize(const Options& sanitized_options) {
+  return sanitized_options.max_open_files - kNumNonTableCacheFiles -
+         BlobCacheSize(sanitized_options);
+}
+
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const Options& src) {
@@ -81,7 +155,28 @@ Options SanitizeOptions(const std::string& dbname,
   result.comparator = icmp;
   ClipToRange(&result.max_open_files,           20,     50000);
   ClipToRange(&result.write_buffer_size,        64<<10, 1<<30);
+  ClipToRange(&result.max_file_opening_threads, 1,      128);
   ClipToRange(&result.block_size,               1<<10,  4<<20);
+  ClipToRange(&result.num_levels,               2,      config::kMaxNumLevels);
+  ClipToRange(&result.max_mem_compaction_level, 0,      result.num_levels - 1);
+  ClipToRange(&result.max_bytes_for_level_multiplier, 2, 1000);
+  ClipToRange(&result.universal_size_ratio,     0,      1000);
+  ClipToRange(&result.universal_min_merge_width, 2,     1000);
+  if (result.max_bytes_for_level_base == 0) {
+    result.max_bytes_for_level_base = 1;
+  }
+  if (result.level0_file_num_compaction_trigger < 1) {
+    result.level0_file_num_compaction_trigger = 1;
+  }
+  if (result.level0_slowdown_writes_trigger <
+      result.level0_file_num_compaction_trigger) {
+    result.level0_slowdown_writes_trigger =
+        result.level0_file_num_compaction_trigger;
+  }
+  if (result.level0_stop_writes_trigger <
+      result.level0_slowdown_writes_trigger) {
+    result.level0_stop_writes_trigger = result.level0_slowdown_writes_trigger;
+  }
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -95,16 +190,45 @@ Options SanitizeOptions(const std::string& dbname,
   if (result.block_cache == NULL) {
     result.block_cache = NewLRUCache(8 << 20);
   }
+  if (result.wal_dir.empty()) {
+    result.wal_dir = dbname;
+  } else if (result.wal_dir.size() > 1 &&
+             result.wal_dir[result.wal_dir.size() - 1] == '/') {
+    result.wal_dir.resize(result.wal_dir.size() - 1);
+  }
+  if (result.db_paths.empty()) {
+    result.db_paths.push_back(DbPath(dbname, ~static_cast<uint64_t>(0)));
+  }
   return result;
 }
 
+void GetDBDirs(const std::string& dbname, const Options& options,
+               std::vector<std::string>* dirs) {
+  dirs->push_back(dbname);
+  std::vector<std::string> candidates;
+  candidates.push_back(options.wal_dir);
+  for (size_t i = 0; i < options.db_paths.size(); i++) {
+    candidates.push_back(options.db_paths[i].path);
+  }
+  for (size_t i = 0; i < candidates.size(); i++) {
+    if (!candidates[i].empty() &&
+        std::find(dirs->begin(), dirs->end(), candidates[i]) == dirs->end()) {
+      dirs->push_back(candidates[i]);
+    }
+  }
+}
+
 DBImpl::DBImpl(const Options& options, const std::string& dbname)
     : env_(options.env),
-      internal_comparator_(options.comparator),
+      column_family_comparator_(options.comparator),
+      internal_comparator_(options.use_column_families
+                           ? &column_family_comparator_
+                           : options.comparator),
       options_(SanitizeOptions(dbname, &internal_comparator_, options)),
       owns_info_log_(options_.info_log != options.info_log),
       owns_cache_(options_.block_cache != options.block_cache),
       dbname_(dbname),
+      merge_helper_(options.merge_operator, options.use_column_families),
       db_lock_(NULL),
       shutting_down_(NULL),
       bg_cv_(&mutex_),
@@ -113,22 +237,64 @@ DBImpl::DBImpl(const Options& options, const std::string& dbname)
       logfile_(NULL),
       logfile_number_(0),
       log_(NULL),
+      min_log_number_to_recycle_(0),
       logger_(NULL),
+      unlogged_writes_(false),
       logger_cv_(&mutex_),
+      write_buffer_consumer_(this),
+      flush_requested_(false),
       bg_compaction_scheduled_(false),
-      manual_compaction_(NULL) {
+      file_deletions_disabled_(0),
+      recovery_mem_(NULL),
+      recovery_edit_(NULL),
+      manual_compaction_(NULL),
+      write_controller_(options_.delayed_write_rate),
+      bg_write_rate_(options_.delayed_write_rate),
+      stall_version_(NULL),
+      stall_level0_files_(0),
+      stall_pending_bytes_(0),
+      stall_condition_(kWriteStallNormal),
+      imm_flush_reason_(kFlushReasonWriteBufferFull) {
+  for (int i = 0; i < kNumStallCauses; i++) {
+    stall_count_[i] = 0;
+    stall_micros_[i] = 0;
+  }
   mem_->Ref();
   has_imm_.Release_Store(NULL);
+  default_column_family_ =
+      new ColumnFamilyHandleImpl(kDefaultColumnFamilyName,
+                                 kDefaultColumnFamilyId);
+  column_families_.push_back(default_column_family_);
+  column_family_ids_.insert(kDefaultColumnFamilyId);
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
-  const int table_cache_size = options.max_open_files - 10;
-  table_cache_ = new TableCache(dbname_, &options_, table_cache_size);
+  table_cache_ = new TableCache(&options_, TableCacheSize(options_));
+  blob_cache_ = new BlobFileCache(dbname_, &options_, BlobCacheSize(options_));
 
   versions_ = new VersionSet(dbname_, &options_, table_cache_,
                              &internal_comparator_);
+
+  if (options_.write_buffer_manager != NULL) {
+    options_.write_buffer_manager->Register(&write_buffer_consumer_);
+  }
 }
 
 DBImpl::~DBImpl() {
+  // Writes that skipped the log only survive in a table.  There is no
+  // one to report a failure to, so errors are ignored.
+  mutex_.Lock();
+  const bool flush = unlogged_writes_ && bg_error_.ok();
+  mutex_.Unlock();
+  if (flush) {
+    FlushMemTable();
+  }
+
+  // Stop taking part in the shared memory budget before shutting down,
+  // so that no flush request can arrive during destruction.
+  if (options_.write_buffer_manager != NULL) {
+    options_.write_buffer_manager->Unregister(&write_buffer_consumer_);
+  }
+
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
@@ -141,12 +307,16 @@ DBImpl::~DBImpl() {
     env_->UnlockFile(db_lock_);
   }
 
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    delete column_families_[i];
+  }
   delete versions_;
   if (mem_ != NULL) mem_->Unref();
   if (imm_ != NULL) imm_->Unref();
   delete log_;
   delete logfile_;
   delete table_cache_;
+  delete blob_cache_;
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -197,54 +367,177 @@ void DBImpl::MaybeIgnoreError(Status* s) const {
   }
 }
 
+namespace {
+
+// Opens table files on several threads
+struct TablePreloader {
+  TableCache* table_cache;
+  const std::vector<FileMetaData*>* files;
+  port::Mutex mu;
+  port::CondVar cv;         // Signalled when a helper thread is done
+  size_t next;              // Index of the next file to open
+  int helpers;              // Number of helper threads still running
+
+  TablePreloader() : cv(&mu), next(0), helpers(0) { }
+
+  void OpenFiles() {
+    MutexLock l(&mu);
+    while (next < files->size()) {
+      const FileMetaData* f = (*files)[next++];
+      mu.Unlock();
+      // Errors are ignored here; they are reported by the reads that
+      // need the file.
+      table_cache->Preload(f->number, f->file_size, f->path_id);
+      mu.Lock();
+    }
+  }
+
+  static void Helper(void* arg) {
+    TablePreloader* preloader = reinterpret_cast<TablePreloader*>(arg);
+    preloader->OpenFiles();
+    MutexLock l(&preloader->mu);
+    preloader->helpers--;
+    preloader->cv.SignalAll();
+  }
+};
+
+}
+
+void DBImpl::PreloadTables() {
+  mutex_.AssertHeld();
+  Version* current = versions_->current();
+  current->Ref();
+  std::vector<FileMetaData*> files;
+  current->AddFiles(&files);
+  // Opening more files than the cache holds would evict the first ones
+  const size_t capacity = TableCacheSize(options_);
+  if (files.size() > capacity) {
+    files.resize(capacity);
+  }
+  mutex_.Unlock();
+
+  const uint64_t start_micros = env_->NowMicros();
+  TablePreloader preloader;
+  preloader.table_cache = table_cache_;
+  preloader.files = &files;
+  if (files.size() > 1) {
+    preloader.helpers = std::min<size_t>(options_.max_file_opening_threads,
+                                         files.size()) - 1;
+  }
+  // Finished helpers decrement preloader.helpers, so count on a copy
+  const int n = preloader.helpers;
+  for (int i = 0; i < n; i++) {
+    env_->StartThread(&TablePreloader::Helper, &preloader);
+  }
+  preloader.OpenFiles();
+  {
+    MutexLock l(&preloader.mu);
+    while (preloader.helpers > 0) {
+      preloader.cv.Wait();
+    }
+  }
+  Log(options_.info_log, "Preloaded %d tables in %llu us",
+      static_cast<int>(files.size()),
+      static_cast<unsigned long long>(env_->NowMicros() - start_micros));
+
+  mutex_.Lock();
+  current->Unref();
+}
+
 void DBImpl::DeleteObsoleteFiles() {
+  mutex_.AssertHeld();
+  if (file_deletions_disabled_ > 0) {
+    return;
+  }
+
   // Make a set of all of the live files
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
 
-  std::vector<std::string> filenames;
-  env_->GetChildren(dbname_, &filenames); // Ignoring errors on purpose
+  std::vector<std::string> dirs;
+  GetDBDirs(dbname_, options_, &dirs);
+  std::vector<TableFileDeletionInfo> deleted;
   uint64_t number;
   FileType type;
-  for (size_t i = 0; i < filenames.size(); i++) {
-    if (ParseFileName(filenames[i], &number, &type)) {
-      bool keep = true;
-      switch (type) {
-        case kLogFile:
-          keep = ((number >= versions_->LogNumber()) ||
-                  (number == versions_->PrevLogNumber()));
-          break;
-        case kDescriptorFile:
-          // Keep my manifest file, and any newer incarnations'
-          // (in case there is a race that allows other incarnations)
-          keep = (number >= versions_->ManifestFileNumber());
-          break;
-        case kTableFile:
-          keep = (live.find(number) != live.end());
-          break;
-        case kTempFile:
-          // Any temp files that are currently being written to must
-          // be recorded in pending_outputs_, which is inserted into "live"
-          keep = (live.find(number) != live.end());
-          break;
-        case kCurrentFile:
-        case kDBLockFile:
-        case kInfoLogFile:
-          keep = true;
-          break;
-      }
+  for (size_t d = 0; d < dirs.size(); d++) {
+    std::vector<std::string> filenames;
+    env_->GetChildren(dirs[d], &filenames); // Ignoring errors on purpose
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type)) {
+        bool keep = true;
+        switch (type) {
+          case kLogFile:
+            keep = ((number >= versions_->LogNumber()) ||
+                    (number == versions_->PrevLogNumber()));
+            if (!keep && options_.recycle_log_file_num > 0 &&
+                dirs[d] == options_.wal_dir &&
+                min_log_number_to_recycle_ != 0 &&
+                number >= min_log_number_to_recycle_) {
+              // Keep the log to write the next logs over
+              if (std::find(log_recycle_files_.begin(),
+                            log_recycle_files_.end(),
+                            number) != log_recycle_files_.end()) {
+                keep = true;
+              } else if (log_recycle_files_.size() <
+                         options_.recycle_log_file_num) {
+                log_recycle_files_.push_back(number);
+                keep = true;
+              }
+            }
+            break;
+          case kDescriptorFile:
+            // Keep my manifest file, and any newer incarnations'
+            // (in case there is a race that allows other incarnations)
+            keep = (number >= versions_->ManifestFileNumber());
+            break;
+          case kTableFile:
+          case kBlobFile:
+            keep = (live.find(number) != live.end());
+            break;
+          case kTempFile:
+            // Any temp files that are currently being written to must
+            // be recorded in pending_outputs_, which is inserted into "live"
+            keep = (live.find(number) != live.end());
+            break;
+          case kCurrentFile:
+          case kDBLockFile:
+          case kInfoLogFile:
+            keep = true;
+            break;
+        }
 
-      if (!keep) {
-        if (type == kTableFile) {
-          table_cache_->Evict(number);
+        if (!keep) {
+          if (type == kTableFile) {
+            table_cache_->Evict(number);
+          } else if (type == kBlobFile) {
+            blob_cache_->Evict(number);
+          }
+          Log(options_.info_log, "Delete type=%d #%lld\n",
+              int(type),
+              static_cast<unsigned long long>(number));
+          Status s = env_->DeleteFile(dirs[d] + "/" + filenames[i]);
+          if (type == kTableFile && !options_.listeners.empty()) {
+            TableFileDeletionInfo info;
+            info.db_name = dbname_;
+            info.file_number = number;
+            info.file_path = dirs[d] + "/" + filenames[i];
+            info.status = s;
+            deleted.push_back(info);
+          }
         }
-        Log(options_.info_log, "Delete type=%d #%lld\n",
-            int(type),
-            static_cast<unsigned long long>(number));
-        env_->DeleteFile(dbname_ + "/" + filenames[i]);
       }
     }
   }
+
+  if (!deleted.empty()) {
+    mutex_.Unlock();
+    for (size_t i = 0; i < deleted.size(); i++) {
+      for (size_t j = 0; j < options_.listeners.size(); j++) {
+        options_.listeners[j]->OnTableFileDeleted(deleted[i]);
+      }
+    }
+    mutex_.Lock();
+  }
 }
 
 Status DBImpl::Recover(VersionEdit* edit) {
@@ -253,7 +546,11 @@ Status DBImpl::Recover(VersionEdit* edit) {
   // Ignore error from CreateDir since the creation of the DB is
   // committed only when the descriptor is created, and this directory
   // may already exist from a previous failed creation attempt.
-  env_->CreateDir(dbname_);
+  std::vector<std::string> dirs;
+  GetDBDirs(dbname_, options_, &dirs);
+  for (size_t i = 0; i < dirs.size(); i++) {
+    env_->CreateDir(dirs[i]);
+  }
   assert(db_lock_ == NULL);
   Status s = env_->LockFile(LockFileName(dbname_), &db_lock_);
   if (!s.ok()) {
@@ -291,7 +588,7 @@ Status DBImpl::Recover(VersionEdit* edit) {
     const uint64_t min_log = versions_->LogNumber();
     const uint64_t prev_log = versions_->PrevLogNumber();
     std::vector<std::string> filenames;
-    s = env_->GetChildren(dbname_, &filenames);
+    s = env_->GetChildren(options_.wal_dir, &filenames);
     if (!s.ok()) {
       return s;
     }
@@ -327,6 +624,120 @@ Status DBImpl::Recover(VersionEdit* edit) {
   return s;
 }
 
+namespace {
+
+// Reads the records of a log on a helper thread during recovery, so that
+// reading and checksumming the log overlaps with applying its records.
+// Records are handed over in chunks to keep the synchronization cheap.
+class RecoveryLogReader {
+ public:
+  // "status" is the status set by "reporter", if any.
+  RecoveryLogReader(log::Reader* reader, log::Reader::Reporter* reporter,
+                    const Status* status)
+      : reader_(reader),
+        reporter_(reporter),
+        status_(status),
+        cv_(&mu_),
+        done_(false),
+        stop_(false) {
+  }
+
+  ~RecoveryLogReader() {
+    for (size_t i = 0; i < chunks_.size(); i++) {
+      delete chunks_[i];
+    }
+  }
+
+  static void Run(void* arg) {
+    reinterpret_cast<RecoveryLogReader*>(arg)->ReadAll();
+  }
+
+  // Return the next chunk of records, to be deleted by the caller, or
+  // NULL once all records have been returned.
+  std::vector<std::string>* Next() {
+    MutexLock l(&mu_);
+    while (chunks_.empty() && !done_) {
+      cv_.Wait();
+    }
+    if (chunks_.empty()) {
+      return NULL;
+    }
+    std::vector<std::string>* chunk = chunks_.front();
+    chunks_.pop_front();
+    cv_.SignalAll();
+    return chunk;
+  }
+
+  // Stop reading and wait for the helper thread to be done.
+  void Finish() {
+    MutexLock l(&mu_);
+    stop_ = true;
+    cv_.SignalAll();
+    while (!done_) {
+      cv_.Wait();
+    }
+  }
+
+ private:
+  static const size_t kChunkBytes = 1 << 20;
+  static const size_t kMaxChunks = 4;
+
+  void ReadAll() {
+    std::string scratch;
+    Slice record;
+    std::vector<std::string>* chunk = new std::vector<std::string>;
+    size_t bytes = 0;
+    bool stop = false;
+    while (!stop && status_->ok() &&
+           reader_->ReadRecord(&record, &scratch) && status_->ok()) {
+      if (record.size() < 12) {
+        reporter_->Corruption(
+            record.size(), Status::Corruption("log record too small"));
+        continue;
+      }
+      chunk->push_back(record.ToString());
+      bytes += record.size();
+      if (bytes >= kChunkBytes) {
+        stop = Add(chunk);
+        chunk = new std::vector<std::string>;
+        bytes = 0;
+      }
+    }
+    Add(chunk);
+
+    MutexLock l(&mu_);
+    done_ = true;
+    cv_.SignalAll();
+  }
+
+  // Queue "chunk" once there is room for it.  Returns true if the
+  // reader should stop.
+  bool Add(std::vector<std::string>* chunk) {
+    MutexLock l(&mu_);
+    while (chunks_.size() >= kMaxChunks && !stop_) {
+      cv_.Wait();
+    }
+    if (stop_ || chunk->empty()) {
+      delete chunk;
+    } else {
+      chunks_.push_back(chunk);
+      cv_.SignalAll();
+    }
+    return stop_;
+  }
+
+  log::Reader* const reader_;
+  log::Reader::Reporter* const reporter_;
+  const Status* const status_;
+  port::Mutex mu_;
+  port::CondVar cv_;
+  std::deque<std::vector<std::string>*> chunks_;
+  bool done_;       // The helper thread will not touch this object again
+  bool stop_;       // The records are no longer needed
+};
+
+}
+
 Status DBImpl::RecoverLogFile(uint64_t log_number,
                               VersionEdit* edit,
                               SequenceNumber* max_sequence) {
@@ -346,7 +757,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   mutex_.AssertHeld();
 
   // Open the log file
-  std::string fname = LogFileName(dbname_, log_number);
+  std::string fname = LogFileName(options_.wal_dir, log_number);
   SequentialFile* file;
   Status status = env_->NewSequentialFile(fname, &file);
   if (!status.ok()) {
@@ -354,65 +765,85 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
     return status;
   }
 
-  // Create the log reader.
+  // Create the log reader.  It reports to its own status since it runs
+  // on another thread than the one applying the records.
+  Status read_status;
   LogReporter reporter;
   reporter.env = env_;
   reporter.info_log = options_.info_log;
   reporter.fname = fname.c_str();
-  reporter.status = (options_.paranoid_checks ? &status : NULL);
+  reporter.status = (options_.paranoid_checks ? &read_status : NULL);
   // We intentially make log::Reader do checksumming even if
   // paranoid_checks==false so that corruptions cause entire commits
   // to be skipped instead of propagating bad information (like overly
   // large sequence numbers).
   log::Reader reader(file, &reporter, true/*checksum*/,
-                     0/*initial_offset*/);
+                     0/*initial_offset*/, log_number);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long) log_number);
 
-  // Read all the records and add to a memtable
-  std::string scratch;
-  Slice record;
+  // Read all the records and add to a memtable.  The memtables are only
+  // seen by this thread until they are handed to RecoveryFlush(), so
+  // mutex_ is not needed meanwhile.
+  RecoveryLogReader log_reader(&reader, &reporter, &read_status);
+  env_->StartThread(&RecoveryLogReader::Run, &log_reader);
+  mutex_.Unlock();
   WriteBatch batch;
   MemTable* mem = NULL;
-  while (reader.ReadRecord(&record, &scratch) &&
-         status.ok()) {
-    if (record.size() < 12) {
-      reporter.Corruption(
-          record.size(), Status::Corruption("log record too small"));
-      continue;
-    }
-    WriteBatchInternal::SetContents(&batch, record);
-
-    if (mem == NULL) {
-      mem = new MemTable(internal_comparator_);
-      mem->Ref();
-    }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
-    MaybeIgnoreError(&status);
-    if (!status.ok()) {
-      break;
-    }
-    const SequenceNumber last_seq =
-        WriteBatchInternal::Sequence(&batch) +
-        WriteBatchInternal::Count(&batch) - 1;
-    if (last_seq > *max_sequence) {
-      *max_sequence = last_seq;
-    }
-
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      status = WriteLevel0Table(mem, edit, NULL);
+  std::vector<std::string>* chunk;
+  while (status.ok() && (chunk = log_reader.Next()) != NULL) {
+    for (size_t i = 0; i < chunk->size(); i++) {
+      WriteBatchInternal::SetContents(&batch, (*chunk)[i]);
+
+      if (mem == NULL) {
+        mem = new MemTable(internal_comparator_);
+        mem->Ref();
+      }
+      status = WriteBatchInternal::InsertInto(&batch, mem,
+                                              options_.use_column_families);
+      MaybeIgnoreError(&status);
       if (!status.ok()) {
-        // Reflect errors immediately so that conditions like full
-        // file-systems cause the DB::Open() to fail.
         break;
       }
-      mem->Unref();
-      mem = NULL;
+      const SequenceNumber last_seq =
+          WriteBatchInternal::Sequence(&batch) +
+          WriteBatchInternal::Count(&batch) - 1;
+      if (last_seq > *max_sequence) {
+        *max_sequence = last_seq;
+      }
+
+      if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+        MutexLock l(&mutex_);
+        status = WaitForRecoveryFlush();
+        if (!status.ok()) {
+          // Reflect errors immediately so that conditions like full
+          // file-systems cause the DB::Open() to fail.
+          mem->Unref();
+        } else {
+          recovery_mem_ = mem;
+          recovery_edit_ = edit;
+          env_->StartThread(&DBImpl::RecoveryFlushWork, this);
+        }
+        mem = NULL;
+        if (!status.ok()) {
+          break;
+        }
+      }
     }
+    delete chunk;
   }
+  log_reader.Finish();
+  mutex_.Lock();
 
+  Status flush_status = WaitForRecoveryFlush();
+  if (status.ok()) {
+    status = flush_status;
+  }
+  if (status.ok()) {
+    status = read_status;
+  }
   if (status.ok() && mem != NULL) {
-    status = WriteLevel0Table(mem, edit, NULL);
+    status = WriteLevel0Table(mem, edit, NULL, NULL);
     // Reflect errors immediately so that conditions like full
     // file-systems cause the DB::Open() to fail.
   }
@@ -422,21 +853,82 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   return status;
 }
 
+void DBImpl::RecoveryFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->RecoveryFlush();
+}
+
+void DBImpl::RecoveryFlush() {
+  MutexLock l(&mutex_);
+  assert(recovery_mem_ != NULL);
+  recovery_flush_status_ = WriteLevel0Table(recovery_mem_, recovery_edit_,
+                                            NULL, NULL);
+  recovery_mem_->Unref();
+  recovery_mem_ = NULL;
+  bg_cv_.SignalAll();
+}
+
+Status DBImpl::WaitForRecoveryFlush() {
+  mutex_.AssertHeld();
+  while (recovery_mem_ != NULL) {
+    bg_cv_.Wait();
+  }
+  Status s = recovery_flush_status_;
+  recovery_flush_status_ = Status::OK();
+  return s;
+}
+
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, FlushJobInfo* flush_info) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
+  meta.path_id = 0;  // Flushed tables go to the fastest directory
   pending_outputs_.insert(meta.number);
+  const uint64_t blob_number =
+      (options_.min_blob_size > 0) ? versions_->NewFileNumber() : 0;
+  if (blob_number != 0) {
+    pending_outputs_.insert(blob_number);
+  }
+  uint64_t blob_bytes = 0;
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeDeletionIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
+  if (flush_info != NULL) {
+    flush_info->db_name = dbname_;
+    flush_info->file_number = meta.number;
+    flush_info->file_path = TableFileName(options_.db_paths, meta.number,
+                                          meta.path_id);
+    flush_info->file_size = 0;
+    flush_info->output_level = 0;
+    flush_info->micros = 0;
+  }
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    if (flush_info != NULL) {
+      for (size_t i = 0; i < options_.listeners.size(); i++) {
+        options_.listeners[i]->OnFlushBegin(*flush_info);
+      }
+    }
+    BlobFileBuilder blobs(options_, dbname_, blob_number,
+                          RateLimiter::IO_HIGH);
+    s = BuildTable(env_, options_, table_cache_, iter,
+                   range_del_iter, &meta, blob_number != 0 ? &blobs : NULL);
+    if (s.ok()) {
+      s = blobs.Finish();
+    }
+    blob_bytes = blobs.FileSize();
+    if (!s.ok() && blob_bytes > 0) {
+      env_->DeleteFile(BlobFileName(dbname_, blob_number));
+    }
+    if (!s.ok() || meta.file_size > 0) {
+      NotifyTableFileCreated(flush_info != NULL ? kTableFileCreationFlush
+                                                : kTableFileCreationRecovery,
+                             meta.number, meta.file_size, meta.path_id, s);
+    }
     mutex_.Lock();
   }
 
@@ -444,8 +936,10 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.number,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
+  delete range_del_iter;
   delete iter;
   pending_outputs_.erase(meta.number);
+  pending_outputs_.erase(blob_number);
 
 
   // Note that if file_size is zero, the file has been deleted and
@@ -457,14 +951,26 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     if (base != NULL) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size,
-                  meta.smallest, meta.largest);
+    edit->AddFile(level, meta);
+    if (blob_bytes > 0) {
+      edit->AddBlobFile(blob_number, blob_bytes);
+    }
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
-  stats.bytes_written = meta.file_size;
+  stats.bytes_written = meta.file_size + blob_bytes;
   stats_[level].Add(stats);
+  RecordBackgroundWrite(stats.bytes_written, stats.micros);
+  if (options_.statistics != NULL) {
+    options_.statistics->RecordTick(kFlushWriteBytes, stats.bytes_written);
+    options_.statistics->MeasureTime(kFlushMicros, stats.micros);
+  }
+  if (flush_info != NULL) {
+    flush_info->file_size = meta.file_size;
+    flush_info->output_level = level;
+    flush_info->micros = stats.micros;
+  }
   return s;
 }
 
@@ -474,9 +980,11 @@ Status DBImpl::CompactMemTable() {
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
+  FlushJobInfo flush_info;
+  flush_info.reason = imm_flush_reason_;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  Status s = WriteLevel0Table(imm_, &edit, base, &flush_info);
   base->Unref();
 
   if (s.ok() && shutting_down_.Acquire_Load()) {
@@ -495,18 +1003,40 @@ Status DBImpl::CompactMemTable() {
     imm_->Unref();
     imm_ = NULL;
     has_imm_.Release_Store(NULL);
+    UpdateWriteBufferUsage();
     DeleteObsoleteFiles();
+    if (!options_.listeners.empty()) {
+      mutex_.Unlock();
+      for (size_t i = 0; i < options_.listeners.size(); i++) {
+        options_.listeners[i]->OnFlushCompleted(flush_info);
+      }
+      mutex_.Lock();
+    }
+  } else if (!shutting_down_.Acquire_Load()) {
+    NotifyBackgroundError(kBackgroundErrorFlush, &s);
   }
 
   return s;
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
+  // Keys name entries of the default column family
+  std::string begin_scratch, end_scratch;
+  Slice begin_key, end_key;
+  if (begin != NULL) {
+    begin_key = StorageKey(kDefaultColumnFamilyId, *begin, &begin_scratch);
+    begin = &begin_key;
+  }
+  if (end != NULL) {
+    end_key = StorageKey(kDefaultColumnFamilyId, *end, &end_scratch);
+    end = &end_key;
+  }
+
   int max_level_with_files = 1;
   {
     MutexLock l(&mutex_);
     Version* base = versions_->current();
-    for (int level = 1; level < config::kNumLevels; level++) {
+    for (int level = 1; level < options_.num_levels; level++) {
       if (base->OverlapInLevel(level, begin, end)) {
         max_level_with_files = level;
       }
@@ -518,84 +1048,417 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
-void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
-  assert(level >= 0);
-  assert(level + 1 < config::kNumLevels);
+namespace {
+// A file passed to DB::IngestExternalFile()
+struct ExternalFile {
+  std::string path;
+  uint64_t file_size;
+  InternalKey smallest;
+  InternalKey largest;
+  int level;
+  SequenceNumber sequence;  // Zero if the file is added as it is
+  uint64_t number;
+  uint32_t path_id;
+};
 
-  InternalKey begin_storage, end_storage;
+struct ExternalFileLess {
+  const InternalKeyComparator* icmp;
+  explicit ExternalFileLess(const InternalKeyComparator* c) : icmp(c) { }
+  bool operator()(const ExternalFile& a, const ExternalFile& b) const {
+    return icmp->Compare(a.smallest, b.smallest) < 0;
+  }
+};
 
-  ManualCompaction manual;
-  manual.level = level;
-  manual.done = false;
-  if (begin == NULL) {
-    manual.begin = NULL;
-  } else {
-    begin_storage = InternalKey(*begin, kMaxSequenceNumber, kValueTypeForSeek);
-    manual.begin = &begin_storage;
+// Check that the table "f->path" was built by SstFileWriter and store
+// its size and key range in *f.
+Status ReadExternalFile(const Options& options, ExternalFile* f) {
+  Env* env = options.env;
+  Status s = env->GetFileSize(f->path, &f->file_size);
+  RandomAccessFile* file = NULL;
+  if (s.ok()) {
+    s = env->NewRandomAccessFile(f->path, &file);
   }
-  if (end == NULL) {
-    manual.end = NULL;
-  } else {
-    end_storage = InternalKey(*end, 0, static_cast<ValueType>(0));
-    manual.end = &end_storage;
+  Table* table = NULL;
+  if (s.ok()) {
+    s = Table::Open(options, file, f->file_size, &table);
   }
-
-  MutexLock l(&mutex_);
-  while (!manual.done) {
-    while (manual_compaction_ != NULL) {
-      bg_cv_.Wait();
+  if (s.ok()) {
+    Iterator* range_del_iter = table->NewRangeDeletionIterator();
+    if (range_del_iter != NULL) {
+      s = Status::InvalidArgument("external file has range deletions",
+                                  f->path);
+      delete range_del_iter;
     }
-    manual_compaction_ = &manual;
-    MaybeScheduleCompaction();
-    while (manual_compaction_ == &manual) {
-      bg_cv_.Wait();
+  }
+  if (s.ok()) {
+    Iterator* iter = table->NewIterator(ReadOptions());
+    iter->SeekToFirst();
+    if (!iter->Valid()) {
+      s = iter->status().ok()
+          ? Status::InvalidArgument("external file is empty", f->path)
+          : iter->status();
+    } else {
+      f->smallest.DecodeFrom(iter->key());
+      iter->SeekToLast();
+      if (iter->Valid()) {
+        f->largest.DecodeFrom(iter->key());
+      }
+      s = iter->status();
+    }
+    delete iter;
+
+    ParsedInternalKey smallest, largest;
+    if (s.ok() &&
+        (!ParseInternalKey(f->smallest.Encode(), &smallest) ||
+         !ParseInternalKey(f->largest.Encode(), &largest) ||
+         smallest.sequence != 0 || largest.sequence != 0)) {
+      s = Status::InvalidArgument("external file not written by SstFileWriter",
+                                  f->path);
     }
   }
+  delete table;
+  delete file;
+  return s;
 }
 
-Status DBImpl::TEST_CompactMemTable() {
-  MutexLock l(&mutex_);
-  LoggerId self;
-  AcquireLoggingResponsibility(&self);
-  Status s = MakeRoomForWrite(true /* force compaction */);
-  ReleaseLoggingResponsibility(&self);
+// Copy the entries of "f" to a new table "fname", assigning them the
+// sequence number f.sequence.
+Status RewriteExternalFile(const Options& options, const ExternalFile& f,
+                           const std::string& fname) {
+  Env* env = options.env;
+  RandomAccessFile* source = NULL;
+  Table* table = NULL;
+  Status s = env->NewRandomAccessFile(f.path, &source);
   if (s.ok()) {
-    // Wait until the compaction completes
-    while (imm_ != NULL && bg_error_.ok()) {
-      bg_cv_.Wait();
+    s = Table::Open(options, source, f.file_size, &table);
+  }
+  WritableFile* file = NULL;
+  if (s.ok()) {
+    s = env->NewWritableFile(fname, &file);
+  }
+  if (s.ok()) {
+    TableBuilder* builder = new TableBuilder(options, file);
+    Iterator* iter = table->NewIterator(ReadOptions());
+    std::string key;
+    for (iter->SeekToFirst(); s.ok() && iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      if (!ParseInternalKey(iter->key(), &ikey) ||
+          (ikey.type != kTypeValue && ikey.type != kTypeDeletion)) {
+        s = Status::Corruption("bad entry in external file", f.path);
+        break;
+      }
+      ikey.sequence = f.sequence;
+      key.clear();
+      AppendInternalKey(&key, ikey);
+      builder->Add(key, iter->value());
     }
-    if (imm_ != NULL) {
-      s = bg_error_;
+    if (s.ok()) {
+      s = iter->status();
+    }
+    delete iter;
+    if (s.ok()) {
+      s = builder->Finish();
+    } else {
+      builder->Abandon();
+    }
+    delete builder;
+    if (s.ok()) {
+      s = file->Sync();
+    }
+    if (s.ok()) {
+      s = file->Close();
+    }
+    delete file;
+    if (!s.ok()) {
+      env->DeleteFile(fname);
     }
   }
+  delete table;
+  delete source;
   return s;
 }
 
-void DBImpl::MaybeScheduleCompaction() {
-  mutex_.AssertHeld();
-  if (bg_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.Acquire_Load()) {
-    // DB is being deleted; no more background compactions
-  } else if (imm_ == NULL &&
-             manual_compaction_ == NULL &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
-  } else {
-    bg_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
-  }
+InternalKey WithSequence(const InternalKey& key, SequenceNumber sequence) {
+  ParsedInternalKey ikey;
+  ParseInternalKey(key.Encode(), &ikey);
+  ikey.sequence = sequence;
+  InternalKey result;
+  result.SetFrom(ikey);
+  return result;
 }
 
-void DBImpl::BGWork(void* db) {
-  reinterpret_cast<DBImpl*>(db)->BackgroundCall();
+// Return true if "mem" may have entries for keys in
+// [smallest_user_key,largest_user_key].
+bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                      const Slice& smallest_user_key,
+                      const Slice& largest_user_key) {
+  Iterator* range_del_iter = mem->NewRangeDeletionIterator();
+  if (range_del_iter != NULL) {
+    delete range_del_iter;
+    return true;
+  }
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(start.Encode());
+  const bool overlaps = iter->Valid() &&
+      ucmp->Compare(ExtractUserKey(iter->key()), largest_user_key) <= 0;
+  delete iter;
+  return overlaps;
+}
 }
 
-void DBImpl::BackgroundCall() {
+Status DBImpl::IngestExternalFile(const std::vector<std::string>& files,
+                                  const IngestExternalFileOptions& options) {
+  if (options_.use_column_families) {
+    return Status::NotSupported("IngestExternalFile with column families");
+  }
+  if (files.empty()) {
+    return Status::OK();
+  }
+
+  // Read the key ranges of the files without holding the lock
+  Options table_options = options_;
+  table_options.block_cache = NULL;
+  std::vector<ExternalFile> ingested(files.size());
+  Status s;
+  for (size_t i = 0; s.ok() && i < files.size(); i++) {
+    ingested[i].path = files[i];
+    s = ReadExternalFile(table_options, &ingested[i]);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  const Comparator* ucmp = user_comparator();
+  std::sort(ingested.begin(), ingested.end(),
+            ExternalFileLess(&internal_comparator_));
+  for (size_t i = 1; i < ingested.size(); i++) {
+    if (ucmp->Compare(ingested[i - 1].largest.user_key(),
+                      ingested[i].smallest.user_key()) >= 0) {
+      return Status::InvalidArgument("external files overlap",
+                                     ingested[i].path);
+    }
+  }
+
+  MutexLock l(&mutex_);
+  // Hold off writers so that no entry gets a sequence number while the
+  // files are being added.  Entries of the memtables that overlap the
+  // files must be flushed first, since the files go into the levels.
+  LoggerId self;
+  AcquireLoggingResponsibility(&self);
+  bool flush = false;
+  for (size_t i = 0; !flush && i < ingested.size(); i++) {
+    const Slice smallest = ingested[i].smallest.user_key();
+    const Slice largest = ingested[i].largest.user_key();
+    flush = MemTableOverlaps(mem_, ucmp, smallest, largest) ||
+        (imm_ != NULL && MemTableOverlaps(imm_, ucmp, smallest, largest));
+  }
+  if (flush) {
+    s = MakeRoomForWrite(true /* force compaction */, 0);
+    while (s.ok() && imm_ != NULL && bg_error_.ok()) {
+      bg_cv_.Wait();
+    }
+    if (s.ok() && imm_ != NULL) {
+      s = bg_error_;
+    }
+  }
+  if (!s.ok()) {
+    ReleaseLoggingResponsibility(&self);
+    return s;
+  }
+
+  BeginForegroundEdit();
+  s = bg_error_;
+
+  // Add each file to the lowest level above the first level that
+  // overlaps it.  Files that overlap nothing go to the last level and
+  // keep sequence number zero, so that they need not be rewritten,
+  // unless a snapshot must not see them.  Other files get a sequence
+  // number newer than all entries of the DB.
+  const SequenceNumber sequence = versions_->LastSequence() + 1;
+  bool sequence_used = false;
+  Version* current = versions_->current();
+  for (size_t i = 0; s.ok() && i < ingested.size(); i++) {
+    ExternalFile* f = &ingested[i];
+    const Slice smallest = f->smallest.user_key();
+    const Slice largest = f->largest.user_key();
+    int level = 0;
+    while (level < options_.num_levels &&
+           !current->OverlapInLevel(level, &smallest, &largest)) {
+      level++;
+    }
+    if (level == options_.num_levels) {
+      f->level = options_.num_levels - 1;
+      f->sequence = snapshots_.empty() ? 0 : sequence;
+    } else {
+      f->level = (level > 0) ? level - 1 : 0;
+      f->sequence = sequence;
+    }
+    if (f->sequence != 0) {
+      sequence_used = true;
+      f->smallest = WithSequence(f->smallest, sequence);
+      f->largest = WithSequence(f->largest, sequence);
+    }
+    f->number = versions_->NewFileNumber();
+    f->path_id = versions_->PathIdForLevel(f->level);
+    pending_outputs_.insert(f->number);
+  }
+
+  if (s.ok()) {
+    mutex_.Unlock();
+    for (size_t i = 0; s.ok() && i < ingested.size(); i++) {
+      ExternalFile* f = &ingested[i];
+      const std::string fname = TableFileName(options_.db_paths, f->number,
+                                              f->path_id);
+      if (f->sequence != 0) {
+        s = RewriteExternalFile(table_options, *f, fname);
+        if (s.ok()) {
+          s = env_->GetFileSize(fname, &f->file_size);
+        }
+      } else if (options.move_files) {
+        s = env_->RenameFile(f->path, fname);
+      } else {
+        s = env_->LinkFile(f->path, fname);
+        if (s.IsNotSupported()) {
+          s = CopyFile(env_, f->path, fname);
+        }
+      }
+    }
+    mutex_.Lock();
+  }
+
+  if (s.ok()) {
+    VersionEdit edit;
+    for (size_t i = 0; i < ingested.size(); i++) {
+      const ExternalFile& f = ingested[i];
+      edit.AddFile(f.level, f.number, f.file_size, f.smallest, f.largest,
+                   false, f.sequence, f.sequence, f.path_id);
+    }
+    if (sequence_used) {
+      versions_->SetLastSequence(sequence);
+    }
+    s = versions_->LogAndApply(&edit, &mutex_);
+  }
+  for (size_t i = 0; i < ingested.size(); i++) {
+    const ExternalFile& f = ingested[i];
+    if (!s.ok()) {
+      const std::string fname = TableFileName(options_.db_paths, f.number,
+                                              f.path_id);
+      if (options.move_files && f.sequence == 0) {
+        env_->RenameFile(fname, f.path);
+      } else {
+        env_->DeleteFile(fname);
+      }
+    } else {
+      Log(options_.info_log, "Ingested %s as #%llu at level %d",
+          f.path.c_str(), (unsigned long long) f.number, f.level);
+      if (options.move_files && f.sequence != 0) {
+        env_->DeleteFile(f.path);
+      }
+    }
+    pending_outputs_.erase(f.number);
+  }
+  EndForegroundEdit();
+  ReleaseLoggingResponsibility(&self);
+  return s;
+}
+
+void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
+  assert(level >= 0);
+  assert(level + 1 < options_.num_levels);
+
+  InternalKey begin_storage, end_storage;
+
+  ManualCompaction manual;
+  manual.level = level;
+  manual.done = false;
+  if (begin == NULL) {
+    manual.begin = NULL;
+  } else {
+    begin_storage = InternalKey(*begin, kMaxSequenceNumber, kValueTypeForSeek);
+    manual.begin = &begin_storage;
+  }
+  if (end == NULL) {
+    manual.end = NULL;
+  } else {
+    end_storage = InternalKey(*end, 0, static_cast<ValueType>(0));
+    manual.end = &end_storage;
+  }
+
+  MutexLock l(&mutex_);
+  while (!manual.done) {
+    while (manual_compaction_ != NULL) {
+      bg_cv_.Wait();
+    }
+    manual_compaction_ = &manual;
+    MaybeScheduleCompaction();
+    while (manual_compaction_ == &manual) {
+      bg_cv_.Wait();
+    }
+  }
+}
+
+Status DBImpl::TEST_CompactMemTable() {
+  return FlushMemTable();
+}
+
+Status DBImpl::FlushMemTable() {
+  MutexLock l(&mutex_);
+  LoggerId self;
+  AcquireLoggingResponsibility(&self);
+  Status s = MakeRoomForWrite(true /* force compaction */, 0);
+  ReleaseLoggingResponsibility(&self);
+  if (s.ok()) {
+    // Wait until the compaction completes
+    while (imm_ != NULL && bg_error_.ok()) {
+      bg_cv_.Wait();
+    }
+    if (imm_ != NULL) {
+      s = bg_error_;
+    }
+  }
+  return s;
+}
+
+uint64_t DBImpl::TEST_ManifestFileNumber() {
+  MutexLock l(&mutex_);
+  return versions_->ManifestFileNumber();
+}
+
+Status DBImpl::TEST_WaitForCompact() {
+  MutexLock l(&mutex_);
+  while (bg_compaction_scheduled_ && bg_error_.ok()) {
+    bg_cv_.Wait();
+  }
+  return bg_error_;
+}
+
+void DBImpl::MaybeScheduleCompaction() {
+  mutex_.AssertHeld();
+  if (bg_compaction_scheduled_) {
+    // Already scheduled
+  } else if (shutting_down_.Acquire_Load()) {
+    // DB is being deleted; no more background compactions
+  } else if (imm_ == NULL &&
+             manual_compaction_ == NULL &&
+             (options_.disable_auto_compactions ||
+              !versions_->NeedsCompaction())) {
+    // No work to be done
+  } else {
+    bg_compaction_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGWork, this);
+  }
+}
+
+void DBImpl::BGWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundCall();
+}
+
+void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
   assert(bg_compaction_scheduled_);
   if (!shutting_down_.Acquire_Load()) {
     BackgroundCompaction();
+    NotifyStallConditionChanged();
   }
   bg_compaction_scheduled_ = false;
 
@@ -619,7 +1482,8 @@ void DBImpl::BackgroundCompaction() {
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
-    m->done = (c == NULL);
+    // Universal compactions merge all runs at once
+    m->done = (c == NULL || c->output_level() == c->level());
     if (c != NULL) {
       manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
     }
@@ -629,33 +1493,68 @@ void DBImpl::BackgroundCompaction() {
         (m->begin ? m->begin->DebugString().c_str() : "(begin)"),
         (m->end ? m->end->DebugString().c_str() : "(end)"),
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
-  } else {
+  } else if (!options_.disable_auto_compactions) {
     c = versions_->PickCompaction();
+  } else {
+    c = NULL;
+  }
+
+  CompactionJobInfo job_info;
+  uint64_t start_micros = 0;
+  if (c != NULL && !options_.listeners.empty()) {
+    job_info.db_name = dbname_;
+    job_info.reason = is_manual ? kCompactionReasonManual : c->reason();
+    job_info.base_level = c->level();
+    job_info.output_level = c->output_level();
+    job_info.is_trivial_move = !is_manual && c->IsTrivialMove();
+    for (int which = 0; which < 2; which++) {
+      for (int i = 0; i < c->num_input_files(which); i++) {
+        job_info.input_files.push_back(c->input(which, i)->number);
+      }
+    }
+    job_info.bytes_read = job_info.bytes_written = job_info.micros = 0;
+    start_micros = env_->NowMicros();
+    NotifyCompaction(job_info, false);
   }
 
   Status status;
   if (c == NULL) {
     // Nothing to do
   } else if (!is_manual && c->IsTrivialMove()) {
-    // Move file to next level
-    assert(c->num_input_files(0) == 1);
-    FileMetaData* f = c->input(0, 0);
-    c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
+    // Move files to next level
+    int64_t moved_bytes = 0;
+    for (int i = 0; i < c->num_input_files(0); i++) {
+      FileMetaData* f = c->input(0, i);
+      c->edit()->DeleteFile(c->level(), f->number);
+      c->edit()->AddFile(c->output_level(), *f);
+      moved_bytes += f->file_size;
+    }
     status = versions_->LogAndApply(c->edit(), &mutex_);
     VersionSet::LevelSummaryStorage tmp;
-    Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-        static_cast<unsigned long long>(f->number),
-        c->level() + 1,
-        static_cast<unsigned long long>(f->file_size),
+    Log(options_.info_log,
+        "Moved #%lld (%d files) to level-%d %lld bytes %s: %s\n",
+        static_cast<unsigned long long>(c->input(0, 0)->number),
+        c->num_input_files(0),
+        c->output_level(),
+        static_cast<unsigned long long>(moved_bytes),
         status.ToString().c_str(),
         versions_->LevelSummary(&tmp));
   } else {
     CompactionState* compact = new CompactionState(c);
+    compact->job_info = &job_info;
     status = DoCompactionWork(compact);
     CleanupCompaction(compact);
   }
+  if (c != NULL && !options_.listeners.empty()) {
+    if (job_info.is_trivial_move) {
+      for (int i = 0; i < c->num_input_files(0); i++) {
+        job_info.output_files.push_back(c->input(0, i)->number);
+      }
+    }
+    job_info.micros = env_->NowMicros() - start_micros;
+    job_info.status = status;
+    NotifyCompaction(job_info, true);
+  }
   delete c;
 
   if (status.ok()) {
@@ -665,7 +1564,8 @@ void DBImpl::BackgroundCompaction() {
   } else {
     Log(options_.info_log,
         "Compaction error: %s", status.ToString().c_str());
-    if (options_.paranoid_checks && bg_error_.ok()) {
+    NotifyBackgroundError(kBackgroundErrorCompaction, &status);
+    if (!status.ok() && options_.paranoid_checks && bg_error_.ok()) {
       bg_error_ = status;
     }
   }
@@ -696,6 +1596,9 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
     const CompactionState::Output& out = compact->outputs[i];
     pending_outputs_.erase(out.number);
   }
+  if (compact->blobs != NULL) {
+    pending_outputs_.erase(compact->blobs->number());
+  }
   delete compact;
 }
 
@@ -709,32 +1612,99 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     pending_outputs_.insert(file_number);
     CompactionState::Output out;
     out.number = file_number;
+    out.path_id = versions_->PathIdForLevel(
+        compact->compaction->output_level());
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_deletions = false;
+    out.smallest_seqno = kMaxSequenceNumber;
+    out.largest_seqno = 0;
+    out.num_entries = 0;
+    out.num_deletions = 0;
+    out.oldest_blob_file = 0;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
 
   // Make the output file
-  std::string fname = TableFileName(dbname_, file_number);
+  std::string fname = TableFileName(options_.db_paths, file_number,
+                                    compact->outputs.back().path_id);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
+    compact->outfile = NewRateLimitedFile(compact->outfile,
+                                          options_.rate_limiter,
+                                          RateLimiter::IO_LOW);
     compact->builder = new TableBuilder(options_, compact->outfile);
   }
   return s;
 }
 
+void DBImpl::OutputRangeDeletions(CompactionState* compact,
+                                  const Slice* next_user_key,
+                                  std::vector<RangeDeletion>* result) {
+  result->clear();
+  if (compact->range_deletions == NULL) {
+    return;
+  }
+  Slice lower(compact->output_lower_bound);
+  std::vector<RangeDeletion> clipped;
+  compact->range_deletions->Clip(
+      compact->has_output_lower_bound ? &lower : NULL, next_user_key,
+      &clipped);
+  for (size_t i = 0; i < clipped.size(); i++) {
+    const RangeDeletion& d = clipped[i];
+    if (d.sequence <= compact->smallest_snapshot &&
+        compact->compaction->IsBaseLevelForRange(d.begin, d.end)) {
+      // Every entry the deletion covers is dropped by this compaction
+      continue;
+    }
+    result->push_back(d);
+  }
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* next_user_key) {
   assert(compact != NULL);
   assert(compact->outfile != NULL);
   assert(compact->builder != NULL);
 
-  const uint64_t output_number = compact->current_output()->number;
+  CompactionState::Output* out = compact->current_output();
+  const uint64_t output_number = out->number;
   assert(output_number != 0);
 
   // Check for iterator errors
   Status s = input->status();
+  if (s.ok() && compact->range_deletions != NULL) {
+    // Keep the range deletions up to the start of the next output, and
+    // widen the key range of the output to them
+    std::vector<RangeDeletion> deletions;
+    OutputRangeDeletions(compact, next_user_key, &deletions);
+    bool empty = (compact->builder->NumEntries() == 0);
+    for (size_t i = 0; i < deletions.size(); i++) {
+      const RangeDeletion& d = deletions[i];
+      InternalKey begin(d.begin, d.sequence, kTypeRangeDeletion);
+      InternalKey end(d.end, kMaxSequenceNumber, kTypeRangeDeletion);
+      compact->builder->AddRangeDeletion(begin.Encode(), d.end);
+      out->AddEntry(d.sequence, kTypeRangeDeletion);
+      if (empty || internal_comparator_.Compare(begin, out->smallest) < 0) {
+        out->smallest = begin;
+      }
+      if (empty || internal_comparator_.Compare(end, out->largest) > 0) {
+        out->largest = end;
+      }
+      empty = false;
+    }
+    out->has_range_deletions = !deletions.empty();
+  }
+  if (out->smallest_seqno > out->largest_seqno) {
+    out->smallest_seqno = 0;  // No entries
+  }
+  if (next_user_key != NULL) {
+    compact->output_lower_bound.assign(next_user_key->data(),
+                                       next_user_key->size());
+    compact->has_output_lower_bound = true;
+  }
   const uint64_t current_entries = compact->builder->NumEntries();
   if (s.ok()) {
     s = compact->builder->Finish();
@@ -742,7 +1712,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
     compact->builder->Abandon();
   }
   const uint64_t current_bytes = compact->builder->FileSize();
-  compact->current_output()->file_size = current_bytes;
+  out->file_size = current_bytes;
   compact->total_bytes += current_bytes;
   delete compact->builder;
   compact->builder = NULL;
@@ -756,12 +1726,15 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   }
   delete compact->outfile;
   compact->outfile = NULL;
+  NotifyTableFileCreated(kTableFileCreationCompaction, output_number,
+                         current_bytes, out->path_id, s);
 
-  if (s.ok() && current_entries > 0) {
+  if (s.ok() && (current_entries > 0 || out->has_range_deletions)) {
     // Verify that the table is usable
     Iterator* iter = table_cache_->NewIterator(ReadOptions(),
                                                output_number,
-                                               current_bytes);
+                                               current_bytes,
+                                               out->path_id);
     s = iter->status();
     delete iter;
     if (s.ok()) {
@@ -782,20 +1755,40 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
       compact->compaction->num_input_files(0),
       compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1,
+      compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(
-        level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
+    FileMetaData f;
+    f.number = out.number;
+    f.file_size = out.file_size;
+    f.smallest = out.smallest;
+    f.largest = out.largest;
+    f.has_range_deletions = out.has_range_deletions;
+    f.smallest_seqno = out.smallest_seqno;
+    f.largest_seqno = out.largest_seqno;
+    f.num_entries = out.num_entries;
+    f.num_deletions = out.num_deletions;
+    f.path_id = out.path_id;
+    f.oldest_blob_file = out.oldest_blob_file;
+    compact->compaction->edit()->AddFile(level, f);
     pending_outputs_.erase(out.number);
   }
   compact->outputs.clear();
+  if (compact->blobs != NULL && compact->blobs->FileSize() > 0) {
+    compact->compaction->edit()->AddBlobFile(compact->blobs->number(),
+                                             compact->blobs->FileSize());
+  }
+  for (std::map<uint64_t, uint64_t>::const_iterator it =
+           compact->blob_garbage.begin();
+       it != compact->blob_garbage.end();
+       ++it) {
+    compact->compaction->edit()->AddBlobGarbage(it->first, it->second);
+  }
 
   Status s = versions_->LogAndApply(compact->compaction->edit(), &mutex_);
   if (s.ok()) {
@@ -804,12 +1797,200 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   } else {
     // Discard any files we may have created during this failed compaction
     for (size_t i = 0; i < compact->outputs.size(); i++) {
-      env_->DeleteFile(TableFileName(dbname_, compact->outputs[i].number));
+      env_->DeleteFile(TableFileName(options_.db_paths,
+                                     compact->outputs[i].number,
+                                     compact->outputs[i].path_id));
+    }
+    if (compact->blobs != NULL && compact->blobs->FileSize() > 0) {
+      env_->DeleteFile(BlobFileName(dbname_, compact->blobs->number()));
+    }
+  }
+  return s;
+}
+
+CompactionFilter::Decision DBImpl::FilterCompactionValue(
+    int level, const Slice& user_key, const Slice& value,
+    std::string* new_value) {
+  Slice key = user_key;
+  if (options_.use_column_families) {
+    uint32_t id;
+    if (!ParseColumnFamilyKey(user_key, &id, &key)) {
+      return CompactionFilter::kKeep;
+    }
+  }
+  new_value->clear();
+  return options_.compaction_filter->Filter(level, key, value, new_value);
+}
+
+Status DBImpl::MergeCompactionOperands(CompactionState* compact,
+                                       Iterator* input,
+                                       std::string* key,
+                                       std::string* value) {
+  ParsedInternalKey ikey;
+  ParseInternalKey(input->key(), &ikey);  // Already checked by the caller
+  const std::string user_key = ikey.user_key.ToString();
+  const SequenceNumber sequence = ikey.sequence;
+  std::vector<std::string> operands;
+  operands.push_back(input->value().ToString());
+
+  // Collect the older operands down to the value or deletion they apply
+  // to.  That entry is consumed too, so that a blob value it refers to
+  // is counted as garbage here; any older entries of the key are left in
+  // "input", where rule (A) of the caller drops them.
+  bool found_base = false;
+  bool has_value = false;
+  std::string base;
+  for (input->Next(); input->Valid(); input->Next()) {
+    if (!ParseInternalKey(input->key(), &ikey) ||
+        user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (compact->range_deletions != NULL &&
+        compact->range_deletions->MaxCoveringSequence(
+            user_key, compact->smallest_snapshot) > ikey.sequence) {
+      // The older entries are deleted by a range deletion
+      found_base = true;
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      operands.push_back(input->value().ToString());
+    } else {
+      found_base = true;
+      has_value = (ikey.type == kTypeValue || ikey.type == kTypeBlobIndex);
+      if (ikey.type == kTypeBlobIndex) {
+        Status s = blob_cache_->Get(input->value(), &base);
+        if (!s.ok()) {
+          return s;
+        }
+        compact->AddBlobGarbage(input->value());
+      } else if (has_value) {
+        base = input->value().ToString();
+      }
+      input->Next();
+      break;
+    }
+  }
+
+  Status s;
+  ValueType type;
+  if (found_base || compact->compaction->IsBaseLevelForKey(user_key)) {
+    // All the entries of the key are here: produce its value
+    type = kTypeValue;
+    Slice base_slice(base);
+    s = merge_helper_.ApplyAll(user_key, has_value ? &base_slice : NULL,
+                               operands, value);
+  } else {
+    // The value lives in a deeper level: combine the operands into one,
+    // starting from the oldest
+    type = kTypeMerge;
+    base.swap(operands.back());
+    operands.pop_back();
+    if (operands.empty()) {
+      value->swap(base);
+    } else {
+      Slice base_slice(base);
+      s = merge_helper_.ApplyAll(user_key, &base_slice, operands, value);
+    }
+  }
+  key->clear();
+  AppendInternalKey(key, ParsedInternalKey(user_key, sequence, type));
+  return s;
+}
+
+Status DBImpl::PrepareBlobValue(CompactionState* compact, Slice* key,
+                                Slice* value) {
+  if (key->size() < 8) {
+    return Status::OK();  // A corrupted key, kept as it is
+  }
+  const ValueType type = ExtractValueType(*key);
+  Status s;
+  if (type == kTypeValue && options_.min_blob_size > 0 &&
+      value->size() >= options_.min_blob_size) {
+    s = compact->blobs->Add(*value, &compact->blob_index);
+  } else if (type == kTypeBlobIndex) {
+    BlobIndex handle;
+    s = handle.DecodeFrom(*value);
+    if (s.ok() && !compact->compaction->ShouldRelocateBlob(
+            handle.file_number)) {
+      // The entry keeps referring to the same value
+      CompactionState::Output* out = compact->current_output();
+      if (out->oldest_blob_file == 0 ||
+          handle.file_number < out->oldest_blob_file) {
+        out->oldest_blob_file = handle.file_number;
+      }
+      return s;
+    }
+    if (s.ok()) {
+      s = blob_cache_->Get(*value, &compact->blob_value);
+    }
+    if (s.ok()) {
+      s = compact->blobs->Add(compact->blob_value, &compact->blob_index);
+    }
+    if (s.ok()) {
+      compact->blob_garbage[handle.file_number] += handle.record_size();
+    }
+  } else {
+    return s;
+  }
+
+  if (s.ok()) {
+    compact->blob_key.clear();
+    AppendInternalKey(&compact->blob_key, ParsedInternalKey(
+        ExtractUserKey(*key), ExtractSequence(*key), kTypeBlobIndex));
+    *key = compact->blob_key;
+    *value = compact->blob_index;
+    // Blob files are numbered after the ones that existed when the
+    // compaction started, so any other one the output refers to is older
+    CompactionState::Output* out = compact->current_output();
+    if (out->oldest_blob_file == 0) {
+      out->oldest_blob_file = compact->blobs->number();
     }
   }
   return s;
 }
 
+Status DBImpl::SetupCompactionRangeDeletions(CompactionState* compact) {
+  Compaction* c = compact->compaction;
+  Status s;
+
+  // The "level+1" files are older than the "level" files, so those whose
+  // whole key range is deleted by the latter need not be read at all.
+  RangeDeletions upper(user_comparator());
+  for (int i = 0; s.ok() && i < c->num_input_files(0); i++) {
+    const FileMetaData* f = c->input(0, i);
+    if (f->has_range_deletions) {
+      s = table_cache_->AddRangeDeletions(f->number, f->file_size,
+                                          f->path_id, &upper);
+    }
+  }
+  if (s.ok() && !upper.empty()) {
+    upper.Finish();
+    const int dropped = c->DropCoveredInputs(upper, compact->smallest_snapshot);
+    if (dropped > 0) {
+      Log(options_.info_log, "Dropping %d@%d files covered by range deletions",
+          dropped, c->output_level());
+    }
+  }
+
+  RangeDeletions* deletions = new RangeDeletions(user_comparator());
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; s.ok() && i < c->num_input_files(which); i++) {
+      const FileMetaData* f = c->input(which, i);
+      if (f->has_range_deletions) {
+        s = table_cache_->AddRangeDeletions(f->number, f->file_size,
+                                            f->path_id, deletions);
+      }
+    }
+  }
+  if (s.ok() && !deletions->empty()) {
+    deletions->Finish();
+    compact->range_deletions = deletions;
+  } else {
+    delete deletions;
+  }
+  return s;
+}
+
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
   int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
@@ -818,7 +1999,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       compact->compaction->num_input_files(0),
       compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->output_level());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == NULL);
@@ -828,18 +2009,32 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
   }
+  if (options_.min_blob_size > 0 || compact->compaction->HasBlobFiles()) {
+    const uint64_t blob_number = versions_->NewFileNumber();
+    pending_outputs_.insert(blob_number);
+    compact->blobs = new BlobFileBuilder(options_, dbname_, blob_number,
+                                         RateLimiter::IO_LOW);
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
+  Status status = SetupCompactionRangeDeletions(compact);
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
   input->SeekToFirst();
-  Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-  for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
+  std::string filtered_key;
+  std::string filtered_value;
+  std::string blob_value;
+  std::vector<std::string> merge_operands;
+  // Outputs are only finished between the entries of different user
+  // keys, so that the range deletions that cover a key are in the same
+  // output as its entries.
+  bool finish_output = false;
+  for (; status.ok() && input->Valid() && !shutting_down_.Acquire_Load(); ) {
     // Prioritize immutable compaction work
     if (has_imm_.NoBarrier_Load() != NULL) {
       const uint64_t imm_start = env_->NowMicros();
@@ -855,7 +2050,14 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     Slice key = input->key();
     if (compact->compaction->ShouldStopBefore(key) &&
         compact->builder != NULL) {
-      status = FinishCompactionOutputFile(compact, input);
+      finish_output = true;
+    }
+    if (finish_output && ParseInternalKey(key, &ikey) &&
+        (!has_current_user_key ||
+         user_comparator()->Compare(ikey.user_key,
+                                    Slice(current_user_key)) != 0)) {
+      status = FinishCompactionOutputFile(compact, input, &ikey.user_key);
+      finish_output = false;
       if (!status.ok()) {
         break;
       }
@@ -863,6 +2065,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 
     // Handle key/value, add to state, etc.
     bool drop = false;
+    bool first_occurrence = false;
+    bool merged = false;       // input is already past the entry
+    CompactionFilter::Decision filter_decision = CompactionFilter::kKeep;
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_user_key.clear();
@@ -876,6 +2081,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
         last_sequence_for_key = kMaxSequenceNumber;
+        first_occurrence = true;
       }
 
       if (last_sequence_for_key <= compact->smallest_snapshot) {
@@ -892,9 +2098,51 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (compact->range_deletions != NULL &&
+                 compact->range_deletions->MaxCoveringSequence(
+                     ikey.user_key, compact->smallest_snapshot) >
+                 ikey.sequence) {
+        // Deleted by a range deletion that every snapshot sees
+        drop = true;
       }
 
       last_sequence_for_key = ikey.sequence;
+
+      if (!drop && ikey.type == kTypeMerge &&
+          ikey.sequence <= compact->smallest_snapshot &&
+          merge_helper_.enabled()) {
+        // No snapshot needs the older entries of this key individually,
+        // so combine them into this one.
+        status = MergeCompactionOperands(compact, input,
+                                         &filtered_key, &filtered_value);
+        if (!status.ok()) {
+          break;
+        }
+        merged = true;
+      }
+
+      if (!drop && first_occurrence &&
+          (ikey.type == kTypeValue || ikey.type == kTypeBlobIndex) &&
+          options_.compaction_filter != NULL) {
+        Slice value = input->value();
+        if (ikey.type == kTypeBlobIndex) {
+          status = blob_cache_->Get(value, &blob_value);
+          if (!status.ok()) {
+            break;
+          }
+          value = blob_value;
+        }
+        filter_decision = FilterCompactionValue(
+            compact->compaction->output_level(), ikey.user_key, value,
+            &filtered_value);
+        if (filter_decision == CompactionFilter::kRemove &&
+            ikey.sequence <= compact->smallest_snapshot &&
+            compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+          // No older value of the key remains below, so the key can go
+          // without leaving a deletion marker behind.
+          drop = true;
+        }
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -906,6 +2154,13 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
+    if (!merged && key.size() >= 8 &&
+        ExtractValueType(key) == kTypeBlobIndex &&
+        (drop || filter_decision != CompactionFilter::kKeep)) {
+      // The blob value of the entry is no longer referred to
+      compact->AddBlobGarbage(input->value());
+    }
+
     if (!drop) {
       // Open output file if necessary
       if (compact->builder == NULL) {
@@ -914,34 +2169,71 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
           break;
         }
       }
+      Slice output_key = merged ? Slice(filtered_key) : key;
+      Slice output_value = merged ? Slice(filtered_value) : input->value();
+      if (filter_decision == CompactionFilter::kRemove) {
+        // Older values of the key may remain in other files, so they have
+        // to be hidden by a deletion marker in place of the value.
+        filtered_key.clear();
+        AppendInternalKey(&filtered_key, ParsedInternalKey(
+            ikey.user_key, ikey.sequence, kTypeDeletion));
+        output_key = filtered_key;
+        output_value = Slice();
+      } else if (filter_decision == CompactionFilter::kChangeValue) {
+        output_value = filtered_value;
+        if (ikey.type == kTypeBlobIndex) {
+          filtered_key.clear();
+          AppendInternalKey(&filtered_key, ParsedInternalKey(
+              ikey.user_key, ikey.sequence, kTypeValue));
+          output_key = filtered_key;
+        }
+      }
+      status = PrepareBlobValue(compact, &output_key, &output_value);
+      if (!status.ok()) {
+        break;
+      }
       if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+        compact->current_output()->smallest.DecodeFrom(output_key);
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+      compact->current_output()->largest.DecodeFrom(output_key);
+      compact->current_output()->AddEntry(
+          ikey.sequence, filter_decision == CompactionFilter::kRemove
+                         ? kTypeDeletion : ikey.type);
+      compact->builder->Add(output_key, output_value);
 
-      // Close output file if it is big enough
+      // Close output file before the next key if it is big enough
       if (compact->builder->FileSize() >=
           compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+        finish_output = true;
       }
     }
 
-    input->Next();
+    if (!merged) {
+      input->Next();
+    }
   }
 
   if (status.ok() && shutting_down_.Acquire_Load()) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == NULL &&
+      compact->range_deletions != NULL) {
+    // Range deletions past the last output entry still need an output
+    std::vector<RangeDeletion> deletions;
+    OutputRangeDeletions(compact, NULL, &deletions);
+    if (!deletions.empty()) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != NULL) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, NULL);
   }
   if (status.ok()) {
     status = input->status();
   }
+  if (status.ok() && compact->blobs != NULL) {
+    status = compact->blobs->Finish();
+  }
   delete input;
   input = NULL;
 
@@ -955,9 +2247,25 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     stats.bytes_written += compact->outputs[i].file_size;
   }
+  if (compact->blobs != NULL) {
+    stats.bytes_written += compact->blobs->FileSize();
+  }
+  if (compact->job_info != NULL) {
+    for (size_t i = 0; i < compact->outputs.size(); i++) {
+      compact->job_info->output_files.push_back(compact->outputs[i].number);
+    }
+    compact->job_info->bytes_read = stats.bytes_read;
+    compact->job_info->bytes_written = stats.bytes_written;
+  }
 
   mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+  stats_[compact->compaction->output_level()].Add(stats);
+  RecordBackgroundWrite(stats.bytes_written, stats.micros);
+  if (options_.statistics != NULL) {
+    options_.statistics->RecordTick(kCompactReadBytes, stats.bytes_read);
+    options_.statistics->RecordTick(kCompactWriteBytes, stats.bytes_written);
+    options_.statistics->MeasureTime(kCompactionMicros, stats.micros);
+  }
 
   if (status.ok()) {
     status = InstallCompactionResults(compact);
@@ -988,7 +2296,8 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 }
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
-                                      SequenceNumber* latest_snapshot) {
+                                      SequenceNumber* latest_snapshot,
+                                      RangeDeletions** range_deletions) {
   IterState* cleanup = new IterState;
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
@@ -1013,12 +2322,42 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, NULL);
 
   mutex_.Unlock();
+
+  if (range_deletions != NULL) {
+    // The memtables and version are kept alive by internal_iter
+    *range_deletions = NULL;
+    RangeDeletions* deletions = new RangeDeletions(user_comparator());
+    Status s;
+    MemTable* mems[2] = { cleanup->mem, cleanup->imm };
+    for (int i = 0; s.ok() && i < 2; i++) {
+      Iterator* iter = (mems[i] != NULL ? mems[i]->NewRangeDeletionIterator()
+                        : NULL);
+      if (iter != NULL) {
+        s = deletions->AddAll(iter);
+        delete iter;
+      }
+    }
+    if (s.ok()) {
+      s = cleanup->version->AddRangeDeletions(deletions);
+    }
+    if (!s.ok()) {
+      delete deletions;
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+    if (deletions->empty()) {
+      delete deletions;
+    } else {
+      deletions->Finish();
+      *range_deletions = deletions;
+    }
+  }
   return internal_iter;
 }
 
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
-  return NewInternalIterator(ReadOptions(), &ignored);
+  return NewInternalIterator(ReadOptions(), &ignored, NULL);
 }
 
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
@@ -1029,8 +2368,35 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
+  return Get(options, NULL, key, value);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   ColumnFamilyHandle* column_family,
+                   const Slice& key,
+                   std::string* value) {
+  StopWatch sw(env_, options_.statistics, kDbGetMicros);
+  uint32_t id;
+  Status s = ColumnFamilyId(column_family, &id);
+  if (!s.ok()) {
+    return s;
+  }
+  std::string scratch;
+  s = GetStorageKey(options, StorageKey(id, key, &scratch), value);
+  if (s.ok() && options_.statistics != NULL) {
+    options_.statistics->RecordTick(kNumberKeysRead);
+    options_.statistics->RecordTick(kBytesRead, value->size());
+  }
+  return s;
+}
+
+Status DBImpl::GetStorageKey(const ReadOptions& options,
+                             const Slice& key,
+                             std::string* value) {
   Status s;
+  PerfTimer lock_timer(&PerfContext::db_mutex_lock_nanos);
   MutexLock l(&mutex_);
+  lock_timer.Stop();
   SequenceNumber snapshot;
   if (options.snapshot != NULL) {
     snapshot = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
@@ -1053,13 +2419,36 @@ Status DBImpl::Get(const ReadOptions& options,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
+    std::vector<std::string> merge_operands;
+    SequenceNumber max_covering_deletion = 0;
+    PerfTimer memtable_timer(&PerfContext::get_from_memtable_nanos);
+    PerfCount(&PerfContext::get_from_memtable_count);
+    bool found = mem->Get(lkey, value, &s, &merge_operands,
+                          &max_covering_deletion);
+    if (!found && imm != NULL) {
+      PerfCount(&PerfContext::get_from_memtable_count);
+      found = imm->Get(lkey, value, &s, &merge_operands,
+                       &max_covering_deletion);
+    }
+    memtable_timer.Stop();
+    if (!found) {
+      PerfTimer files_timer(&PerfContext::get_from_output_files_nanos);
+      bool is_blob_index = false;
+      s = current->Get(options, lkey, value, &stats, &merge_operands,
+                       &max_covering_deletion, &is_blob_index);
       have_stat_update = true;
+      if (s.ok() && is_blob_index) {
+        s = blob_cache_->Get(std::string(*value), value);
+      }
+    }
+    if (!merge_operands.empty() && (s.ok() || s.IsNotFound())) {
+      // Apply the operands to the value they were found above, if any
+      Slice base;
+      if (s.ok()) {
+        base = *value;
+      }
+      s = merge_helper_.ApplyAll(key, s.ok() ? &base : NULL, merge_operands,
+                                 value);
     }
     mutex_.Lock();
   }
@@ -1074,13 +2463,30 @@ Status DBImpl::Get(const ReadOptions& options,
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+  return NewIterator(options, NULL);
+}
+
+Iterator* DBImpl::NewIterator(const ReadOptions& options,
+                              ColumnFamilyHandle* column_family) {
+  uint32_t id;
+  Status s = ColumnFamilyId(column_family, &id);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
   SequenceNumber latest_snapshot;
-  Iterator* internal_iter = NewInternalIterator(options, &latest_snapshot);
-  return NewDBIterator(
-      &dbname_, env_, user_comparator(), internal_iter,
+  RangeDeletions* range_deletions = NULL;
+  Iterator* internal_iter = NewInternalIterator(options, &latest_snapshot,
+                                                &range_deletions);
+  Iterator* iter = NewDBIterator(
+      &dbname_, env_, user_comparator(), &merge_helper_, blob_cache_,
+      internal_iter, range_deletions,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot));
+  if (options_.use_column_families) {
+    iter = NewColumnFamilyIterator(id, iter);
+  }
+  return iter;
 }
 
 const Snapshot* DBImpl::GetSnapshot() {
@@ -1102,6 +2508,162 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  return Merge(options, NULL, key, value);
+}
+
+Status DBImpl::Put(const WriteOptions& o, ColumnFamilyHandle* column_family,
+                   const Slice& key, const Slice& val) {
+  return DB::Put(o, column_family, key, val);
+}
+
+Status DBImpl::Delete(const WriteOptions& options,
+                      ColumnFamilyHandle* column_family, const Slice& key) {
+  return DB::Delete(options, column_family, key);
+}
+
+Status DBImpl::Merge(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key, const Slice& value) {
+  if (!merge_helper_.enabled()) {
+    return Status::NotSupported("no merge operator in options");
+  }
+  return DB::Merge(options, column_family, key, value);
+}
+
+Status DBImpl::ColumnFamilyId(ColumnFamilyHandle* column_family,
+                              uint32_t* id) const {
+  *id = (column_family == NULL) ? kDefaultColumnFamilyId
+                                : column_family->GetID();
+  if (*id != kDefaultColumnFamilyId && !options_.use_column_families) {
+    return Status::InvalidArgument("column families are not enabled");
+  }
+  return Status::OK();
+}
+
+Slice DBImpl::StorageKey(uint32_t id, const Slice& key,
+                         std::string* scratch) const {
+  if (!options_.use_column_families) {
+    return key;
+  }
+  scratch->clear();
+  AppendColumnFamilyKey(scratch, id, key);
+  return Slice(*scratch);
+}
+
+Status DBImpl::DisableFileDeletions() {
+  MutexLock l(&mutex_);
+  file_deletions_disabled_++;
+  return Status::OK();
+}
+
+Status DBImpl::EnableFileDeletions() {
+  MutexLock l(&mutex_);
+  if (file_deletions_disabled_ == 0) {
+    return Status::InvalidArgument("file deletions are not disabled");
+  }
+  file_deletions_disabled_--;
+  if (file_deletions_disabled_ == 0) {
+    DeleteObsoleteFiles();
+  }
+  return Status::OK();
+}
+
+Status DBImpl::GetLiveFiles(std::vector<std::string>* files,
+                            uint64_t* manifest_file_size,
+                            bool flush_memtable) {
+  files->clear();
+  *manifest_file_size = 0;
+  if (flush_memtable) {
+    Status s = FlushMemTable();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  MutexLock l(&mutex_);
+  // Wait for background work so that the descriptor holds no edit
+  // beyond the current version.
+  BeginForegroundEdit();
+  versions_->AddCurrentFiles(files);
+  files->push_back(DescriptorFileName(dbname_,
+                                      versions_->ManifestFileNumber()));
+  files->push_back(CurrentFileName(dbname_));
+  *manifest_file_size = versions_->ManifestFileSize();
+  EndForegroundEdit();
+  return Status::OK();
+}
+
+void DBImpl::BeginForegroundEdit() {
+  mutex_.AssertHeld();
+  while (bg_compaction_scheduled_) {
+    bg_cv_.Wait();
+  }
+  // Claim the background slot so that no compaction is scheduled
+  // while the descriptor is being updated.
+  bg_compaction_scheduled_ = true;
+}
+
+void DBImpl::EndForegroundEdit() {
+  mutex_.AssertHeld();
+  assert(bg_compaction_scheduled_);
+  bg_compaction_scheduled_ = false;
+  MaybeScheduleCompaction();
+  bg_cv_.SignalAll();
+}
+
+Status DBImpl::CreateColumnFamily(const std::string& name,
+                                  ColumnFamilyHandle** handle) {
+  *handle = NULL;
+  if (!options_.use_column_families) {
+    return Status::InvalidArgument("column families are not enabled");
+  }
+
+  MutexLock l(&mutex_);
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    if (column_families_[i]->GetName() == name) {
+      return Status::InvalidArgument(name, "column family already exists");
+    }
+  }
+
+  BeginForegroundEdit();
+  Status s = bg_error_;
+  if (s.ok()) {
+    const uint32_t id = versions_->NewColumnFamilyId();
+    VersionEdit edit;
+    edit.AddColumnFamily(id, name);
+    s = versions_->LogAndApply(&edit, &mutex_);
+    if (s.ok()) {
+      ColumnFamilyHandleImpl* cf = new ColumnFamilyHandleImpl(name, id);
+      column_families_.push_back(cf);
+      column_family_ids_.insert(id);
+      *handle = cf;
+      Log(options_.info_log, "Created column family %s (id %u)",
+          name.c_str(), static_cast<unsigned int>(id));
+    }
+  }
+  EndForegroundEdit();
+  return s;
+}
+
+Status DBImpl::GetColumnFamily(const std::string& name,
+                               ColumnFamilyHandle** handle) {
+  MutexLock l(&mutex_);
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    if (column_families_[i]->GetName() == name) {
+      *handle = column_families_[i];
+      return Status::OK();
+    }
+  }
+  *handle = NULL;
+  return Status::NotFound(name, "no such column family");
+}
+
+ColumnFamilyHandle* DBImpl::DefaultColumnFamily() {
+  return default_column_family_;
+}
+
 // There is at most one thread that is the current logger.  This call
 // waits until preceding logger(s) have finished and becomes the
 // current logger.
@@ -1119,11 +2681,19 @@ void DBImpl::ReleaseLoggingResponsibility(LoggerId* self) {
 }
 
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  StopWatch sw(env_, options_.statistics, kDbWriteMicros);
   Status status;
   MutexLock l(&mutex_);
+  // Reject the whole batch before any of it is logged or applied
+  status = WriteBatchInternal::CheckColumnFamilies(
+      updates, options_.use_column_families ? &column_family_ids_ : NULL);
+  if (!status.ok()) {
+    return status;
+  }
   LoggerId self;
   AcquireLoggingResponsibility(&self);
-  status = MakeRoomForWrite(false);  // May temporarily release lock and wait
+  // May temporarily release lock and wait
+  status = MakeRoomForWrite(false, WriteBatchInternal::ByteSize(updates));
   uint64_t last_sequence = versions_->LastSequence();
   if (status.ok()) {
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
@@ -1135,18 +2705,34 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     {
       assert(logger_ == &self);
       mutex_.Unlock();
-      status = log_->AddRecord(WriteBatchInternal::Contents(updates));
-      if (status.ok() && options.sync) {
-        status = logfile_->Sync();
+      Statistics* const stats = options_.statistics;
+      if (!options.disable_wal) {
+        status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+        RecordTick(stats, kWalBytes, WriteBatchInternal::ByteSize(updates));
+        if (status.ok() && options.sync) {
+          StopWatch sync_sw(env_, stats, kWalSyncMicros);
+          status = logfile_->Sync();
+          RecordTick(stats, kWalSynced);
+        }
       }
       if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(updates, mem_);
+        status = WriteBatchInternal::InsertInto(updates, mem_,
+                                                options_.use_column_families);
+      }
+      if (status.ok() && stats != NULL) {
+        stats->RecordTick(kNumberKeysWritten,
+                          WriteBatchInternal::Count(updates));
+        stats->RecordTick(kBytesWritten, WriteBatchInternal::ByteSize(updates));
       }
       mutex_.Lock();
       assert(logger_ == &self);
     }
+    if (options.disable_wal) {
+      unlogged_writes_ = true;
+    }
 
     versions_->SetLastSequence(last_sequence);
+    UpdateWriteBufferUsage();
   }
   ReleaseLoggingResponsibility(&self);
   return status;
@@ -1154,29 +2740,75 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is the current logger
-Status DBImpl::MakeRoomForWrite(bool force) {
+Status DBImpl::MakeRoomForWrite(bool force, size_t write_bytes) {
   mutex_.AssertHeld();
   assert(logger_ != NULL);
+  FlushReason flush_reason =
+      force ? kFlushReasonManual : kFlushReasonWriteBufferFull;
+  if (flush_requested_) {
+    // The write buffer manager picked mem_ for flushing while this
+    // thread was logging.  Nothing to do if a flush is under way.
+    flush_requested_ = false;
+    if (imm_ == NULL) {
+      force = true;
+      flush_reason = kFlushReasonWriteBufferManager;
+    }
+  }
   bool allow_delay = !force;
+  bool allow_shared_flush = !force && options_.write_buffer_manager != NULL;
+  bool stalled[kNumStallCauses] = { false, false, false };
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (
-        allow_delay &&
-        versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
+    } else if (allow_delay && UpdateWriteController()) {
       // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+      // L0 files, or compactions are otherwise falling behind.  Rather
+      // than stopping writes for several seconds once we hit the hard
+      // limit, admit writes at the rate of the write controller, which
+      // follows the compaction throughput.  The delay also hands over
+      // some CPU to the compaction thread in case it is sharing the
+      // same core as the writer.
       allow_delay = false;  // Do not delay a single write more than once
+      const uint64_t delay =
+          write_controller_.GetDelay(env_->NowMicros(), write_bytes);
+      // Sleep at most a second at a time, and stop early once compactions
+      // have caught up, so that a large write at a low rate cannot stall
+      // for long after the backlog is gone.
+      uint64_t slept = 0;
+      while (slept < delay) {
+        const uint64_t step = std::min<uint64_t>(delay - slept, 1000000);
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(step));
+        mutex_.Lock();
+        slept += step;
+        if (!bg_error_.ok() || shutting_down_.Acquire_Load() ||
+            !UpdateWriteController()) {
+          break;
+        }
+      }
+      if (slept > 0) {
+        stall_count_[kStallDelayed]++;
+        stall_micros_[kStallDelayed] += slept;
+        RecordTick(options_.statistics, kStallMicros, slept);
+      }
+    } else if (allow_shared_flush &&
+               options_.write_buffer_manager->ShouldFlush()) {
+      // The memtables of all DBs sharing the write buffer manager use
+      // more memory than allowed.  Flush the largest one, which may
+      // belong to another DB; the lock is released since that DB may
+      // be writing to this one's manager concurrently.
+      allow_shared_flush = false;  // Do not flush more than once per write
+      mutex_.Unlock();
+      const bool flush_self =
+          options_.write_buffer_manager->FlushLargest(&write_buffer_consumer_);
       mutex_.Lock();
+      if (flush_self && imm_ == NULL) {
+        force = true;
+        flush_reason = kFlushReasonWriteBufferManager;
+      }
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1184,17 +2816,42 @@ Status DBImpl::MakeRoomForWrite(bool force) {
     } else if (imm_ != NULL) {
       // We have filled up the current memtable, but the previous
       // one is still being compacted, so we wait.
+      if (NotifyStallConditionChanged()) {
+        continue;  // The lock was released; check again before waiting
+      }
+      const uint64_t start_micros = env_->NowMicros();
       bg_cv_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+      if (!stalled[kStallMemtable]) {
+        stalled[kStallMemtable] = true;
+        stall_count_[kStallMemtable]++;
+      }
+      const uint64_t stall = env_->NowMicros() - start_micros;
+      stall_micros_[kStallMemtable] += stall;
+      RecordTick(options_.statistics, kStallMicros, stall);
+    } else if (!options_.disable_auto_compactions &&
+               versions_->NumLevelFiles(0) >=
+                   options_.level0_stop_writes_trigger) {
       // There are too many level-0 files.
+      if (NotifyStallConditionChanged()) {
+        continue;  // The lock was released; check again before waiting
+      }
       Log(options_.info_log, "waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
       bg_cv_.Wait();
+      if (!stalled[kStallLevel0]) {
+        stalled[kStallLevel0] = true;
+        stall_count_[kStallLevel0]++;
+      }
+      const uint64_t stall = env_->NowMicros() - start_micros;
+      stall_micros_[kStallLevel0] += stall;
+      RecordTick(options_.statistics, kStallMicros, stall);
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = NULL;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      log::Writer* new_log = NULL;
+      s = NewLogFile(new_log_number, &lfile, &new_log);
       if (!s.ok()) {
         break;
       }
@@ -1202,18 +2859,208 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       delete logfile_;
       logfile_ = lfile;
       logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
+      log_ = new_log;
       imm_ = mem_;
+      imm_flush_reason_ = flush_reason;
       has_imm_.Release_Store(imm_);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
       force = false;   // Do not force another compaction if have room
+      flush_reason = kFlushReasonWriteBufferFull;
+      flush_requested_ = false;
+      UpdateWriteBufferUsage();
       MaybeScheduleCompaction();
     }
   }
+  NotifyStallConditionChanged();
+  return s;
+}
+
+Status DBImpl::NewLogFile(uint64_t number, WritableFile** file,
+                          log::Writer** log) {
+  mutex_.AssertHeld();
+  const std::string fname = LogFileName(options_.wal_dir, number);
+  Status s;
+  if (!log_recycle_files_.empty()) {
+    const uint64_t old_number = log_recycle_files_.front();
+    log_recycle_files_.pop_front();
+    Log(options_.info_log, "Recycling log #%llu as #%llu\n",
+        static_cast<unsigned long long>(old_number),
+        static_cast<unsigned long long>(number));
+    s = env_->ReuseWritableFile(fname,
+                                LogFileName(options_.wal_dir, old_number),
+                                file);
+  } else {
+    s = env_->NewWritableFile(fname, file);
+    if (s.ok()) {
+      // A log holds about a write buffer's worth of updates
+      (*file)->Preallocate(options_.write_buffer_size +
+                           options_.write_buffer_size / 10);
+    }
+  }
+  if (s.ok()) {
+    *log = new log::Writer(*file, number, options_.recycle_log_file_num > 0);
+    if (min_log_number_to_recycle_ == 0) {
+      min_log_number_to_recycle_ = number;
+    }
+  }
   return s;
 }
 
+bool DBImpl::UpdateWriteController() {
+  mutex_.AssertHeld();
+  Version* current = versions_->current();
+  const int level0_files = versions_->NumLevelFiles(0);
+  const uint64_t pending_bytes = versions_->PendingCompactionBytes();
+  const uint64_t pending_limit = options_.soft_pending_compaction_bytes_limit;
+  const bool delay = !options_.disable_auto_compactions &&
+      (level0_files >= options_.level0_slowdown_writes_trigger ||
+       (pending_limit > 0 && pending_bytes >= pending_limit));
+
+  if (!delay) {
+    write_controller_.SetDelayed(false, 0);
+  } else if (!write_controller_.delayed()) {
+    write_controller_.SetDelayed(true, bg_write_rate_);
+    Log(options_.info_log,
+        "Delaying writes: %d level-0 files, %llu pending compaction bytes, "
+        "rate %llu bytes/s\n",
+        level0_files,
+        static_cast<unsigned long long>(pending_bytes),
+        static_cast<unsigned long long>(
+            write_controller_.delayed_write_rate()));
+  } else if (current != stall_version_) {
+    // Adapt the rate once per new version: slow down while the backlog
+    // keeps growing and speed up again once it shrinks.
+    if (level0_files > stall_level0_files_ ||
+        pending_bytes > stall_pending_bytes_) {
+      write_controller_.SlowDown();
+    } else if (level0_files < stall_level0_files_ ||
+               pending_bytes < stall_pending_bytes_) {
+      write_controller_.SpeedUp();
+    }
+  }
+  stall_version_ = current;
+  stall_level0_files_ = level0_files;
+  stall_pending_bytes_ = pending_bytes;
+  return delay;
+}
+
+void DBImpl::RecordBackgroundWrite(uint64_t bytes, uint64_t micros) {
+  mutex_.AssertHeld();
+  if (bytes > 0 && micros > 0) {
+    const uint64_t rate = bytes * 1000000 / micros;
+    bg_write_rate_ = (3 * bg_write_rate_ + rate) / 4;
+  }
+}
+
+void DBImpl::NotifyTableFileCreated(TableFileCreationReason reason,
+                                    uint64_t number, uint64_t file_size,
+                                    uint32_t path_id, const Status& s) {
+  if (options_.listeners.empty()) {
+    return;
+  }
+  TableFileCreationInfo info;
+  info.db_name = dbname_;
+  info.reason = reason;
+  info.file_number = number;
+  info.file_path = TableFileName(options_.db_paths, number, path_id);
+  info.file_size = file_size;
+  info.status = s;
+  for (size_t i = 0; i < options_.listeners.size(); i++) {
+    options_.listeners[i]->OnTableFileCreated(info);
+  }
+}
+
+void DBImpl::NotifyBackgroundError(BackgroundErrorReason reason, Status* s) {
+  mutex_.AssertHeld();
+  if (options_.listeners.empty()) {
+    return;
+  }
+  mutex_.Unlock();
+  for (size_t i = 0; i < options_.listeners.size(); i++) {
+    options_.listeners[i]->OnBackgroundError(reason, s);
+  }
+  mutex_.Lock();
+}
+
+void DBImpl::NotifyCompaction(const CompactionJobInfo& info, bool completed) {
+  mutex_.AssertHeld();
+  mutex_.Unlock();
+  for (size_t i = 0; i < options_.listeners.size(); i++) {
+    if (completed) {
+      options_.listeners[i]->OnCompactionCompleted(info);
+    } else {
+      options_.listeners[i]->OnCompactionBegin(info);
+    }
+  }
+  mutex_.Lock();
+}
+
+WriteStallCondition DBImpl::CurrentStallCondition() {
+  mutex_.AssertHeld();
+  if ((!options_.disable_auto_compactions &&
+       versions_->NumLevelFiles(0) >= options_.level0_stop_writes_trigger) ||
+      (imm_ != NULL &&
+       mem_->ApproximateMemoryUsage() > options_.write_buffer_size)) {
+    return kWriteStallStopped;
+  } else if (write_controller_.delayed()) {
+    return kWriteStallDelayed;
+  }
+  return kWriteStallNormal;
+}
+
+bool DBImpl::NotifyStallConditionChanged() {
+  mutex_.AssertHeld();
+  const WriteStallCondition condition = CurrentStallCondition();
+  if (condition == stall_condition_) {
+    return false;
+  }
+  WriteStallInfo info;
+  info.db_name = dbname_;
+  info.condition = condition;
+  info.previous_condition = stall_condition_;
+  stall_condition_ = condition;
+  if (options_.listeners.empty()) {
+    return false;
+  }
+  mutex_.Unlock();
+  for (size_t i = 0; i < options_.listeners.size(); i++) {
+    options_.listeners[i]->OnStallConditionsChanged(info);
+  }
+  mutex_.Lock();
+  return true;
+}
+
+void DBImpl::UpdateWriteBufferUsage() {
+  mutex_.AssertHeld();
+  if (options_.write_buffer_manager != NULL) {
+    const size_t active = mem_->ApproximateMemoryUsage();
+    const size_t total =
+        active + (imm_ != NULL ? imm_->ApproximateMemoryUsage() : 0);
+    options_.write_buffer_manager->SetUsage(&write_buffer_consumer_,
+                                            active, total);
+  }
+}
+
+void DBImpl::FlushForWriteBufferManager() {
+  MutexLock l(&mutex_);
+  if (log_ == NULL || shutting_down_.Acquire_Load() || imm_ != NULL) {
+    // Not yet open, shutting down, or a flush is already under way
+    return;
+  }
+  if (logger_ != NULL) {
+    // Leave the switch to the current logger.  Waiting for it here could
+    // deadlock with a logger of this DB that is flushing another DB.
+    flush_requested_ = true;
+    return;
+  }
+  LoggerId self;
+  AcquireLoggingResponsibility(&self);
+  flush_requested_ = true;  // Forces the switch, as a flush for the manager
+  MakeRoomForWrite(false, 0);
+  ReleaseLoggingResponsibility(&self);
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   value->clear();
 
@@ -1227,7 +3074,7 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     in.remove_prefix(strlen("num-files-at-level"));
     uint64_t level;
     bool ok = ConsumeDecimalNumber(&in, &level) && in.empty();
-    if (!ok || level >= config::kNumLevels) {
+    if (!ok || level >= options_.num_levels) {
       return false;
     } else {
       char buf[100];
@@ -1244,7 +3091,7 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
              "--------------------------------------------------\n"
              );
     value->append(buf);
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < options_.num_levels; level++) {
       int files = versions_->NumLevelFiles(level);
       if (stats_[level].micros > 0 || files > 0) {
         snprintf(
@@ -1263,6 +3110,38 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "write-stalls") {
+    static const char* kCauses[kNumStallCauses] = {
+      "delayed", "memtable", "level0-stop"
+    };
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "Stall cause     Count  Time(sec)\n"
+             "--------------------------------\n");
+    value->append(buf);
+    for (int i = 0; i < kNumStallCauses; i++) {
+      snprintf(buf, sizeof(buf), "%-11s %9llu %10.3f\n",
+               kCauses[i],
+               static_cast<unsigned long long>(stall_count_[i]),
+               stall_micros_[i] / 1e6);
+      value->append(buf);
+    }
+    snprintf(buf, sizeof(buf),
+             "delayed-write-rate: %llu bytes/s (%s)\n"
+             "pending-compaction-bytes: %llu\n",
+             static_cast<unsigned long long>(
+                 write_controller_.delayed_write_rate()),
+             write_controller_.delayed() ? "active" : "inactive",
+             static_cast<unsigned long long>(
+                 versions_->PendingCompactionBytes()));
+    value->append(buf);
+    return true;
+  } else if (in == "statistics") {
+    if (options_.statistics == NULL) {
+      return false;
+    }
+    *value = options_.statistics->ToString();
+    return true;
   }
 
   return false;
@@ -1279,10 +3158,15 @@ void DBImpl::GetApproximateSizes(
     v = versions_->current();
   }
 
+  std::string start_scratch, limit_scratch;
   for (int i = 0; i < n; i++) {
     // Convert user_key into a corresponding internal key.
-    InternalKey k1(range[i].start, kMaxSequenceNumber, kValueTypeForSeek);
-    InternalKey k2(range[i].limit, kMaxSequenceNumber, kValueTypeForSeek);
+    InternalKey k1(StorageKey(kDefaultColumnFamilyId, range[i].start,
+                              &start_scratch),
+                   kMaxSequenceNumber, kValueTypeForSeek);
+    InternalKey k2(StorageKey(kDefaultColumnFamilyId, range[i].limit,
+                              &limit_scratch),
+                   kMaxSequenceNumber, kValueTypeForSeek);
     uint64_t start = versions_->ApproximateOffsetOf(v, k1);
     uint64_t limit = versions_->ApproximateOffsetOf(v, k2);
     sizes[i] = (limit >= start ? limit - start : 0);
@@ -1308,6 +3192,104 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Put(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+               const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Put(column_family, key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Delete(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+                  const Slice& key) {
+  WriteBatch batch;
+  batch.Delete(column_family, key);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, ColumnFamilyHandle* column_family,
+                 const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(column_family, key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRange(const WriteOptions& opt,
+                       ColumnFamilyHandle* column_family,
+                       const Slice& begin, const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(column_family, begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::IngestExternalFile(const std::vector<std::string>& files,
+                              const IngestExternalFileOptions& options) {
+  return Status::NotSupported("IngestExternalFile");
+}
+
+Status DB::DisableFileDeletions() {
+  return Status::NotSupported("DisableFileDeletions");
+}
+
+Status DB::EnableFileDeletions() {
+  return Status::NotSupported("EnableFileDeletions");
+}
+
+Status DB::GetLiveFiles(std::vector<std::string>* files,
+                        uint64_t* manifest_file_size,
+                        bool flush_memtable) {
+  return Status::NotSupported("GetLiveFiles");
+}
+
+Env* DB::GetEnv() const {
+  return Env::Default();
+}
+
+Status DB::Get(const ReadOptions& options, ColumnFamilyHandle* column_family,
+               const Slice& key, std::string* value) {
+  if (column_family != NULL && column_family->GetID() != 0) {
+    return Status::NotSupported("column families");
+  }
+  return Get(options, key, value);
+}
+
+Iterator* DB::NewIterator(const ReadOptions& options,
+                          ColumnFamilyHandle* column_family) {
+  if (column_family != NULL && column_family->GetID() != 0) {
+    return NewErrorIterator(Status::NotSupported("column families"));
+  }
+  return NewIterator(options);
+}
+
+Status DB::CreateColumnFamily(const std::string& name,
+                              ColumnFamilyHandle** handle) {
+  *handle = NULL;
+  return Status::NotSupported("column families");
+}
+
+Status DB::GetColumnFamily(const std::string& name,
+                           ColumnFamilyHandle** handle) {
+  *handle = NULL;
+  return Status::NotSupported("column families");
+}
+
+ColumnFamilyHandle* DB::DefaultColumnFamily() {
+  return NULL;
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
@@ -1321,17 +3303,29 @@ Status DB::Open(const Options& options, const std::string& dbname,
   if (s.ok()) {
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    log::Writer* log;
+    s = impl->NewLogFile(new_log_number, &lfile, &log);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
+      impl->log_ = log;
       s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
     }
     if (s.ok()) {
+      const VersionSet::ColumnFamilyMap& families =
+          impl->versions_->ColumnFamilies();
+      for (VersionSet::ColumnFamilyMap::const_iterator iter = families.begin();
+           iter != families.end();
+           ++iter) {
+        impl->column_families_.push_back(
+            new ColumnFamilyHandleImpl(iter->first, iter->second));
+        impl->column_family_ids_.insert(iter->second);
+      }
       impl->DeleteObsoleteFiles();
+      if (impl->options_.preload_table_files) {
+        impl->PreloadTables();
+      }
       impl->MaybeScheduleCompaction();
     }
   }
@@ -1371,6 +3365,24 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
         }
       }
     }
+
+    // Then the logs and tables kept in other directories
+    std::vector<std::string> dirs;
+    GetDBDirs(dbname, options, &dirs);
+    for (size_t d = 1; d < dirs.size(); d++) {
+      std::vector<std::string> children;
+      env->GetChildren(dirs[d], &children);  // Ignoring errors on purpose
+      for (size_t i = 0; i < children.size(); i++) {
+        if (ParseFileName(children[i], &number, &type) &&
+            (type == kLogFile || type == kTableFile || type == kTempFile)) {
+          Status del = env->DeleteFile(dirs[d] + "/" + children[i]);
+          if (result.ok() && !del.ok()) {
+            result = del;
+          }
+        }
+      }
+      env->DeleteDir(dirs[d]);  // Ignore error in case dir has other files
+    }
     env->UnlockFile(lock);  // Ignore error since state is already gone
     env->DeleteFile(lockname);
     env->DeleteDir(dbname);  // Ignore error in case dir contains other files
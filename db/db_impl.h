@@ -5,17 +5,28 @@
 #ifndef STORAGE_LEVELDB_DB_DB_IMPL_H_
 #define STORAGE_LEVELDB_DB_DB_IMPL_H_
 
+#include <deque>
 #include <set>
+#include <vector>
+#include "db/column_family.h"
 #include "db/dbformat.h"
 #include "db/log_writer.h"
+#include "db/merge_helper.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/listener.h"
+#include "leveldb/write_buffer_manager.h"
 #include "port/port.h"
 
 namespace leveldb {
 
+class BlobFileCache;
 class MemTable;
+class RangeDeletions;
+struct RangeDeletion;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -29,6 +40,8 @@ class DBImpl : public DB {
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
@@ -39,6 +52,31 @@ class DBImpl : public DB {
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status IngestExternalFile(const std::vector<std::string>& files,
+                                    const IngestExternalFileOptions& options);
+  virtual Status DisableFileDeletions();
+  virtual Status EnableFileDeletions();
+  virtual Status GetLiveFiles(std::vector<std::string>* files,
+                              uint64_t* manifest_file_size,
+                              bool flush_memtable);
+  virtual Env* GetEnv() const { return env_; }
+  virtual Status CreateColumnFamily(const std::string& name,
+                                    ColumnFamilyHandle** handle);
+  virtual Status GetColumnFamily(const std::string& name,
+                                 ColumnFamilyHandle** handle);
+  virtual ColumnFamilyHandle* DefaultColumnFamily();
+  virtual Status Put(const WriteOptions&, ColumnFamilyHandle* column_family,
+                     const Slice& key, const Slice& value);
+  virtual Status Delete(const WriteOptions&, ColumnFamilyHandle* column_family,
+                        const Slice& key);
+  virtual Status Merge(const WriteOptions&, ColumnFamilyHandle* column_family,
+                       const Slice& key, const Slice& value);
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key,
+                     std::string* value);
+  virtual Iterator* NewIterator(const ReadOptions&,
+                                ColumnFamilyHandle* column_family);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -48,6 +86,9 @@ class DBImpl : public DB {
   // Force current memtable contents to be compacted.
   Status TEST_CompactMemTable();
 
+  // Wait until the background compactions that are needed are done.
+  Status TEST_WaitForCompact();
+
   // Return an internal iterator over the current state of the database.
   // The keys of this iterator are internal keys (see format.h).
   // The returned iterator should be deleted when no longer needed.
@@ -57,14 +98,41 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Return the number of the current descriptor file.
+  uint64_t TEST_ManifestFileNumber();
+
  private:
   friend class DB;
 
+  // If range_deletions is non-NULL, *range_deletions is set to the range
+  // deletions of the returned state, or NULL if there are none.
   Iterator* NewInternalIterator(const ReadOptions&,
-                                SequenceNumber* latest_snapshot);
+                                SequenceNumber* latest_snapshot,
+                                RangeDeletions** range_deletions);
 
   Status NewDB();
 
+  // Look up the value of a key as stored in the DB, i.e. including the
+  // column family prefix when column families are enabled.
+  Status GetStorageKey(const ReadOptions& options,
+                       const Slice& storage_key,
+                       std::string* value);
+
+  // Store in *id the id of "column_family" (NULL denotes the default
+  // family).  Fails if the family cannot be used with this DB.
+  Status ColumnFamilyId(ColumnFamilyHandle* column_family, uint32_t* id) const;
+
+  // Return the key under which "key" of column family "id" is stored.
+  // May use *scratch as backing store.
+  Slice StorageKey(uint32_t id, const Slice& key, std::string* scratch) const;
+
+  // Serialize a descriptor update made outside of the background
+  // thread with background work, so that no two threads call
+  // VersionSet::LogAndApply() concurrently.
+  // REQUIRES: mutex_ is held
+  void BeginForegroundEdit();
+  void EndForegroundEdit();
+
   // Recover the descriptor from persistent storage.  May do a significant
   // amount of work to recover recently logged updates.  Any changes to
   // be made to the descriptor are added to *edit.
@@ -72,25 +140,109 @@ class DBImpl : public DB {
 
   void MaybeIgnoreError(Status* s) const;
 
-  // Delete any unneeded files and stale in-memory entries.
+  // Open the table files of the current version on
+  // options_.max_file_opening_threads threads, up to the capacity of the
+  // table cache (see Options::preload_table_files).
+  // REQUIRES: mutex_ is held
+  void PreloadTables();
+
+  // Delete any unneeded files and stale in-memory entries.  Does
+  // nothing while file deletions are disabled.
   void DeleteObsoleteFiles();
 
   // Compact the in-memory write buffer to disk.  Switches to a new
   // log-file/memtable and writes a new descriptor iff successful.
   Status CompactMemTable();
 
+  // Switch to a new memtable and wait until the old one has been
+  // compacted to disk.
+  Status FlushMemTable();
+
   Status RecoverLogFile(uint64_t log_number,
                         VersionEdit* edit,
                         SequenceNumber* max_sequence);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base);
+  // While a log is recovered, full memtables are written to tables by a
+  // helper thread (RecoveryFlush) as the next memtable is filled.
+  // WaitForRecoveryFlush waits for the table being written, if any, and
+  // returns the status of the last one.
+  // REQUIRES: mutex_ is held
+  static void RecoveryFlushWork(void* db);
+  void RecoveryFlush();
+  Status WaitForRecoveryFlush();
+
+  // Write "mem" to a new table and add it to *edit.  If "flush_info" is
+  // non-NULL, this is a flush of imm_ that is reported to the listeners
+  // and *flush_info receives the details; otherwise it is recovery.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          FlushJobInfo* flush_info);
 
   // Only thread is allowed to log at a time.
   struct LoggerId { };          // Opaque identifier for logging thread
   void AcquireLoggingResponsibility(LoggerId* self);
   void ReleaseLoggingResponsibility(LoggerId* self);
 
-  Status MakeRoomForWrite(bool force /* compact even if there is room? */);
+  Status MakeRoomForWrite(bool force /* compact even if there is room? */,
+                          size_t write_bytes);
+
+  // Open the file of log "number", writing over the oldest log kept for
+  // recycling if there is one (see Options::recycle_log_file_num), and
+  // the matching log writer.
+  // REQUIRES: mutex_ is held
+  Status NewLogFile(uint64_t number, WritableFile** file, log::Writer** log);
+
+  // Bring write_controller_ up to date with the current compaction
+  // backlog.  Returns true iff writes should be delayed.
+  // REQUIRES: mutex_ is held
+  bool UpdateWriteController();
+
+  // Fold the throughput of a memtable or table compaction into
+  // bg_write_rate_.
+  // REQUIRES: mutex_ is held
+  void RecordBackgroundWrite(uint64_t bytes, uint64_t micros);
+
+  // Report the memory used by mem_ and imm_ to the write buffer manager.
+  // REQUIRES: mutex_ is held
+  void UpdateWriteBufferUsage();
+
+  // Helpers for calling options_.listeners.  Those that require mutex_
+  // release it while the listeners run.
+  void NotifyTableFileCreated(TableFileCreationReason reason,
+                              uint64_t number, uint64_t file_size,
+                              uint32_t path_id, const Status& s);
+  // REQUIRES: mutex_ is held
+  void NotifyBackgroundError(BackgroundErrorReason reason, Status* s);
+  // REQUIRES: mutex_ is held
+  void NotifyCompaction(const CompactionJobInfo& info, bool completed);
+
+  // Pass the value of "user_key" to options_.compaction_filter, without
+  // the column family prefix of the key.
+  // REQUIRES: options_.compaction_filter != NULL
+  CompactionFilter::Decision FilterCompactionValue(int level,
+                                                   const Slice& user_key,
+                                                   const Slice& value,
+                                                   std::string* new_value);
+
+  // Return the condition that writes are in at present.
+  // REQUIRES: mutex_ is held
+  WriteStallCondition CurrentStallCondition();
+
+  // Tell the listeners if CurrentStallCondition() differs from the last
+  // condition reported.  Returns true iff mutex_ was released.
+  // REQUIRES: mutex_ is held
+  bool NotifyStallConditionChanged();
+
+  // Switch to a new memtable on behalf of the write buffer manager.
+  // REQUIRES: mutex_ is not held
+  void FlushForWriteBufferManager();
+
+  class WriteBufferConsumer : public WriteBufferManager::Consumer {
+   public:
+    explicit WriteBufferConsumer(DBImpl* db) : db_(db) { }
+    virtual void FlushMemTable() { db_->FlushForWriteBufferManager(); }
+   private:
+    DBImpl* db_;
+  };
 
   struct CompactionState;
 
@@ -102,19 +254,51 @@ class DBImpl : public DB {
   Status DoCompactionWork(CompactionState* compact);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // "next_user_key" is the first key of the next output, or NULL for the
+  // last output.
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* next_user_key);
   Status InstallCompactionResults(CompactionState* compact);
 
+  // Gather the range deletions of the compaction inputs, and drop the
+  // inputs they hide entirely.
+  // REQUIRES: lock is not held
+  Status SetupCompactionRangeDeletions(CompactionState* compact);
+
+  // Store in *result the range deletions that the current output, which
+  // ends before *next_user_key, has to keep.
+  void OutputRangeDeletions(CompactionState* compact,
+                            const Slice* next_user_key,
+                            std::vector<RangeDeletion>* result);
+
+  // Combine the merge operand at "input" with the older entries of its
+  // key in the compaction.  Stores the entry that replaces them in *key
+  // and *value and leaves "input" after the combined operands.
+  // REQUIRES: input is at a merge operand that no snapshot can tell
+  // apart from the older entries of its key.
+  Status MergeCompactionOperands(CompactionState* compact, Iterator* input,
+                                 std::string* key, std::string* value);
+
+  // Prepare the entry *key => *value for the current output of the
+  // compaction.  A large value is moved to compact->blobs, as is the
+  // value of a blob file in need of garbage collection, and the entry is
+  // replaced by one that refers to the new copy.
+  Status PrepareBlobValue(CompactionState* compact, Slice* key,
+                          Slice* value);
+
   // Constant after construction
   Env* const env_;
+  const ColumnFamilyComparator column_family_comparator_;
   const InternalKeyComparator internal_comparator_;
   const Options options_;  // options_.comparator == &internal_comparator_
   bool owns_info_log_;
   bool owns_cache_;
   const std::string dbname_;
+  const MergeHelper merge_helper_;
 
-  // table_cache_ provides its own synchronization
+  // table_cache_ and blob_cache_ provide their own synchronization
   TableCache* table_cache_;
+  BlobFileCache* blob_cache_;
 
   // Lock over the persistent DB state.  Non-NULL iff successfully acquired.
   FileLock* db_lock_;
@@ -129,10 +313,24 @@ class DBImpl : public DB {
   WritableFile* logfile_;
   uint64_t logfile_number_;
   log::Writer* log_;
+  std::deque<uint64_t> log_recycle_files_;  // Obsolete logs to write over
+  // Number of the first log this DB wrote, or zero.  Only logs from this
+  // one on have records that carry the log number, and may be recycled.
+  uint64_t min_log_number_to_recycle_;
   LoggerId* logger_;            // NULL, or the id of the current logging thread
+  // True once a write skipped the log (WriteOptions::disable_wal), so
+  // that the memtables are flushed before the DB is closed.
+  bool unlogged_writes_;
   port::CondVar logger_cv_;     // For threads waiting to log
   SnapshotList snapshots_;
 
+  // Registered with options_.write_buffer_manager, if any
+  WriteBufferConsumer write_buffer_consumer_;
+
+  // Has the write buffer manager asked for mem_ to be flushed while
+  // another thread was logging?
+  bool flush_requested_;
+
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_;
@@ -140,6 +338,16 @@ class DBImpl : public DB {
   // Has a background compaction been scheduled or is running?
   bool bg_compaction_scheduled_;
 
+  // Number of DisableFileDeletions() calls not yet undone.  Obsolete
+  // files are kept while it is non-zero.
+  int file_deletions_disabled_;
+
+  // Memtable being written to a table by RecoveryFlush(), or NULL, the
+  // edit the table is added to, and the status of the last such write.
+  MemTable* recovery_mem_;
+  VersionEdit* recovery_edit_;
+  Status recovery_flush_status_;
+
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
@@ -155,6 +363,45 @@ class DBImpl : public DB {
   // Have we encountered a background error in paranoid mode?
   Status bg_error_;
 
+  // Handles of all known column families.  The first entry is the
+  // default family.
+  std::vector<ColumnFamilyHandleImpl*> column_families_;
+
+  // The default family, which is also in column_families_.  Set by the
+  // constructor and never changed, so it is read without mutex_.
+  ColumnFamilyHandleImpl* default_column_family_;
+
+  // Ids of column_families_, which writes are checked against
+  std::set<uint32_t> column_family_ids_;
+
+  // Rate limits writes while compactions are falling behind
+  WriteController write_controller_;
+
+  // Measured compaction output rate in bytes per second
+  uint64_t bg_write_rate_;
+
+  // State of the compaction backlog at the last UpdateWriteController()
+  Version* stall_version_;
+  int stall_level0_files_;
+  uint64_t stall_pending_bytes_;
+
+  // Number of writes that stalled for each reason and the total time
+  // they spent stalled.  Reported by the "leveldb.write-stalls" property.
+  enum StallCause {
+    kStallDelayed,        // Rate limited by write_controller_
+    kStallMemtable,       // Waiting for imm_ to be compacted
+    kStallLevel0,         // Waiting for level-0 files to be compacted
+    kNumStallCauses
+  };
+  uint64_t stall_count_[kNumStallCauses];
+  uint64_t stall_micros_[kNumStallCauses];
+
+  // The stall condition last reported to the listeners
+  WriteStallCondition stall_condition_;
+
+  // Why imm_ is being flushed
+  FlushReason imm_flush_reason_;
+
   // Per level compaction stats.  stats_[level] stores the stats for
   // compactions that produced data for the specified "level".
   struct CompactionStats {
@@ -170,7 +417,7 @@ class DBImpl : public DB {
       this->bytes_written += c.bytes_written;
     }
   };
-  CompactionStats stats_[config::kNumLevels];
+  CompactionStats stats_[config::kMaxNumLevels];
 
   // No copying allowed
   DBImpl(const DBImpl&);
@@ -187,6 +434,12 @@ extern Options SanitizeOptions(const std::string& db,
                                const InternalKeyComparator* icmp,
                                const Options& src);
 
+// Append to *dirs the directories that hold the files of the DB "dbname"
+// opened with "options": "dbname" itself first, then Options::wal_dir and
+// Options::db_paths, each once.
+extern void GetDBDirs(const std::string& dbname, const Options& options,
+                      std::vector<std::string>* dirs);
+
 }
 
 #endif  // STORAGE_LEVELDB_DB_DB_IMPL_H_
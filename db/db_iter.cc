@@ -4,8 +4,11 @@
 
 #include "db/db_iter.h"
 
+#include "db/blob_file.h"
 #include "db/filename.h"
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -38,7 +41,12 @@ class DBIter: public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), unless
+  //     that entry is a merge operand: then the iterator is positioned
+  //     after the operands and base value that were combined into
+  //     saved_value_, and merged_ is true.  If the entry refers to a
+  //     blob value, that value is read into saved_value_, and blob_ is
+  //     true
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction {
@@ -47,26 +55,36 @@ class DBIter: public Iterator {
   };
 
   DBIter(const std::string* dbname, Env* env,
-         const Comparator* cmp, Iterator* iter, SequenceNumber s)
+         const Comparator* cmp, const MergeHelper* merger,
+         BlobFileCache* blobs, Iterator* iter,
+         RangeDeletions* range_deletions, SequenceNumber s)
       : dbname_(dbname),
         env_(env),
         user_comparator_(cmp),
+        merger_(merger),
+        blobs_(blobs),
         iter_(iter),
+        range_deletions_(range_deletions),
         sequence_(s),
         direction_(kForward),
-        valid_(false) {
+        valid_(false),
+        merged_(false),
+        blob_(false) {
   }
   virtual ~DBIter() {
     delete iter_;
+    delete range_deletions_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_ && !blob_) ? iter_->value()
+                                                          : saved_value_;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -85,7 +103,20 @@ class DBIter: public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeValuesNewToOld(const ParsedInternalKey& ikey);
   bool ParseKey(ParsedInternalKey* key);
+  bool ReadSavedBlob();
+
+  // Return the type of "ikey", or kTypeDeletion if a range deletion
+  // visible at sequence_ covers it.
+  inline ValueType TypeOf(const ParsedInternalKey& ikey) const {
+    if (range_deletions_ != NULL &&
+        range_deletions_->MaxCoveringSequence(ikey.user_key, sequence_) >
+        ikey.sequence) {
+      return kTypeDeletion;
+    }
+    return ikey.type;
+  }
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
@@ -103,14 +134,21 @@ class DBIter: public Iterator {
   const std::string* const dbname_;
   Env* const env_;
   const Comparator* const user_comparator_;
+  const MergeHelper* const merger_;
+  BlobFileCache* const blobs_;
   Iterator* const iter_;
+  RangeDeletions* const range_deletions_;  // NULL if there are none
   SequenceNumber const sequence_;
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
-  std::string saved_value_;   // == current raw value when direction_==kReverse
+                              //    or merged_
+  std::string saved_value_;   // == current value when direction_==kReverse
+                              //    or merged_
   Direction direction_;
   bool valid_;
+  bool merged_;               // The current entry combines merge operands
+  bool blob_;                 // The current entry refers to a blob value
 
   // No copying allowed
   DBIter(const DBIter&);
@@ -126,6 +164,20 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   }
 }
 
+// Replace the BlobIndex in saved_value_ by the value it refers to.
+bool DBIter::ReadSavedBlob() {
+  std::string index;
+  index.swap(saved_value_);
+  Status s = blobs_->Get(index, &saved_value_);
+  if (!s.ok()) {
+    if (status_.ok()) {
+      status_ = s;
+    }
+    return false;
+  }
+  return true;
+}
+
 void DBIter::Next() {
   assert(valid_);
 
@@ -148,7 +200,19 @@ void DBIter::Next() {
 
   // Temporarily use saved_key_ as storage for key to skip.
   std::string* skip = &saved_key_;
-  SaveKey(ExtractUserKey(iter_->key()), skip);
+  if (merged_) {
+    // saved_key_ already holds the current key and iter_ is past the
+    // entries that were merged into it.
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
+    }
+  } else {
+    SaveKey(ExtractUserKey(iter_->key()), skip);
+  }
   FindNextUserEntry(true, skip);
 }
 
@@ -156,10 +220,11 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  blob_ = false;
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+      switch (TypeOf(ikey)) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
@@ -167,21 +232,86 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeBlobIndex:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
           } else {
             valid_ = true;
+            merged_ = false;
             saved_key_.clear();
+            if (ikey.type == kTypeBlobIndex) {
+              blob_ = true;
+              saved_value_.assign(iter_->value().data(),
+                                  iter_->value().size());
+              valid_ = ReadSavedBlob();
+            }
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            MergeValuesNewToOld(ikey);
+            return;
+          }
+          break;
+        case kTypeRangeDeletion:
+          break;
       }
     }
     iter_->Next();
   } while (iter_->Valid());
   saved_key_.clear();
   valid_ = false;
+  merged_ = false;
+}
+
+void DBIter::MergeValuesNewToOld(const ParsedInternalKey& ikey) {
+  // iter_ is at the newest visible entry of ikey.user_key, an operand.
+  // Collect the operands down to the value or deletion they apply to.
+  SaveKey(ikey.user_key, &saved_key_);
+  std::vector<std::string> operands;
+  operands.push_back(iter_->value().ToString());
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey older;
+    if (!ParseKey(&older)) {
+      break;
+    }
+    if (user_comparator_->Compare(older.user_key, saved_key_) != 0) {
+      break;
+    }
+    const ValueType type = TypeOf(older);
+    if (type == kTypeMerge) {
+      operands.push_back(iter_->value().ToString());
+    } else {
+      has_base = (type == kTypeValue || type == kTypeBlobIndex);
+      if (has_base) {
+        saved_value_.assign(iter_->value().data(), iter_->value().size());
+      }
+      if (type == kTypeBlobIndex) {
+        has_base = ReadSavedBlob();
+      }
+      // Step past the base so that iter_ is after all merged entries
+      iter_->Next();
+      break;
+    }
+  }
+  Slice base(saved_value_);
+  Status s = merger_->ApplyAll(saved_key_, has_base ? &base : NULL, operands,
+                               &saved_value_);
+  merged_ = true;
+  if (s.ok() && status_.ok()) {
+    valid_ = true;
+  } else {
+    if (status_.ok()) {
+      status_ = s;
+    }
+    valid_ = false;
+  }
 }
 
 void DBIter::Prev() {
@@ -190,8 +320,16 @@ void DBIter::Prev() {
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    if (merged_) {
+      // saved_key_ holds the current key and iter_ is past its entries
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -219,15 +357,40 @@ void DBIter::FindPrevUserEntry() {
     do {
       ParsedInternalKey ikey;
       if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+        const ValueType type = TypeOf(ikey);
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
+        if (type == kTypeMerge) {
+          // Apply the operand to the value of the older entries, if any
+          Status s;
+          if (value_type == kTypeBlobIndex && !ReadSavedBlob()) {
+            s = status_;
+          }
+          Slice existing(saved_value_);
+          if (s.ok()) {
+            s = merger_->Apply(ikey.user_key,
+                               value_type == kTypeDeletion ? NULL : &existing,
+                               iter_->value(), &saved_value_);
+          }
+          if (!s.ok()) {
+            status_ = s;
+            valid_ = false;
+            saved_key_.clear();
+            ClearSavedValue();
+            direction_ = kForward;
+            return;
+          }
+          SaveKey(ikey.user_key, &saved_key_);
+        }
+        value_type = type;
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+        } else if (value_type == kTypeMerge) {
+          // saved_key_ and saved_value_ were set above
         } else {
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
@@ -242,6 +405,9 @@ void DBIter::FindPrevUserEntry() {
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeBlobIndex && !ReadSavedBlob()) {
+    value_type = kTypeDeletion;  // Stop at the error
+  }
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -255,6 +421,7 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(
@@ -269,6 +436,7 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -280,6 +448,7 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -291,9 +460,13 @@ Iterator* NewDBIterator(
     const std::string* dbname,
     Env* env,
     const Comparator* user_key_comparator,
+    const MergeHelper* merger,
+    BlobFileCache* blobs,
     Iterator* internal_iter,
+    RangeDeletions* range_deletions,
     const SequenceNumber& sequence) {
-  return new DBIter(dbname, env, user_key_comparator, internal_iter, sequence);
+  return new DBIter(dbname, env, user_key_comparator, merger, blobs,
+                    internal_iter, range_deletions, sequence);
 }
 
 }
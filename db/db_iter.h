@@ -11,14 +11,25 @@
 
 namespace leveldb {
 
+class BlobFileCache;
+class MergeHelper;
+class RangeDeletions;
+
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Merge operands are combined with
+// "*merger", and values kept in blob files are read through "*blobs";
+// both must outlive the result.  Entries covered by "*range_deletions"
+// are hidden; the result takes ownership of it, and it may be NULL if
+// there are no range deletions.
 extern Iterator* NewDBIterator(
     const std::string* dbname,
     Env* env,
     const Comparator* user_key_comparator,
+    const MergeHelper* merger,
+    BlobFileCache* blobs,
     Iterator* internal_iter,
+    RangeDeletions* range_deletions,
     const SequenceNumber& sequence);
 
 }
@@ -7,8 +7,19 @@
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
+#include "leveldb/checkpoint.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/env.h"
+#include "leveldb/listener.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/sst_file_writer.h"
+#include "leveldb/statistics.h"
 #include "leveldb/table.h"
+#include "leveldb/write_buffer_manager.h"
+#include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
 #include "util/testharness.h"
@@ -166,6 +177,15 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "+" + iter->value().ToString();
+              break;
+            case kTypeBlobIndex:
+              result += "BLOB";
+              break;
+            case kTypeRangeDeletion:
+              // Kept apart from the other entries
+              break;
           }
         }
         iter->Next();
@@ -187,9 +207,19 @@ class DBTest {
     return atoi(property.c_str());
   }
 
+  // Flush overlapping memtables until level-0 holds at least "n" files.
+  void FillLevel0(int n) {
+    for (int i = 0; NumTableFilesAtLevel(0) < n; i++) {
+      ASSERT_LT(i, 2 * n);
+      ASSERT_OK(Put("a", "begin"));
+      ASSERT_OK(Put("z", "end"));
+      dbfull()->TEST_CompactMemTable();
+    }
+  }
+
   int TotalTableFiles() {
     int result = 0;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < last_options_.num_levels; level++) {
       result += NumTableFilesAtLevel(level);
     }
     return result;
@@ -199,7 +229,7 @@ class DBTest {
   std::string FilesPerLevel() {
     std::string result;
     int last_non_zero_offset = 0;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < last_options_.num_levels; level++) {
       int f = NumTableFilesAtLevel(level);
       char buf[100];
       snprintf(buf, sizeof(buf), "%s%d", (level ? "," : ""), f);
@@ -236,7 +266,7 @@ class DBTest {
   // Prevent pushing of new sstables into deeper levels by adding
   // tables that cover a specified range to all levels.
   void FillLevels(const std::string& smallest, const std::string& largest) {
-    MakeTables(config::kNumLevels, smallest, largest);
+    MakeTables(last_options_.num_levels, smallest, largest);
   }
 
   void DumpFileCounts(const char* label) {
@@ -244,7 +274,7 @@ class DBTest {
     fprintf(stderr, "maxoverlap: %lld\n",
             static_cast<long long>(
                 dbfull()->TEST_MaxNextLevelOverlappingBytes()));
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < last_options_.num_levels; level++) {
       int num = NumTableFilesAtLevel(level);
       if (num > 0) {
         fprintf(stderr, "  level %3d : %d files\n", level, num);
@@ -696,6 +726,225 @@ TEST(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST(DBTest, RecoverManyRecords) {
+  // Enough records for the log to be read in several chunks, and for
+  // recovery to write many tables while it reads on
+  Options options;
+  Reopen(&options);
+  for (int i = 0; i < 4000; i++) {
+    ASSERT_OK(Put(Key(i % 1000), std::string(1000, 'a' + i / 1000)));
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+
+  options.write_buffer_size = 100000;
+  Reopen(&options);
+  ASSERT_GT(NumTableFilesAtLevel(0), 10);
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(std::string(1000, 'd'), Get(Key(i)));
+  }
+}
+
+TEST(DBTest, ManifestRollover) {
+  Options options;
+  options.max_manifest_file_size = 1000;
+  Reopen(&options);
+  const uint64_t first_manifest = dbfull()->TEST_ManifestFileNumber();
+  for (int i = 0; i < 20; i++) {
+    ASSERT_OK(Put(Key(i), "v1"));
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  // The descriptor was replaced, and only the latest one is left
+  ASSERT_GT(dbfull()->TEST_ManifestFileNumber(), first_manifest);
+  std::vector<std::string> filenames;
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  int manifests = 0;
+  uint64_t number;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) &&
+        type == kDescriptorFile) {
+      manifests++;
+    }
+  }
+  ASSERT_EQ(1, manifests);
+
+  const std::string files = FilesPerLevel();
+  Reopen(&options);
+  ASSERT_EQ(files, FilesPerLevel());
+  for (int i = 0; i < 20; i++) {
+    ASSERT_EQ("v1", Get(Key(i)));
+  }
+}
+
+TEST(DBTest, RecycleLogFiles) {
+  Options options;
+  options.write_buffer_size = 100000;
+  options.recycle_log_file_num = 2;
+  Reopen(&options);
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), std::string(1000, 'a' + round)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_OK(Put("foo", "v1"));
+
+  // The current log is written over an earlier one, which was not shrunk
+  std::vector<std::string> filenames;
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  uint64_t number, current_log = 0;
+  FileType type;
+  int logs = 0;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == kLogFile) {
+      logs++;
+      current_log = std::max(current_log, number);
+    }
+  }
+  ASSERT_LE(logs, 1 + options.recycle_log_file_num);
+  uint64_t size;
+  ASSERT_OK(env_->GetFileSize(LogFileName(dbname_, current_log), &size));
+  ASSERT_GT(size, 65536);  // More than a new log maps at first
+
+  // Recovery stops at the records left over from the earlier log
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(std::string(1000, 'd'), Get(Key(i)));
+  }
+}
+
+static int CountFiles(Env* env, const std::string& dir, FileType want) {
+  std::vector<std::string> filenames;
+  env->GetChildren(dir, &filenames);
+  uint64_t number;
+  FileType type;
+  int result = 0;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == want) {
+      result++;
+    }
+  }
+  return result;
+}
+
+TEST(DBTest, WalDirAndDbPaths) {
+  Options options;
+  options.create_if_missing = true;
+  options.write_buffer_size = 100000;
+  options.wal_dir = dbname_ + "_wal";
+  options.db_paths.push_back(DbPath(dbname_ + "_fast", 1 << 20));
+  options.db_paths.push_back(DbPath(dbname_ + "_slow", 1ull << 40));
+  delete db_;
+  db_ = NULL;
+  DestroyDB(dbname_, options);
+  DestroyAndReopen(&options);
+
+  // Flushed tables go to the first path
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), std::string(10000, 'x')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(NumTableFilesAtLevel(0), 0);
+  ASSERT_EQ(NumTableFilesAtLevel(0), CountFiles(env_, dbname_ + "_fast",
+                                                kTableFile));
+
+  // Level 1 does not fit in the first path
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_EQ(0, CountFiles(env_, dbname_ + "_fast", kTableFile));
+  ASSERT_GT(CountFiles(env_, dbname_ + "_slow", kTableFile), 0);
+  ASSERT_EQ(0, CountFiles(env_, dbname_, kTableFile));
+
+  // Logs live in the WAL directory only
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_GT(CountFiles(env_, dbname_ + "_wal", kLogFile), 0);
+  ASSERT_EQ(0, CountFiles(env_, dbname_, kLogFile));
+
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(std::string(10000, 'x'), Get(Key(i)));
+  }
+
+  delete db_;
+  db_ = NULL;
+  ASSERT_OK(DestroyDB(dbname_, options));
+  ASSERT_EQ(0, CountFiles(env_, dbname_ + "_wal", kLogFile));
+  ASSERT_EQ(0, CountFiles(env_, dbname_ + "_slow", kTableFile));
+}
+
+TEST(DBTest, BlobFiles) {
+  Options options;
+  options.create_if_missing = true;
+  options.min_blob_size = 1000;
+  DestroyAndReopen(&options);
+
+  // Large values are kept in a blob file when flushed
+  ASSERT_OK(Put("small", "v1"));
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put(Key(i), std::string(10000, 'x')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, CountFiles(env_, dbname_, kBlobFile));
+  ASSERT_EQ("v1", Get("small"));
+  ASSERT_EQ(std::string(10000, 'x'), Get(Key(7)));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    if (iter->key() != "small") {
+      ASSERT_EQ(std::string(10000, 'x'), iter->value().ToString());
+    }
+    count++;
+  }
+  ASSERT_EQ(51, count);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    if (iter->key() != "small") {
+      ASSERT_EQ(std::string(10000, 'x'), iter->value().ToString());
+    }
+    count--;
+  }
+  ASSERT_EQ(0, count);
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  // A blob file whose values were all overwritten is deleted
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put(Key(i), std::string(10000, 'y')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(2, CountFiles(env_, dbname_, kBlobFile));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(1, CountFiles(env_, dbname_, kBlobFile));
+  std::vector<std::string> filenames;
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  uint64_t number, blob_number = 0;
+  FileType type;
+  for (size_t i = 0; i < filenames.size(); i++) {
+    if (ParseFileName(filenames[i], &number, &type) && type == kBlobFile) {
+      blob_number = number;
+    }
+  }
+
+  // The values still in use are moved out of a blob file that is mostly
+  // garbage, which is then deleted
+  for (int i = 0; i < 50; i += 2) {
+    ASSERT_OK(Put(Key(i), std::string(10000, 'z')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(NULL, NULL);
+  ASSERT_OK(dbfull()->TEST_WaitForCompact());
+  ASSERT_TRUE(!env_->FileExists(BlobFileName(dbname_, blob_number)));
+  ASSERT_EQ(2, CountFiles(env_, dbname_, kBlobFile));
+
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("small"));
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(std::string(10000, i % 2 == 0 ? 'z' : 'y'), Get(Key(i)));
+  }
+}
+
 TEST(DBTest, CompactionsGenerateMultipleFiles) {
   Options options;
   options.write_buffer_size = 100000000;        // Large write buffer
@@ -730,7 +979,8 @@ TEST(DBTest, RepeatedWritesToSameKey) {
 
   // We must have at most one file per level except for level-0,
   // which may have up to kL0_StopWritesTrigger files.
-  const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+  const int kMaxFiles = last_options_.num_levels +
+                        Options().level0_stop_writes_trigger;
 
   Random rnd(301);
   std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -741,6 +991,132 @@ TEST(DBTest, RepeatedWritesToSameKey) {
   }
 }
 
+TEST(DBTest, BulkLoad) {
+  Options options;
+  options.create_if_missing = true;
+  options.PrepareForBulkLoad();
+  options.write_buffer_size = 100000;  // Small write buffer
+  DestroyAndReopen(&options);
+
+  // Level-0 files pile up beyond the stop trigger without stalling
+  WriteOptions write_options;
+  write_options.disable_wal = true;
+  Random rnd(301);
+  std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
+  const int kNumFiles = 2 * Options().level0_stop_writes_trigger;
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_OK(db_->Put(write_options, "key", value));
+  }
+  ASSERT_GT(NumTableFilesAtLevel(0), Options().level0_stop_writes_trigger);
+  ASSERT_EQ(value, Get("key"));
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ(value, Get("key"));
+
+  // Closing the DB flushes the writes that skipped the log
+  ASSERT_OK(db_->Put(write_options, "foo", "v1"));
+  ASSERT_EQ("v1", Get("foo"));
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(value, Get("key"));
+}
+
+TEST(DBTest, SequentialInsertsGoToLastLevel) {
+  Options options;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  // Flushes of keys after all others skip the levels in between
+  for (int f = 0; f < 5; f++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(f * 100 + i), "v"));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ("0,0,1,0,0,0,4", FilesPerLevel());
+
+  // Others do not
+  ASSERT_OK(Put(Key(50), "v2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1,0,0,0,4", FilesPerLevel());
+  ASSERT_EQ("v2", Get(Key(50)));
+  ASSERT_EQ("v", Get(Key(450)));
+}
+
+TEST(DBTest, NumLevels) {
+  Options options;
+  options.create_if_missing = true;
+  options.num_levels = 4;
+  options.max_mem_compaction_level = 1;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1", FilesPerLevel());
+  ASSERT_OK(Put("b", "vb"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,0,1", FilesPerLevel());
+
+  // The DB has files in level 3
+  options.num_levels = 3;
+  ASSERT_TRUE(!TryReopen(&options).ok());
+  options.num_levels = 4;
+  Reopen(&options);
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vb", Get("b"));
+}
+
+TEST(DBTest, UniversalCompaction) {
+  Options options;
+  options.create_if_missing = true;
+  options.compression = kNoCompression;
+  options.compaction_style = kCompactionStyleUniversal;
+  options.level0_file_num_compaction_trigger = 4;
+  DestroyAndReopen(&options);
+
+  // Runs of the same size: the fourth one makes those newer than the
+  // oldest take three times its space, so all of them are merged.
+  for (int run = 0; run < 4; run++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), std::string(100, 'a' + run)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_WaitForCompact();
+    ASSERT_EQ(run < 3 ? NumberToString(run + 1) : "1", FilesPerLevel());
+  }
+  ASSERT_EQ(std::string(100, 'd'), Get(Key(7)));
+
+  // Runs much smaller than the oldest one are merged among themselves,
+  // keeping the deletion that hides an entry of the oldest one.
+  for (int run = 0; run < 3; run++) {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(Put(Key(i), std::string(100, 'e' + run)));
+    }
+    if (run == 2) {
+      ASSERT_OK(Delete(Key(50)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  dbfull()->TEST_WaitForCompact();
+  ASSERT_EQ("2", FilesPerLevel());
+  ASSERT_EQ(std::string(100, 'g'), Get(Key(7)));
+  ASSERT_EQ(std::string(100, 'd'), Get(Key(70)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(50)));
+  ASSERT_EQ("[ DEL, " + std::string(100, 'd') + " ]", AllEntriesFor(Key(50)));
+
+  // The order of the runs survives a reopen
+  Reopen(&options);
+  ASSERT_EQ(std::string(100, 'g'), Get(Key(7)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(50)));
+
+  // A manual compaction merges all runs
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("1", FilesPerLevel());
+  ASSERT_EQ(std::string(100, 'g'), Get(Key(7)));
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(50)));
+}
+
 TEST(DBTest, SparseMerge) {
   Options options;
   options.compression = kNoCompression;
@@ -957,7 +1333,7 @@ TEST(DBTest, HiddenValuesAreRemoved) {
 TEST(DBTest, DeletionMarkers1) {
   Put("foo", "v1");
   ASSERT_OK(dbfull()->TEST_CompactMemTable());
-  const int last = config::kMaxMemCompactLevel;
+  const int last = Options().max_mem_compaction_level;
   ASSERT_EQ(NumTableFilesAtLevel(last), 1);   // foo => v1 is now in last level
 
   // Place a table at level last-1 to prevent merging with preceding mutation
@@ -986,7 +1362,7 @@ TEST(DBTest, DeletionMarkers1) {
 TEST(DBTest, DeletionMarkers2) {
   Put("foo", "v1");
   ASSERT_OK(dbfull()->TEST_CompactMemTable());
-  const int last = config::kMaxMemCompactLevel;
+  const int last = Options().max_mem_compaction_level;
   ASSERT_EQ(NumTableFilesAtLevel(last), 1);   // foo => v1 is now in last level
 
   // Place a table at level last-1 to prevent merging with preceding mutation
@@ -1010,7 +1386,8 @@ TEST(DBTest, DeletionMarkers2) {
 }
 
 TEST(DBTest, OverlapInLevel0) {
-  ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
+  ASSERT_EQ(Options().max_mem_compaction_level, 2)
+      << "Fix test to match config";
 
   // Fill levels 1 and 2 to disable the pushing of new memtables to levels > 0.
   ASSERT_OK(Put("100", "v100"));
@@ -1048,6 +1425,50 @@ TEST(DBTest, OverlapInLevel0) {
   ASSERT_EQ("NOT_FOUND", Get("600"));
 }
 
+namespace {
+// Holds background compactions at their start until released.
+class CompactionBlocker : public EventListener {
+ public:
+  CompactionBlocker() { blocked_.Release_Store(this); }
+
+  virtual void OnCompactionBegin(const CompactionJobInfo& info) {
+    while (blocked_.Acquire_Load() != NULL) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+  }
+
+  void Release() { blocked_.Release_Store(NULL); }
+
+ private:
+  port::AtomicPointer blocked_;
+};
+}
+
+TEST(DBTest, WriteStallsProperty) {
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stalls", &property));
+  ASSERT_TRUE(property.find("level0-stop") != std::string::npos) << property;
+  ASSERT_TRUE(property.find("(inactive)") != std::string::npos) << property;
+
+  // Fill level-0 beyond the slowdown trigger, and hold the compaction
+  // that would empty it.  Writes are never delayed without compactions.
+  Options options;
+  options.disable_auto_compactions = true;
+  Reopen(&options);
+  FillLevel0(options.level0_slowdown_writes_trigger);
+  CompactionBlocker blocker;
+  options.disable_auto_compactions = false;
+  options.listeners.push_back(&blocker);
+  Reopen(&options);
+
+  ASSERT_OK(Put("b", "value"));
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stalls", &property));
+  ASSERT_TRUE(property.find("(active)") != std::string::npos) << property;
+  blocker.Release();
+  ASSERT_OK(dbfull()->TEST_WaitForCompact());
+  Reopen();
+}
+
 TEST(DBTest, ComparatorCheck) {
   class NewComparator : public Comparator {
    public:
@@ -1072,7 +1493,7 @@ TEST(DBTest, ComparatorCheck) {
 }
 
 TEST(DBTest, ManualCompaction) {
-  ASSERT_EQ(config::kMaxMemCompactLevel, 2)
+  ASSERT_EQ(Options().max_mem_compaction_level, 2)
       << "Need to update this test to match kMaxMemCompactLevel";
 
   MakeTables(3, "p", "q");
@@ -1144,6 +1565,1055 @@ TEST(DBTest, DBOpen_Options) {
   db = NULL;
 }
 
+TEST(DBTest, ColumnFamilies) {
+  Options options;
+  options.create_if_missing = true;
+  options.use_column_families = true;
+  DestroyAndReopen(&options);
+
+  ColumnFamilyHandle* cf;
+  ASSERT_OK(db_->CreateColumnFamily("pikachu", &cf));
+  ASSERT_EQ("pikachu", cf->GetName());
+  ASSERT_TRUE(cf->GetID() != db_->DefaultColumnFamily()->GetID());
+  ASSERT_TRUE(!db_->CreateColumnFamily("pikachu", &cf).ok());
+  ASSERT_OK(db_->GetColumnFamily("pikachu", &cf));
+
+  // One batch spanning both families
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("v1"));
+  batch.Put(cf, Slice("foo"), Slice("v2"));
+  batch.Put(cf, Slice("bar"), Slice("v3"));
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_OK(db_->Put(WriteOptions(), "zzz", "v4"));
+
+  std::string value;
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_OK(db_->Get(ReadOptions(), cf, "foo", &value));
+  ASSERT_EQ("v2", value);
+  ASSERT_EQ("NOT_FOUND", Get("bar"));
+
+  // Iterators only see their own family
+  Iterator* iter = db_->NewIterator(ReadOptions(), cf);
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "bar->v3");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "foo->v2");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "foo->v2");
+  iter->Prev();
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  delete iter;
+  iter = db_->NewIterator(ReadOptions());
+  iter->SeekToLast();
+  ASSERT_EQ(IterStatus(iter), "zzz->v4");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "foo->v1");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  delete iter;
+
+  // Families and their contents survive a reopen through the log and
+  // through a compaction
+  for (int i = 0; i < 2; i++) {
+    Reopen(&options);
+    ASSERT_OK(db_->GetColumnFamily("pikachu", &cf));
+    ASSERT_OK(db_->Get(ReadOptions(), cf, "bar", &value));
+    ASSERT_EQ("v3", value);
+    ASSERT_OK(db_->Delete(WriteOptions(), cf, "bar"));
+    ASSERT_TRUE(db_->Get(ReadOptions(), cf, "bar", &value).IsNotFound());
+    ASSERT_OK(db_->Put(WriteOptions(), cf, "bar", "v3"));
+    ASSERT_EQ("v1", Get("foo"));
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  // A batch naming a family this DB does not know is rejected whole
+  ColumnFamilyHandleImpl unknown("raichu", cf->GetID() + 1);
+  WriteBatch bad;
+  bad.Put(Slice("new"), Slice("v5"));
+  bad.Put(&unknown, Slice("new"), Slice("v6"));
+  ASSERT_TRUE(!db_->Write(WriteOptions(), &bad).ok());
+  ASSERT_EQ("NOT_FOUND", Get("new"));
+
+  // The family setting must match the one the DB was created with
+  Options plain;
+  Status s = TryReopen(&plain);
+  ASSERT_TRUE(!s.ok());
+  ASSERT_TRUE(s.ToString().find("comparator") != std::string::npos)
+      << s.ToString();
+}
+
+TEST(DBTest, ColumnFamiliesDisabled) {
+  Options options;
+  options.create_if_missing = true;
+  options.paranoid_checks = true;
+  DestroyAndReopen(&options);
+
+  // Nothing of a batch naming another family is logged or applied
+  ColumnFamilyHandleImpl cf("pikachu", 3);
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("v1"));
+  batch.Put(&cf, Slice("bar"), Slice("v2"));
+  ASSERT_TRUE(!db_->Write(WriteOptions(), &batch).ok());
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_OK(Put("baz", "v3"));
+
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("v3", Get("baz"));
+}
+
+static int TotalTableFilesOf(DB* db) {
+  int result = 0;
+  for (int level = 0; level < Options().num_levels; level++) {
+    std::string property;
+    ASSERT_TRUE(db->GetProperty(
+        "leveldb.num-files-at-level" + NumberToString(level), &property));
+    result += atoi(property.c_str());
+  }
+  return result;
+}
+
+TEST(DBTest, SharedWriteBufferManager) {
+  Cache* cache = NewLRUCache(16 << 20);
+  WriteBufferManager manager(1 << 20, cache);
+  Options options;
+  options.create_if_missing = true;
+  options.write_buffer_size = 64 << 20;  // Only the shared budget applies
+  options.write_buffer_manager = &manager;
+  options.block_cache = cache;
+  DestroyAndReopen(&options);
+
+  std::string dbname2 = test::TmpDir() + "/db_test_shared_buffer";
+  DestroyDB(dbname2, Options());
+  DB* db2 = NULL;
+  ASSERT_OK(DB::Open(options, dbname2, &db2));
+
+  // Fill most of the budget through the second DB
+  Random rnd(301);
+  for (int i = 0; i < 7; i++) {
+    ASSERT_OK(db2->Put(WriteOptions(), Key(i), RandomString(&rnd, 100000)));
+  }
+  ASSERT_GT(manager.memory_usage(), 700000);
+  ASSERT_EQ(0, TotalTableFilesOf(db2));
+
+  // Writes to the first DB push the total over budget, which flushes
+  // the largest memtable: the one of the second DB.
+  for (int i = 0; i < 5; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 100000)));
+  }
+  reinterpret_cast<DBImpl*>(db2)->TEST_CompactMemTable();
+  ASSERT_GT(TotalTableFilesOf(db2), 0);
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_LT(manager.memory_usage(), 1 << 20);
+
+  std::string value;
+  ASSERT_OK(db2->Get(ReadOptions(), Key(3), &value));
+  ASSERT_EQ(100000, value.size());
+
+  delete db2;
+  DestroyDB(dbname2, Options());
+  delete db_;
+  db_ = NULL;
+  ASSERT_EQ(0, manager.memory_usage());
+  Reopen();
+  delete cache;
+}
+
+TEST(DBTest, RateLimiter) {
+  RateLimiter* limiter = NewGenericRateLimiter(100 << 20);
+  Options options;
+  options.create_if_missing = true;
+  options.rate_limiter = limiter;
+  DestroyAndReopen(&options);
+
+  // Two overlapping tables, so that compacting them is not a trivial
+  // move
+  Random rnd(301);
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+  const int64_t flushed = limiter->GetTotalBytesThrough(RateLimiter::IO_HIGH);
+  ASSERT_GT(flushed, 100000);
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(RateLimiter::IO_LOW));
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_GT(limiter->GetTotalBytesThrough(RateLimiter::IO_LOW), 100000);
+  ASSERT_EQ(flushed, limiter->GetTotalBytesThrough(RateLimiter::IO_HIGH));
+  ASSERT_EQ(1000, Get(Key(50)).size());
+
+  Reopen();
+  delete limiter;
+}
+
+TEST(DBTest, Statistics) {
+  Statistics* stats = CreateDBStatistics();
+  Options options;
+  options.create_if_missing = true;
+  options.statistics = stats;
+  DestroyAndReopen(&options);
+
+  std::string property;
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Put("bar", "v2"));
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("missing"));
+  ASSERT_EQ(2, stats->GetTickerCount(kNumberKeysWritten));
+  ASSERT_EQ(1, stats->GetTickerCount(kNumberKeysRead));
+  ASSERT_EQ(2, stats->GetTickerCount(kBytesRead));
+  ASSERT_GT(stats->GetTickerCount(kWalBytes), 0);
+  ASSERT_EQ(0, stats->GetTickerCount(kWalSynced));
+
+  // Reads from a table go through the table and block caches
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(stats->GetTickerCount(kFlushWriteBytes), 0);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_GE(stats->GetTickerCount(kIndexBlockHit), 1);
+  ASSERT_EQ(1, stats->GetTickerCount(kBlockCacheDataMiss));
+  ASSERT_EQ(1, stats->GetTickerCount(kBlockCacheDataHit));
+
+  StatisticsSnapshot snapshot;
+  stats->GetSnapshot(&snapshot);
+  ASSERT_EQ(2, snapshot.tickers[kNumberKeysWritten]);
+  ASSERT_EQ(2, snapshot.histograms[kDbWriteMicros].count);
+  ASSERT_EQ(4, snapshot.histograms[kDbGetMicros].count);
+  ASSERT_EQ(1, snapshot.histograms[kFlushMicros].count);
+
+  ASSERT_TRUE(db_->GetProperty("leveldb.statistics", &property));
+  ASSERT_TRUE(property.find("leveldb.number.keys.written COUNT : 2") !=
+              std::string::npos) << property;
+
+  stats->Reset();
+  ASSERT_EQ(0, stats->GetTickerCount(kNumberKeysWritten));
+
+  Reopen();
+  ASSERT_TRUE(!db_->GetProperty("leveldb.statistics", &property));
+  delete stats;
+}
+
+TEST(DBTest, PerfContext) {
+  ASSERT_OK(Put("foo", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  Reopen();
+  PerfContext* context = GetPerfContext();
+
+  // Nothing is recorded by default
+  context->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("", context->ToString());
+
+  // Counters only: the lookup misses the memtable and opens the table
+  SetPerfLevel(kPerfCounts);
+  Reopen();
+  context->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(1, context->get_from_memtable_count);
+  ASSERT_EQ(1, context->get_files_probed_count);
+  ASSERT_EQ(1, context->table_open_count);
+  ASSERT_EQ(1, context->index_block_read_count);
+  ASSERT_EQ(1, context->data_block_read_count);
+  ASSERT_EQ(2, context->block_read_count);
+  ASSERT_GT(context->block_read_byte, 0);
+  ASSERT_EQ(0, context->find_table_nanos);
+
+  // The second lookup finds the table open and the block cached
+  context->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(0, context->table_open_count);
+  ASSERT_EQ(1, context->block_cache_hit_count);
+  ASSERT_EQ(0, context->block_read_count);
+
+  SetPerfLevel(kPerfTimings);
+  Reopen();
+  context->Reset();
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_GT(context->find_table_nanos, 0);
+  ASSERT_GT(context->get_from_output_files_nanos,
+            context->find_table_nanos);
+  ASSERT_GT(context->block_read_nanos, 0);
+
+  SetPerfLevel(kPerfDisabled);
+}
+
+namespace {
+class RecordingListener : public EventListener {
+ public:
+  port::Mutex mu;
+  std::vector<FlushJobInfo> flushes_begun, flushes;
+  std::vector<CompactionJobInfo> compactions_begun, compactions;
+  std::vector<TableFileCreationInfo> created;
+  std::vector<TableFileDeletionInfo> deleted;
+  std::vector<WriteStallInfo> stalls;
+
+  virtual void OnFlushBegin(const FlushJobInfo& info) {
+    MutexLock l(&mu);
+    flushes_begun.push_back(info);
+  }
+  virtual void OnFlushCompleted(const FlushJobInfo& info) {
+    MutexLock l(&mu);
+    flushes.push_back(info);
+  }
+  virtual void OnCompactionBegin(const CompactionJobInfo& info) {
+    MutexLock l(&mu);
+    compactions_begun.push_back(info);
+  }
+  virtual void OnCompactionCompleted(const CompactionJobInfo& info) {
+    MutexLock l(&mu);
+    compactions.push_back(info);
+  }
+  virtual void OnTableFileCreated(const TableFileCreationInfo& info) {
+    MutexLock l(&mu);
+    created.push_back(info);
+  }
+  virtual void OnTableFileDeleted(const TableFileDeletionInfo& info) {
+    MutexLock l(&mu);
+    deleted.push_back(info);
+  }
+  virtual void OnStallConditionsChanged(const WriteStallInfo& info) {
+    MutexLock l(&mu);
+    stalls.push_back(info);
+  }
+};
+}
+
+TEST(DBTest, PreloadTableFiles) {
+  Options options;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  for (int i = 0; i < 5; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ(5, TotalTableFiles());
+
+  // Without preloading, the first lookup of each table opens it
+  PerfContext* context = GetPerfContext();
+  SetPerfLevel(kPerfCounts);
+  Reopen(&options);
+  context->Reset();
+  for (int i = 0; i < 5; i++) {
+    ASSERT_EQ("v", Get(Key(i)));
+  }
+  ASSERT_GT(context->table_open_count, 0);
+
+  options.preload_table_files = true;
+  options.max_file_opening_threads = 3;
+  Reopen(&options);
+  context->Reset();
+  for (int i = 0; i < 5; i++) {
+    ASSERT_EQ("v", Get(Key(i)));
+  }
+  ASSERT_EQ(0, context->table_open_count);
+  ASSERT_EQ(0, context->index_block_read_count);
+  SetPerfLevel(kPerfDisabled);
+}
+
+TEST(DBTest, EventListener) {
+  RecordingListener listener;
+  Options options;
+  options.create_if_missing = true;
+  options.listeners.push_back(&listener);
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("z", "vz"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, listener.flushes_begun.size());
+  ASSERT_EQ(1, listener.flushes.size());
+  const FlushJobInfo flush = listener.flushes[0];
+  ASSERT_EQ(kFlushReasonManual, flush.reason);
+  ASSERT_GT(flush.file_size, 0);
+  ASSERT_EQ(1, listener.created.size());
+  ASSERT_EQ(kTableFileCreationFlush, listener.created[0].reason);
+  ASSERT_EQ(flush.file_number, listener.created[0].file_number);
+  ASSERT_EQ(flush.file_path, listener.created[0].file_path);
+  ASSERT_OK(listener.created[0].status);
+
+  // A second, overlapping table is placed above the first one, so that
+  // compacting it merges both
+  ASSERT_OK(Put("a", "va2"));
+  ASSERT_OK(Put("z", "vz2"));
+  dbfull()->TEST_CompactMemTable();
+  const int level = listener.flushes[1].output_level;
+  ASSERT_EQ(flush.output_level, level + 1);
+  dbfull()->TEST_CompactRange(level, NULL, NULL);
+  ASSERT_EQ(1, listener.compactions_begun.size());
+  ASSERT_EQ(1, listener.compactions.size());
+  const CompactionJobInfo compaction = listener.compactions[0];
+  ASSERT_EQ(kCompactionReasonManual, compaction.reason);
+  ASSERT_EQ(level, compaction.base_level);
+  ASSERT_EQ(level + 1, compaction.output_level);
+  ASSERT_TRUE(!compaction.is_trivial_move);
+  ASSERT_EQ(2, compaction.input_files.size());
+  ASSERT_EQ(1, compaction.output_files.size());
+  ASSERT_GT(compaction.bytes_read, 0);
+  ASSERT_GT(compaction.bytes_written, 0);
+  ASSERT_OK(compaction.status);
+  ASSERT_EQ(3, listener.created.size());
+  ASSERT_EQ(kTableFileCreationCompaction, listener.created[2].reason);
+
+  // The compaction inputs were deleted
+  ASSERT_EQ(2, listener.deleted.size());
+  for (size_t i = 0; i < listener.deleted.size(); i++) {
+    ASSERT_TRUE(listener.deleted[i].file_number ==
+                    compaction.input_files[0] ||
+                listener.deleted[i].file_number ==
+                    compaction.input_files[1]);
+  }
+  ASSERT_EQ("va2", Get("a"));
+
+  // Filling level-0 beyond the slowdown trigger delays writes while the
+  // compaction that would empty it is held
+  options.disable_auto_compactions = true;
+  Reopen(&options);
+  FillLevel0(options.level0_slowdown_writes_trigger);
+  CompactionBlocker blocker;
+  options.disable_auto_compactions = false;
+  options.listeners.push_back(&blocker);
+  Reopen(&options);
+  ASSERT_OK(Put("b", "value"));
+  {
+    MutexLock l(&listener.mu);
+    ASSERT_GE(listener.stalls.size(), 1);
+    ASSERT_EQ(kWriteStallNormal, listener.stalls[0].previous_condition);
+    ASSERT_EQ(kWriteStallDelayed, listener.stalls[0].condition);
+  }
+  blocker.Release();
+  ASSERT_OK(dbfull()->TEST_WaitForCompact());
+
+  Reopen();
+}
+
+TEST(DBTest, MinOverlappingRatio) {
+  Options options;
+  options.create_if_missing = true;
+  options.compression = kNoCompression;
+  options.num_levels = 3;
+  options.disable_auto_compactions = true;
+  DestroyAndReopen(&options);
+
+  // Level-2 holds a large file and a small one, each overlapped by a
+  // level-1 file
+  const std::string big(10000, 'x');
+  for (int i = 0; i < 10; i++) {
+    ASSERT_OK(Put("a" + NumberToString(i), big));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("z0", "v"));
+  ASSERT_OK(Put("z1", "v"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("a5", "v"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("z05", "v"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,2,2", FilesPerLevel());
+
+  // Level-1 exceeds its size limit: the file over the small one goes first
+  RecordingListener listener;
+  options.listeners.push_back(&listener);
+  options.disable_auto_compactions = false;
+  options.max_bytes_for_level_base = 1;
+  options.compaction_pri = kCompactionPriMinOverlappingRatio;
+  Reopen(&options);
+  dbfull()->TEST_WaitForCompact();
+  ASSERT_EQ("0,0,2", FilesPerLevel());
+  {
+    MutexLock l(&listener.mu);
+    ASSERT_EQ(2, listener.compactions.size());
+    ASSERT_EQ(kCompactionReasonLevelBytes, listener.compactions[0].reason);
+    ASSERT_LT(listener.compactions[0].bytes_read, 1000);
+    ASSERT_GT(listener.compactions[1].bytes_read, 100000);
+  }
+  ASSERT_EQ("v", Get("a5"));
+  ASSERT_EQ("v", Get("z05"));
+  Reopen();
+}
+
+TEST(DBTest, DeletionCompaction) {
+  Options options;
+  options.create_if_missing = true;
+  options.deletion_compaction_percent = 50;
+  DestroyAndReopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // A file with few deletions stays in place
+  ASSERT_OK(Put(Key(0), "v2"));
+  ASSERT_OK(Put(Key(1), "v2"));
+  ASSERT_OK(Delete(Key(2)));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_WaitForCompact();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // A file of deletions is merged with the entries it deletes
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_WaitForCompact();
+  ASSERT_EQ("", FilesPerLevel());
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(5)));
+}
+
+namespace {
+// Removes the keys that start with "remove" and replaces the values of
+// the keys that start with "change".
+class PrefixCompactionFilter : public CompactionFilter {
+ public:
+  mutable port::Mutex mu;
+  mutable int calls;
+
+  PrefixCompactionFilter() : calls(0) { }
+
+  virtual Decision Filter(int level, const Slice& key, const Slice& value,
+                          std::string* new_value) const {
+    MutexLock l(&mu);
+    calls++;
+    if (key.starts_with("remove")) {
+      return kRemove;
+    } else if (key.starts_with("change")) {
+      new_value->assign("changed");
+      return kChangeValue;
+    }
+    return kKeep;
+  }
+
+  virtual const char* Name() const { return "PrefixCompactionFilter"; }
+};
+}
+
+TEST(DBTest, CompactionFilter) {
+  PrefixCompactionFilter filter;
+  Options options;
+  options.create_if_missing = true;
+  options.compaction_filter = &filter;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("change1", "v1"));
+  ASSERT_OK(Put("keep1", "v2"));
+  ASSERT_OK(Put("remove1", "v3"));
+  ASSERT_OK(Put("remove2", "old"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("remove2", "new"));
+
+  // Memtable flushes are not filtered.  The second, overlapping table is
+  // placed above the first one, so that compacting it merges both.
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("z", "vz"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(0, filter.calls);
+  ASSERT_EQ("v3", Get("remove1"));
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_GT(filter.calls, 0);
+  ASSERT_EQ("changed", Get("change1"));
+  ASSERT_EQ("v2", Get("keep1"));
+  ASSERT_EQ("NOT_FOUND", Get("remove1"));
+
+  // The snapshot keeps the older value of remove2, which must remain
+  // hidden by the removal of the newer one
+  ASSERT_EQ("NOT_FOUND", Get("remove2"));
+  ASSERT_EQ("old", Get("remove2", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("NOT_FOUND", Get("remove2"));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  std::string contents;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    contents += "(" + iter->key().ToString() + "->" +
+                iter->value().ToString() + ")";
+  }
+  delete iter;
+  ASSERT_EQ("(a->va)(change1->changed)(keep1->v2)(z->vz)", contents);
+
+  Reopen();
+}
+
+TEST(DBTest, CompactionFilterTTL) {
+  const CompactionFilter* filter = NewTTLCompactionFilter(100);
+  Options options;
+  options.create_if_missing = true;
+  options.compaction_filter = filter;
+  DestroyAndReopen(&options);
+
+  std::string fresh = "fresh";
+  AppendTTLTimestamp(&fresh);
+  std::string expired = "expired";
+  AppendTTLTimestamp(&expired);
+  const size_t n = expired.size() - 4;
+  EncodeFixed32(&expired[n], DecodeFixed32(expired.data() + n) - 1000);
+  ASSERT_OK(Put("b", expired));
+  ASSERT_OK(Put("y", fresh));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("a", fresh));
+  ASSERT_OK(Put("z", fresh));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(expired, Get("b"));
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  const std::string value = Get("y");
+  Slice v = value;
+  uint32_t timestamp;
+  ASSERT_TRUE(StripTTLTimestamp(&v, &timestamp));
+  ASSERT_EQ("fresh", v.ToString());
+  ASSERT_GT(timestamp, 0);
+
+  Reopen();
+  delete filter;
+}
+
+namespace {
+// Appends operands to the value, separated by commas
+class AppendOperator : public MergeOperator {
+ public:
+  virtual bool Merge(const Slice& key, const Slice* existing_value,
+                     const Slice& value, std::string* new_value) const {
+    new_value->clear();
+    if (existing_value != NULL) {
+      new_value->assign(existing_value->data(), existing_value->size());
+      new_value->push_back(',');
+    }
+    new_value->append(value.data(), value.size());
+    return true;
+  }
+  virtual const char* Name() const { return "AppendOperator"; }
+};
+
+std::string IterContents(DB* db, bool reverse) {
+  Iterator* iter = db->NewIterator(ReadOptions());
+  std::string contents;
+  if (reverse) {
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      contents += "(" + iter->key().ToString() + "->" +
+                  iter->value().ToString() + ")";
+    }
+  } else {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      contents += "(" + iter->key().ToString() + "->" +
+                  iter->value().ToString() + ")";
+    }
+  }
+  delete iter;
+  return contents;
+}
+}
+
+TEST(DBTest, MergeOperator) {
+  ASSERT_TRUE(!db_->Merge(WriteOptions(), "a", "1").ok());
+
+  AppendOperator append;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &append;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "x"));
+  ASSERT_OK(Put("c", "old"));
+  ASSERT_OK(Delete("c"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "y"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "3"));
+  ASSERT_OK(Put("d", "v"));
+  const std::string expected = "(a->1,2,3)(b->x)(c->y)(d->v)";
+  ASSERT_EQ("1,2,3", Get("a"));
+  ASSERT_EQ("x", Get("b"));
+  ASSERT_EQ("y", Get("c"));
+  ASSERT_EQ(expected, IterContents(db_, false));
+  ASSERT_EQ("(d->v)(c->y)(b->x)(a->1,2,3)", IterContents(db_, true));
+
+  // Switch directions on a merged entry
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_EQ("x", iter->value().ToString());
+  iter->Prev();
+  ASSERT_EQ("1,2,3", iter->value().ToString());
+  iter->Next();
+  ASSERT_EQ("b", iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ("c", iter->key().ToString());
+  ASSERT_EQ("y", iter->value().ToString());
+  iter->Prev();
+  ASSERT_EQ("b", iter->key().ToString());
+  delete iter;
+
+  // Operands in tables are combined the same way
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("[ +3, +2, 1 ]", AllEntriesFor("a"));
+  ASSERT_EQ("1,2,3", Get("a"));
+  ASSERT_EQ(expected, IterContents(db_, false));
+
+  // Operands spread over the memtable and several levels
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "4"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "z"));
+  ASSERT_EQ("1,2,3,4", Get("a"));
+  ASSERT_EQ("(a->1,2,3,4)(b->x,z)(c->y)(d->v)", IterContents(db_, false));
+  ASSERT_EQ("(d->v)(c->y)(b->x,z)(a->1,2,3,4)", IterContents(db_, true));
+
+  Reopen(&options);
+  ASSERT_EQ("1,2,3,4", Get("a"));
+  ASSERT_EQ("x,z", Get("b"));
+}
+
+TEST(DBTest, BlobFilesWithMerge) {
+  AppendOperator append;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &append;
+  options.min_blob_size = 1000;
+  DestroyAndReopen(&options);
+
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(Put(Key(i), std::string(10000, 'x')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, CountFiles(env_, dbname_, kBlobFile));
+
+  // Merging into every blob value leaves its old blob file all garbage
+  for (int i = 0; i < 50; i++) {
+    ASSERT_OK(db_->Merge(WriteOptions(), Key(i), "m"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(NULL, NULL);
+  ASSERT_OK(dbfull()->TEST_WaitForCompact());
+  ASSERT_EQ(1, CountFiles(env_, dbname_, kBlobFile));
+
+  Reopen(&options);
+  for (int i = 0; i < 50; i++) {
+    ASSERT_EQ(std::string(10000, 'x') + ",m", Get(Key(i)));
+  }
+}
+
+TEST(DBTest, MergeOperatorCompaction) {
+  AppendOperator append;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &append;
+  DestroyAndReopen(&options);
+
+  // A base value in a deep level
+  ASSERT_OK(Put("a", "1"));
+  ASSERT_OK(Put("z", "v"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ(1, NumTableFilesAtLevel(2));
+
+  // Operands without their base are combined into a single operand
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "3"));
+  ASSERT_OK(Put("b", "v"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("a0", "v"));
+  ASSERT_OK(Put("c", "v"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ("[ +2,3, 1 ]", AllEntriesFor("a"));
+  ASSERT_EQ("1,2,3", Get("a"));
+
+  // A snapshot keeps the operands it can see apart from newer ones
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "4"));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ +4, 1,2,3 ]", AllEntriesFor("a"));
+  ASSERT_EQ("1,2,3", Get("a", snapshot));
+  ASSERT_EQ("1,2,3,4", Get("a"));
+
+  // Once the snapshot is gone all operands are combined with the value
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_OK(Put("0", "v"));
+  ASSERT_OK(Put("zz", "v"));
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ 1,2,3,4 ]", AllEntriesFor("a"));
+  ASSERT_EQ("(0->v)(a->1,2,3,4)(a0->v)(b->v)(c->v)(z->v)(zz->v)",
+            IterContents(db_, false));
+
+  Reopen(&options);
+}
+
+TEST(DBTest, DeleteRange) {
+  AppendOperator append;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &append;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(Put("c", "vc"));
+  ASSERT_OK(Put("d", "vd"));
+  ASSERT_OK(Put("e", "ve"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+  ASSERT_OK(Put("c", "vc2"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "1"));
+
+  // The deletion hides older entries in the memtable, in tables and
+  // after recovery, but not the snapshot's view or newer entries
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("1", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ(i < 2 ? "vb" : "1", Get("b", snapshot));
+    ASSERT_EQ("(a->va)(b->1)(c->vc2)(d->vd)(e->ve)", IterContents(db_, false));
+    ASSERT_EQ("(e->ve)(d->vd)(c->vc2)(b->1)(a->va)", IterContents(db_, true));
+    if (i == 0) {
+      dbfull()->TEST_CompactMemTable();
+    } else if (i == 1) {
+      db_->ReleaseSnapshot(snapshot);
+      Reopen(&options);
+      snapshot = db_->GetSnapshot();
+      ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "c"));
+      ASSERT_OK(db_->Merge(WriteOptions(), "b", "1"));
+      ASSERT_OK(Put("a", "va"));
+    }
+  }
+  ASSERT_EQ("vd", Get("d", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Compactions drop the covered entries
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "e"));
+  ASSERT_OK(Put("0", "v"));
+  ASSERT_OK(Put("z", "v"));
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ ]", AllEntriesFor("d"));
+  ASSERT_EQ("(0->v)(e->ve)(z->v)", IterContents(db_, false));
+  ASSERT_EQ("(z->v)(e->ve)(0->v)", IterContents(db_, true));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+}
+
+TEST(DBTest, DeleteRangeDropsFiles) {
+  Options options;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "k%03d", i);
+    ASSERT_OK(Put(key, std::string(1000, 'x')));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // The level-2 file is dropped without being read, and the deletion
+  // itself is obsolete once it has been compacted to the last level
+  // holding the range
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "k", "l"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get("k050"));
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get("k050"));
+  ASSERT_EQ("", IterContents(db_, false));
+
+  Reopen(&options);
+  ASSERT_EQ("NOT_FOUND", Get("k050"));
+}
+
+TEST(DBTest, IngestExternalFile) {
+  Options options;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  Env* env = Env::Default();
+  std::vector<std::string> files;
+  files.push_back(test::TmpDir() + "/ingest1.sst");
+  files.push_back(test::TmpDir() + "/ingest2.sst");
+  SstFileWriter writer(options);
+  ASSERT_OK(writer.Open(files[0]));
+  ASSERT_OK(writer.Put("a", "va"));
+  ASSERT_TRUE(!writer.Put("a", "va2").ok());
+  ASSERT_OK(writer.Put("b", "vb"));
+  ASSERT_OK(writer.Finish());
+  ASSERT_OK(writer.Open(files[1]));
+  ASSERT_OK(writer.Put("b", "vb2"));
+  ASSERT_OK(writer.Finish());
+
+  // The files must not overlap
+  ASSERT_TRUE(!db_->IngestExternalFile(files,
+                                       IngestExternalFileOptions()).ok());
+  ASSERT_EQ("", FilesPerLevel());
+
+  // Files that overlap nothing are linked into the last level
+  ASSERT_OK(writer.Open(files[1]));
+  ASSERT_OK(writer.Put("c", "vc"));
+  ASSERT_OK(writer.Delete("d"));
+  ASSERT_OK(writer.Finish());
+  ASSERT_OK(db_->IngestExternalFile(files, IngestExternalFileOptions()));
+  ASSERT_EQ("0,0,0,0,0,0,2", FilesPerLevel());
+  ASSERT_TRUE(env->FileExists(files[0]));
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vc", Get("c"));
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+
+  // Files that overlap the DB override it, also the memtable
+  ASSERT_OK(Put("c", "old"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(writer.Open(files[0]));
+  ASSERT_OK(writer.Put("c", "new"));
+  ASSERT_OK(writer.Finish());
+  IngestExternalFileOptions move;
+  move.move_files = true;
+  ASSERT_OK(db_->IngestExternalFile(std::vector<std::string>(1, files[0]),
+                                    move));
+  ASSERT_EQ("0,1,1,0,0,0,2", FilesPerLevel());
+  ASSERT_TRUE(!env->FileExists(files[0]));
+  ASSERT_EQ("new", Get("c"));
+  ASSERT_EQ("old", Get("c", snapshot));
+  ASSERT_EQ("va", Get("a"));
+  db_->ReleaseSnapshot(snapshot);
+
+  Reopen(&options);
+  ASSERT_EQ("new", Get("c"));
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("(a->va)(b->vb)(c->new)", IterContents(db_, false));
+  ASSERT_OK(Put("d", "vd"));
+  ASSERT_EQ("vd", Get("d"));
+  env->DeleteFile(files[1]);
+}
+
+TEST(DBTest, Checkpoint) {
+  Options options;
+  options.create_if_missing = true;
+  options.use_column_families = true;
+  DestroyAndReopen(&options);
+
+  Env* env = Env::Default();
+  const std::string dir = test::TmpDir() + "/db_checkpoint";
+  DestroyDB(dir, options);
+
+  ColumnFamilyHandle* cf;
+  ASSERT_OK(db_->CreateColumnFamily("pikachu", &cf));
+  ASSERT_OK(Put("a", "v1"));
+  ASSERT_OK(db_->Put(WriteOptions(), cf, "b", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("c", "v3"));           // Only in the memtable
+  ASSERT_OK(Checkpoint::Create(db_, dir));
+  ASSERT_TRUE(!Checkpoint::Create(db_, dir).ok());
+
+  // Later changes to the DB do not reach the checkpoint, even when the
+  // files it shares are compacted away
+  ASSERT_OK(Put("a", "v4"));
+  ASSERT_OK(Delete("c"));
+  db_->CompactRange(NULL, NULL);
+
+  // The checkpoint does not depend on the DB staying open
+  delete db_;
+  db_ = NULL;
+  DB* checkpoint;
+  ASSERT_OK(DB::Open(options, dir, &checkpoint));
+  std::string value;
+  ASSERT_OK(checkpoint->Get(ReadOptions(), "a", &value));
+  ASSERT_EQ("v1", value);
+  ASSERT_OK(checkpoint->Get(ReadOptions(), "c", &value));
+  ASSERT_EQ("v3", value);
+  ASSERT_OK(checkpoint->GetColumnFamily("pikachu", &cf));
+  ASSERT_OK(checkpoint->Get(ReadOptions(), cf, "b", &value));
+  ASSERT_EQ("v2", value);
+  delete checkpoint;
+  ASSERT_TRUE(!env->FileExists(dir + ".tmp"));
+  DestroyDB(dir, options);
+  Reopen(&options);
+  ASSERT_EQ("v4", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+}
+
+TEST(DBTest, CheckpointOfDbPaths) {
+  Options options;
+  options.create_if_missing = true;
+  options.write_buffer_size = 100000;
+  options.wal_dir = dbname_ + "_wal";
+  options.db_paths.push_back(DbPath(dbname_ + "_fast", 1 << 20));
+  options.db_paths.push_back(DbPath(dbname_ + "_slow", 1ull << 40));
+  delete db_;
+  db_ = NULL;
+  DestroyDB(dbname_, options);
+  DestroyAndReopen(&options);
+
+  const std::string dir = test::TmpDir() + "/db_checkpoint";
+  Options copy_options = options;
+  copy_options.wal_dir.clear();
+  copy_options.db_paths.clear();
+  DestroyDB(dir, copy_options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), std::string(10000, 'x')));
+  }
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_GT(CountFiles(env_, dbname_ + "_slow", kTableFile), 0);
+  ASSERT_OK(Put("foo", "v1"));             // Only in the memtable
+  ASSERT_OK(Checkpoint::Create(db_, dir));
+  const int slow_tables = CountFiles(env_, dbname_ + "_slow", kTableFile);
+  delete db_;
+  db_ = NULL;
+
+  // The checkpoint holds all of its tables, and leaves those of the DB
+  DB* checkpoint;
+  ASSERT_OK(DB::Open(copy_options, dir, &checkpoint));
+  std::string value;
+  ASSERT_OK(checkpoint->Get(ReadOptions(), "foo", &value));
+  ASSERT_EQ("v1", value);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(checkpoint->Get(ReadOptions(), Key(i), &value));
+    ASSERT_EQ(std::string(10000, 'x'), value);
+  }
+  delete checkpoint;
+  DestroyDB(dir, copy_options);
+  ASSERT_EQ(slow_tables, CountFiles(env_, dbname_ + "_slow", kTableFile));
+
+  Reopen(&options);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ(std::string(10000, 'x'), Get(Key(7)));
+  delete db_;
+  db_ = NULL;
+  ASSERT_OK(DestroyDB(dbname_, options));
+}
+
+TEST(DBTest, DisableFileDeletions) {
+  Options options;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  ASSERT_OK(Put("a", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  std::vector<std::string> files;
+  uint64_t manifest_file_size;
+  ASSERT_OK(db_->GetLiveFiles(&files, &manifest_file_size, false));
+  ASSERT_EQ(3, static_cast<int>(files.size()));  // Table, MANIFEST, CURRENT
+  ASSERT_GT(manifest_file_size, static_cast<uint64_t>(0));
+
+  // The table stays while deletions are disabled, twice
+  ASSERT_OK(db_->DisableFileDeletions());
+  ASSERT_OK(db_->DisableFileDeletions());
+  ASSERT_OK(Put("a", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(NULL, NULL);
+  ASSERT_TRUE(env_->FileExists(files[0]));
+  ASSERT_OK(db_->EnableFileDeletions());
+  ASSERT_TRUE(env_->FileExists(files[0]));
+  ASSERT_OK(db_->EnableFileDeletions());
+  ASSERT_TRUE(!env_->FileExists(files[0]));
+  ASSERT_TRUE(!db_->EnableFileDeletions().ok());
+  ASSERT_EQ("v2", Get("a"));
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -30,6 +30,20 @@ std::string TableFileName(const std::string& name, uint64_t number) {
   return MakeFileName(name, number, "sst");
 }
 
+std::string TableFileName(const std::vector<DbPath>& db_paths,
+                          uint64_t number, uint32_t path_id) {
+  assert(!db_paths.empty());
+  if (path_id >= db_paths.size()) {
+    path_id = db_paths.size() - 1;
+  }
+  return TableFileName(db_paths[path_id].path, number);
+}
+
+std::string BlobFileName(const std::string& dbname, uint64_t number) {
+  assert(number > 0);
+  return MakeFileName(dbname, number, "blob");
+}
+
 std::string DescriptorFileName(const std::string& dbname, uint64_t number) {
   assert(number > 0);
   char buf[100];
@@ -67,7 +81,7 @@ std::string OldInfoLogFileName(const std::string& dbname) {
 //    dbname/LOG
 //    dbname/LOG.old
 //    dbname/MANIFEST-[0-9]+
-//    dbname/[0-9]+.(log|sst)
+//    dbname/[0-9]+.(log|sst|blob)
 bool ParseFileName(const std::string& fname,
                    uint64_t* number,
                    FileType* type) {
@@ -104,6 +118,8 @@ bool ParseFileName(const std::string& fname,
       *type = kLogFile;
     } else if (suffix == Slice(".sst")) {
       *type = kTableFile;
+    } else if (suffix == Slice(".blob")) {
+      *type = kBlobFile;
     } else if (suffix == Slice(".dbtmp")) {
       *type = kTempFile;
     } else {
@@ -9,6 +9,8 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 #include "port/port.h"
@@ -24,7 +26,8 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile, // Either the current one, or an old one
+  kBlobFile
 };
 
 // Return the name of the log file with the specified number
@@ -37,6 +40,18 @@ extern std::string LogFileName(const std::string& dbname, uint64_t number);
 // "dbname".
 extern std::string TableFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the sstable with the specified number in the
+// directory "path_id" of "db_paths" (see Options::db_paths).  A path id
+// beyond the end of "db_paths" stands for the last directory.
+// REQUIRES: "db_paths" is not empty
+extern std::string TableFileName(const std::vector<DbPath>& db_paths,
+                                 uint64_t number, uint32_t path_id);
+
+// Return the name of the blob file (see db/blob_file.h) with the
+// specified number in the db named by "dbname".  The result will be
+// prefixed with "dbname".
+extern std::string BlobFileName(const std::string& dbname, uint64_t number);
+
 // Return the name of the descriptor file for the db named by
 // "dbname" and the specified incarnation number.  The result will be
 // prefixed with "dbname".
@@ -16,7 +16,7 @@ Reader::Reporter::~Reporter() {
 }
 
 Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-               uint64_t initial_offset)
+               uint64_t initial_offset, uint64_t log_number)
     : file_(file),
       reporter_(reporter),
       checksum_(checksum),
@@ -25,7 +25,9 @@ Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
       eof_(false),
       last_record_offset_(0),
       end_of_buffer_offset_(0),
-      initial_offset_(initial_offset) {
+      initial_offset_(initial_offset),
+      log_number_(log_number),
+      recycled_(false) {
 }
 
 Reader::~Reader() {
@@ -176,6 +178,12 @@ void Reader::ReportDrop(size_t bytes, const Status& reason) {
   }
 }
 
+unsigned int Reader::EndOfRecycledLog() {
+  buffer_.clear();
+  eof_ = true;
+  return kEof;
+}
+
 unsigned int Reader::ReadPhysicalRecord(Slice* result) {
   while (true) {
     if (buffer_.size() < kHeaderSize) {
@@ -196,6 +204,8 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
       } else if (buffer_.size() == 0) {
         // End of file
         return kEof;
+      } else if (recycled_) {
+        return EndOfRecycledLog();
       } else {
         size_t drop_size = buffer_.size();
         buffer_.clear();
@@ -208,9 +218,16 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     const char* header = buffer_.data();
     const uint32_t a = static_cast<uint32_t>(header[4]) & 0xff;
     const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
-    const unsigned int type = header[6];
+    unsigned int type = static_cast<unsigned char>(header[6]);
     const uint32_t length = a | (b << 8);
-    if (kHeaderSize + length > buffer_.size()) {
+    const bool recyclable = (type >= kRecyclableFullType &&
+                             type <= kRecyclableLastType);
+    const size_t header_size = recyclable ? kRecyclableHeaderSize
+                                          : kHeaderSize;
+    if (header_size + length > buffer_.size()) {
+      if (recycled_) {
+        return EndOfRecycledLog();
+      }
       size_t drop_size = buffer_.size();
       buffer_.clear();
       ReportCorruption(drop_size, "bad record length");
@@ -227,9 +244,15 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
 
     // Check crc
     if (checksum_) {
+      // The crc covers the type, the log number if any, and the payload,
+      // which are contiguous in the record.
       uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
-      uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+      uint32_t actual_crc = crc32c::Value(header + 6,
+                                          header_size - 6 + length);
       if (actual_crc != expected_crc) {
+        if (recycled_) {
+          return EndOfRecycledLog();
+        }
         // Drop the rest of the buffer since "length" itself may have
         // been corrupted and if we trust it, we could find some
         // fragment of a real log record that just happens to look
@@ -241,16 +264,30 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
       }
     }
 
-    buffer_.remove_prefix(kHeaderSize + length);
+    if (recyclable) {
+      // A record of another log is left over from an earlier use of the
+      // file, as is a plain record that follows recyclable ones.
+      const uint32_t log_number = DecodeFixed32(header + 7);
+      if (log_number_ != 0 &&
+          log_number != static_cast<uint32_t>(log_number_)) {
+        return EndOfRecycledLog();
+      }
+      recycled_ = true;
+      type -= kRecyclableFullType - kFullType;
+    } else if (recycled_ && type <= kMaxRecordType) {
+      return EndOfRecycledLog();
+    }
+
+    buffer_.remove_prefix(header_size + length);
 
     // Skip physical record that started before initial_offset_
-    if (end_of_buffer_offset_ - buffer_.size() - kHeaderSize - length <
+    if (end_of_buffer_offset_ - buffer_.size() - header_size - length <
         initial_offset_) {
       result->clear();
       return kBadRecord;
     }
 
-    *result = Slice(header + kHeaderSize, length);
+    *result = Slice(header + header_size, length);
     return type;
   }
 }
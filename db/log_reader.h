@@ -40,8 +40,12 @@ class Reader {
   //
   // The Reader will start reading at the first record located at physical
   // position >= initial_offset within the file.
+  //
+  // If "log_number" is non-zero, it is the number of the log in "*file",
+  // and records of recyclable logs that carry another log number are
+  // taken to be stale records left by an earlier use of the file.
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-         uint64_t initial_offset);
+         uint64_t initial_offset, uint64_t log_number = 0);
 
   ~Reader();
 
@@ -73,6 +77,14 @@ class Reader {
   // Offset at which to start looking for the first record to return
   uint64_t const initial_offset_;
 
+  uint64_t const log_number_;
+
+  // Whether a record of a recyclable log has been read.  The data that
+  // follows the last record of such a log may be left over from the log
+  // the file held before, so anything that does not parse ends the log
+  // rather than being reported as a corruption.
+  bool recycled_;
+
   // Extend record types with the following special values
   enum {
     kEof = kMaxRecordType + 1,
@@ -89,9 +101,14 @@ class Reader {
   // Returns true on success. Handles reporting.
   bool SkipToInitialBlock();
 
-  // Return type, or one of the preceding special values
+  // Return type, or one of the preceding special values.  The types of
+  // recyclable records are mapped to the matching plain types.
   unsigned int ReadPhysicalRecord(Slice* result);
 
+  // Drop the rest of the file, which is left over from an earlier use of
+  // a recycled log.  Returns kEof.
+  unsigned int EndOfRecycledLog();
+
   // Reports dropped bytes to the reporter.
   // buffer_ must be updated to remove the dropped bytes prior to invocation.
   void ReportCorruption(size_t bytes, const char* reason);
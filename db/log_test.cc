@@ -104,8 +104,9 @@ class LogTest {
   StringSource source_;
   ReportCollector report_;
   bool reading_;
-  Writer writer_;
-  Reader reader_;
+  Writer* writer_;
+  Reader* reader_;
+  std::string stale_;   // Contents of the file before it was recycled
 
   // Record metadata for testing initial offset functionality
   static size_t initial_offset_record_sizes_[];
@@ -113,14 +114,32 @@ class LogTest {
 
  public:
   LogTest() : reading_(false),
-              writer_(&dest_),
-              reader_(&source_, &report_, true/*checksum*/,
-                      0/*initial_offset*/) {
+              writer_(new Writer(&dest_)),
+              reader_(new Reader(&source_, &report_, true/*checksum*/,
+                                 0/*initial_offset*/)) {
+  }
+
+  ~LogTest() {
+    delete writer_;
+    delete reader_;
+  }
+
+  // Start writing the recyclable log "log_number" over the beginning of
+  // the file, keeping what was written so far after the new records.
+  void RecycleLog(uint64_t log_number) {
+    ASSERT_TRUE(!reading_) << "RecycleLog() after starting to read";
+    stale_ = dest_.contents_;
+    dest_.contents_.clear();
+    delete writer_;
+    writer_ = new Writer(&dest_, log_number, true/*recyclable*/);
+    delete reader_;
+    reader_ = new Reader(&source_, &report_, true/*checksum*/,
+                         0/*initial_offset*/, log_number);
   }
 
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
-    writer_.AddRecord(Slice(msg));
+    writer_->AddRecord(Slice(msg));
   }
 
   size_t WrittenBytes() const {
@@ -130,11 +149,15 @@ class LogTest {
   std::string Read() {
     if (!reading_) {
       reading_ = true;
+      if (dest_.contents_.size() < stale_.size()) {
+        dest_.contents_.append(stale_, dest_.contents_.size(),
+                               std::string::npos);
+      }
       source_.contents_ = Slice(dest_.contents_);
     }
     std::string scratch;
     Slice record;
-    if (reader_.ReadRecord(&record, &scratch)) {
+    if (reader_->ReadRecord(&record, &scratch)) {
       return record.ToString();
     } else {
       return "EOF";
@@ -438,6 +461,63 @@ TEST(LogTest, ErrorJoinsRecords) {
   ASSERT_GE(dropped, 2*kBlockSize);
 }
 
+TEST(LogTest, RecyclableReadWrite) {
+  RecycleLog(7);
+  Write("foo");
+  Write("");
+  Write(BigString("bar", 3 * kBlockSize));
+  Write("xxxx");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ(BigString("bar", 3 * kBlockSize), Read());
+  ASSERT_EQ("xxxx", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecyclableChecksumMismatch) {
+  RecycleLog(7);
+  Write("foo");
+  IncrementByte(kRecyclableHeaderSize, 1);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(kRecyclableHeaderSize + 3, DroppedBytes());
+  ASSERT_EQ("OK", MatchError("checksum mismatch"));
+}
+
+TEST(LogTest, RecycledLogEndsAtStaleRecord) {
+  RecycleLog(7);
+  Write("foo");
+  Write("bar");
+  Write("baz");
+  RecycleLog(8);
+  Write("xyz");  // Same size as the records of log 7
+  ASSERT_EQ("xyz", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogEndsAtStaleFragment) {
+  RecycleLog(7);
+  Write(BigString("foo", 1000));
+  Write(BigString("bar", 1000));
+  RecycleLog(8);
+  Write("xyz");  // Ends in the middle of a record of log 7
+  ASSERT_EQ("xyz", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogEndsAtPlainRecord) {
+  Write("fooba");
+  Write("fooba");
+  RecycleLog(8);
+  Write("x");  // Same size as the plain records
+  ASSERT_EQ("x", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
 TEST(LogTest, ReadStart) {
   CheckInitialOffsetRecord(0, 0);
 }
@@ -14,7 +14,25 @@ namespace log {
 
 Writer::Writer(WritableFile* dest)
     : dest_(dest),
-      block_offset_(0) {
+      block_offset_(0),
+      size_(0),
+      log_number_(0),
+      recyclable_(false),
+      header_size_(kHeaderSize) {
+  Init();
+}
+
+Writer::Writer(WritableFile* dest, uint64_t log_number, bool recyclable)
+    : dest_(dest),
+      block_offset_(0),
+      size_(0),
+      log_number_(log_number),
+      recyclable_(recyclable),
+      header_size_(recyclable ? kRecyclableHeaderSize : kHeaderSize) {
+  Init();
+}
+
+void Writer::Init() {
   for (int i = 0; i <= kMaxRecordType; i++) {
     char t = static_cast<char>(i);
     type_crc_[i] = crc32c::Value(&t, 1);
@@ -36,20 +54,21 @@ Status Writer::AddRecord(const Slice& slice) {
   do {
     const int leftover = kBlockSize - block_offset_;
     assert(leftover >= 0);
-    if (leftover < kHeaderSize) {
+    if (leftover < header_size_) {
       // Switch to a new block
       if (leftover > 0) {
-        // Fill the trailer (literal below relies on kHeaderSize being 7)
-        assert(kHeaderSize == 7);
-        dest_->Append(Slice("\x00\x00\x00\x00\x00\x00", leftover));
+        // Fill the trailer
+        static const char kTrailer[kRecyclableHeaderSize] = { 0 };
+        dest_->Append(Slice(kTrailer, leftover));
+        size_ += leftover;
       }
       block_offset_ = 0;
     }
 
-    // Invariant: we never leave < kHeaderSize bytes in a block.
-    assert(kBlockSize - block_offset_ - kHeaderSize >= 0);
+    // Invariant: we never leave < header_size_ bytes in a block.
+    assert(kBlockSize - block_offset_ - header_size_ >= 0);
 
-    const size_t avail = kBlockSize - block_offset_ - kHeaderSize;
+    const size_t avail = kBlockSize - block_offset_ - header_size_;
     const size_t fragment_length = (left < avail) ? left : avail;
 
     RecordType type;
@@ -74,28 +93,38 @@ Status Writer::AddRecord(const Slice& slice) {
 
 Status Writer::EmitPhysicalRecord(RecordType t, const char* ptr, size_t n) {
   assert(n <= 0xffff);  // Must fit in two bytes
-  assert(block_offset_ + kHeaderSize + n <= kBlockSize);
+  assert(block_offset_ + header_size_ + n <= kBlockSize);
 
   // Format the header
-  char buf[kHeaderSize];
+  char buf[kRecyclableHeaderSize];
   buf[4] = static_cast<char>(n & 0xff);
   buf[5] = static_cast<char>(n >> 8);
-  buf[6] = static_cast<char>(t);
 
-  // Compute the crc of the record type and the payload.
-  uint32_t crc = crc32c::Extend(type_crc_[t], ptr, n);
+  // Compute the crc of the record type, the log number and the payload.
+  uint32_t crc;
+  if (recyclable_) {
+    t = static_cast<RecordType>(t + (kRecyclableFullType - kFullType));
+    buf[6] = static_cast<char>(t);
+    EncodeFixed32(buf + 7, static_cast<uint32_t>(log_number_));
+    crc = crc32c::Extend(type_crc_[t], buf + 7, 4);
+  } else {
+    buf[6] = static_cast<char>(t);
+    crc = type_crc_[t];
+  }
+  crc = crc32c::Extend(crc, ptr, n);
   crc = crc32c::Mask(crc);                 // Adjust for storage
   EncodeFixed32(buf, crc);
 
   // Write the header and the payload
-  Status s = dest_->Append(Slice(buf, kHeaderSize));
+  Status s = dest_->Append(Slice(buf, header_size_));
   if (s.ok()) {
     s = dest_->Append(Slice(ptr, n));
     if (s.ok()) {
       s = dest_->Flush();
     }
   }
-  block_offset_ += kHeaderSize + n;
+  block_offset_ += header_size_ + n;
+  size_ += header_size_ + n;
   return s;
 }
 
@@ -22,13 +22,26 @@ class Writer {
   // "*dest" must be initially empty.
   // "*dest" must remain live while this Writer is in use.
   explicit Writer(WritableFile* dest);
+
+  // Create a writer for log "log_number".  If "recyclable" is true, the
+  // records carry the log number so that a reader of a reused file can
+  // tell them from the stale records of an earlier log.
+  Writer(WritableFile* dest, uint64_t log_number, bool recyclable);
+
   ~Writer();
 
   Status AddRecord(const Slice& slice);
 
+  // Number of bytes appended to "*dest" so far
+  uint64_t Size() const { return size_; }
+
  private:
   WritableFile* dest_;
   int block_offset_;       // Current offset in block
+  uint64_t size_;
+  uint64_t log_number_;
+  bool recyclable_;
+  int header_size_;
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
@@ -40,6 +53,8 @@ class Writer {
   // No copying allowed
   Writer(const Writer&);
   void operator=(const Writer&);
+
+  void Init();
 };
 
 }
@@ -21,7 +21,8 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 MemTable::MemTable(const InternalKeyComparator& cmp)
     : comparator_(cmp),
       refs_(0),
-      table_(comparator_, &arena_) {
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_) {
 }
 
 MemTable::~MemTable() {
@@ -79,6 +80,15 @@ Iterator* MemTable::NewIterator() {
   return new MemTableIterator(&table_);
 }
 
+Iterator* MemTable::NewRangeDeletionIterator() {
+  Table::Iterator iter(&range_del_table_);
+  iter.SeekToFirst();
+  if (!iter.Valid()) {
+    return NULL;
+  }
+  return new MemTableIterator(&range_del_table_);
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type,
                    const Slice& key,
                    const Slice& value) {
@@ -102,14 +112,53 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert((p + val_size) - buf == encoded_len);
-  table_.Insert(buf);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.Insert(buf);
+  } else {
+    table_.Insert(buf);
+  }
+}
+
+SequenceNumber MemTable::MaxCoveringDeletion(const Slice& user_key,
+                                             SequenceNumber snapshot) {
+  // Range deletions are few: look at all those that start at or before
+  // user_key.
+  const Comparator* ucmp = comparator_.comparator.user_comparator();
+  SequenceNumber result = 0;
+  Table::Iterator iter(&range_del_table_);
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    const char* entry = iter.key();
+    uint32_t key_length;
+    const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
+    if (ucmp->Compare(Slice(key_ptr, key_length - 8), user_key) > 0) {
+      break;
+    }
+    const SequenceNumber seq = DecodeFixed64(key_ptr + key_length - 8) >> 8;
+    if (seq <= snapshot && seq > result &&
+        ucmp->Compare(user_key, GetLengthPrefixedSlice(key_ptr + key_length))
+            < 0) {
+      result = seq;
+    }
+  }
+  return result;
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   std::vector<std::string>* merge_operands,
+                   SequenceNumber* max_covering_deletion) {
+  const Slice ikey = key.internal_key();
+  const SequenceNumber snapshot =
+      DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
+  const SequenceNumber covering = MaxCoveringDeletion(key.user_key(),
+                                                      snapshot);
+  if (covering > *max_covering_deletion) {
+    *max_covering_deletion = covering;
+  }
+
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  while (iter.Valid()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -124,20 +173,43 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
             Slice(key_ptr, key_length - 8),
-            key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
+            key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    if ((tag >> 8) < *max_covering_deletion) {
+      // The entry and all older ones are covered by a range deletion
+      *s = Status::NotFound(Slice());
+      return true;
+    }
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue: {
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        value->assign(v.data(), v.size());
+        return true;
       }
+      case kTypeDeletion:
+        *s = Status::NotFound(Slice());
+        return true;
+      case kTypeMerge: {
+        // Keep looking for the value the operand applies to
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        merge_operands->push_back(v.ToString());
+        break;
+      }
+      case kTypeRangeDeletion:
+        break;
+      case kTypeBlobIndex:
+        // Values are only moved to blob files when tables are written
+        assert(false);
+        break;
     }
+    iter.Next();
+  }
+  if (*max_covering_deletion > 0) {
+    *s = Status::NotFound(Slice());
+    return true;
   }
   return false;
 }
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
 #include <string>
+#include <vector>
 #include "leveldb/db.h"
 #include "db/dbformat.h"
 #include "db/skiplist.h"
@@ -50,9 +51,15 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range deletions of the memtable, which
+  // NewIterator() does not yield, or NULL if there are none.  Its keys
+  // are internal keys of type kTypeRangeDeletion (see db/range_del.h).
+  Iterator* NewRangeDeletionIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  For
+  // kTypeRangeDeletion, key and value are the bounds of the range.
   void Add(SequenceNumber seq, ValueType type,
            const Slice& key,
            const Slice& value);
@@ -61,7 +68,18 @@ class MemTable {
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  //
+  // Merge operands for key that are newer than the value or deletion
+  // are appended to *merge_operands, newest first.
+  //
+  // *max_covering_deletion is the largest sequence number of the range
+  // deletions covering key in newer memtables, and is raised by those of
+  // this one.  Older entries count as deleted, and if it is non-zero
+  // the older memtables and tables need not be searched: the result is
+  // true even if this memtable holds no entry for key.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           std::vector<std::string>* merge_operands,
+           SequenceNumber* max_covering_deletion);
 
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
@@ -76,10 +94,16 @@ class MemTable {
 
   typedef SkipList<const char*, KeyComparator> Table;
 
+  // Return the largest sequence number no larger than "snapshot" of the
+  // range deletions that cover user_key, or zero.
+  SequenceNumber MaxCoveringDeletion(const Slice& user_key,
+                                     SequenceNumber snapshot);
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;
 
   // No copying allowed
   MemTable(const MemTable&);
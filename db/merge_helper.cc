@@ -0,0 +1,45 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include "db/column_family.h"
+
+namespace leveldb {
+
+MergeOperator::~MergeOperator() { }
+
+Status MergeHelper::Apply(const Slice& key, const Slice* existing,
+                          const Slice& operand, std::string* result) const {
+  if (op_ == NULL) {
+    return Status::NotSupported("merge operand without a merge operator");
+  }
+  Slice user_key = key;
+  if (column_families_) {
+    uint32_t id;
+    if (!ParseColumnFamilyKey(key, &id, &user_key)) {
+      return Status::Corruption("bad column family key for merge");
+    }
+  }
+  std::string merged;
+  if (!op_->Merge(user_key, existing, operand, &merged)) {
+    return Status::Corruption("merge failed for ", user_key);
+  }
+  result->swap(merged);
+  return Status::OK();
+}
+
+Status MergeHelper::ApplyAll(const Slice& key, const Slice* base,
+                             const std::vector<std::string>& operands,
+                             std::string* result) const {
+  assert(!operands.empty());
+  Status s = Apply(key, base, operands.back(), result);
+  for (size_t i = operands.size() - 1; s.ok() && i > 0; i--) {
+    Slice existing = *result;
+    s = Apply(key, &existing, operands[i - 1], result);
+  }
+  return s;
+}
+
+}
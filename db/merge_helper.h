@@ -0,0 +1,46 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <string>
+#include <vector>
+#include "leveldb/merge_operator.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+// MergeHelper applies Options::merge_operator to keys in their stored
+// form, i.e. with the column family prefix if the DB uses column
+// families, and turns failures into Status values.
+class MergeHelper {
+ public:
+  MergeHelper(const MergeOperator* op, bool column_families)
+      : op_(op), column_families_(column_families) { }
+
+  bool enabled() const { return op_ != NULL; }
+
+  // Store in *result the value obtained by applying "operand" to
+  // *existing, or to nothing if "existing" is NULL.  "existing" may
+  // point into *result.
+  Status Apply(const Slice& key, const Slice* existing,
+               const Slice& operand, std::string* result) const;
+
+  // Store in *result the value obtained by applying "operands", which are
+  // ordered newest first, to *base, or to nothing if "base" is NULL.
+  // "base" may point into *result.
+  // REQUIRES: !operands.empty()
+  Status ApplyAll(const Slice& key, const Slice* base,
+                  const std::vector<std::string>& operands,
+                  std::string* result) const;
+
+ private:
+  const MergeOperator* op_;
+  bool column_families_;
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
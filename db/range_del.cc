@@ -0,0 +1,190 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <functional>
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+namespace {
+struct UserKeyLess {
+  const Comparator* ucmp;
+  explicit UserKeyLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+
+// Orders deletions like their internal keys: by begin, newest first
+struct DeletionLess {
+  const Comparator* ucmp;
+  explicit DeletionLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const RangeDeletion& a, const RangeDeletion& b) const {
+    int r = ucmp->Compare(a.begin, b.begin);
+    return (r < 0) || (r == 0 && a.sequence > b.sequence);
+  }
+};
+
+// Return the largest element of "sequences" (sorted in decreasing order)
+// that is no larger than "snapshot", or zero.
+SequenceNumber NewestVisible(const std::vector<SequenceNumber>& sequences,
+                             SequenceNumber snapshot) {
+  for (size_t i = 0; i < sequences.size(); i++) {
+    if (sequences[i] <= snapshot) {
+      return sequences[i];
+    }
+  }
+  return 0;
+}
+}
+
+RangeDeletions::RangeDeletions(const Comparator* user_comparator)
+    : ucmp_(user_comparator),
+      finished_(false) {
+}
+
+void RangeDeletions::Add(const Slice& begin, const Slice& end,
+                         SequenceNumber sequence) {
+  assert(!finished_);
+  if (ucmp_->Compare(begin, end) < 0) {
+    deletions_.push_back(RangeDeletion(begin, end, sequence));
+  }
+}
+
+Status RangeDeletions::AddAll(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range deletion");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeDeletions::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  if (deletions_.empty()) {
+    return;
+  }
+
+  std::vector<std::string> points;
+  for (size_t i = 0; i < deletions_.size(); i++) {
+    points.push_back(deletions_[i].begin);
+    points.push_back(deletions_[i].end);
+  }
+  UserKeyLess less(ucmp_);
+  std::sort(points.begin(), points.end(), less);
+  fragments_.reserve(points.size());
+  for (size_t i = 0; i < points.size(); i++) {
+    if (fragments_.empty() ||
+        ucmp_->Compare(fragments_.back().begin, points[i]) != 0) {
+      fragments_.push_back(Fragment());
+      fragments_.back().begin.swap(points[i]);
+    }
+  }
+
+  for (size_t i = 0; i < deletions_.size(); i++) {
+    const RangeDeletion& d = deletions_[i];
+    for (int f = FindFragment(d.begin);
+         f < static_cast<int>(fragments_.size()) &&
+             ucmp_->Compare(fragments_[f].begin, d.end) < 0;
+         f++) {
+      fragments_[f].sequences.push_back(d.sequence);
+    }
+  }
+  for (size_t f = 0; f < fragments_.size(); f++) {
+    std::vector<SequenceNumber>* s = &fragments_[f].sequences;
+    std::sort(s->begin(), s->end(), std::greater<SequenceNumber>());
+  }
+}
+
+int RangeDeletions::FindFragment(const Slice& user_key) const {
+  // Binary search for the last fragment that starts at or before user_key
+  int left = 0;
+  int right = fragments_.size();
+  while (left < right) {
+    int mid = (left + right) / 2;
+    if (ucmp_->Compare(fragments_[mid].begin, user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left - 1;
+}
+
+SequenceNumber RangeDeletions::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  assert(finished_);
+  const int f = FindFragment(user_key);
+  if (f < 0) {
+    return 0;
+  }
+  return NewestVisible(fragments_[f].sequences, snapshot);
+}
+
+bool RangeDeletions::CoversRange(const Slice& smallest, const Slice& largest,
+                                 SequenceNumber snapshot) const {
+  assert(finished_);
+  int f = FindFragment(smallest);
+  if (f < 0) {
+    return false;
+  }
+  for (; f < static_cast<int>(fragments_.size()); f++) {
+    if (ucmp_->Compare(fragments_[f].begin, largest) > 0) {
+      return true;
+    }
+    if (NewestVisible(fragments_[f].sequences, snapshot) == 0) {
+      return false;
+    }
+  }
+  return false;
+}
+
+void RangeDeletions::Clip(const Slice* lower, const Slice* upper,
+                          std::vector<RangeDeletion>* result) const {
+  result->clear();
+  for (size_t i = 0; i < deletions_.size(); i++) {
+    const RangeDeletion& d = deletions_[i];
+    Slice begin = d.begin;
+    Slice end = d.end;
+    if (lower != NULL && ucmp_->Compare(begin, *lower) < 0) {
+      begin = *lower;
+    }
+    if (upper != NULL && ucmp_->Compare(*upper, end) < 0) {
+      end = *upper;
+    }
+    if (ucmp_->Compare(begin, end) < 0) {
+      result->push_back(RangeDeletion(begin, end, d.sequence));
+    }
+  }
+  DeletionLess less(ucmp_);
+  std::sort(result->begin(), result->end(), less);
+
+  // Pieces of the same deletion may have been added more than once
+  size_t n = 0;
+  for (size_t i = 0; i < result->size(); i++) {
+    if (n > 0 && !less((*result)[n - 1], (*result)[i])) {
+      RangeDeletion* last = &(*result)[n - 1];
+      if (ucmp_->Compare(last->end, (*result)[i].end) < 0) {
+        last->end = (*result)[i].end;
+      }
+      continue;
+    }
+    if (n != i) {
+      (*result)[n] = (*result)[i];
+    }
+    n++;
+  }
+  result->resize(n);
+}
+
+}
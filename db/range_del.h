@@ -0,0 +1,92 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Range deletions are written by DB::DeleteRange.  A range deletion at
+// sequence number S hides the entries of all keys in [begin,end) whose
+// sequence numbers are smaller than S.  Memtables and tables keep them
+// apart from their other entries, as internal keys (begin,S,
+// kTypeRangeDeletion) mapped to "end".
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+
+struct RangeDeletion {
+  std::string begin;
+  std::string end;            // Exclusive
+  SequenceNumber sequence;
+
+  RangeDeletion() : sequence(0) { }
+  RangeDeletion(const Slice& b, const Slice& e, SequenceNumber s)
+      : begin(b.data(), b.size()), end(e.data(), e.size()), sequence(s) { }
+};
+
+// A set of range deletions that answers which keys they cover.
+//
+// Queries need the deletions split into non-overlapping fragments, which
+// is done by Finish().  A RangeDeletions object may be queried from
+// several threads once Finish() has been called.
+class RangeDeletions {
+ public:
+  explicit RangeDeletions(const Comparator* user_comparator);
+
+  // Add the deletion of [begin,end) at "sequence".  Empty ranges are
+  // ignored.
+  // REQUIRES: Finish() has not been called
+  void Add(const Slice& begin, const Slice& end, SequenceNumber sequence);
+
+  // Add the deletions yielded by "iter" in the format described above.
+  // Does not take ownership of "iter".
+  Status AddAll(Iterator* iter);
+
+  bool empty() const { return deletions_.empty(); }
+
+  // Prepare for the queries below.
+  void Finish();
+
+  // Return the largest sequence number no larger than "snapshot" of the
+  // deletions that cover "user_key", or zero if there is none.  An entry
+  // of "user_key" is deleted iff its sequence number is smaller.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+  // Return true iff every key in [smallest,largest] is covered by some
+  // deletion no newer than "snapshot".
+  bool CoversRange(const Slice& smallest, const Slice& largest,
+                   SequenceNumber snapshot) const;
+
+  // Store in *result the deletions clipped to [*lower,*upper), ordered
+  // like their internal keys.  NULL bounds are unbounded.
+  void Clip(const Slice* lower, const Slice* upper,
+            std::vector<RangeDeletion>* result) const;
+
+ private:
+  // The deletions that cover [begin, begin of the next fragment), newest
+  // first.  The last fragment starts at the largest end and is empty.
+  struct Fragment {
+    std::string begin;
+    std::vector<SequenceNumber> sequences;
+  };
+
+  // Return the index of the fragment holding "user_key", or -1.
+  int FindFragment(const Slice& user_key) const;
+
+  const Comparator* const ucmp_;
+  std::vector<RangeDeletion> deletions_;
+  std::vector<Fragment> fragments_;
+  bool finished_;
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
@@ -14,6 +14,8 @@
 //        all tables (see 2c)
 //      - compaction pointers are cleared
 //      - every table file is added at level 0
+//      - every blob file that a table refers to is added, with no garbage
+//      - column families registered in the old descriptors are kept
 //
 // Possible optimization 1:
 //   (a) Compute total size and use to pick appropriate max-level M
@@ -24,7 +26,11 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <map>
+#include <set>
+#include "db/blob_file.h"
 #include "db/builder.h"
+#include "db/column_family.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
@@ -47,13 +53,14 @@ class Repairer {
   Repairer(const std::string& dbname, const Options& options)
       : dbname_(dbname),
         env_(options.env),
-        icmp_(options.comparator),
+        cf_cmp_(options.comparator),
+        icmp_(options.use_column_families ? &cf_cmp_ : options.comparator),
         options_(SanitizeOptions(dbname, &icmp_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
     // TableCache can be small since we expect each table to be opened once.
-    table_cache_ = new TableCache(dbname_, &options_, 10);
+    table_cache_ = new TableCache(&options_, 10);
   }
 
   ~Repairer() {
@@ -69,6 +76,7 @@ class Repairer {
   Status Run() {
     Status status = FindFiles();
     if (status.ok()) {
+      RecoverColumnFamilies();
       ConvertLogFilesToTables();
       ExtractMetaData();
       status = WriteDescriptor();
@@ -93,11 +101,11 @@ class Repairer {
  private:
   struct TableInfo {
     FileMetaData meta;
-    SequenceNumber max_sequence;
   };
 
   std::string const dbname_;
   Env* const env_;
+  ColumnFamilyComparator const cf_cmp_;
   InternalKeyComparator const icmp_;
   Options const options_;
   bool owns_info_log_;
@@ -107,7 +115,10 @@ class Repairer {
 
   std::vector<std::string> manifests_;
   std::vector<uint64_t> table_numbers_;
+  std::map<uint64_t, uint32_t> table_path_ids_;  // Where not the first path
   std::vector<uint64_t> logs_;
+  std::vector<uint64_t> blob_numbers_;
+  std::set<uint64_t> blob_refs_;                  // Blob files tables use
   std::vector<TableInfo> tables_;
   uint64_t next_file_number_;
 
@@ -121,22 +132,45 @@ class Repairer {
       return Status::IOError(dbname_, "repair found no files");
     }
 
+    // The descriptors are in the DB directory, the logs in
+    // Options::wal_dir and the tables in Options::db_paths
+    std::vector<std::string> dirs;
+    GetDBDirs(dbname_, options_, &dirs);
     uint64_t number;
     FileType type;
-    for (size_t i = 0; i < filenames.size(); i++) {
-      if (ParseFileName(filenames[i], &number, &type)) {
-        if (type == kDescriptorFile) {
-          manifests_.push_back(filenames[i]);
-        } else {
-          if (number + 1 > next_file_number_) {
-            next_file_number_ = number + 1;
-          }
-          if (type == kLogFile) {
-            logs_.push_back(number);
-          } else if (type == kTableFile) {
-            table_numbers_.push_back(number);
+    for (size_t d = 0; d < dirs.size(); d++) {
+      if (d > 0) {
+        env_->GetChildren(dirs[d], &filenames);  // Ignoring errors
+      }
+      int path_id = -1;
+      for (size_t p = 0; p < options_.db_paths.size(); p++) {
+        if (options_.db_paths[p].path == dirs[d]) {
+          path_id = p;
+          break;
+        }
+      }
+      for (size_t i = 0; i < filenames.size(); i++) {
+        if (ParseFileName(filenames[i], &number, &type)) {
+          if (type == kDescriptorFile) {
+            if (dirs[d] == dbname_) {
+              manifests_.push_back(filenames[i]);
+            }
           } else {
-            // Ignore other files
+            if (number + 1 > next_file_number_) {
+              next_file_number_ = number + 1;
+            }
+            if (type == kLogFile && dirs[d] == options_.wal_dir) {
+              logs_.push_back(number);
+            } else if (type == kTableFile && path_id >= 0) {
+              table_numbers_.push_back(number);
+              if (path_id > 0) {
+                table_path_ids_[number] = path_id;
+              }
+            } else if (type == kBlobFile && dirs[d] == dbname_) {
+              blob_numbers_.push_back(number);
+            } else {
+              // Ignore other files
+            }
           }
         }
       }
@@ -144,9 +178,47 @@ class Repairer {
     return status;
   }
 
+  // Collect the column family registrations from the old descriptors
+  // so that they survive the rewrite of the descriptor.
+  void RecoverColumnFamilies() {
+    struct LogReporter : public log::Reader::Reporter {
+      virtual void Corruption(size_t bytes, const Status& s) { }
+    };
+    std::map<std::string, uint32_t> families;
+    for (size_t i = 0; i < manifests_.size(); i++) {
+      SequentialFile* file;
+      Status status = env_->NewSequentialFile(dbname_ + "/" + manifests_[i],
+                                              &file);
+      if (!status.ok()) {
+        continue;
+      }
+      LogReporter reporter;
+      log::Reader reader(file, &reporter, true/*checksum*/,
+                         0/*initial_offset*/);
+      Slice record;
+      std::string scratch;
+      while (reader.ReadRecord(&record, &scratch)) {
+        VersionEdit edit;
+        if (edit.DecodeFrom(record).ok()) {
+          for (size_t j = 0; j < edit.column_families().size(); j++) {
+            families[edit.column_families()[j].second] =
+                edit.column_families()[j].first;
+          }
+        }
+      }
+      delete file;
+    }
+    for (std::map<std::string, uint32_t>::const_iterator iter =
+             families.begin();
+         iter != families.end();
+         ++iter) {
+      edit_.AddColumnFamily(iter->second, iter->first);
+    }
+  }
+
   void ConvertLogFilesToTables() {
     for (size_t i = 0; i < logs_.size(); i++) {
-      std::string logname = LogFileName(dbname_, logs_[i]);
+      std::string logname = LogFileName(options_.wal_dir, logs_[i]);
       Status status = ConvertLogToTable(logs_[i]);
       if (!status.ok()) {
         Log(options_.info_log, "Log #%llu: ignoring conversion error: %s",
@@ -172,7 +244,7 @@ class Repairer {
     };
 
     // Open the log file
-    std::string logname = LogFileName(dbname_, log);
+    std::string logname = LogFileName(options_.wal_dir, log);
     SequentialFile* lfile;
     Status status = env_->NewSequentialFile(logname, &lfile);
     if (!status.ok()) {
@@ -189,7 +261,7 @@ class Repairer {
     // propagating bad information (like overly large sequence
     // numbers).
     log::Reader reader(lfile, &reporter, false/*do not checksum*/,
-                       0/*initial_offset*/);
+                       0/*initial_offset*/, log);
 
     // Read all the records and add to a memtable
     std::string scratch;
@@ -205,7 +277,8 @@ class Repairer {
         continue;
       }
       WriteBatchInternal::SetContents(&batch, record);
-      status = WriteBatchInternal::InsertInto(&batch, mem);
+      status = WriteBatchInternal::InsertInto(&batch, mem,
+                                              options_.use_column_families);
       if (status.ok()) {
         counter += WriteBatchInternal::Count(&batch);
       } else {
@@ -222,7 +295,10 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeDeletionIterator();
+    status = BuildTable(env_, options_, table_cache_, iter,
+                        range_del_iter, &meta, NULL);
+    delete range_del_iter;
     delete iter;
     mem->Unref();
     mem = NULL;
@@ -244,9 +320,11 @@ class Repairer {
     for (size_t i = 0; i < table_numbers_.size(); i++) {
       TableInfo t;
       t.meta.number = table_numbers_[i];
+      t.meta.path_id = table_path_ids_[t.meta.number];
       Status status = ScanTable(&t);
       if (!status.ok()) {
-        std::string fname = TableFileName(dbname_, table_numbers_[i]);
+        std::string fname = TableFileName(options_.db_paths, t.meta.number,
+                                          t.meta.path_id);
         Log(options_.info_log, "Table #%llu: ignoring %s",
             (unsigned long long) table_numbers_[i],
             status.ToString().c_str());
@@ -258,15 +336,21 @@ class Repairer {
   }
 
   Status ScanTable(TableInfo* t) {
-    std::string fname = TableFileName(dbname_, t->meta.number);
+    std::string fname = TableFileName(options_.db_paths, t->meta.number,
+                                      t->meta.path_id);
     int counter = 0;
     Status status = env_->GetFileSize(fname, &t->meta.file_size);
     if (status.ok()) {
+      Table* table = NULL;
       Iterator* iter = table_cache_->NewIterator(
-          ReadOptions(), t->meta.number, t->meta.file_size);
+          ReadOptions(), t->meta.number, t->meta.file_size, t->meta.path_id,
+          &table);
       bool empty = true;
       ParsedInternalKey parsed;
-      t->max_sequence = 0;
+      t->meta.smallest_seqno = kMaxSequenceNumber;
+      t->meta.largest_seqno = 0;
+      t->meta.num_entries = 0;
+      t->meta.num_deletions = 0;
       for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
         Slice key = iter->key();
         if (!ParseInternalKey(key, &parsed)) {
@@ -282,14 +366,27 @@ class Repairer {
           t->meta.smallest.DecodeFrom(key);
         }
         t->meta.largest.DecodeFrom(key);
-        if (parsed.sequence > t->max_sequence) {
-          t->max_sequence = parsed.sequence;
+        AddEntry(t, parsed);
+        BlobIndex blob;
+        if (parsed.type == kTypeBlobIndex &&
+            blob.DecodeFrom(iter->value()).ok()) {
+          blob_refs_.insert(blob.file_number);
+          if (t->meta.oldest_blob_file == 0 ||
+              blob.file_number < t->meta.oldest_blob_file) {
+            t->meta.oldest_blob_file = blob.file_number;
+          }
         }
       }
       if (!iter->status().ok()) {
         status = iter->status();
       }
+      if (status.ok() && table != NULL) {
+        status = ScanRangeDeletions(table, t, empty);
+      }
       delete iter;
+      if (t->meta.smallest_seqno > t->meta.largest_seqno) {
+        t->meta.smallest_seqno = 0;  // No entries
+      }
     }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long) t->meta.number,
@@ -298,6 +395,51 @@ class Repairer {
     return status;
   }
 
+  // Account in the metadata of *t for the entry "key".
+  static void AddEntry(TableInfo* t, const ParsedInternalKey& key) {
+    if (key.sequence < t->meta.smallest_seqno) {
+      t->meta.smallest_seqno = key.sequence;
+    }
+    if (key.sequence > t->meta.largest_seqno) {
+      t->meta.largest_seqno = key.sequence;
+    }
+    t->meta.num_entries++;
+    if (key.type == kTypeDeletion || key.type == kTypeRangeDeletion) {
+      t->meta.num_deletions++;
+    }
+  }
+
+  // Extend the metadata of *t, gathered from the entries of "table", to
+  // its range deletions.
+  Status ScanRangeDeletions(Table* table, TableInfo* t, bool empty) {
+    Iterator* iter = table->NewRangeDeletionIterator();
+    if (iter == NULL) {
+      return Status::OK();
+    }
+    t->meta.has_range_deletions = true;
+    ParsedInternalKey parsed;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (!ParseInternalKey(iter->key(), &parsed)) {
+        continue;
+      }
+      InternalKey smallest;
+      smallest.DecodeFrom(iter->key());
+      InternalKey largest(iter->value(), kMaxSequenceNumber,
+                          kTypeRangeDeletion);
+      if (empty || icmp_.Compare(smallest, t->meta.smallest) < 0) {
+        t->meta.smallest = smallest;
+      }
+      if (empty || icmp_.Compare(largest, t->meta.largest) > 0) {
+        t->meta.largest = largest;
+      }
+      empty = false;
+      AddEntry(t, parsed);
+    }
+    Status status = iter->status();
+    delete iter;
+    return status;
+  }
+
   Status WriteDescriptor() {
     std::string tmp = TempFileName(dbname_, 1);
     WritableFile* file;
@@ -308,8 +450,8 @@ class Repairer {
 
     SequenceNumber max_sequence = 0;
     for (size_t i = 0; i < tables_.size(); i++) {
-      if (max_sequence < tables_[i].max_sequence) {
-        max_sequence = tables_[i].max_sequence;
+      if (max_sequence < tables_[i].meta.largest_seqno) {
+        max_sequence = tables_[i].meta.largest_seqno;
       }
     }
 
@@ -321,8 +463,15 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+      edit_.AddFile(0, t.meta);
+    }
+    for (size_t i = 0; i < blob_numbers_.size(); i++) {
+      uint64_t size;
+      if (blob_refs_.count(blob_numbers_[i]) > 0 &&
+          env_->GetFileSize(BlobFileName(dbname_, blob_numbers_[i]),
+                            &size).ok()) {
+        edit_.AddBlobFile(blob_numbers_[i], size);
+      }
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
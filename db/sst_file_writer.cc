@@ -0,0 +1,127 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+// The file holds internal keys like the tables of a DB.  All entries
+// have sequence number zero; DB::IngestExternalFile() assigns the file
+// its sequence number.
+struct SstFileWriter::Rep {
+  const InternalKeyComparator icmp;
+  Options options;
+  std::string fname;
+  WritableFile* file;
+  TableBuilder* builder;
+  uint64_t file_size;
+  std::string last_key;       // Last user key added
+  std::string internal_key;   // Scratch space for the internal key
+
+  explicit Rep(const Options& opt)
+      : icmp(opt.comparator),
+        options(opt),
+        file(NULL),
+        builder(NULL),
+        file_size(0) {
+    options.comparator = &icmp;
+  }
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {
+}
+
+SstFileWriter::~SstFileWriter() {
+  Rep* r = rep_;
+  if (r->builder != NULL) {
+    r->builder->Abandon();
+    delete r->builder;
+    delete r->file;
+    r->options.env->DeleteFile(r->fname);
+  }
+  delete r;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  Rep* r = rep_;
+  assert(r->builder == NULL);
+  // An existing file may be linked into a DB by IngestExternalFile(),
+  // so it must be replaced rather than truncated.
+  r->options.env->DeleteFile(fname);
+  Status s = r->options.env->NewWritableFile(fname, &r->file);
+  if (s.ok()) {
+    r->fname = fname;
+    r->builder = new TableBuilder(r->options, r->file);
+    r->file_size = 0;
+    r->last_key.clear();
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  Rep* r = rep_;
+  assert(r->builder != NULL);
+  if (r->builder->NumEntries() > 0 &&
+      r->icmp.user_comparator()->Compare(key, r->last_key) <= 0) {
+    return Status::InvalidArgument("keys must be added in increasing order",
+                                   key);
+  }
+  r->last_key.assign(key.data(), key.size());
+  r->internal_key.clear();
+  AppendInternalKey(&r->internal_key, ParsedInternalKey(
+      key, 0, deletion ? kTypeDeletion : kTypeValue));
+  r->builder->Add(r->internal_key, value);
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  assert(r->builder != NULL);
+  Status s;
+  if (r->builder->NumEntries() == 0) {
+    s = Status::InvalidArgument("no entries in", r->fname);
+    r->builder->Abandon();
+  } else {
+    s = r->builder->Finish();
+  }
+  r->file_size = r->builder->FileSize();
+  delete r->builder;
+  r->builder = NULL;
+  if (s.ok()) {
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  delete r->file;
+  r->file = NULL;
+  if (!s.ok()) {
+    r->options.env->DeleteFile(r->fname);
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::NumEntries() const {
+  return rep_->builder != NULL ? rep_->builder->NumEntries() : 0;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return rep_->builder != NULL ? rep_->builder->FileSize() : rep_->file_size;
+}
+
+}
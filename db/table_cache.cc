@@ -5,19 +5,24 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
+#include "util/perf_context.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  RangeDeletions* range_deletions;  // NULL if the table has none
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->range_deletions;
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -29,11 +34,8 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
-TableCache::TableCache(const std::string& dbname,
-                       const Options* options,
-                       int entries)
+TableCache::TableCache(const Options* options, int entries)
     : env_(options->env),
-      dbname_(dbname),
       options_(options),
       cache_(NewLRUCache(entries)) {
 }
@@ -42,39 +44,74 @@ TableCache::~TableCache() {
   delete cache_;
 }
 
-Iterator* TableCache::NewIterator(const ReadOptions& options,
-                                  uint64_t file_number,
-                                  uint64_t file_size,
-                                  Table** tableptr) {
-  if (tableptr != NULL) {
-    *tableptr = NULL;
-  }
-
+Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
+                             uint32_t path_id, Cache::Handle** handle) {
+  Status s;
+  PerfTimer find_timer(&PerfContext::find_table_nanos);
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   Slice key(buf, sizeof(buf));
-  Cache::Handle* handle = cache_->Lookup(key);
-  if (handle == NULL) {
-    std::string fname = TableFileName(dbname_, file_number);
+  *handle = cache_->Lookup(key);
+  if (*handle != NULL) {
+    RecordTick(options_->statistics, kIndexBlockHit);
+  } else {
+    RecordTick(options_->statistics, kIndexBlockMiss);
+    PerfCount(&PerfContext::table_open_count);
+    std::string fname = TableFileName(options_->db_paths, file_number,
+                                      path_id);
     RandomAccessFile* file = NULL;
     Table* table = NULL;
-    Status s = env_->NewRandomAccessFile(fname, &file);
+    s = env_->NewRandomAccessFile(fname, &file);
     if (s.ok()) {
       s = Table::Open(*options_, file, file_size, &table);
     }
 
+    // Range deletions are parsed once, when the table is opened, so
+    // that lookups can binary search them.
+    RangeDeletions* range_deletions = NULL;
+    Iterator* range_del_iter = NULL;
+    if (s.ok()) {
+      range_del_iter = table->NewRangeDeletionIterator();
+    }
+    if (range_del_iter != NULL) {
+      const InternalKeyComparator* icmp =
+          static_cast<const InternalKeyComparator*>(options_->comparator);
+      range_deletions = new RangeDeletions(icmp->user_comparator());
+      s = range_deletions->AddAll(range_del_iter);
+      range_deletions->Finish();
+      delete range_del_iter;
+    }
+
     if (!s.ok()) {
-      assert(table == NULL);
+      delete range_deletions;
+      delete table;
       delete file;
       // We do not cache error results so that if the error is transient,
       // or somebody repairs the file, we recover automatically.
-      return NewErrorIterator(s);
+    } else {
+      TableAndFile* tf = new TableAndFile;
+      tf->file = file;
+      tf->table = table;
+      tf->range_deletions = range_deletions;
+      *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
+  }
+  return s;
+}
 
-    TableAndFile* tf = new TableAndFile;
-    tf->file = file;
-    tf->table = table;
-    handle = cache_->Insert(key, tf, 1, &DeleteEntry);
+Iterator* TableCache::NewIterator(const ReadOptions& options,
+                                  uint64_t file_number,
+                                  uint64_t file_size,
+                                  uint32_t path_id,
+                                  Table** tableptr) {
+  if (tableptr != NULL) {
+    *tableptr = NULL;
+  }
+
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, path_id, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
   }
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
@@ -86,6 +123,58 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Status TableCache::Preload(uint64_t file_number, uint64_t file_size,
+                           uint32_t path_id) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, path_id, &handle);
+  if (s.ok()) {
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::AddRangeDeletions(uint64_t file_number,
+                                     uint64_t file_size,
+                                     uint32_t path_id,
+                                     RangeDeletions* deletions) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, path_id, &handle);
+  if (s.ok()) {
+    Table* table =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    Iterator* iter = table->NewRangeDeletionIterator();
+    if (iter != NULL) {
+      s = deletions->AddAll(iter);
+      delete iter;
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MaxCoveringRangeDeletion(uint64_t file_number,
+                                            uint64_t file_size,
+                                            uint32_t path_id,
+                                            const Slice& user_key,
+                                            SequenceNumber snapshot,
+                                            SequenceNumber* sequence) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, path_id, &handle);
+  if (s.ok()) {
+    const RangeDeletions* deletions =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))->range_deletions;
+    if (deletions != NULL) {
+      SequenceNumber covering =
+          deletions->MaxCoveringSequence(user_key, snapshot);
+      if (covering > *sequence) {
+        *sequence = covering;
+      }
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
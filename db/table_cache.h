@@ -17,14 +17,18 @@
 namespace leveldb {
 
 class Env;
+class RangeDeletions;
 
 class TableCache {
  public:
-  TableCache(const std::string& dbname, const Options* options, int entries);
+  // The table files are looked for in options->db_paths, which must not
+  // be empty.
+  TableCache(const Options* options, int entries);
   ~TableCache();
 
   // Return an iterator for the specified file number (the corresponding
-  // file length must be exactly "file_size" bytes).  If "tableptr" is
+  // file length must be exactly "file_size" bytes), which is kept in the
+  // directory "path_id" of Options::db_paths.  If "tableptr" is
   // non-NULL, also sets "*tableptr" to point to the Table object
   // underlying the returned iterator, or NULL if no Table object underlies
   // the returned iterator.  The returned "*tableptr" object is owned by
@@ -33,16 +37,39 @@ class TableCache {
   Iterator* NewIterator(const ReadOptions& options,
                         uint64_t file_number,
                         uint64_t file_size,
+                        uint32_t path_id,
                         Table** tableptr = NULL);
 
+  // Append the range deletions of the specified file to *deletions.
+  Status AddRangeDeletions(uint64_t file_number,
+                           uint64_t file_size,
+                           uint32_t path_id,
+                           RangeDeletions* deletions);
+
+  // Raise *sequence to the largest sequence number no larger than
+  // "snapshot" of the range deletions of the specified file that cover
+  // "user_key", if that is larger.
+  Status MaxCoveringRangeDeletion(uint64_t file_number,
+                                  uint64_t file_size,
+                                  uint32_t path_id,
+                                  const Slice& user_key,
+                                  SequenceNumber snapshot,
+                                  SequenceNumber* sequence);
+
+  // Open the specified file, if it is not open already, so that later
+  // lookups find its index in the cache.
+  Status Preload(uint64_t file_number, uint64_t file_size, uint32_t path_id);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
  private:
   Env* const env_;
-  const std::string dbname_;
   const Options* options_;
   Cache* cache_;
+
+  Status FindTable(uint64_t file_number, uint64_t file_size, uint32_t path_id,
+                   Cache::Handle** handle);
 };
 
 }
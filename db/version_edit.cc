@@ -20,7 +20,20 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kColumnFamily         = 10,
+  kNewFileRangeDeletions = 11,  // kNewFile of a file with range deletions
+  kNewFileSequences     = 12,   // kNewFile with sequence numbers and flags
+  kBlobFile             = 13,
+  kBlobGarbage          = 14
+};
+
+// Flags of kNewFileSequences
+enum NewFileFlag {
+  kFlagRangeDeletions   = 1,
+  kFlagEntries          = 2,    // Followed by the entry and deletion counts
+  kFlagPathId           = 4,    // Followed by the path id
+  kFlagOldestBlobFile   = 8     // Followed by the oldest blob file number
 };
 
 void VersionEdit::Clear() {
@@ -36,6 +49,9 @@ void VersionEdit::Clear() {
   has_last_sequence_ = false;
   deleted_files_.clear();
   new_files_.clear();
+  new_blob_files_.clear();
+  blob_garbage_.clear();
+  column_families_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -76,12 +92,61 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // Files written by this release always record their sequence numbers
+    // and entry counts, so they always get kNewFileSequences, which older
+    // releases do not know.  Only files carried over from older releases
+    // keep the old tags.
+    uint32_t tag = kNewFile;
+    if (f.largest_seqno != 0 || f.num_entries != 0 || f.path_id != 0 ||
+        f.oldest_blob_file != 0) {
+      tag = kNewFileSequences;
+    } else if (f.has_range_deletions) {
+      tag = kNewFileRangeDeletions;
+    }
+    PutVarint32(dst, tag);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (tag == kNewFileSequences) {
+      PutVarint64(dst, f.smallest_seqno);
+      PutVarint64(dst, f.largest_seqno);
+      uint32_t flags = 0;
+      if (f.has_range_deletions) flags |= kFlagRangeDeletions;
+      if (f.num_entries != 0) flags |= kFlagEntries;
+      if (f.path_id != 0) flags |= kFlagPathId;
+      if (f.oldest_blob_file != 0) flags |= kFlagOldestBlobFile;
+      PutVarint32(dst, flags);
+      if (flags & kFlagEntries) {
+        PutVarint64(dst, f.num_entries);
+        PutVarint64(dst, f.num_deletions);
+      }
+      if (flags & kFlagPathId) {
+        PutVarint32(dst, f.path_id);
+      }
+      if (flags & kFlagOldestBlobFile) {
+        PutVarint64(dst, f.oldest_blob_file);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < new_blob_files_.size(); i++) {
+    PutVarint32(dst, kBlobFile);
+    PutVarint64(dst, new_blob_files_[i].first);   // file number
+    PutVarint64(dst, new_blob_files_[i].second);  // total bytes
+  }
+
+  for (size_t i = 0; i < blob_garbage_.size(); i++) {
+    PutVarint32(dst, kBlobGarbage);
+    PutVarint64(dst, blob_garbage_[i].first);   // file number
+    PutVarint64(dst, blob_garbage_[i].second);  // garbage bytes
+  }
+
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    PutVarint32(dst, kColumnFamily);
+    PutVarint32(dst, column_families_[i].first);  // id
+    PutLengthPrefixedSlice(dst, column_families_[i].second);
   }
 }
 
@@ -98,7 +163,7 @@ static bool GetInternalKey(Slice* input, InternalKey* dst) {
 static bool GetLevel(Slice* input, int* level) {
   uint32_t v;
   if (GetVarint32(input, &v) &&
-      v < config::kNumLevels) {
+      v < config::kMaxNumLevels) {
     *level = v;
     return true;
   } else {
@@ -115,9 +180,12 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   // Temporary storage for parsing
   int level;
   uint64_t number;
+  uint64_t bytes;
   FileMetaData f;
   Slice str;
   InternalKey key;
+  uint32_t id;
+  uint32_t flags;
 
   while (msg == NULL && GetVarint32(&input, &tag)) {
     switch (tag) {
@@ -181,17 +249,82 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileRangeDeletions:
+        f.has_range_deletions = (tag == kNewFileRangeDeletions);
         if (GetLevel(&input, &level) &&
             GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.smallest_seqno = f.largest_seqno = 0;
+          f.num_entries = f.num_deletions = 0;
+          f.path_id = 0;
+          f.oldest_blob_file = 0;
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kNewFileSequences:
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.smallest_seqno) &&
+            GetVarint64(&input, &f.largest_seqno) &&
+            GetVarint32(&input, &flags) &&
+            ((flags & kFlagEntries) == 0 ||
+             (GetVarint64(&input, &f.num_entries) &&
+              GetVarint64(&input, &f.num_deletions))) &&
+            ((flags & kFlagPathId) == 0 ||
+             GetVarint32(&input, &f.path_id)) &&
+            ((flags & kFlagOldestBlobFile) == 0 ||
+             GetVarint64(&input, &f.oldest_blob_file))) {
+          f.has_range_deletions = (flags & kFlagRangeDeletions) != 0;
+          if ((flags & kFlagEntries) == 0) {
+            f.num_entries = f.num_deletions = 0;
+          }
+          if ((flags & kFlagPathId) == 0) {
+            f.path_id = 0;
+          }
+          if ((flags & kFlagOldestBlobFile) == 0) {
+            f.oldest_blob_file = 0;
+          }
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-file entry";
+        }
+        break;
+
+      case kBlobFile:
+        if (GetVarint64(&input, &number) &&
+            GetVarint64(&input, &bytes)) {
+          new_blob_files_.push_back(std::make_pair(number, bytes));
+        } else {
+          msg = "blob file";
+        }
+        break;
+
+      case kBlobGarbage:
+        if (GetVarint64(&input, &number) &&
+            GetVarint64(&input, &bytes)) {
+          blob_garbage_.push_back(std::make_pair(number, bytes));
+        } else {
+          msg = "blob garbage";
+        }
+        break;
+
+      case kColumnFamily:
+        if (GetVarint32(&input, &id) &&
+            GetLengthPrefixedSlice(&input, &str)) {
+          column_families_.push_back(std::make_pair(id, str.ToString()));
+        } else {
+          msg = "column family";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -258,6 +391,38 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.largest_seqno != 0) {
+      r.append(" seq ");
+      AppendNumberTo(&r, f.smallest_seqno);
+      r.append(" .. ");
+      AppendNumberTo(&r, f.largest_seqno);
+    }
+    if (f.path_id != 0) {
+      r.append(" path ");
+      AppendNumberTo(&r, f.path_id);
+    }
+    if (f.oldest_blob_file != 0) {
+      r.append(" blob ");
+      AppendNumberTo(&r, f.oldest_blob_file);
+    }
+  }
+  for (size_t i = 0; i < new_blob_files_.size(); i++) {
+    r.append("\n  AddBlobFile: ");
+    AppendNumberTo(&r, new_blob_files_[i].first);
+    r.append(" ");
+    AppendNumberTo(&r, new_blob_files_[i].second);
+  }
+  for (size_t i = 0; i < blob_garbage_.size(); i++) {
+    r.append("\n  BlobGarbage: ");
+    AppendNumberTo(&r, blob_garbage_[i].first);
+    r.append(" ");
+    AppendNumberTo(&r, blob_garbage_[i].second);
+  }
+  for (size_t i = 0; i < column_families_.size(); i++) {
+    r.append("\n  ColumnFamily: ");
+    AppendNumberTo(&r, column_families_[i].first);
+    r.append(" ");
+    r.append(column_families_[i].second);
   }
   r.append("\n}\n");
   return r;
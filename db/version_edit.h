@@ -21,8 +21,29 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
+  bool has_range_deletions;   // Table holds range deletions (see DeleteRange)
+  SequenceNumber smallest_seqno;  // Bounds of the sequence numbers of its
+  SequenceNumber largest_seqno;   // entries; zero if unknown
+  // Numbers of entries and of deletions among them, counting range
+  // deletions as both; zero if unknown
+  uint64_t num_entries;
+  uint64_t num_deletions;
+  uint32_t path_id;           // Directory of the file in Options::db_paths
+  uint64_t oldest_blob_file;  // Oldest blob file it refers to; zero if none
+
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), file_size(0),
+        has_range_deletions(false), smallest_seqno(0), largest_seqno(0),
+        num_entries(0), num_deletions(0), path_id(0), oldest_blob_file(0) { }
+};
+
+// A blob file (see db/blob_file.h) is live until all of the values it
+// holds are garbage, i.e. have been dropped or moved by compactions.
+struct BlobFileMetaData {
+  uint64_t total_bytes;       // Bytes of the records of the file
+  uint64_t garbage_bytes;     // Bytes of the records no table refers to
 
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+  BlobFileMetaData() : total_bytes(0), garbage_bytes(0) { }
 };
 
 class VersionEdit {
@@ -62,20 +83,59 @@ class VersionEdit {
   void AddFile(int level, uint64_t file,
                uint64_t file_size,
                const InternalKey& smallest,
-               const InternalKey& largest) {
+               const InternalKey& largest,
+               bool has_range_deletions = false,
+               SequenceNumber smallest_seqno = 0,
+               SequenceNumber largest_seqno = 0,
+               uint32_t path_id = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_deletions = has_range_deletions;
+    f.smallest_seqno = smallest_seqno;
+    f.largest_seqno = largest_seqno;
+    f.path_id = path_id;
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add a file described by "f" at the specified level.
+  void AddFile(int level, const FileMetaData& f) {
+    AddFile(level, f.number, f.file_size, f.smallest, f.largest,
+            f.has_range_deletions, f.smallest_seqno, f.largest_seqno,
+            f.path_id);
+    new_files_.back().second.num_entries = f.num_entries;
+    new_files_.back().second.num_deletions = f.num_deletions;
+    new_files_.back().second.oldest_blob_file = f.oldest_blob_file;
+  }
+
+  // Add the blob file "number", which holds "total_bytes" of records.
+  void AddBlobFile(uint64_t number, uint64_t total_bytes) {
+    new_blob_files_.push_back(std::make_pair(number, total_bytes));
+  }
+
+  // Record that "bytes" more bytes of the blob file "number" are garbage.
+  void AddBlobGarbage(uint64_t number, uint64_t bytes) {
+    blob_garbage_.push_back(std::make_pair(number, bytes));
+  }
+
   // Delete the specified "file" from the specified "level".
   void DeleteFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
+  // Register column family "name" under "id".
+  void AddColumnFamily(uint32_t id, const std::string& name) {
+    column_families_.push_back(std::make_pair(id, name));
+  }
+
+  // Column families registered by this edit.
+  const std::vector< std::pair<uint32_t, std::string> >&
+  column_families() const {
+    return column_families_;
+  }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(const Slice& src);
 
@@ -100,6 +160,9 @@ class VersionEdit {
   std::vector< std::pair<int, InternalKey> > compact_pointers_;
   DeletedFileSet deleted_files_;
   std::vector< std::pair<int, FileMetaData> > new_files_;
+  std::vector< std::pair<uint64_t, uint64_t> > new_blob_files_;
+  std::vector< std::pair<uint64_t, uint64_t> > blob_garbage_;
+  std::vector< std::pair<uint32_t, std::string> > column_families_;
 };
 
 }
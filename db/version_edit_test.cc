@@ -27,9 +27,28 @@ TEST(VersionEditTest, EncodeDecode) {
     TestEncodeDecode(edit);
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
-                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion),
+                 (i % 2) == 1,
+                 (i < 2) ? 0 : kBig + 500 + i,
+                 (i < 2) ? 0 : kBig + 600 + i);
+    if (i == 3) {
+      FileMetaData f;
+      f.number = kBig + 800;
+      f.num_entries = kBig + 801;
+      f.num_deletions = kBig + 802;
+      edit.AddFile(5, f);
+      f.number = kBig + 803;
+      f.path_id = 2;
+      edit.AddFile(6, f);
+      f.number = kBig + 804;
+      f.oldest_blob_file = kBig + 805;
+      edit.AddFile(6, f);
+    }
+    edit.AddBlobFile(kBig + 1100 + i, kBig + 1200 + i);
+    edit.AddBlobGarbage(kBig + 1100 + i, kBig + 1300 + i);
     edit.DeleteFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
+    edit.AddColumnFamily(i + 1, "family");
   }
 
   edit.SetComparatorName("foo");
@@ -10,6 +10,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -17,6 +18,8 @@
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/perf_context.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
@@ -26,17 +29,6 @@ static const int kTargetFileSize = 2 * 1048576;
 // stop building a single file in a level->level+1 compaction.
 static const int64_t kMaxGrandParentOverlapBytes = 10 * kTargetFileSize;
 
-static double MaxBytesForLevel(int level) {
-  // Note: the result for level zero is not really used since we set
-  // the level-0 compaction threshold based on number of files.
-  double result = 10 * 1048576.0;  // Result for both level-0 and level-1
-  while (level > 1) {
-    result *= 10;
-    level--;
-  }
-  return result;
-}
-
 static uint64_t MaxFileSizeForLevel(int level) {
   return kTargetFileSize;  // We could vary per level to reduce number of files?
 }
@@ -50,6 +42,14 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
 }
 
 namespace {
+struct SmallestKeyLess {
+  const InternalKeyComparator* icmp;
+  explicit SmallestKeyLess(const InternalKeyComparator* c) : icmp(c) { }
+  bool operator()(FileMetaData* a, FileMetaData* b) const {
+    return icmp->Compare(a->smallest, b->smallest) < 0;
+  }
+};
+
 std::string IntSetToString(const std::set<uint64_t>& s) {
   std::string result = "{";
   for (std::set<uint64_t>::const_iterator it = s.begin();
@@ -71,7 +71,7 @@ Version::~Version() {
   next_->prev_ = prev_;
 
   // Drop references to files
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < config::kMaxNumLevels; level++) {
     for (size_t i = 0; i < files_[level].size(); i++) {
       FileMetaData* f = files_[level][i];
       assert(f->refs > 0);
@@ -198,6 +198,7 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_+8, (*flist_)[index_]->file_size);
+    EncodeFixed32(value_buf_+16, (*flist_)[index_]->path_id);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   virtual Status status() const { return Status::OK(); }
@@ -206,21 +207,22 @@ class Version::LevelFileNumIterator : public Iterator {
   const std::vector<FileMetaData*>* const flist_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and path id.
+  mutable char value_buf_[20];
 };
 
 static Iterator* GetFileIterator(void* arg,
                                  const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 20) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options,
                               DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8),
+                              DecodeFixed32(file_value.data() + 16));
   }
 }
 
@@ -237,13 +239,14 @@ void Version::AddIterators(const ReadOptions& options,
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(
         vset_->table_cache_->NewIterator(
-            options, files_[0][i]->number, files_[0][i]->file_size));
+            options, files_[0][i]->number, files_[0][i]->file_size,
+            files_[0][i]->path_id));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
   // walks through the non-overlapping files in the level, opening them
   // lazily.
-  for (int level = 1; level < config::kNumLevels; level++) {
+  for (int level = 1; level < vset_->NumberLevels(); level++) {
     if (!files_[level].empty()) {
       iters->push_back(NewConcatenatingIterator(options, level));
     }
@@ -252,44 +255,70 @@ void Version::AddIterators(const ReadOptions& options,
 
 // If "*iter" points at a value or deletion for user_key, store
 // either the value, or a NotFound error and return true.
-// Else return false.
+// Else return false.  Entries older than "max_covering_deletion" count
+// as deletions.
 static bool GetValue(Iterator* iter, const Slice& user_key,
                      std::string* value,
-                     Status* s) {
-  if (!iter->Valid()) {
-    return false;
-  }
-  ParsedInternalKey parsed_key;
-  if (!ParseInternalKey(iter->key(), &parsed_key)) {
-    *s = Status::Corruption("corrupted key for ", user_key);
-    return true;
-  }
-  if (parsed_key.user_key != user_key) {
-    return false;
-  }
-  switch (parsed_key.type) {
-    case kTypeDeletion:
-      *s = Status::NotFound(Slice());  // Use an empty error message for speed
-      break;
-    case kTypeValue: {
-      Slice v = iter->value();
-      value->assign(v.data(), v.size());
-      break;
+                     Status* s,
+                     std::vector<std::string>* merge_operands,
+                     SequenceNumber max_covering_deletion,
+                     bool* is_blob_index) {
+  for (; iter->Valid(); iter->Next()) {
+    ParsedInternalKey parsed_key;
+    if (!ParseInternalKey(iter->key(), &parsed_key)) {
+      *s = Status::Corruption("corrupted key for ", user_key);
+      return true;
+    }
+    if (parsed_key.user_key != user_key) {
+      return false;
+    }
+    if (parsed_key.sequence < max_covering_deletion) {
+      *s = Status::NotFound(Slice());
+      return true;
+    }
+    switch (parsed_key.type) {
+      case kTypeDeletion:
+        *s = Status::NotFound(Slice());  // Use an empty error message for speed
+        return true;
+      case kTypeValue:
+      case kTypeBlobIndex: {
+        Slice v = iter->value();
+        value->assign(v.data(), v.size());
+        *is_blob_index = (parsed_key.type == kTypeBlobIndex);
+        return true;
+      }
+      case kTypeMerge:
+        // Keep looking for the value the operand applies to
+        merge_operands->push_back(iter->value().ToString());
+        break;
+      case kTypeRangeDeletion:
+        break;
     }
   }
-  return true;
+  return false;
 }
 
+// Orders level-0 files from newest to oldest.  Universal compactions
+// give old entries new file numbers, so files are ordered by their
+// sequence numbers, and by number if they do not record them.
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
+  if (a->largest_seqno != b->largest_seqno) {
+    return a->largest_seqno > b->largest_seqno;
+  }
   return a->number > b->number;
 }
 
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
-                    GetStats* stats) {
+                    GetStats* stats,
+                    std::vector<std::string>* merge_operands,
+                    SequenceNumber* max_covering_deletion,
+                    bool* is_blob_index) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
+  const SequenceNumber snapshot =
+      DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8;
   const Comparator* ucmp = vset_->icmp_.user_comparator();
   Status s;
 
@@ -303,7 +332,7 @@ Status Version::Get(const ReadOptions& options,
   // in an smaller level, later levels are irrelevant.
   std::vector<FileMetaData*> tmp;
   FileMetaData* tmp2;
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < vset_->NumberLevels(); level++) {
     size_t num_files = files_[level].size();
     if (num_files == 0) continue;
 
@@ -338,8 +367,10 @@ Status Version::Get(const ReadOptions& options,
           files = NULL;
           num_files = 0;
         } else {
-          files = &tmp2;
-          num_files = 1;
+          // The entries of user_key may continue in the next files when
+          // they hold merge operands; see the check below.
+          files = &files[index];
+          num_files -= index;
         }
       }
     }
@@ -352,15 +383,31 @@ Status Version::Get(const ReadOptions& options,
       }
 
       FileMetaData* f = files[i];
+      if (level > 0 && i > 0 &&
+          ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
+        break;
+      }
       last_file_read = f;
       last_file_read_level = level;
+      PerfCount(&PerfContext::get_files_probed_count);
+
+      if (f->has_range_deletions) {
+        s = vset_->table_cache_->MaxCoveringRangeDeletion(
+            f->number, f->file_size, f->path_id, user_key, snapshot,
+            max_covering_deletion);
+        if (!s.ok()) {
+          return s;
+        }
+      }
 
       Iterator* iter = vset_->table_cache_->NewIterator(
           options,
           f->number,
-          f->file_size);
+          f->file_size,
+          f->path_id);
       iter->Seek(ikey);
-      const bool done = GetValue(iter, user_key, value, &s);
+      const bool done = GetValue(iter, user_key, value, &s, merge_operands,
+                                 *max_covering_deletion, is_blob_index);
       if (!iter->status().ok()) {
         s = iter->status();
         delete iter;
@@ -370,6 +417,10 @@ Status Version::Get(const ReadOptions& options,
         if (done) {
           return s;
         }
+        if (*max_covering_deletion > 0) {
+          // Older files only hold entries that are covered
+          return Status::NotFound(Slice());
+        }
       }
     }
   }
@@ -377,9 +428,24 @@ Status Version::Get(const ReadOptions& options,
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
+Status Version::AddRangeDeletions(RangeDeletions* deletions) {
+  Status s;
+  for (int level = 0; s.ok() && level < vset_->NumberLevels(); level++) {
+    for (size_t i = 0; s.ok() && i < files_[level].size(); i++) {
+      const FileMetaData* f = files_[level][i];
+      if (f->has_range_deletions) {
+        s = vset_->table_cache_->AddRangeDeletions(f->number, f->file_size,
+                                                   f->path_id, deletions);
+      }
+    }
+  }
+  return s;
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
-  if (f != NULL) {
+  if (f != NULL &&
+      vset_->options_->compaction_style == kCompactionStyleLevel) {
     f->allowed_seeks--;
     if (f->allowed_seeks <= 0 && file_to_compact_ == NULL) {
       file_to_compact_ = f;
@@ -414,20 +480,34 @@ int Version::PickLevelForMemTableOutput(
     const Slice& smallest_user_key,
     const Slice& largest_user_key) {
   int level = 0;
+  if (vset_->options_->compaction_style == kCompactionStyleUniversal) {
+    return level;  // Each flush is a new level-0 run
+  }
   if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
-    while (level < config::kMaxMemCompactLevel) {
+    // Keys inserted in increasing order are unlikely to be overwritten
+    // by later flushes, so they may go beyond kMaxMemCompactLevel, down
+    // to the last level.
+    const int max_level = IsAfterAllKeys(smallest_user_key)
+        ? vset_->NumberLevels() - 1
+        : vset_->options_->max_mem_compaction_level;
+    while (level < max_level) {
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
-      GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
-      const int64_t sum = TotalFileSize(overlaps);
-      if (sum > kMaxGrandParentOverlapBytes) {
-        break;
+      if (vset_->PathIdForLevel(level + 1) != 0) {
+        break;  // Flushed tables are written to the first path
+      }
+      if (level + 2 < vset_->NumberLevels()) {
+        GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
+        const int64_t sum = TotalFileSize(overlaps);
+        if (sum > kMaxGrandParentOverlapBytes) {
+          break;
+        }
       }
       level++;
     }
@@ -435,6 +515,24 @@ int Version::PickLevelForMemTableOutput(
   return level;
 }
 
+bool Version::IsAfterAllKeys(const Slice& smallest_user_key) const {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  bool empty = true;
+  for (int level = 0; level < vset_->NumberLevels(); level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    // Files in levels other than 0 are sorted: only the last one matters
+    const size_t first = (level == 0 || files.empty()) ? 0 : files.size() - 1;
+    for (size_t i = first; i < files.size(); i++) {
+      empty = false;
+      if (ucmp->Compare(smallest_user_key,
+                        files[i]->largest.user_key()) <= 0) {
+        return false;
+      }
+    }
+  }
+  return !empty;
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(
     int level,
@@ -464,9 +562,27 @@ void Version::GetOverlappingInputs(
   }
 }
 
+void Version::AddFiles(std::vector<FileMetaData*>* files) const {
+  for (int level = 0; level < config::kMaxNumLevels; level++) {
+    files->insert(files->end(), files_[level].begin(), files_[level].end());
+  }
+}
+
+bool Version::NeedsBlobGarbageCollection(uint64_t number) const {
+  if (vset_->options_->blob_garbage_collection_ratio <= 0) {
+    return false;
+  }
+  std::map<uint64_t, BlobFileMetaData>::const_iterator it =
+      blob_files_.find(number);
+  return it != blob_files_.end() &&
+         it->second.garbage_bytes >=
+             it->second.total_bytes *
+                 vset_->options_->blob_garbage_collection_ratio;
+}
+
 std::string Version::DebugString() const {
   std::string r;
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < vset_->NumberLevels(); level++) {
     // E.g.,
     //   --- level 1 ---
     //   17:123['a' .. 'd']
@@ -518,23 +634,25 @@ class VersionSet::Builder {
 
   VersionSet* vset_;
   Version* base_;
-  LevelState levels_[config::kNumLevels];
+  LevelState levels_[config::kMaxNumLevels];
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
 
  public:
   // Initialize a builder with the files from *base and other info from *vset
   Builder(VersionSet* vset, Version* base)
       : vset_(vset),
-        base_(base) {
+        base_(base),
+        blob_files_(base->blob_files_) {
     base_->Ref();
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < config::kMaxNumLevels; level++) {
       levels_[level].added_files = new FileSet(cmp);
     }
   }
 
   ~Builder() {
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < config::kMaxNumLevels; level++) {
       const FileSet* added = levels_[level].added_files;
       std::vector<FileMetaData*> to_unref;
       to_unref.reserve(added->size());
@@ -598,13 +716,27 @@ class VersionSet::Builder {
       levels_[level].deleted_files.erase(f->number);
       levels_[level].added_files->insert(f);
     }
+
+    // Add new blob files, and the garbage of existing ones
+    for (size_t i = 0; i < edit->new_blob_files_.size(); i++) {
+      BlobFileMetaData* b = &blob_files_[edit->new_blob_files_[i].first];
+      b->total_bytes = edit->new_blob_files_[i].second;
+      b->garbage_bytes = 0;
+    }
+    for (size_t i = 0; i < edit->blob_garbage_.size(); i++) {
+      std::map<uint64_t, BlobFileMetaData>::iterator it =
+          blob_files_.find(edit->blob_garbage_[i].first);
+      if (it != blob_files_.end()) {
+        it->second.garbage_bytes += edit->blob_garbage_[i].second;
+      }
+    }
   }
 
   // Save the current state in *v.
   void SaveTo(Version* v) {
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < config::kMaxNumLevels; level++) {
       // Merge the set of added files with the set of pre-existing files.
       // Drop any deleted files.  Store the result in *v.
       const std::vector<FileMetaData*>& base_files = base_->files_[level];
@@ -647,6 +779,16 @@ class VersionSet::Builder {
       }
 #endif
     }
+
+    // Blob files whose values are all garbage are dropped
+    for (std::map<uint64_t, BlobFileMetaData>::const_iterator it =
+             blob_files_.begin();
+         it != blob_files_.end();
+         ++it) {
+      if (it->second.garbage_bytes < it->second.total_bytes) {
+        v->blob_files_.insert(*it);
+      }
+    }
   }
 
   void MaybeAddFile(Version* v, int level, FileMetaData* f) {
@@ -679,6 +821,7 @@ VersionSet::VersionSet(const std::string& dbname,
       last_sequence_(0),
       log_number_(0),
       prev_log_number_(0),
+      max_column_family_(0),
       descriptor_file_(NULL),
       descriptor_log_(NULL),
       dummy_versions_(this),
@@ -722,6 +865,20 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     edit->SetPrevLogNumber(prev_log_number_);
   }
 
+  // Start a new descriptor once the current one has grown too large.
+  // The old one stays in use if the new one cannot be installed.
+  log::Writer* old_descriptor_log = NULL;
+  WritableFile* old_descriptor_file = NULL;
+  const uint64_t old_manifest_file_number = manifest_file_number_;
+  if (descriptor_log_ != NULL &&
+      descriptor_log_->Size() >= options_->max_manifest_file_size) {
+    old_descriptor_log = descriptor_log_;
+    old_descriptor_file = descriptor_file_;
+    descriptor_log_ = NULL;
+    descriptor_file_ = NULL;
+    manifest_file_number_ = NewFileNumber();
+  }
+
   edit->SetNextFile(next_file_number_);
   edit->SetLastSequence(last_sequence_);
 
@@ -739,7 +896,8 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
   Status s;
   if (descriptor_log_ == NULL) {
     // No reason to unlock *mu here since we only hit this path in the
-    // first call to LogAndApply (when opening the database).
+    // first call to LogAndApply (when opening the database) and when the
+    // descriptor is replaced, which is rare.
     assert(descriptor_file_ == NULL);
     new_manifest_file = DescriptorFileName(dbname_, manifest_file_number_);
     edit->SetNextFile(next_file_number_);
@@ -778,6 +936,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     AppendVersion(v);
     log_number_ = edit->log_number_;
     prev_log_number_ = edit->prev_log_number_;
+    RegisterColumnFamilies(*edit);
   } else {
     delete v;
     if (!new_manifest_file.empty()) {
@@ -787,7 +946,16 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
       descriptor_file_ = NULL;
       env_->DeleteFile(new_manifest_file);
     }
+    if (old_descriptor_log != NULL) {
+      descriptor_log_ = old_descriptor_log;
+      descriptor_file_ = old_descriptor_file;
+      manifest_file_number_ = old_manifest_file_number;
+      old_descriptor_log = NULL;
+      old_descriptor_file = NULL;
+    }
   }
+  delete old_descriptor_log;
+  delete old_descriptor_file;
 
   return s;
 }
@@ -848,6 +1016,7 @@ Status VersionSet::Recover() {
 
       if (s.ok()) {
         builder.Apply(&edit);
+        RegisterColumnFamilies(edit);
       }
 
       if (edit.has_log_number_) {
@@ -894,6 +1063,13 @@ Status VersionSet::Recover() {
   if (s.ok()) {
     Version* v = new Version(this);
     builder.SaveTo(v);
+    for (int level = NumberLevels(); level < config::kMaxNumLevels; level++) {
+      if (!v->files_[level].empty()) {
+        delete v;
+        return Status::InvalidArgument(
+            dbname_, "has more levels than options.num_levels");
+      }
+    }
     // Install recovered version
     Finalize(v);
     AppendVersion(v);
@@ -907,18 +1083,66 @@ Status VersionSet::Recover() {
   return s;
 }
 
+void VersionSet::RegisterColumnFamilies(const VersionEdit& edit) {
+  for (size_t i = 0; i < edit.column_families_.size(); i++) {
+    const uint32_t id = edit.column_families_[i].first;
+    column_families_[edit.column_families_[i].second] = id;
+    if (id > max_column_family_) {
+      max_column_family_ = id;
+    }
+  }
+}
+
 void VersionSet::MarkFileNumberUsed(uint64_t number) {
   if (next_file_number_ <= number) {
     next_file_number_ = number + 1;
   }
 }
 
+void VersionSet::LevelMaxBytes(Version* v, double* max_bytes) const {
+  const int last = NumberLevels() - 1;
+  const double base = options_->max_bytes_for_level_base;
+  const double multiplier = options_->max_bytes_for_level_multiplier;
+  // Note: the result for level zero is not really used since we set
+  // the level-0 compaction threshold based on number of files.
+  max_bytes[0] = base;
+  if (options_->level_compaction_dynamic_level_bytes) {
+    // Each level holds about 1/multiplier of the bytes of the next one,
+    // down to the last level whatever its size, which bounds the space
+    // taken by obsolete entries.
+    double limit = TotalFileSize(v->files_[last]);
+    for (int level = last - 1; level >= 1; level--) {
+      limit /= multiplier;
+      max_bytes[level] = std::max(limit, base);
+    }
+  } else {
+    double limit = base;
+    for (int level = 1; level < last; level++) {
+      max_bytes[level] = limit;
+      limit *= multiplier;
+    }
+  }
+}
+
 void VersionSet::Finalize(Version* v) {
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    // Only level-0 runs are compacted, and they are merged into one
+    const size_t runs = v->files_[0].size();
+    v->compaction_level_ = 0;
+    v->compaction_score_ = (runs < 2) ? 0 : runs /
+        static_cast<double>(options_->level0_file_num_compaction_trigger);
+    v->pending_compaction_bytes_ = 0;
+    return;
+  }
+
+  double max_bytes[config::kMaxNumLevels];
+  LevelMaxBytes(v, max_bytes);
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
 
-  for (int level = 0; level < config::kNumLevels-1; level++) {
+  for (int level = 0; level < NumberLevels()-1; level++) {
     double score;
     if (level == 0) {
       // We treat level-0 specially by bounding the number of files
@@ -933,11 +1157,11 @@ void VersionSet::Finalize(Version* v) {
       // setting, or very high compression ratios, or lots of
       // overwrites/deletions).
       score = v->files_[level].size() /
-          static_cast<double>(config::kL0_CompactionTrigger);
+          static_cast<double>(options_->level0_file_num_compaction_trigger);
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score = static_cast<double>(level_bytes) / MaxBytesForLevel(level);
+      score = static_cast<double>(level_bytes) / max_bytes[level];
     }
 
     if (score > best_score) {
@@ -948,6 +1172,67 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Estimate how many bytes compactions have to rewrite to bring every
+  // level within its size limit.  Bytes pushed out of a level are
+  // merged with about max_bytes_for_level_multiplier times as many bytes
+  // of the next level.
+  const uint64_t rewrite_factor = options_->max_bytes_for_level_multiplier + 1;
+  uint64_t pending = 0;
+  uint64_t inflow = 0;
+  if (v->files_[0].size() >=
+      static_cast<size_t>(options_->level0_file_num_compaction_trigger)) {
+    inflow = TotalFileSize(v->files_[0]);
+    pending += inflow;
+  }
+  for (int level = 1; level < NumberLevels()-1; level++) {
+    const uint64_t level_bytes = TotalFileSize(v->files_[level]) + inflow;
+    const uint64_t limit = static_cast<uint64_t>(max_bytes[level]);
+    if (level_bytes > limit) {
+      inflow = level_bytes - limit;
+      pending += inflow * rewrite_factor;
+    } else {
+      inflow = 0;
+    }
+  }
+  v->pending_compaction_bytes_ = pending;
+
+  // Pick the file densest in deletions above the last level, whose
+  // deletions cannot be pushed further down
+  const int percent = options_->deletion_compaction_percent;
+  for (int level = 0; percent > 0 && level < NumberLevels()-1; level++) {
+    const std::vector<FileMetaData*>& files = v->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      FileMetaData* best = v->deletion_compaction_file_;
+      if (f->num_entries > 0 &&
+          f->num_deletions * 100 >= f->num_entries * percent &&
+          (best == NULL ||
+           f->num_deletions * best->num_entries >
+               best->num_deletions * f->num_entries)) {
+        v->deletion_compaction_file_ = f;
+        v->deletion_compaction_level_ = level;
+      }
+    }
+  }
+
+  // Pick the file that refers to the oldest blob file in need of garbage
+  // collection.  Level-0 files are left to the compactions that soon
+  // merge them anyway.
+  for (int level = 1; !v->blob_files_.empty() && level < NumberLevels();
+       level++) {
+    const std::vector<FileMetaData*>& files = v->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      FileMetaData* best = v->blob_compaction_file_;
+      if (f->oldest_blob_file != 0 &&
+          (best == NULL || f->oldest_blob_file < best->oldest_blob_file) &&
+          v->NeedsBlobGarbageCollection(f->oldest_blob_file)) {
+        v->blob_compaction_file_ = f;
+        v->blob_compaction_level_ = level;
+      }
+    }
+  }
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -958,7 +1243,7 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
   edit.SetComparatorName(icmp_.user_comparator()->Name());
 
   // Save compaction pointers
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < config::kMaxNumLevels; level++) {
     if (!compact_pointer_[level].empty()) {
       InternalKey key;
       key.DecodeFrom(compact_pointer_[level]);
@@ -967,14 +1252,32 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
   }
 
   // Save files
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < config::kMaxNumLevels; level++) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
     }
   }
 
+  // Save blob files
+  for (std::map<uint64_t, BlobFileMetaData>::const_iterator it =
+           current_->blob_files_.begin();
+       it != current_->blob_files_.end();
+       ++it) {
+    edit.AddBlobFile(it->first, it->second.total_bytes);
+    if (it->second.garbage_bytes > 0) {
+      edit.AddBlobGarbage(it->first, it->second.garbage_bytes);
+    }
+  }
+
+  // Save column families
+  for (ColumnFamilyMap::const_iterator iter = column_families_.begin();
+       iter != column_families_.end();
+       ++iter) {
+    edit.AddColumnFamily(iter->second, iter->first);
+  }
+
   std::string record;
   edit.EncodeTo(&record);
   return log->AddRecord(record);
@@ -982,28 +1285,26 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
 
 int VersionSet::NumLevelFiles(int level) const {
   assert(level >= 0);
-  assert(level < config::kNumLevels);
+  assert(level < NumberLevels());
   return current_->files_[level].size();
 }
 
 const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
-  // Update code if kNumLevels changes
-  assert(config::kNumLevels == 7);
-  snprintf(scratch->buffer, sizeof(scratch->buffer),
-           "files[ %d %d %d %d %d %d %d ]",
-           int(current_->files_[0].size()),
-           int(current_->files_[1].size()),
-           int(current_->files_[2].size()),
-           int(current_->files_[3].size()),
-           int(current_->files_[4].size()),
-           int(current_->files_[5].size()),
-           int(current_->files_[6].size()));
+  char* p = scratch->buffer;
+  char* limit = scratch->buffer + sizeof(scratch->buffer);
+  p += snprintf(p, limit - p, "files[");
+  for (int level = 0; level < NumberLevels() && p < limit; level++) {
+    p += snprintf(p, limit - p, " %d", int(current_->files_[level].size()));
+  }
+  if (p < limit) {
+    snprintf(p, limit - p, " ]");
+  }
   return scratch->buffer;
 }
 
 uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   uint64_t result = 0;
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < NumberLevels(); level++) {
     const std::vector<FileMetaData*>& files = v->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       if (icmp_.Compare(files[i]->largest, ikey) <= 0) {
@@ -1022,7 +1323,8 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
         // approximate offset of "ikey" within the table.
         Table* tableptr;
         Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+            ReadOptions(), files[i]->number, files[i]->file_size,
+            files[i]->path_id, &tableptr);
         if (tableptr != NULL) {
           result += tableptr->ApproximateOffsetOf(ikey.Encode());
         }
@@ -1037,25 +1339,84 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   for (Version* v = dummy_versions_.next_;
        v != &dummy_versions_;
        v = v->next_) {
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < config::kMaxNumLevels; level++) {
       const std::vector<FileMetaData*>& files = v->files_[level];
       for (size_t i = 0; i < files.size(); i++) {
         live->insert(files[i]->number);
       }
     }
+    for (std::map<uint64_t, BlobFileMetaData>::const_iterator it =
+             v->blob_files_.begin();
+         it != v->blob_files_.end();
+         ++it) {
+      live->insert(it->first);
+    }
   }
 }
 
+void VersionSet::AddCurrentFiles(std::vector<std::string>* files) const {
+  std::vector<FileMetaData*> current_files;
+  current_->AddFiles(&current_files);
+  for (size_t i = 0; i < current_files.size(); i++) {
+    files->push_back(TableFileName(options_->db_paths,
+                                   current_files[i]->number,
+                                   current_files[i]->path_id));
+  }
+  for (std::map<uint64_t, BlobFileMetaData>::const_iterator it =
+           current_->blob_files_.begin();
+       it != current_->blob_files_.end();
+       ++it) {
+    files->push_back(BlobFileName(dbname_, it->first));
+  }
+}
+
+uint64_t VersionSet::ManifestFileSize() const {
+  return (descriptor_log_ == NULL) ? 0 : descriptor_log_->Size();
+}
+
+uint32_t VersionSet::PathIdForLevel(int level) const {
+  const std::vector<DbPath>& paths = options_->db_paths;
+  if (paths.size() <= 1) {
+    return 0;
+  }
+  const int last = NumberLevels() - 1;
+  double max_bytes[config::kMaxNumLevels];
+  LevelMaxBytes(current_, max_bytes);
+
+  // Fill the paths from level 0 down, moving on to the next path when
+  // a level does not fit in what is left of the current one.  The last
+  // path takes the levels that fit nowhere else.
+  uint32_t path_id = 0;
+  double room = paths[0].target_size;
+  for (int l = 0; l <= level; l++) {
+    double level_bytes;
+    if (l == 0) {
+      level_bytes = static_cast<double>(options_->write_buffer_size) *
+                    options_->level0_file_num_compaction_trigger;
+    } else if (l == last) {
+      level_bytes = TotalFileSize(current_->files_[last]);
+    } else {
+      level_bytes = max_bytes[l];
+    }
+    while (level_bytes > room && path_id + 1 < paths.size()) {
+      path_id++;
+      room = paths[path_id].target_size;
+    }
+    room -= level_bytes;
+  }
+  return path_id;
+}
+
 int64_t VersionSet::NumLevelBytes(int level) const {
   assert(level >= 0);
-  assert(level < config::kNumLevels);
+  assert(level < NumberLevels());
   return TotalFileSize(current_->files_[level]);
 }
 
 int64_t VersionSet::MaxNextLevelOverlappingBytes() {
   int64_t result = 0;
   std::vector<FileMetaData*> overlaps;
-  for (int level = 1; level < config::kNumLevels - 1; level++) {
+  for (int level = 1; level < NumberLevels() - 1; level++) {
     for (size_t i = 0; i < current_->files_[level].size(); i++) {
       const FileMetaData* f = current_->files_[level][i];
       current_->GetOverlappingInputs(level+1, &f->smallest, &f->largest,
@@ -1123,7 +1484,8 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
           list[num++] = table_cache_->NewIterator(
-              options, files[i]->number, files[i]->file_size);
+              options, files[i]->number, files[i]->file_size,
+              files[i]->path_id);
         }
       } else {
         // Create concatenating iterator for the files from this level
@@ -1143,6 +1505,10 @@ Compaction* VersionSet::PickCompaction() {
   Compaction* c;
   int level;
 
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    return PickUniversalCompaction();
+  }
+
   // We prefer compactions triggered by too much data in a level over
   // the compactions triggered by seeks.
   const bool size_compaction = (current_->compaction_score_ >= 1);
@@ -1150,26 +1516,46 @@ Compaction* VersionSet::PickCompaction() {
   if (size_compaction) {
     level = current_->compaction_level_;
     assert(level >= 0);
-    assert(level+1 < config::kNumLevels);
-    c = new Compaction(level);
+    assert(level+1 < NumberLevels());
+    c = new Compaction(level, level == 0 ? kCompactionReasonLevel0Files
+                                         : kCompactionReasonLevelBytes);
 
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
+    if (options_->compaction_pri == kCompactionPriMinOverlappingRatio) {
+      c->inputs_[0].push_back(MinOverlappingRatioFile(level));
+    } else {
+      // Pick the first file that comes after compact_pointer_[level]
+      for (size_t i = 0; i < current_->files_[level].size(); i++) {
+        FileMetaData* f = current_->files_[level][i];
+        if (compact_pointer_[level].empty() ||
+            icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
+          c->inputs_[0].push_back(f);
+          break;
+        }
+      }
+      if (c->inputs_[0].empty()) {
+        // Wrap-around to the beginning of the key space
+        c->inputs_[0].push_back(current_->files_[level][0]);
       }
-    }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
     }
   } else if (seek_compaction) {
     level = current_->file_to_compact_level_;
-    c = new Compaction(level);
+    c = new Compaction(level, kCompactionReasonSeek);
     c->inputs_[0].push_back(current_->file_to_compact_);
+    RecordTick(options_->statistics, kSeekCompactions);
+  } else if (current_->deletion_compaction_file_ != NULL) {
+    level = current_->deletion_compaction_level_;
+    c = new Compaction(level, kCompactionReasonDeletions);
+    c->inputs_[0].push_back(current_->deletion_compaction_file_);
+  } else if (current_->blob_compaction_file_ != NULL) {
+    // The file is rewritten in its level, moving the values it refers to
+    // out of the blob files that need garbage collection
+    level = current_->blob_compaction_level_;
+    c = new Compaction(level, kCompactionReasonBlobGarbageCollection);
+    c->output_level_ = level;
+    c->inputs_[0].push_back(current_->blob_compaction_file_);
+    c->input_version_ = current_;
+    c->input_version_->Ref();
+    return c;
   } else {
     return NULL;
   }
@@ -1187,12 +1573,132 @@ Compaction* VersionSet::PickCompaction() {
     current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
     assert(!c->inputs_[0].empty());
   }
+  if (c->reason() != kCompactionReasonDeletions) {
+    // The deletions are only dropped if the file is rewritten
+    ExtendTrivialMove(c);
+  }
 
   SetupOtherInputs(c);
 
   return c;
 }
 
+Compaction* VersionSet::PickUniversalCompaction() {
+  std::vector<FileMetaData*> runs = current_->files_[0];
+  const size_t n = runs.size();
+  if (n < 2 ||
+      n < static_cast<size_t>(options_->level0_file_num_compaction_trigger)) {
+    return NULL;
+  }
+  std::sort(runs.begin(), runs.end(), NewestFirst);
+
+  // Files written by older releases do not record sequence numbers, so
+  // only merging all runs keeps their order.
+  bool unordered = false;
+  uint64_t newer_bytes = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (runs[i]->largest_seqno == 0) {
+      unordered = true;
+    }
+    if (i + 1 < n) {
+      newer_bytes += runs[i]->file_size;
+    }
+  }
+
+  // Merge all runs if the newer ones take too much space compared to the
+  // oldest, which holds most of the data: entries they overwrite or
+  // delete are only dropped by merging them with it.
+  const uint64_t oldest_bytes = runs[n - 1]->file_size;
+  if (unordered ||
+      newer_bytes * 100 > oldest_bytes *
+          options_->universal_max_size_amplification_percent) {
+    return NewUniversalCompaction(kCompactionReasonUniversalSizeAmplification,
+                                  runs, false);
+  }
+
+  // Merge the first sequence of consecutive runs, from newest to oldest,
+  // in which each run is not much larger than the ones before it
+  // combined.  Each byte is then rewritten a logarithmic number of times.
+  for (size_t first = 0; first + 1 < n; first++) {
+    uint64_t candidate_bytes = runs[first]->file_size;
+    size_t last = first + 1;
+    while (last < n &&
+           runs[last]->file_size * 100 <=
+               candidate_bytes * (100 + options_->universal_size_ratio)) {
+      candidate_bytes += runs[last]->file_size;
+      last++;
+    }
+    if (last - first >= static_cast<size_t>(
+            options_->universal_min_merge_width)) {
+      std::vector<FileMetaData*> inputs(runs.begin() + first,
+                                        runs.begin() + last);
+      return NewUniversalCompaction(kCompactionReasonUniversalSizeRatio,
+                                    inputs, last < n);
+    }
+  }
+
+  // Otherwise merge the newest runs, so that fewer than
+  // level0_file_num_compaction_trigger remain.
+  const size_t count = std::min(n, std::max<size_t>(
+      2, n + 2 - options_->level0_file_num_compaction_trigger));
+  std::vector<FileMetaData*> inputs(runs.begin(), runs.begin() + count);
+  return NewUniversalCompaction(kCompactionReasonUniversalRunCount,
+                                inputs, count < n);
+}
+
+Compaction* VersionSet::NewUniversalCompaction(
+    CompactionReason reason,
+    const std::vector<FileMetaData*>& inputs,
+    bool has_older_runs) {
+  Compaction* c = new Compaction(0, reason);
+  c->output_level_ = 0;
+  c->max_output_file_size_ = ~static_cast<uint64_t>(0);  // A single run
+  c->has_older_runs_ = has_older_runs;
+  c->inputs_[0] = inputs;
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  return c;
+}
+
+FileMetaData* VersionSet::MinOverlappingRatioFile(int level) {
+  const Comparator* ucmp = icmp_.user_comparator();
+  const std::vector<FileMetaData*>& files = current_->files_[level];
+  const std::vector<FileMetaData*>& next = current_->files_[level + 1];
+  FileMetaData* best = NULL;
+  double best_ratio = 0;
+  std::vector<FileMetaData*> overlaps;
+  size_t first = 0;  // First file of "next" that may overlap files[i]
+  for (size_t i = 0; i < files.size(); i++) {
+    FileMetaData* f = files[i];
+    uint64_t overlapping_bytes = 0;
+    if (level == 0) {
+      // Level-0 files are not sorted
+      current_->GetOverlappingInputs(1, &f->smallest, &f->largest, &overlaps);
+      overlapping_bytes = TotalFileSize(overlaps);
+    } else {
+      while (first < next.size() &&
+             ucmp->Compare(next[first]->largest.user_key(),
+                           f->smallest.user_key()) < 0) {
+        first++;
+      }
+      for (size_t j = first;
+           j < next.size() &&
+               ucmp->Compare(next[j]->smallest.user_key(),
+                             f->largest.user_key()) <= 0;
+           j++) {
+        overlapping_bytes += next[j]->file_size;
+      }
+    }
+    const double ratio = static_cast<double>(overlapping_bytes) /
+        std::max<uint64_t>(f->file_size, 1);
+    if (best == NULL || ratio < best_ratio) {
+      best = f;
+      best_ratio = ratio;
+    }
+  }
+  return best;
+}
+
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
@@ -1234,7 +1740,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
 
   // Compute the set of grandparent files that overlap this compaction
   // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
+  if (level + 2 < NumberLevels()) {
     current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
                                    &c->grandparents_);
   }
@@ -1254,6 +1760,55 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   c->edit_.SetCompactPointer(level, largest);
 }
 
+void VersionSet::ExtendTrivialMove(Compaction* c) {
+  const int level = c->level();
+  if (c->inputs_[0].size() != 1) {
+    return;  // Overlapping level-0 files
+  }
+  InternalKey smallest, largest;
+  GetRange(c->inputs_[0], &smallest, &largest);
+  std::vector<FileMetaData*> overlaps;
+  current_->GetOverlappingInputs(level + 1, &smallest, &largest, &overlaps);
+  if (!overlaps.empty()) {
+    return;
+  }
+
+  // Level-0 files may overlap each other; the ones that do are skipped
+  const Comparator* ucmp = icmp_.user_comparator();
+  std::vector<FileMetaData*> files = current_->files_[level];
+  if (level == 0) {
+    std::sort(files.begin(), files.end(), SmallestKeyLess(&icmp_));
+  }
+  size_t next = 0;
+  while (files[next] != c->inputs_[0][0]) {
+    next++;
+  }
+  for (next++; next < files.size(); next++) {
+    FileMetaData* f = files[next];
+    if (level == 0 &&
+        ((next + 1 < files.size() &&
+          ucmp->Compare(f->largest.user_key(),
+                        files[next + 1]->smallest.user_key()) >= 0) ||
+         ucmp->Compare(files[next - 1]->largest.user_key(),
+                       f->smallest.user_key()) >= 0)) {
+      break;
+    }
+    current_->GetOverlappingInputs(level + 1, &smallest, &f->largest,
+                                   &overlaps);
+    if (!overlaps.empty()) {
+      break;
+    }
+    if (level + 2 < NumberLevels()) {
+      current_->GetOverlappingInputs(level + 2, &smallest, &f->largest,
+                                     &overlaps);
+      if (TotalFileSize(overlaps) > kMaxGrandParentOverlapBytes) {
+        break;
+      }
+    }
+    c->inputs_[0].push_back(f);
+  }
+}
+
 Compaction* VersionSet::CompactRange(
     int level,
     const InternalKey* begin,
@@ -1263,6 +1818,12 @@ Compaction* VersionSet::CompactRange(
   if (inputs.empty()) {
     return NULL;
   }
+  if (level == 0 &&
+      options_->compaction_style == kCompactionStyleUniversal) {
+    // Runs cannot be merged out of order, so all of them are
+    return NewUniversalCompaction(kCompactionReasonManual,
+                                  current_->files_[0], false);
+  }
 
   // Avoid compacting too much in one shot in case the range is large.
   const uint64_t limit = MaxFileSizeForLevel(level);
@@ -1276,7 +1837,7 @@ Compaction* VersionSet::CompactRange(
     }
   }
 
-  Compaction* c = new Compaction(level);
+  Compaction* c = new Compaction(level, kCompactionReasonManual);
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
@@ -1284,14 +1845,17 @@ Compaction* VersionSet::CompactRange(
   return c;
 }
 
-Compaction::Compaction(int level)
+Compaction::Compaction(int level, CompactionReason reason)
     : level_(level),
+      output_level_(level + 1),
+      reason_(reason),
       max_output_file_size_(MaxFileSizeForLevel(level)),
       input_version_(NULL),
       grandparent_index_(0),
       seen_key_(false),
-      overlapped_bytes_(0) {
-  for (int i = 0; i < config::kNumLevels; i++) {
+      overlapped_bytes_(0),
+      has_older_runs_(false) {
+  for (int i = 0; i < config::kMaxNumLevels; i++) {
     level_ptrs_[i] = 0;
   }
 }
@@ -1306,9 +1870,36 @@ bool Compaction::IsTrivialMove() const {
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 &&
-          num_input_files(1) == 0 &&
-          TotalFileSize(grandparents_) <= kMaxGrandParentOverlapBytes);
+  if (output_level_ == level_ ||
+      reason_ == kCompactionReasonDeletions ||
+      num_input_files(1) != 0 ||
+      TotalFileSize(grandparents_) > kMaxGrandParentOverlapBytes) {
+    return false;
+  }
+  // A moved file stays where it is, so it must already be in the
+  // directory of the output level.
+  const uint32_t path_id = input_version_->vset_->PathIdForLevel(
+      output_level_);
+  for (size_t i = 0; i < inputs_[0].size(); i++) {
+    if (inputs_[0][i]->path_id != path_id) {
+      return false;
+    }
+  }
+  if (level_ == 0 && num_input_files(0) > 1) {
+    // Level-0 files that overlap each other must be merged
+    const Comparator* ucmp = input_version_->vset_->icmp_.user_comparator();
+    for (size_t i = 0; i < inputs_[0].size(); i++) {
+      for (size_t j = i + 1; j < inputs_[0].size(); j++) {
+        const FileMetaData* a = inputs_[0][i];
+        const FileMetaData* b = inputs_[0][j];
+        if (ucmp->Compare(a->largest.user_key(), b->smallest.user_key()) >= 0 &&
+            ucmp->Compare(b->largest.user_key(), a->smallest.user_key()) >= 0) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
@@ -1317,12 +1908,41 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
       edit->DeleteFile(level_ + which, inputs_[which][i]->number);
     }
   }
+  for (size_t i = 0; i < dropped_inputs_.size(); i++) {
+    edit->DeleteFile(level_ + 1, dropped_inputs_[i]->number);
+  }
+}
+
+int Compaction::DropCoveredInputs(const RangeDeletions& deletions,
+                                  SequenceNumber snapshot) {
+  // The entries of the "level+1" files are older than the deletions of
+  // the "level" files, so a file is hidden once its key range is covered.
+  std::vector<FileMetaData*> kept;
+  const size_t dropped_before = dropped_inputs_.size();
+  for (size_t i = 0; i < inputs_[1].size(); i++) {
+    FileMetaData* f = inputs_[1][i];
+    // Files that refer to blob files are read, so that the blob values
+    // they drop are counted as garbage
+    if (f->oldest_blob_file == 0 &&
+        deletions.CoversRange(f->smallest.user_key(), f->largest.user_key(),
+                              snapshot)) {
+      dropped_inputs_.push_back(f);
+    } else {
+      kept.push_back(f);
+    }
+  }
+  inputs_[1].swap(kept);
+  return dropped_inputs_.size() - dropped_before;
 }
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   // Maybe use binary search to find right entry instead of linear search?
+  if (has_older_runs_) {
+    return false;
+  }
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  const int num_levels = input_version_->vset_->NumberLevels();
+  for (int lvl = output_level_ + 1; lvl < num_levels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
     for (; level_ptrs_[lvl] < files.size(); ) {
       FileMetaData* f = files[level_ptrs_[lvl]];
@@ -1340,6 +1960,19 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  if (has_older_runs_) {
+    return false;
+  }
+  const int num_levels = input_version_->vset_->NumberLevels();
+  for (int lvl = output_level_ + 1; lvl < num_levels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
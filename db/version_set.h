@@ -20,6 +20,7 @@
 #include <vector>
 #include "db/dbformat.h"
 #include "db/version_edit.h"
+#include "leveldb/listener.h"
 #include "port/port.h"
 
 namespace leveldb {
@@ -29,6 +30,7 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class RangeDeletions;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -64,13 +66,24 @@ class Version {
 
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
+  // Merge operands that are newer than the value are appended to
+  // *merge_operands, newest first.  *max_covering_deletion is as for
+  // MemTable::Get().
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
+  // If the value is kept in a blob file, *val is set to its BlobIndex
+  // instead and *is_blob_index to true.
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, std::vector<std::string>* merge_operands,
+             SequenceNumber* max_covering_deletion, bool* is_blob_index);
+
+  // Append the range deletions of the files of this Version to
+  // *deletions.
+  // REQUIRES: lock is not held
+  Status AddRangeDeletions(RangeDeletions* deletions);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -103,6 +116,14 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Append the files of this version to *files, level by level.
+  void AddFiles(std::vector<FileMetaData*>* files) const;
+
+  // Returns true iff the blob file "number" holds so much garbage that
+  // compactions should move its values to new blob files (see
+  // Options::blob_garbage_collection_ratio).
+  bool NeedsBlobGarbageCollection(uint64_t number) const;
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -113,30 +134,58 @@ class Version {
   class LevelFileNumIterator;
   Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
 
+  // Returns true iff some level has files and all of their keys are
+  // before "smallest_user_key", as when keys are inserted in increasing
+  // order.
+  bool IsAfterAllKeys(const Slice& smallest_user_key) const;
+
   VersionSet* vset_;            // VersionSet to which this Version belongs
   Version* next_;               // Next version in linked list
   Version* prev_;               // Previous version in linked list
   int refs_;                    // Number of live refs to this version
 
   // List of files per level
-  std::vector<FileMetaData*> files_[config::kNumLevels];
+  std::vector<FileMetaData*> files_[config::kMaxNumLevels];
+
+  // Blob files referred to by the tables, keyed by number
+  std::map<uint64_t, BlobFileMetaData> blob_files_;
 
   // Next file to compact based on seek stats.
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
+  // File to compact because of its deletions (see
+  // Options::deletion_compaction_percent), or NULL.  Initialized by
+  // Finalize().
+  FileMetaData* deletion_compaction_file_;
+  int deletion_compaction_level_;
+
+  // File to rewrite because it refers to a blob file that needs garbage
+  // collection, or NULL.  Initialized by Finalize().
+  FileMetaData* blob_compaction_file_;
+  int blob_compaction_level_;
+
   // Level that should be compacted next and its compaction score.
   // Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
 
+  // Estimated number of bytes that compactions have to rewrite before
+  // every level is within its size limit.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
+
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
+        deletion_compaction_file_(NULL),
+        deletion_compaction_level_(-1),
+        blob_compaction_file_(NULL),
+        blob_compaction_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_level_(-1),
+        pending_compaction_bytes_(0) {
   }
 
   ~Version();
@@ -173,6 +222,9 @@ class VersionSet {
   // Allocate and return a new file number
   uint64_t NewFileNumber() { return next_file_number_++; }
 
+  // Return the number of levels of the DB (Options::num_levels).
+  int NumberLevels() const { return options_->num_levels; }
+
   // Return the number of Table files at the specified level.
   int NumLevelFiles(int level) const;
 
@@ -198,6 +250,14 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
+  // Allocate and return a new column family id.  The id is only
+  // recorded once an edit registering it has been applied.
+  uint32_t NewColumnFamilyId() { return ++max_column_family_; }
+
+  // Return the registered column families, keyed by name.
+  typedef std::map<std::string, uint32_t> ColumnFamilyMap;
+  const ColumnFamilyMap& ColumnFamilies() const { return column_families_; }
+
   // Pick level and inputs for a new compaction.
   // Returns NULL if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
@@ -224,13 +284,33 @@ class VersionSet {
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != NULL);
+    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != NULL) ||
+        (v->deletion_compaction_file_ != NULL) ||
+        (v->blob_compaction_file_ != NULL);
+  }
+
+  // Return the estimated number of bytes that compactions have to
+  // rewrite before every level is within its size limit.
+  uint64_t PendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
   }
 
   // Add all files listed in any live version to *live.
   // May also mutate some internal state.
   void AddLiveFiles(std::set<uint64_t>* live);
 
+  // Append the names of the table and blob files of the current version
+  // to *files.
+  void AddCurrentFiles(std::vector<std::string>* files) const;
+
+  // Return the number of bytes written so far to the current manifest.
+  // The manifest file may be longer than that if the Env pads it.
+  uint64_t ManifestFileSize() const;
+
+  // Return the index in Options::db_paths of the directory that new
+  // tables of "level" are written to (see Options::db_paths).
+  uint32_t PathIdForLevel(int level) const;
+
   // Return the approximate offset in the database of the data for
   // "key" as of version "v".
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
@@ -250,6 +330,10 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Store in max_bytes[level] the size limit of each level of "v" above
+  // the last one.
+  void LevelMaxBytes(Version* v, double* max_bytes) const;
+
   void GetRange(const std::vector<FileMetaData*>& inputs,
                 InternalKey* smallest,
                 InternalKey* largest);
@@ -261,11 +345,32 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Return the file of "level" that overlaps the fewest bytes of the next
+  // level relative to its size (see kCompactionPriMinOverlappingRatio).
+  FileMetaData* MinOverlappingRatioFile(int level);
+
+  // Pick a compaction of consecutive level-0 runs for
+  // kCompactionStyleUniversal, or return NULL.
+  Compaction* PickUniversalCompaction();
+
+  // Return a compaction that merges the level-0 runs "inputs" into one.
+  // "has_older_runs" tells whether the runs left out include older ones.
+  Compaction* NewUniversalCompaction(CompactionReason reason,
+                                     const std::vector<FileMetaData*>& inputs,
+                                     bool has_older_runs);
+
+  // Add to the inputs of "c", which overlap no file of the next level,
+  // the files that follow them in their level as long as that remains
+  // true, so that they are all moved at once.
+  void ExtendTrivialMove(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
   void AppendVersion(Version* v);
 
+  void RegisterColumnFamilies(const VersionEdit& edit);
+
   Env* const env_;
   const std::string dbname_;
   const Options* const options_;
@@ -276,6 +381,8 @@ class VersionSet {
   uint64_t last_sequence_;
   uint64_t log_number_;
   uint64_t prev_log_number_;  // 0 or backing store for memtable being compacted
+  ColumnFamilyMap column_families_;
+  uint32_t max_column_family_;
 
   // Opened lazily
   WritableFile* descriptor_file_;
@@ -285,7 +392,7 @@ class VersionSet {
 
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
-  std::string compact_pointer_[config::kNumLevels];
+  std::string compact_pointer_[config::kMaxNumLevels];
 
   // No copying allowed
   VersionSet(const VersionSet&);
@@ -301,6 +408,23 @@ class Compaction {
   // and "level+1" will be merged to produce a set of "level+1" files.
   int level() const { return level_; }
 
+  // Return the level of the files produced by this compaction: "level+1",
+  // or "level" for universal compactions, which merge level-0 runs, and
+  // for the compactions that rewrite a file to collect blob garbage.
+  int output_level() const { return output_level_; }
+
+  // Returns true iff the values of the blob file "number" should be
+  // moved to a new blob file by this compaction.
+  bool ShouldRelocateBlob(uint64_t number) const {
+    return input_version_->NeedsBlobGarbageCollection(number);
+  }
+
+  // Returns true iff the input version has blob files.
+  bool HasBlobFiles() const { return !input_version_->blob_files_.empty(); }
+
+  // Return why this compaction was picked.
+  CompactionReason reason() const { return reason_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -315,17 +439,28 @@ class Compaction {
   uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
 
   // Is this a trivial compaction that can be implemented by just
-  // moving a single input file to the next level (no merging or splitting)
+  // moving the input files to the next level (no merging or splitting)
   bool IsTrivialMove() const;
 
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Remove from the "level+1" inputs the files all of whose keys are
+  // covered by "deletions" at "snapshot", so that they are not read,
+  // unless they refer to blob files.
+  // They are still deleted by AddInputDeletions.  Returns the number of
+  // files removed.
+  int DropCoveredInputs(const RangeDeletions& deletions,
+                        SequenceNumber snapshot);
+
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
+  // the compaction is producing data in "output_level()" for which no
+  // older data exists, in levels greater than it or in older runs.
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Like IsBaseLevelForKey(), for all the keys in [begin,end].
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
@@ -338,15 +473,18 @@ class Compaction {
   friend class Version;
   friend class VersionSet;
 
-  explicit Compaction(int level);
+  Compaction(int level, CompactionReason reason);
 
   int level_;
+  int output_level_;
+  CompactionReason reason_;
   uint64_t max_output_file_size_;
   Version* input_version_;
   VersionEdit edit_;
 
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];      // The two sets of inputs
+  std::vector<FileMetaData*> dropped_inputs_; // See DropCoveredInputs()
 
   // State used to check for number of of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
@@ -358,11 +496,15 @@ class Compaction {
 
   // State for implementing IsBaseLevelForKey
 
+  // Some level-0 file that is not an input holds older entries (only
+  // for universal compactions, whose inputs are level-0 runs)
+  bool has_older_runs_;
+
   // level_ptrs_ holds indices into input_version_->levels_: our state
   // is that we are positioned at one of the file ranges for each
   // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
+  // all L > output_level_).
+  size_t level_ptrs_[config::kMaxNumLevels];
 };
 
 }
@@ -8,7 +8,13 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeMerge varstring varstring         |
+//    kTypeRangeDeletion varstring varstring |
+//    kTypeColumnFamilyValue varint32 varstring varstring |
+//    kTypeColumnFamilyDeletion varint32 varstring |
+//    kTypeColumnFamilyMerge varint32 varstring varstring |
+//    kTypeColumnFamilyRangeDeletion varint32 varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -16,6 +22,7 @@
 #include "leveldb/write_batch.h"
 
 #include "leveldb/db.h"
+#include "db/column_family.h"
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
@@ -23,6 +30,16 @@
 
 namespace leveldb {
 
+// Record tags that only appear inside a WriteBatch.  They carry the
+// column family id of the update and must not collide with ValueType.
+// ValueType grows from 0x0 up, so these tags start well above it.
+enum BatchRecordType {
+  kTypeColumnFamilyDeletion = 0x10,
+  kTypeColumnFamilyValue = 0x11,
+  kTypeColumnFamilyMerge = 0x12,
+  kTypeColumnFamilyRangeDeletion = 0x13
+};
+
 WriteBatch::WriteBatch() {
   Clear();
 }
@@ -31,6 +48,49 @@ WriteBatch::~WriteBatch() { }
 
 WriteBatch::Handler::~Handler() { }
 
+Status WriteBatch::Handler::PutCF(uint32_t column_family_id,
+                                  const Slice& key, const Slice& value) {
+  if (column_family_id != 0) {
+    return Status::InvalidArgument("column families not supported");
+  }
+  Put(key, value);
+  return Status::OK();
+}
+
+Status WriteBatch::Handler::DeleteCF(uint32_t column_family_id,
+                                     const Slice& key) {
+  if (column_family_id != 0) {
+    return Status::InvalidArgument("column families not supported");
+  }
+  Delete(key);
+  return Status::OK();
+}
+
+Status WriteBatch::Handler::Merge(const Slice& key, const Slice& value) {
+  return Status::NotSupported("merge");
+}
+
+Status WriteBatch::Handler::MergeCF(uint32_t column_family_id,
+                                    const Slice& key, const Slice& value) {
+  if (column_family_id != 0) {
+    return Status::InvalidArgument("column families not supported");
+  }
+  return Merge(key, value);
+}
+
+Status WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end) {
+  return Status::NotSupported("range deletion");
+}
+
+Status WriteBatch::Handler::DeleteRangeCF(uint32_t column_family_id,
+                                          const Slice& begin,
+                                          const Slice& end) {
+  if (column_family_id != 0) {
+    return Status::InvalidArgument("column families not supported");
+  }
+  return DeleteRange(begin, end);
+}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(12);
@@ -44,6 +104,8 @@ Status WriteBatch::Iterate(Handler* handler) const {
 
   input.remove_prefix(12);
   Slice key, value;
+  uint32_t column_family;
+  Status s;
   int found = 0;
   while (!input.empty()) {
     found++;
@@ -65,9 +127,63 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeMerge:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          s = handler->Merge(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          s = handler->DeleteRange(key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
+      case kTypeColumnFamilyValue:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          s = handler->PutCF(column_family, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Put");
+        }
+        break;
+      case kTypeColumnFamilyDeletion:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key)) {
+          s = handler->DeleteCF(column_family, key);
+        } else {
+          return Status::Corruption("bad WriteBatch Delete");
+        }
+        break;
+      case kTypeColumnFamilyMerge:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          s = handler->MergeCF(column_family, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch Merge");
+        }
+        break;
+      case kTypeColumnFamilyRangeDeletion:
+        if (GetVarint32(&input, &column_family) &&
+            GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value)) {
+          s = handler->DeleteRangeCF(column_family, key, value);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
+    if (!s.ok()) {
+      return s;
+    }
   }
   if (found != WriteBatchInternal::Count(this)) {
     return Status::Corruption("WriteBatch has wrong count");
@@ -105,28 +221,202 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeMerge));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
+void WriteBatch::Put(ColumnFamilyHandle* column_family,
+                     const Slice& key, const Slice& value) {
+  if (column_family == NULL || column_family->GetID() == 0) {
+    Put(key, value);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyValue));
+  PutVarint32(&rep_, column_family->GetID());
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::Delete(ColumnFamilyHandle* column_family, const Slice& key) {
+  if (column_family == NULL || column_family->GetID() == 0) {
+    Delete(key);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyDeletion));
+  PutVarint32(&rep_, column_family->GetID());
+  PutLengthPrefixedSlice(&rep_, key);
+}
+
+void WriteBatch::Merge(ColumnFamilyHandle* column_family,
+                       const Slice& key, const Slice& value) {
+  if (column_family == NULL || column_family->GetID() == 0) {
+    Merge(key, value);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyMerge));
+  PutVarint32(&rep_, column_family->GetID());
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
+void WriteBatch::DeleteRange(ColumnFamilyHandle* column_family,
+                             const Slice& begin, const Slice& end) {
+  if (column_family == NULL || column_family->GetID() == 0) {
+    DeleteRange(begin, end);
+    return;
+  }
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeColumnFamilyRangeDeletion));
+  PutVarint32(&rep_, column_family->GetID());
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
 namespace {
 class MemTableInserter : public WriteBatch::Handler {
  public:
   SequenceNumber sequence_;
   MemTable* mem_;
+  bool column_families_;
+  std::string key_;
 
   virtual void Put(const Slice& key, const Slice& value) {
-    mem_->Add(sequence_, kTypeValue, key, value);
+    mem_->Add(sequence_, kTypeValue, StorageKey(0, key), value);
     sequence_++;
   }
   virtual void Delete(const Slice& key) {
-    mem_->Add(sequence_, kTypeDeletion, key, Slice());
+    mem_->Add(sequence_, kTypeDeletion, StorageKey(0, key), Slice());
+    sequence_++;
+  }
+  virtual Status Merge(const Slice& key, const Slice& value) {
+    mem_->Add(sequence_, kTypeMerge, StorageKey(0, key), value);
     sequence_++;
+    return Status::OK();
+  }
+  virtual Status DeleteRange(const Slice& begin, const Slice& end) {
+    return DeleteRangeCF(0, begin, end);
+  }
+  virtual Status PutCF(uint32_t column_family_id,
+                       const Slice& key, const Slice& value) {
+    if (!column_families_) {
+      return WriteBatch::Handler::PutCF(column_family_id, key, value);
+    }
+    mem_->Add(sequence_, kTypeValue, StorageKey(column_family_id, key), value);
+    sequence_++;
+    return Status::OK();
+  }
+  virtual Status DeleteCF(uint32_t column_family_id, const Slice& key) {
+    if (!column_families_) {
+      return WriteBatch::Handler::DeleteCF(column_family_id, key);
+    }
+    mem_->Add(sequence_, kTypeDeletion, StorageKey(column_family_id, key),
+              Slice());
+    sequence_++;
+    return Status::OK();
+  }
+  virtual Status MergeCF(uint32_t column_family_id,
+                         const Slice& key, const Slice& value) {
+    if (!column_families_) {
+      return WriteBatch::Handler::MergeCF(column_family_id, key, value);
+    }
+    mem_->Add(sequence_, kTypeMerge, StorageKey(column_family_id, key), value);
+    sequence_++;
+    return Status::OK();
+  }
+  virtual Status DeleteRangeCF(uint32_t column_family_id,
+                               const Slice& begin, const Slice& end) {
+    if (!column_families_ && column_family_id != 0) {
+      return WriteBatch::Handler::DeleteRangeCF(column_family_id, begin, end);
+    }
+    std::string end_key = StorageKey(column_family_id, end).ToString();
+    mem_->Add(sequence_, kTypeRangeDeletion,
+              StorageKey(column_family_id, begin), end_key);
+    sequence_++;
+    return Status::OK();
+  }
+
+ private:
+  Slice StorageKey(uint32_t column_family_id, const Slice& key) {
+    if (!column_families_) {
+      return key;
+    }
+    key_.clear();
+    AppendColumnFamilyKey(&key_, column_family_id, key);
+    return key_;
   }
 };
 }
 
+namespace {
+class ColumnFamilyChecker : public WriteBatch::Handler {
+ public:
+  const std::set<uint32_t>* ids_;
+
+  virtual void Put(const Slice& key, const Slice& value) { }
+  virtual void Delete(const Slice& key) { }
+  virtual Status Merge(const Slice& key, const Slice& value) {
+    return Status::OK();
+  }
+  virtual Status DeleteRange(const Slice& begin, const Slice& end) {
+    return Status::OK();
+  }
+  virtual Status PutCF(uint32_t column_family_id,
+                       const Slice& key, const Slice& value) {
+    return Check(column_family_id);
+  }
+  virtual Status DeleteCF(uint32_t column_family_id, const Slice& key) {
+    return Check(column_family_id);
+  }
+  virtual Status MergeCF(uint32_t column_family_id,
+                         const Slice& key, const Slice& value) {
+    return Check(column_family_id);
+  }
+  virtual Status DeleteRangeCF(uint32_t column_family_id,
+                               const Slice& begin, const Slice& end) {
+    return Check(column_family_id);
+  }
+
+ private:
+  Status Check(uint32_t column_family_id) const {
+    if (column_family_id == kDefaultColumnFamilyId) {
+      return Status::OK();
+    } else if (ids_ == NULL) {
+      return Status::InvalidArgument("column families not supported");
+    } else if (ids_->count(column_family_id) == 0) {
+      return Status::InvalidArgument("no such column family");
+    }
+    return Status::OK();
+  }
+};
+}
+
+Status WriteBatchInternal::CheckColumnFamilies(const WriteBatch* b,
+                                               const std::set<uint32_t>* ids) {
+  ColumnFamilyChecker checker;
+  checker.ids_ = ids;
+  return b->Iterate(&checker);
+}
+
 Status WriteBatchInternal::InsertInto(const WriteBatch* b,
-                                      MemTable* memtable) {
+                                      MemTable* memtable,
+                                      bool column_families) {
   MemTableInserter inserter;
   inserter.sequence_ = WriteBatchInternal::Sequence(b);
   inserter.mem_ = memtable;
+  inserter.column_families_ = column_families;
   return b->Iterate(&inserter);
 }
 
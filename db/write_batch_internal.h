@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_WRITE_BATCH_INTERNAL_H_
 #define STORAGE_LEVELDB_DB_WRITE_BATCH_INTERNAL_H_
 
+#include <set>
 #include "leveldb/write_batch.h"
 
 namespace leveldb {
@@ -38,7 +39,19 @@ class WriteBatchInternal {
 
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
-  static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
+  // Apply the updates in "batch" to "memtable".  If "column_families"
+  // is true, keys are stored with their column family id prepended (see
+  // db/column_family.h); otherwise updates to any column family other
+  // than the default one are rejected.
+  static Status InsertInto(const WriteBatch* batch, MemTable* memtable,
+                           bool column_families = false);
+
+  // Return an InvalidArgument status if "batch" updates a column family
+  // other than the default one whose id is not in "*ids", or any column
+  // family other than the default one if "ids" is NULL.  Meant to reject
+  // a whole batch before any of it is logged or applied.
+  static Status CheckColumnFamilies(const WriteBatch* batch,
+                                    const std::set<uint32_t>* ids);
 };
 
 }
@@ -4,6 +4,7 @@
 
 #include "leveldb/db.h"
 
+#include "db/column_family.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/env.h"
@@ -35,11 +36,38 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(ikey.user_key.ToString());
         state.append(")");
         break;
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        break;
+      case kTypeRangeDeletion:
+      case kTypeBlobIndex:
+        // Kept apart from the other entries, or never in a memtable
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem->NewRangeDeletionIterator();
+  if (iter == NULL) {
+    iter = NewEmptyIterator();
+  }
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    ASSERT_EQ(kTypeRangeDeletion, ikey.type);
+    state.append("DeleteRange(");
+    state.append(ikey.user_key.ToString());
+    state.append(", ");
+    state.append(iter->value().ToString());
+    state.append(")@");
+    state.append(NumberToString(ikey.sequence));
+  }
+  delete iter;
   if (!s.ok()) {
     state.append("ParseError()");
   }
@@ -82,6 +110,104 @@ TEST(WriteBatchTest, Corruption) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Merge(Slice("foo"), Slice("baz"));
+  batch.Merge(Slice("box"), Slice("boo"));
+  WriteBatchInternal::SetSequence(&batch, 300);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Merge(box, boo)@302"
+            "Merge(foo, baz)@301"
+            "Put(foo, bar)@300",
+            PrintContents(&batch));
+}
+
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("g"));
+  batch.Delete(Slice("box"));
+  batch.DeleteRange(Slice("b"), Slice("c"));
+  WriteBatchInternal::SetSequence(&batch, 400);
+  ASSERT_EQ(4, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Delete(box)@402"
+            "Put(foo, bar)@400"
+            "DeleteRange(a, g)@401"
+            "DeleteRange(b, c)@403",
+            PrintContents(&batch));
+}
+
+namespace {
+class RecordPrinter : public WriteBatch::Handler {
+ public:
+  std::string state_;
+  virtual void Put(const Slice& key, const Slice& value) {
+    state_.append("Put(" + key.ToString() + ", " + value.ToString() + ")");
+  }
+  virtual void Delete(const Slice& key) {
+    state_.append("Delete(" + key.ToString() + ")");
+  }
+  virtual Status PutCF(uint32_t id, const Slice& key, const Slice& value) {
+    state_.append("PutCF(" + NumberToString(id) + ", " + key.ToString() +
+                  ", " + value.ToString() + ")");
+    return Status::OK();
+  }
+  virtual Status DeleteCF(uint32_t id, const Slice& key) {
+    state_.append("DeleteCF(" + NumberToString(id) + ", " +
+                  key.ToString() + ")");
+    return Status::OK();
+  }
+  virtual Status MergeCF(uint32_t id, const Slice& key, const Slice& value) {
+    state_.append("MergeCF(" + NumberToString(id) + ", " + key.ToString() +
+                  ", " + value.ToString() + ")");
+    return Status::OK();
+  }
+  virtual Status DeleteRangeCF(uint32_t id, const Slice& begin,
+                               const Slice& end) {
+    state_.append("DeleteRangeCF(" + NumberToString(id) + ", " +
+                  begin.ToString() + ", " + end.ToString() + ")");
+    return Status::OK();
+  }
+};
+}
+
+TEST(WriteBatchTest, ColumnFamilies) {
+  ColumnFamilyHandleImpl cf("family", 3);
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Put(&cf, Slice("baz"), Slice("boo"));
+  batch.Delete(&cf, Slice("box"));
+  batch.Delete(NULL, Slice("bax"));
+  batch.Merge(&cf, Slice("bam"), Slice("bop"));
+  batch.DeleteRange(&cf, Slice("bb"), Slice("bz"));
+  ASSERT_EQ(6, WriteBatchInternal::Count(&batch));
+
+  RecordPrinter printer;
+  ASSERT_OK(batch.Iterate(&printer));
+  ASSERT_EQ("Put(foo, bar)"
+            "PutCF(3, baz, boo)"
+            "DeleteCF(3, box)"
+            "Delete(bax)"
+            "MergeCF(3, bam, bop)"
+            "DeleteRangeCF(3, bb, bz)",
+            printer.state_);
+
+  // A DB rejects the whole batch, before applying any of it, if column
+  // families are not enabled or one of the families is not registered
+  std::set<uint32_t> ids;
+  ids.insert(3);
+  ASSERT_OK(WriteBatchInternal::CheckColumnFamilies(&batch, &ids));
+  ASSERT_TRUE(!WriteBatchInternal::CheckColumnFamilies(&batch, NULL).ok());
+  ids.clear();
+  ids.insert(4);
+  ASSERT_TRUE(!WriteBatchInternal::CheckColumnFamilies(&batch, &ids).ok());
+  WriteBatch plain;
+  plain.Put(Slice("foo"), Slice("bar"));
+  plain.Delete(NULL, Slice("bax"));
+  ASSERT_OK(WriteBatchInternal::CheckColumnFamilies(&plain, NULL));
+}
+
 }
 
 int main(int argc, char** argv) {
@@ -0,0 +1,82 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+namespace leveldb {
+
+// Credit is refilled at most once per this many microseconds so that
+// tiny writes do not each compute a refill.
+static const uint64_t kRefillInterval = 1024;
+
+// Credit never accumulates beyond this many microseconds worth of
+// writes, so that an idle period does not admit an unbounded burst.
+static const uint64_t kMaxBurstMicros = 100000;
+
+WriteController::WriteController(uint64_t max_rate)
+    : max_rate_(max_rate < kMinDelayedWriteRate ? kMinDelayedWriteRate
+                                                 : max_rate),
+      delayed_(false),
+      delayed_write_rate_(max_rate_),
+      credit_(0),
+      last_refill_micros_(0) {
+}
+
+void WriteController::SetRate(uint64_t rate) {
+  if (rate < kMinDelayedWriteRate) rate = kMinDelayedWriteRate;
+  if (rate > max_rate_) rate = max_rate_;
+  delayed_write_rate_ = rate;
+}
+
+void WriteController::SetDelayed(bool delayed, uint64_t initial_rate) {
+  if (delayed && !delayed_) {
+    SetRate(initial_rate);
+    credit_ = 0;
+    last_refill_micros_ = 0;
+  }
+  delayed_ = delayed;
+}
+
+void WriteController::SlowDown() {
+  SetRate(delayed_write_rate_ - delayed_write_rate_ / 5);
+}
+
+void WriteController::SpeedUp() {
+  SetRate(delayed_write_rate_ + delayed_write_rate_ / 4);
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t num_bytes) {
+  if (!delayed_) {
+    return 0;
+  }
+  if (credit_ >= num_bytes) {
+    credit_ -= num_bytes;
+    return 0;
+  }
+
+  if (last_refill_micros_ == 0) {
+    // First write after entering the delayed state
+    last_refill_micros_ = now_micros;
+  } else if (now_micros >= last_refill_micros_ + kRefillInterval) {
+    uint64_t elapsed = now_micros - last_refill_micros_;
+    if (elapsed > kMaxBurstMicros) elapsed = kMaxBurstMicros;
+    credit_ += elapsed * delayed_write_rate_ / 1000000;
+    last_refill_micros_ = now_micros;
+  }
+  if (credit_ >= num_bytes) {
+    credit_ -= num_bytes;
+    return 0;
+  }
+
+  // Wait until the missing credit has been refilled.  The credit that
+  // accumulates during the wait is consumed by this write.
+  const uint64_t missing = num_bytes - credit_;
+  uint64_t delay = missing * 1000000 / delayed_write_rate_;
+  if (delay < kRefillInterval) delay = kRefillInterval;
+  credit_ = 0;
+  last_refill_micros_ = now_micros + delay;
+  return delay;
+}
+
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+// A WriteController admits writes at a limited rate while compactions
+// are falling behind.  It is a token bucket: writes consume credit for
+// their size and credit is refilled at delayed_write_rate() bytes per
+// second.  A write that finds too little credit is delayed until
+// enough would have accumulated.
+//
+// The rate adapts to the state of the DB: it starts at the measured
+// compaction throughput and is lowered while the backlog keeps growing
+// and raised again while it shrinks.
+//
+// WriteController is not thread-safe; the DB calls it while holding its
+// mutex.
+class WriteController {
+ public:
+  // "max_rate" bounds delayed_write_rate() from above.
+  explicit WriteController(uint64_t max_rate);
+
+  // Rates are never lowered below this many bytes per second.
+  static const uint64_t kMinDelayedWriteRate = 16 << 10;
+
+  bool delayed() const { return delayed_; }
+  uint64_t delayed_write_rate() const { return delayed_write_rate_; }
+  uint64_t max_delayed_write_rate() const { return max_rate_; }
+
+  // Enter the delayed state with the specified initial rate, or leave
+  // it if "delayed" is false.
+  void SetDelayed(bool delayed, uint64_t initial_rate);
+
+  // Lower or raise the rate of the delayed state because the backlog of
+  // compaction work grew or shrank.
+  void SlowDown();
+  void SpeedUp();
+
+  // Return the number of microseconds that a write of "num_bytes"
+  // issued at "now_micros" has to wait, and consume its credit.
+  // Returns zero if the controller is not in the delayed state.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t num_bytes);
+
+ private:
+  void SetRate(uint64_t rate);
+
+  const uint64_t max_rate_;
+  bool delayed_;
+  uint64_t delayed_write_rate_;
+  uint64_t credit_;            // Bytes that may be written without delay
+  uint64_t last_refill_micros_;
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
@@ -0,0 +1,61 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class WriteControllerTest { };
+
+TEST(WriteControllerTest, NoDelayWhenNotDelayed) {
+  WriteController controller(1 << 20);
+  ASSERT_TRUE(!controller.delayed());
+  ASSERT_EQ(0, controller.GetDelay(1000000, 1 << 30));
+}
+
+TEST(WriteControllerTest, AdmitsAtRate) {
+  const uint64_t kRate = 1 << 20;  // 1MB/s
+  WriteController controller(10 * kRate);
+  controller.SetDelayed(true, kRate);
+  ASSERT_EQ(kRate, controller.delayed_write_rate());
+
+  // Writing one second's worth of data in 1KB writes issued at the
+  // moments the controller allows takes about one second.
+  uint64_t now = 1000000;
+  for (int i = 0; i < 1024; i++) {
+    now += controller.GetDelay(now, 1024);
+  }
+  ASSERT_GE(now - 1000000, 900000);
+  ASSERT_LE(now - 1000000, 1100000);
+
+  // Leaving the delayed state admits writes immediately
+  controller.SetDelayed(false, 0);
+  ASSERT_EQ(0, controller.GetDelay(now, 1 << 20));
+}
+
+TEST(WriteControllerTest, AdaptsRate) {
+  const uint64_t kRate = 1 << 20;
+  WriteController controller(2 * kRate);
+  controller.SetDelayed(true, kRate);
+  controller.SlowDown();
+  ASSERT_LT(controller.delayed_write_rate(), kRate);
+  controller.SpeedUp();
+  controller.SpeedUp();
+  ASSERT_GT(controller.delayed_write_rate(), kRate);
+
+  // Rates stay within [kMinDelayedWriteRate, max rate]
+  for (int i = 0; i < 100; i++) controller.SpeedUp();
+  ASSERT_EQ(2 * kRate, controller.delayed_write_rate());
+  for (int i = 0; i < 100; i++) controller.SlowDown();
+  ASSERT_EQ(WriteController::kMinDelayedWriteRate,
+            controller.delayed_write_rate());
+}
+
+}
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
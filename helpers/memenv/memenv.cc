@@ -330,6 +330,18 @@ class InMemoryEnv : public EnvWrapper {
     return Status::OK();
   }
 
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result) {
+    // Files in memory cost nothing to grow, so start afresh
+    Status s = RenameFile(old_fname, fname);
+    if (!s.ok()) {
+      *result = NULL;
+      return s;
+    }
+    return NewWritableFile(fname, result);
+  }
+
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) {
     MutexLock lock(&mutex_);
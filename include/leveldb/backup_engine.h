@@ -0,0 +1,122 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A BackupEngine keeps a series of backups of a DB in a directory of its
+// own, which may live on another file system than the DB.  Table files
+// are immutable and named by number, so a table file is copied by the
+// first backup that needs it and shared by the later ones: a backup
+// copies the descriptor and the table files written since the previous
+// backup.
+//
+// The backup directory is laid out as follows:
+//    meta/<id>              Files of backup <id> with their checksums
+//    private/<id>/          Descriptor of backup <id>
+//    shared/<n>_<crc>_<size>.sst
+//                           Table file <n> of the DB, shared by backups
+//
+// Every file is checksummed (crc32c) while it is copied, and table files
+// are also checked against their own block checksums, so that a corrupt
+// file neither enters nor leaves the backup directory unnoticed.
+//
+// A backup directory holds the backups of a single DB, and may be used
+// by only one BackupEngine at a time.  A BackupEngine is not thread-safe.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
+#define STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class DB;
+class Env;
+class RateLimiter;
+
+struct BackupEngineOptions {
+  // Directory the backups are kept in.  Created if missing.
+  std::string backup_dir;
+
+  // Used to access the files of the backups and of the DBs that are
+  // backed up or restored.
+  // Default: Env::Default()
+  Env* env;
+
+  // If non-NULL, the files written by backups and restores are written
+  // no faster than this limiter allows, at RateLimiter::IO_LOW.
+  // Default: NULL
+  RateLimiter* rate_limiter;
+
+  // Number of files copied or verified in parallel.
+  // Default: 1
+  int max_background_operations;
+
+  // Create a BackupEngineOptions object with default values for all fields.
+  BackupEngineOptions();
+};
+
+typedef uint32_t BackupID;
+
+struct BackupInfo {
+  BackupID backup_id;
+  uint64_t timestamp;       // Creation time, in seconds since the epoch
+  uint64_t size;            // Total size of the files, including shared ones
+  uint32_t number_files;
+
+  BackupInfo() : backup_id(0), timestamp(0), size(0), number_files(0) { }
+};
+
+class BackupEngine {
+ public:
+  // Open the backup directory options.backup_dir, creating it if needed.
+  // Leftovers of backups that failed or were interrupted are removed.
+  // Stores a pointer to the engine in *result on success, which the
+  // caller should delete when it is no longer needed.
+  static Status Open(const BackupEngineOptions& options,
+                     BackupEngine** result);
+
+  BackupEngine() { }
+  virtual ~BackupEngine();
+
+  // Add a backup of all of the writes made to "db" before the call.  The
+  // memtable of "db" is flushed first.  "db" must use the Env of the
+  // engine.
+  virtual Status CreateNewBackup(DB* db) = 0;
+
+  // Store in *backups the backups in the directory, oldest first.
+  virtual void GetBackupInfo(std::vector<BackupInfo>* backups) = 0;
+
+  // Delete backup "id", and the shared files no other backup uses.
+  virtual Status DeleteBackup(BackupID id) = 0;
+
+  // Delete all but the "num_backups_to_keep" latest backups.
+  virtual Status PurgeOldBackups(uint32_t num_backups_to_keep) = 0;
+
+  // Check that the files of backup "id" are present and have not been
+  // corrupted.  Returns a Corruption status if they have.
+  virtual Status VerifyBackup(BackupID id) = 0;
+
+  // Restore backup "id" into "db_dir", which is created if missing and
+  // must not be in use by an open DB.  The DB files already in "db_dir"
+  // are deleted first.  Fails without creating a CURRENT file in
+  // "db_dir" if any file of the backup turns out to be corrupt.  All of
+  // the files are restored into "db_dir", so the restored DB must be
+  // opened with Options::wal_dir and Options::db_paths cleared.
+  virtual Status RestoreDBFromBackup(BackupID id,
+                                     const std::string& db_dir) = 0;
+
+  // Restore the latest backup like RestoreDBFromBackup().
+  virtual Status RestoreDBFromLatestBackup(const std::string& db_dir) = 0;
+
+ private:
+  // No copying allowed
+  BackupEngine(const BackupEngine&);
+  void operator=(const BackupEngine&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_BACKUP_ENGINE_H_
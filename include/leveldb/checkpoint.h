@@ -0,0 +1,43 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A checkpoint is an openable copy of a DB as of a point in time, taken
+// while the DB stays open.  Table files are immutable, so they are hard
+// linked into the checkpoint when the file system allows it: a checkpoint
+// on the same file system costs little more than its descriptor until
+// the DB compacts the shared files away.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_CHECKPOINT_H_
+#define STORAGE_LEVELDB_INCLUDE_CHECKPOINT_H_
+
+#include <string>
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class DB;
+
+class Checkpoint {
+ public:
+  // Create in the new directory "checkpoint_dir" a DB holding all of the
+  // writes made to "db" before the call, with all of its column
+  // families.  The memtable of "db" is flushed first.  The checkpoint
+  // can be opened with DB::Open() like any DB, using the options "db"
+  // was opened with, except that Options::wal_dir and Options::db_paths
+  // must be cleared: all of the files of the checkpoint are kept in
+  // "checkpoint_dir".  Opening it with the directories of "db" would
+  // read, and delete, the files of "db" instead.
+  //
+  // Returns a non-OK status if "checkpoint_dir" already exists, or if
+  // "db" does not support GetLiveFiles().  Nothing is left behind on
+  // error.
+  static Status Create(DB* db, const std::string& checkpoint_dir);
+
+ private:
+  Checkpoint();
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_CHECKPOINT_H_
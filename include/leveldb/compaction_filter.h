@@ -0,0 +1,79 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionFilter is consulted for every key that a compaction
+// rewrites (see Options::compaction_filter).  It can keep the value,
+// remove the key, or replace the value, so that data which is no longer
+// needed goes away as a side effect of compaction instead of through
+// explicit deletions.
+//
+// The filter sees the newest value of a key in the compaction.  It is not
+// consulted for keys in memtables or in files that are not compacted, so
+// reads may still return entries that it would remove.  Filtering ignores
+// snapshots: a snapshot may observe the removal or change of a value
+// that was written before the snapshot was taken.
+//
+// Filters are called from the background compaction thread without any
+// lock of the DB held, and must not call back into the DB.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class Env;
+
+class CompactionFilter {
+ public:
+  enum Decision {
+    kKeep = 0,          // Keep the value unchanged
+    kRemove = 1,        // Remove the key as if it had been deleted
+    kChangeValue = 2    // Replace the value with *new_value
+  };
+
+  CompactionFilter() { }
+  virtual ~CompactionFilter();
+
+  // Decide what to do with "value", the value of "key" in a compaction
+  // whose output goes to "level".  For column family DBs, "key" is the
+  // key within its column family.
+  virtual Decision Filter(int level, const Slice& key, const Slice& value,
+                          std::string* new_value) const = 0;
+
+  // The name of the filter, for the info log.
+  virtual const char* Name() const = 0;
+
+ private:
+  // No copying allowed
+  CompactionFilter(const CompactionFilter&);
+  void operator=(const CompactionFilter&);
+};
+
+// Time-to-live support.  Values are written with a timestamp suffix by
+// AppendTTLTimestamp(), which the application strips again with
+// StripTTLTimestamp() when it reads them.  A TTL filter removes the
+// values whose timestamp is more than "ttl_seconds" in the past.
+//
+// "env" supplies the current time; NULL means Env::Default().  The caller
+// should delete the result when it is no longer needed.
+extern const CompactionFilter* NewTTLCompactionFilter(int32_t ttl_seconds,
+                                                      Env* env = NULL);
+
+// Append the current time of "env" (NULL means Env::Default()) to *value.
+extern void AppendTTLTimestamp(std::string* value, Env* env = NULL);
+
+// Remove the timestamp added by AppendTTLTimestamp() from the end of
+// *value, store it in *timestamp (seconds since the epoch) if "timestamp"
+// is non-NULL and return true.  Return false if *value is too short to
+// hold a timestamp.
+extern bool StripTTLTimestamp(Slice* value, uint32_t* timestamp = NULL);
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 
@@ -18,6 +20,8 @@ static const int kMinorVersion = 2;
 struct Options;
 struct ReadOptions;
 struct WriteOptions;
+class ColumnFamilyHandle;
+class Env;
 class WriteBatch;
 
 // Abstract handle to particular state of a DB.
@@ -37,6 +41,20 @@ struct Range {
   Range(const Slice& s, const Slice& l) : start(s), limit(l) { }
 };
 
+// Abstract handle to a column family: an independent key space inside
+// a DB opened with Options::use_column_families.  Handles are owned by
+// the DB that returned them and remain valid until the DB is deleted.
+class ColumnFamilyHandle {
+ public:
+  virtual ~ColumnFamilyHandle();
+
+  // Return the name under which the column family was created.
+  virtual const std::string& GetName() const = 0;
+
+  // Return the id under which keys of this column family are stored.
+  virtual uint32_t GetID() const = 0;
+};
+
 // A DB is a persistent ordered map from keys to values.
 // A DB is safe for concurrent access from multiple threads without
 // any external synchronization.
@@ -67,6 +85,24 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Record "value" as a merge operand for "key": reads of "key" return
+  // the result of applying it to the previous value of "key" with
+  // Options::merge_operator (see leveldb/merge_operator.h).  Returns OK
+  // on success, and a non-OK status on error or if the DB has no merge
+  // operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options,
+                       const Slice& key,
+                       const Slice& value);
+
+  // Remove the database entries (if any) for all keys in [begin,end)
+  // with a single range deletion, whatever the number of keys.  Returns
+  // OK on success, and a non-OK status on error.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin,
+                             const Slice& end);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -114,6 +150,11 @@ class DB {
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.write-stalls" - returns a multi-line string with the number
+  //     of writes that were delayed or stopped by compaction backlog, the
+  //     time they spent waiting, and the current delayed write rate.
+  //  "leveldb.statistics" - returns a multi-line string with the counters
+  //     and histograms of Options::statistics, if set.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -139,6 +180,93 @@ class DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Add the table files named in "files", built with SstFileWriter (see
+  // leveldb/sst_file_writer.h), to the database.  This is much cheaper
+  // than writing their contents, which neither go through the log nor
+  // get compacted into the DB: each file is linked (or copied) into the
+  // DB directory, or moved there if options.move_files is true.  The
+  // contents of a file override the entries already in the DB for the
+  // same keys.  The key ranges of the files must not overlap.
+  //
+  // Returns OK on success, and a non-OK status on error, in which case
+  // none of the files has been added.
+  virtual Status IngestExternalFile(const std::vector<std::string>& files,
+                                    const IngestExternalFileOptions& options);
+
+  // ---- Live files ----
+  //
+  // The methods below let applications copy the files of an open
+  // database, e.g. to take a backup (see also leveldb/checkpoint.h).
+
+  // Stop deleting obsolete files until EnableFileDeletions() has been
+  // called as many times as this method.  Files named by GetLiveFiles()
+  // stay in place meanwhile.
+  virtual Status DisableFileDeletions();
+
+  // Undo one DisableFileDeletions() call, and delete the files that
+  // became obsolete meanwhile once none is left.
+  virtual Status EnableFileDeletions();
+
+  // Store in *files the full paths of the files that make up the current
+  // state of the database: its table files, its descriptor and CURRENT.
+  // Only the first *manifest_file_size bytes of the descriptor belong to
+  // that state.  If flush_memtable is true, the contents of the memtable
+  // are written to a table file first, so that the files hold all of the
+  // writes made before the call; otherwise the writes that are only in
+  // the log are left out.
+  virtual Status GetLiveFiles(std::vector<std::string>* files,
+                              uint64_t* manifest_file_size,
+                              bool flush_memtable);
+
+  // Return the Env the database uses to access its files.
+  virtual Env* GetEnv() const;
+
+  // ---- Column families ----
+  //
+  // The methods below operate on a single column family.  The plain
+  // Put/Delete/Merge/Get/NewIterator methods above operate on the default
+  // column family.  A WriteBatch may mix updates to several column
+  // families; they share one log record and are applied atomically.
+  //
+  // Implementations that do not support column families return a
+  // non-OK status for any family other than the default one.
+
+  // Create a new column family named "name" and store a handle to it
+  // in *handle.  The creation is recorded durably in the descriptor.
+  // Returns a non-OK status if the family already exists.
+  virtual Status CreateColumnFamily(const std::string& name,
+                                    ColumnFamilyHandle** handle);
+
+  // Store in *handle the handle of the existing column family "name".
+  // Returns a status for which IsNotFound() is true if there is none.
+  virtual Status GetColumnFamily(const std::string& name,
+                                 ColumnFamilyHandle** handle);
+
+  // Return the handle of the default column family, or NULL if this
+  // implementation does not support column families.
+  virtual ColumnFamilyHandle* DefaultColumnFamily();
+
+  virtual Status Put(const WriteOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key,
+                     const Slice& value);
+  virtual Status Delete(const WriteOptions& options,
+                        ColumnFamilyHandle* column_family,
+                        const Slice& key);
+  virtual Status Merge(const WriteOptions& options,
+                       ColumnFamilyHandle* column_family,
+                       const Slice& key,
+                       const Slice& value);
+  virtual Status DeleteRange(const WriteOptions& options,
+                             ColumnFamilyHandle* column_family,
+                             const Slice& begin,
+                             const Slice& end);
+  virtual Status Get(const ReadOptions& options,
+                     ColumnFamilyHandle* column_family,
+                     const Slice& key, std::string* value);
+  virtual Iterator* NewIterator(const ReadOptions& options,
+                                ColumnFamilyHandle* column_family);
+
  private:
   // No copying allowed
   DB(const DB&);
@@ -69,6 +69,15 @@ class Env {
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) = 0;
 
+  // Like NewWritableFile(), but reuses the existing file "old_fname",
+  // which is renamed to "fname".  The contents of the file are written
+  // over from the start, and the data past what is written may be left
+  // in place, which saves the cost of growing a new file.  The default
+  // implementation renames the file and truncates it.
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -94,6 +103,12 @@ class Env {
   virtual Status RenameFile(const std::string& src,
                             const std::string& target) = 0;
 
+  // Create target as a hard link to the existing file src.  The default
+  // implementation returns a NotSupported status, and so may
+  // implementations for which src and target are on different devices;
+  // callers are expected to fall back to copying the file.
+  virtual Status LinkFile(const std::string& src, const std::string& target);
+
   // Lock the specified file.  Used to prevent concurrent access to
   // the same db by multiple processes.  On failure, stores NULL in
   // *lock and returns non-OK.
@@ -142,6 +157,11 @@ class Env {
   // useful for computing deltas of time.
   virtual uint64_t NowMicros() = 0;
 
+  // Returns the number of nano-seconds since some fixed point in time.
+  // Only useful for computing deltas of time.  The default
+  // implementation has the resolution of NowMicros().
+  virtual uint64_t NowNanos() { return NowMicros() * 1000; }
+
   // Sleep/delay the thread for the perscribed number of micro-seconds.
   virtual void SleepForMicroseconds(int micros) = 0;
 
@@ -209,6 +229,10 @@ class WritableFile {
   virtual Status Flush() = 0;
   virtual Status Sync() = 0;
 
+  // Hint that about "size" bytes will be appended to the file, so that
+  // the space may be allocated up front.  The default does nothing.
+  virtual void Preallocate(uint64_t size) { }
+
  private:
   // No copying allowed
   WritableFile(const WritableFile&);
@@ -257,6 +281,15 @@ extern Status WriteStringToFile(Env* env, const Slice& data,
 extern Status ReadFileToString(Env* env, const std::string& fname,
                                std::string* data);
 
+// A utility routine: copy the contents of file src to a new file target.
+extern Status CopyFile(Env* env, const std::string& src,
+                       const std::string& target);
+
+// A utility routine: copy the first "size" bytes of file src to a new
+// file target.  Copies less if src is shorter.
+extern Status CopyFilePrefix(Env* env, const std::string& src,
+                             const std::string& target, uint64_t size);
+
 // An implementation of Env that forwards all calls to another Env.
 // May be useful to clients who wish to override just part of the
 // functionality of another Env.
@@ -279,6 +312,10 @@ class EnvWrapper : public Env {
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     return target_->NewWritableFile(f, r);
   }
+  Status ReuseWritableFile(const std::string& f, const std::string& o,
+                           WritableFile** r) {
+    return target_->ReuseWritableFile(f, o, r);
+  }
   bool FileExists(const std::string& f) { return target_->FileExists(f); }
   Status GetChildren(const std::string& dir, std::vector<std::string>* r) {
     return target_->GetChildren(dir, r);
@@ -292,6 +329,9 @@ class EnvWrapper : public Env {
   Status RenameFile(const std::string& s, const std::string& t) {
     return target_->RenameFile(s, t);
   }
+  Status LinkFile(const std::string& s, const std::string& t) {
+    return target_->LinkFile(s, t);
+  }
   Status LockFile(const std::string& f, FileLock** l) {
     return target_->LockFile(f, l);
   }
@@ -311,6 +351,9 @@ class EnvWrapper : public Env {
   uint64_t NowMicros() {
     return target_->NowMicros();
   }
+  uint64_t NowNanos() {
+    return target_->NowNanos();
+  }
   void SleepForMicroseconds(int micros) {
     target_->SleepForMicroseconds(micros);
   }
@@ -0,0 +1,147 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// An EventListener is notified of the background activity of the DBs it
+// is registered with (see Options::listeners): memtable flushes,
+// compactions, changes in write stalls, table file creation and
+// deletion, and background errors.
+//
+// Callbacks are invoked without any lock of the DB held, from the thread
+// that did the work, usually the background compaction thread.  They
+// should return quickly since they hold up that work, and they must not
+// wait for flushes or compactions of the DB, e.g. through CompactRange.
+// A listener shared by several DBs may be called concurrently.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_LISTENER_H_
+#define STORAGE_LEVELDB_INCLUDE_LISTENER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+enum FlushReason {
+  kFlushReasonWriteBufferFull = 0,    // The memtable reached its size
+  kFlushReasonWriteBufferManager = 1, // The shared memory budget was full
+  kFlushReasonManual = 2              // Requested through CompactRange
+};
+
+enum CompactionReason {
+  kCompactionReasonLevel0Files = 0,   // Too many level-0 files
+  kCompactionReasonLevelBytes = 1,    // A level exceeded its size
+  kCompactionReasonSeek = 2,          // A file was sought too often
+  kCompactionReasonManual = 3,        // Requested through CompactRange
+  // Universal compaction (see CompactionStyle) of level-0 runs that
+  // take too much space, are of similar sizes, or are too many
+  kCompactionReasonUniversalSizeAmplification = 4,
+  kCompactionReasonUniversalSizeRatio = 5,
+  kCompactionReasonUniversalRunCount = 6,
+  kCompactionReasonDeletions = 7,     // See deletion_compaction_percent
+  // A file referred to blob files in need of garbage collection (see
+  // Options::blob_garbage_collection_ratio)
+  kCompactionReasonBlobGarbageCollection = 8
+};
+
+enum TableFileCreationReason {
+  kTableFileCreationFlush = 0,
+  kTableFileCreationCompaction = 1,
+  kTableFileCreationRecovery = 2      // Log files replayed by DB::Open
+};
+
+enum WriteStallCondition {
+  kWriteStallNormal = 0,
+  kWriteStallDelayed = 1,             // Writes are admitted at a limited rate
+  kWriteStallStopped = 2              // Writes wait for background work
+};
+
+enum BackgroundErrorReason {
+  kBackgroundErrorFlush = 0,
+  kBackgroundErrorCompaction = 1
+};
+
+struct FlushJobInfo {
+  std::string db_name;
+  FlushReason reason;
+  uint64_t file_number;     // The table written, if file_size > 0
+  std::string file_path;
+  uint64_t file_size;       // Zero if the memtable was empty
+  int output_level;         // The level the table was placed in
+  uint64_t micros;          // Time spent writing the table
+};
+
+struct CompactionJobInfo {
+  std::string db_name;
+  CompactionReason reason;
+  int base_level;           // Inputs come from base_level and output_level
+  int output_level;
+  bool is_trivial_move;     // A single file was moved to output_level
+  std::vector<uint64_t> input_files;   // File numbers of the inputs
+  std::vector<uint64_t> output_files;  // Set on completion
+  uint64_t bytes_read;      // Set on completion
+  uint64_t bytes_written;   // Set on completion
+  uint64_t micros;          // Set on completion
+  Status status;            // Set on completion
+};
+
+struct TableFileCreationInfo {
+  std::string db_name;
+  TableFileCreationReason reason;
+  uint64_t file_number;
+  std::string file_path;
+  uint64_t file_size;
+  Status status;            // The file is not used if this is an error
+};
+
+struct TableFileDeletionInfo {
+  std::string db_name;
+  uint64_t file_number;
+  std::string file_path;
+  Status status;
+};
+
+struct WriteStallInfo {
+  std::string db_name;
+  WriteStallCondition condition;
+  WriteStallCondition previous_condition;
+};
+
+class EventListener {
+ public:
+  EventListener() { }
+  virtual ~EventListener();
+
+  // A memtable flush is about to start or has been installed.
+  virtual void OnFlushBegin(const FlushJobInfo& info) { }
+  virtual void OnFlushCompleted(const FlushJobInfo& info) { }
+
+  // A compaction is about to start or has finished.  OnCompactionCompleted
+  // is also called for failed compactions, with a non-OK info.status.
+  virtual void OnCompactionBegin(const CompactionJobInfo& info) { }
+  virtual void OnCompactionCompleted(const CompactionJobInfo& info) { }
+
+  // Writes became delayed or stopped, or returned to normal.
+  virtual void OnStallConditionsChanged(const WriteStallInfo& info) { }
+
+  // A table file has been written by a flush, a compaction or recovery,
+  // or an obsolete table file has been deleted.
+  virtual void OnTableFileCreated(const TableFileCreationInfo& info) { }
+  virtual void OnTableFileDeleted(const TableFileDeletionInfo& info) { }
+
+  // A flush or compaction failed with *bg_error.  The listener may set
+  // *bg_error to OK, in which case the failure is not recorded as a
+  // background error of the DB (see Options::paranoid_checks).
+  virtual void OnBackgroundError(BackgroundErrorReason reason,
+                                 Status* bg_error) { }
+
+ private:
+  // No copying allowed
+  EventListener(const EventListener&);
+  void operator=(const EventListener&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_LISTENER_H_
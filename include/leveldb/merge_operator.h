@@ -0,0 +1,57 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator lets an application update a value in place, e.g. add
+// to a counter or append to a list, without reading it first (see
+// Options::merge_operator and DB::Merge).  DB::Merge only records the
+// operand; the operands of a key are combined with its base value when
+// the key is read and, in the background, when it is compacted.
+//
+// The operator must be associative: applying operands a and then b to a
+// value must give the same result as applying to it the operand obtained
+// by applying b to a.  Compactions rely on this to combine runs of
+// operands whose base value lives in another file.
+//
+// Operators are called without any lock of the DB held, from reading
+// threads and the background compaction thread, and must not call back
+// into the DB.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class MergeOperator {
+ public:
+  MergeOperator() { }
+  virtual ~MergeOperator();
+
+  // Store in *new_value the result of applying "value" to
+  // *existing_value, or to nothing if existing_value is NULL because
+  // "key" has no value.  "existing_value" may itself be the combination
+  // of earlier operands.  For column family DBs, "key" is the key within
+  // its column family.
+  //
+  // Return false if the operands cannot be combined, e.g. because they
+  // are malformed.  Reads of the key then fail with a corruption error.
+  virtual bool Merge(const Slice& key,
+                     const Slice* existing_value,
+                     const Slice& value,
+                     std::string* new_value) const = 0;
+
+  // The name of the operator, for the info log.
+  virtual const char* Name() const = 0;
+
+ private:
+  // No copying allowed
+  MergeOperator(const MergeOperator&);
+  void operator=(const MergeOperator&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,14 +6,23 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
+class EventListener;
 class Logger;
+class MergeOperator;
+class RateLimiter;
 class Snapshot;
+class Statistics;
+class WriteBufferManager;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -26,7 +35,49 @@ enum CompressionType {
   kSnappyCompression = 0x1
 };
 
+// Which file of a level kCompactionStyleLevel compacts next into the
+// level below (see Options::compaction_pri).
+enum CompactionPri {
+  // The file after the one compacted last, cycling through the key space.
+  kCompactionPriRoundRobin          = 0,
+
+  // The file that overlaps the fewest bytes of the next level relative
+  // to its own size, which rewrites the fewest bytes per byte pushed
+  // down.
+  kCompactionPriMinOverlappingRatio = 1
+};
+
+// How the DB merges its files (see Options::compaction_style).
+enum CompactionStyle {
+  // Each level is a sorted run ten times as large as the one above it,
+  // into which the files of that level are merged a few at a time.
+  // Reads and space are cheap; every byte is rewritten about ten times
+  // per level.
+  kCompactionStyleLevel     = 0,
+
+  // Level-0 files are sorted runs that are merged whole with runs of
+  // similar size, like tiers.  Each byte is rewritten much less often,
+  // which suits write-heavy loads, at the cost of more runs to read and
+  // of up to twice the space while the largest runs are merged.
+  kCompactionStyleUniversal = 1
+};
+
+// A directory holding table files of a DB, and the number of bytes of
+// table files it is meant to hold (see Options::db_paths).
+struct DbPath {
+  std::string path;
+  uint64_t target_size;
+
+  DbPath() : target_size(0) { }
+  DbPath(const std::string& p, uint64_t t) : path(p), target_size(t) { }
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
+//
+// Whatever the options, the descriptor records the sequence numbers and
+// entry counts of each new table, which the compactions rely on.  Older
+// releases cannot read these records, so once a DB has been opened with
+// this release, it can no longer be opened by an older one.
 struct Options {
   // -------------------
   // Parameters that affect behavior
@@ -66,9 +117,145 @@ struct Options {
   // Default: NULL
   Logger* info_log;
 
+  // If non-empty, the directory the log files are kept in, e.g. on a
+  // device with a low write latency.  The descriptor, CURRENT and the
+  // info log stay in the DB directory.
+  // Default: "", for the DB directory
+  std::string wal_dir;
+
+  // If non-empty, the directories the table files are kept in, from the
+  // fastest to the slowest device.  Flushed tables go to the first one.
+  // Compactions write their output to the first directory whose
+  // target_size has room for that level after the levels above it,
+  // filling the directories from level 0 down; the last directory takes
+  // whatever does not fit elsewhere.  The directory of each table is
+  // recorded in the descriptor, so the same directories must be given
+  // on every open, in the same order.  Tables recorded in a directory
+  // beyond the last one given are looked for in the last one.  A
+  // checkpoint or restored backup of the DB keeps all of its files in
+  // one directory, and is opened with wal_dir and db_paths cleared.
+  // Default: empty, for the DB directory
+  std::vector<DbPath> db_paths;
+
+  // If true, the database stores keys of several column families (see
+  // DB::CreateColumnFamily) in one key space, prefixing every key with
+  // the id of its family.
+  //
+  // REQUIRES: The same value must be supplied on every open of a DB.
+  // Opening a DB with a different setting fails with a comparator
+  // mismatch error.
+  // Default: false
+  bool use_column_families;
+
+  // If non-NULL, compactions pass the values they rewrite to this filter,
+  // which may remove them or replace them (see
+  // leveldb/compaction_filter.h).  The filter must outlive the DB.
+  // Default: NULL
+  const CompactionFilter* compaction_filter;
+
+  // If non-NULL, DB::Merge records operands that this operator combines
+  // with the existing value of the key (see leveldb/merge_operator.h).
+  // REQUIRES: The same operator (or a compatible one) must be supplied
+  // on every open of a DB that contains merge operands, and it must
+  // outlive the DB.
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
   // -------------------
   // Parameters that affect performance
 
+  // Number of levels of the DB, at most 12.  A DB cannot be opened with
+  // fewer levels than it has files in.
+  // Default: 7
+  int num_levels;
+
+  // Level-0 compaction is started when there are this many level-0
+  // files.
+  // Default: 4
+  int level0_file_num_compaction_trigger;
+
+  // Soft limit on the number of level-0 files.  Writes are slowed down
+  // at this point (see delayed_write_rate).
+  // Default: 8
+  int level0_slowdown_writes_trigger;
+
+  // Maximum number of level-0 files.  Writes are stopped at this point.
+  // Default: 12
+  int level0_stop_writes_trigger;
+
+  // Maximum level to which a flushed memtable is pushed if it does not
+  // overlap the levels above.  Pushing it past level 0 avoids the
+  // relatively expensive level 0=>1 compactions and some expensive
+  // manifest file operations.  It is not pushed all the way to the last
+  // level since that can generate a lot of wasted disk space if the same
+  // key space is being repeatedly overwritten, unless the memtable only
+  // holds keys after all those of the DB.
+  // Default: 2
+  int max_mem_compaction_level;
+
+  // Size limit of level-1, beyond which it is compacted into level-2.
+  // Default: 10MB
+  uint64_t max_bytes_for_level_base;
+
+  // Each level other than level-0 may hold this many times the bytes of
+  // the level above it.
+  // Default: 10
+  int max_bytes_for_level_multiplier;
+
+  // If true, the size limits of the levels are derived from the size of
+  // the last level instead of growing from max_bytes_for_level_base:
+  // each level may hold 1/max_bytes_for_level_multiplier of the bytes of
+  // the next one, but no less than max_bytes_for_level_base.  This keeps
+  // the space taken by obsolete entries to a small fraction of the DB
+  // whatever its size.
+  // Default: false
+  bool level_compaction_dynamic_level_bytes;
+
+  // Which file is compacted when a level exceeds its size limit (see
+  // CompactionPri).
+  // Default: kCompactionPriRoundRobin
+  CompactionPri compaction_pri;
+
+  // If positive, a file of which at least this percentage of the entries
+  // are deletions is compacted into the next level, even if its level is
+  // within its size limit, so that the deletions reach the entries they
+  // hide and both are dropped.  Reads and iterators no longer skip over
+  // them then.  Zero disables this.
+  // Default: 0
+  int deletion_compaction_percent;
+
+  // How files are merged (see CompactionStyle).  With
+  // kCompactionStyleUniversal, memtables are always flushed to level-0
+  // and compactions merge level-0 runs into a single level-0 file, once
+  // there are level0_file_num_compaction_trigger of them.  The levels
+  // above do not receive new data then.
+  // Default: kCompactionStyleLevel
+  CompactionStyle compaction_style;
+
+  // Universal compaction merges the newest runs that are each at most
+  // this percentage larger than the runs newer than them combined.
+  // Default: 1
+  int universal_size_ratio;
+
+  // Minimum number of runs merged by universal compaction because of
+  // universal_size_ratio.
+  // Default: 2
+  int universal_min_merge_width;
+
+  // Universal compaction merges all runs when those other than the
+  // oldest take more than this percentage of its size, which bounds the
+  // space taken by obsolete entries.
+  // Default: 200
+  int universal_max_size_amplification_percent;
+
+  // If true, the DB does not compact its levels by itself, and writes
+  // are not slowed down or stopped however many level-0 files pile up.
+  // Memtables are still flushed, and DB::CompactRange() still works.
+  // Reads get slower as level-0 files accumulate, so this is meant for
+  // loading data that is compacted with CompactRange() afterwards.
+  // Default: false
+  bool disable_auto_compactions;
+
   // Amount of data to build up in memory (backed by an unsorted log
   // on disk) before converting to a sorted on-disk file.
   //
@@ -81,13 +268,90 @@ struct Options {
   // Default: 4MB
   size_t write_buffer_size;
 
+  // If non-NULL, the memtables of this DB count against the memory
+  // budget of the specified manager, which may be shared by several
+  // DBs.  When the combined memtable memory exceeds the budget, the
+  // largest memtable among those DBs is flushed, even if it is smaller
+  // than write_buffer_size.
+  // Default: NULL
+  WriteBufferManager* write_buffer_manager;
+
+  // When compactions fall behind (too many level-0 files, or more than
+  // soft_pending_compaction_bytes_limit bytes of compaction work
+  // pending), writes are admitted at a limited rate instead of being
+  // stopped.  The rate starts at the measured compaction throughput and
+  // adapts to whether the backlog grows or shrinks; it never exceeds
+  // delayed_write_rate bytes per second.
+  //
+  // Default: 16MB/s
+  uint64_t delayed_write_rate;
+
+  // Estimated number of bytes of pending compaction work beyond which
+  // writes are delayed (see delayed_write_rate).  Zero disables this
+  // trigger.
+  //
+  // Default: 1GB
+  uint64_t soft_pending_compaction_bytes_limit;
+
+  // If non-NULL, memtable flushes and compactions request the bytes they
+  // write from this limiter, which may be shared by several DBs.  Flushes
+  // are given priority over compactions.  Log writes are never limited.
+  // Default: NULL
+  RateLimiter* rate_limiter;
+
+  // If non-NULL, the DB records counters and latency histograms in this
+  // object, which may be shared by several DBs (see
+  // leveldb/statistics.h).
+  // Default: NULL
+  Statistics* statistics;
+
+  // Listeners that are notified of flushes, compactions, write stalls,
+  // table file creation and deletion, and background errors (see
+  // leveldb/listener.h).  The listeners must outlive the DB.
+  // Default: empty
+  std::vector<EventListener*> listeners;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
-  // one open file per 2MB of working set).
+  // one open file per 2MB of working set).  When min_blob_size is
+  // nonzero, a quarter of the files left after a few reserved ones are
+  // kept for blob files, and the rest for tables; otherwise a single one
+  // is kept for blob files.
   //
   // Default: 1000
   int max_open_files;
 
+  // Once the descriptor (MANIFEST) file has grown to this many bytes, the
+  // DB starts a new one holding a snapshot of its current state, and
+  // deletes the old one.  This bounds the history DB::Open replays, and
+  // with it the time an open takes after a long run.
+  //
+  // Default: 64MB
+  uint64_t max_manifest_file_size;
+
+  // If true, DB::Open opens the table files of the DB before it returns,
+  // as many as the table cache holds (see max_open_files), so that the
+  // reads right after a restart do not have to read the footers and
+  // index blocks of the tables they touch.  Files of lower levels are
+  // opened first.
+  // Default: false
+  bool preload_table_files;
+
+  // Number of threads that open table files in parallel when
+  // preload_table_files is true.
+  // Default: 16
+  int max_file_opening_threads;
+
+  // If non-zero, up to this many log files that are no longer needed are
+  // kept and written over by the next logs, instead of being deleted and
+  // created afresh.  Writing over a file that already has its blocks
+  // allocated saves the file system work of growing it, which each sync
+  // of a new log otherwise pays for.  The records of such logs carry the
+  // log number, so that the leftovers of the earlier log are not replayed.
+  // A DB that has recycled logs cannot be opened by older versions.
+  // Default: 0
+  size_t recycle_log_file_num;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -127,8 +391,33 @@ struct Options {
   // efficiently detect that and will switch to uncompressed mode.
   CompressionType compression;
 
+  // If positive, values of at least this many bytes are kept out of the
+  // tables, in blob files, and the tables only hold references to them.
+  // Compactions then move the references instead of rewriting the
+  // values, which saves most of their I/O when values are large.  Values
+  // are moved to blob files when memtables are flushed, so the log and
+  // the memtable still hold them whole.  A DB that has blob files cannot
+  // be opened by older versions.  Zero keeps all values in the tables.
+  // Default: 0
+  size_t min_blob_size;
+
+  // Once at least this fraction of the bytes of a blob file belongs to
+  // values that were overwritten or deleted, compactions move the values
+  // left in it to new blob files, and the tables that refer to it are
+  // rewritten for that, so that the file can be deleted.  Zero disables
+  // this: a blob file is then only deleted once all of its values are.
+  // Default: 0.5
+  double blob_garbage_collection_ratio;
+
   // Create an Options object with default values for all fields.
   Options();
+
+  // Set up the options for loading a large amount of data into a DB:
+  // large memtables and no automatic compactions.  Once the data is in,
+  // call DB::CompactRange(NULL, NULL) and reopen the DB with the usual
+  // options.  Writes of the load may also set WriteOptions::disable_wal.
+  // Returns this.
+  Options* PrepareForBulkLoad();
 };
 
 // Options that control read operations
@@ -177,8 +466,31 @@ struct WriteOptions {
   // Default: false
   bool sync;
 
+  // If true, the write is not recorded in the log, and is lost if the
+  // process crashes before the memtable holding it has been flushed.
+  // Deleting the DB flushes the memtables if they may hold such writes.
+  // Writes are much cheaper then, which helps bulk loads that can be
+  // restarted from scratch.  "sync" is ignored for such writes.
+  //
+  // Default: false
+  bool disable_wal;
+
   WriteOptions()
-      : sync(false) {
+      : sync(false),
+        disable_wal(false) {
+  }
+};
+
+// Options that control DB::IngestExternalFile
+struct IngestExternalFileOptions {
+  // If true, the files are moved into the DB directory, and disappear
+  // from their original location.  If false, they are hard linked when
+  // the Env supports it, or else copied.
+  // Default: false
+  bool move_files;
+
+  IngestExternalFileOptions()
+      : move_files(false) {
   }
 };
 
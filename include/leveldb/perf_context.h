@@ -0,0 +1,82 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext breaks down where the calling thread spent its time in
+// the DB operations it issued, e.g. to find out why one particular Get
+// was slow:
+//
+//   leveldb::SetPerfLevel(leveldb::kPerfTimings);
+//   leveldb::GetPerfContext()->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   ... = leveldb::GetPerfContext()->ToString();
+//
+// Each thread has its own PerfContext and its own perf level.  Nothing
+// is recorded while the level is kPerfDisabled, which is the default.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace leveldb {
+
+enum PerfLevel {
+  kPerfDisabled = 0,    // Record nothing
+  kPerfCounts = 1,      // Record counters only
+  kPerfTimings = 2      // Record counters and timers
+};
+
+// Set or return the perf level of the calling thread.
+extern void SetPerfLevel(PerfLevel level);
+extern PerfLevel GetPerfLevel();
+
+// Counters are plain counts or byte counts; "_nanos" fields are timers
+// that are only updated at kPerfTimings.
+struct PerfContext {
+  // Reset all fields to zero.
+  void Reset();
+
+  // Return a listing of the non-zero fields.
+  std::string ToString() const;
+
+  // Waiting for the DB mutex in Get
+  uint64_t db_mutex_lock_nanos;
+
+  // Lookups in the mutable and immutable memtables
+  uint64_t get_from_memtable_count;
+  uint64_t get_from_memtable_nanos;
+
+  // Lookups in table files (Version::Get), and the number of files
+  // probed by them
+  uint64_t get_from_output_files_nanos;
+  uint64_t get_files_probed_count;
+
+  // Finding a table in the table cache, including opening the file and
+  // reading its index block on a miss
+  uint64_t find_table_nanos;
+  uint64_t table_open_count;
+  uint64_t index_block_read_count;
+  uint64_t index_block_read_nanos;
+
+  // Data blocks found in the block cache or read from the file
+  uint64_t block_cache_hit_count;
+  uint64_t data_block_read_count;
+  uint64_t data_block_read_nanos;
+
+  // The stages of reading any block: file I/O, checksum verification
+  // and decompression
+  uint64_t block_read_count;
+  uint64_t block_read_byte;
+  uint64_t block_read_nanos;
+  uint64_t block_checksum_nanos;
+  uint64_t block_decompress_nanos;
+};
+
+// Return the PerfContext of the calling thread.
+extern PerfContext* GetPerfContext();
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate at which flushes and compactions write
+// to disk (see Options::rate_limiter), so that background work does
+// not starve foreground reads and log writes of I/O bandwidth.
+//
+// A RateLimiter has internal synchronization and may be shared by DBs
+// that are used concurrently from multiple threads.  It must outlive
+// every DB that uses it.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace leveldb {
+
+class Env;
+
+class RateLimiter {
+ public:
+  // Memtable flushes are issued at IO_HIGH since writes stall when they
+  // fall behind; compactions are issued at IO_LOW.
+  enum IOPriority {
+    IO_LOW = 0,
+    IO_HIGH = 1,
+    IO_TOTAL = 2
+  };
+
+  RateLimiter() { }
+  virtual ~RateLimiter();
+
+  // Change the rate limit.  If the limiter is auto-tuned, this is the
+  // current rate, which tuning may change again later.
+  // REQUIRES: bytes_per_second > 0
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+  // Return the current rate limit.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Return the number of bytes that are granted per refill period.
+  // Callers should split larger writes into requests of at most this
+  // many bytes so that other requests are not held up by them.
+  virtual int64_t GetSingleBurstBytes() const = 0;
+
+  // Block until "bytes" may be written at priority "pri".
+  // REQUIRES: pri != IO_TOTAL
+  virtual void Request(int64_t bytes, IOPriority pri) = 0;
+
+  // Return the number of bytes and the number of requests that have
+  // been granted at priority "pri", or at any priority for IO_TOTAL.
+  virtual int64_t GetTotalBytesThrough(IOPriority pri = IO_TOTAL) const = 0;
+  virtual int64_t GetTotalRequests(IOPriority pri = IO_TOTAL) const = 0;
+
+ private:
+  // No copying allowed
+  RateLimiter(const RateLimiter&);
+  void operator=(const RateLimiter&);
+};
+
+// Create a RateLimiter that grants "rate_bytes_per_sec" bytes per second,
+// refilled every "refill_period_us" microseconds.  Requests at IO_HIGH
+// are served first, except that in one out of every "fairness" refills
+// IO_LOW requests are served first so that they cannot starve.
+//
+// If "auto_tuned" is true, "rate_bytes_per_sec" is an upper bound and
+// the actual rate follows the demand: it is lowered while requests
+// rarely use up the granted bytes and raised while they keep waiting,
+// staying between 1/20 of the bound and the bound.
+//
+// "env" is used to read the clock and to sleep; NULL means
+// Env::Default().  The caller should delete the result when done.
+extern RateLimiter* NewGenericRateLimiter(int64_t rate_bytes_per_sec,
+                                          int64_t refill_period_us = 100000,
+                                          int32_t fairness = 10,
+                                          bool auto_tuned = false,
+                                          Env* env = NULL);
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any DB, in the format
+// that DB::IngestExternalFile() adds to a DB.  Several writers may build
+// files in parallel, e.g. one per key range of a bulk load.
+//
+// An SstFileWriter is not thread-safe.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class SstFileWriter {
+ public:
+  // "options.comparator" must be the comparator of the DB the file is
+  // going to be ingested into.  "options.env" is used to create the file.
+  explicit SstFileWriter(const Options& options);
+
+  // Abandons the file if Finish() has not been called.
+  ~SstFileWriter();
+
+  // Create the file "fname", replacing any existing file.
+  Status Open(const std::string& fname);
+
+  // Add a mapping from "key" to "value".
+  // Returns an InvalidArgument status unless "key" is after all keys
+  // added before according to the comparator.
+  // REQUIRES: Open() succeeded and Finish() has not been called
+  Status Put(const Slice& key, const Slice& value);
+
+  // Add a deletion of "key", which hides the values of "key" that are
+  // in the DB when the file is ingested.  The same ordering rule as for
+  // Put() applies.
+  // REQUIRES: Open() succeeded and Finish() has not been called
+  Status Delete(const Slice& key);
+
+  // Write the rest of the table and close the file.  A file without any
+  // entry is rejected with an InvalidArgument status and removed.
+  // REQUIRES: Open() succeeded and Finish() has not been called
+  Status Finish();
+
+  // Number of calls to Put() and Delete() so far.
+  uint64_t NumEntries() const;
+
+  // Size of the file generated so far.  After a successful Finish(),
+  // the size of the final file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+  Rep* rep_;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  // No copying allowed
+  SstFileWriter(const SstFileWriter&);
+  void operator=(const SstFileWriter&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
@@ -0,0 +1,125 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Statistics object collects counters ("tickers") and latency
+// histograms from the DBs that use it (see Options::statistics).  The
+// collected values can be read programmatically through GetSnapshot()
+// or as text through the "leveldb.statistics" property of a DB.
+//
+// A Statistics object has internal synchronization and may be shared by
+// DBs that are used concurrently from multiple threads.  Updates are
+// spread over per-core shards so that threads recording concurrently do
+// not contend with each other.  It must outlive every DB that uses it.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+#define STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace leveldb {
+
+enum Ticker {
+  // Index blocks are kept with the open tables in the table cache: a hit
+  // finds the table open, a miss opens the file and reads its index.
+  kIndexBlockHit = 0,
+  kIndexBlockMiss,
+  // Lookups of data blocks in Options::block_cache
+  kBlockCacheDataHit,
+  kBlockCacheDataMiss,
+
+  // Keys and user bytes passed to and returned by Write and Get
+  kNumberKeysWritten,
+  kBytesWritten,
+  kNumberKeysRead,
+  kBytesRead,
+
+  // Log records and log syncs
+  kWalBytes,
+  kWalSynced,
+
+  // Microseconds that writes were delayed or stopped
+  kStallMicros,
+
+  // Bytes read and written by compactions, and written by memtable
+  // flushes
+  kCompactReadBytes,
+  kCompactWriteBytes,
+  kFlushWriteBytes,
+
+  // Compactions started because a file was sought too often
+  kSeekCompactions,
+
+  kTickerMax
+};
+
+enum HistogramType {
+  kDbGetMicros = 0,
+  kDbWriteMicros,
+  kWalSyncMicros,
+  kCompactionMicros,
+  kFlushMicros,
+
+  kHistogramMax
+};
+
+// Return a stable name for a ticker or histogram, e.g.
+// "leveldb.block.cache.data.hit".
+extern const char* TickerName(Ticker ticker);
+extern const char* HistogramName(HistogramType type);
+
+struct HistogramData {
+  uint64_t count;
+  double sum;
+  double min;
+  double max;
+  double average;
+  double standard_deviation;
+  double median;
+  double percentile95;
+  double percentile99;
+};
+
+// The values of all tickers and histograms at one point in time.
+struct StatisticsSnapshot {
+  uint64_t tickers[kTickerMax];
+  HistogramData histograms[kHistogramMax];
+};
+
+class Statistics {
+ public:
+  Statistics() { }
+  virtual ~Statistics();
+
+  // Add "count" to a ticker.
+  virtual void RecordTick(Ticker ticker, uint64_t count = 1) = 0;
+
+  // Add one sample to a histogram.
+  virtual void MeasureTime(HistogramType type, uint64_t value) = 0;
+
+  // Return the current value of a ticker.
+  virtual uint64_t GetTickerCount(Ticker ticker) const = 0;
+
+  // Store the current values of all tickers and histograms in *snapshot.
+  virtual void GetSnapshot(StatisticsSnapshot* snapshot) const = 0;
+
+  // Reset all tickers and histograms to zero.
+  virtual void Reset() = 0;
+
+  // Return a human-readable listing of all tickers and histograms.
+  virtual std::string ToString() const = 0;
+
+ private:
+  // No copying allowed
+  Statistics(const Statistics&);
+  void operator=(const Statistics&);
+};
+
+// Create a new Statistics object.  The caller should delete the result
+// when it is no longer needed.
+extern Statistics* CreateDBStatistics();
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
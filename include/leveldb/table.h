@@ -45,6 +45,11 @@ class Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the range deletions that were added to
+  // the table with TableBuilder::AddRangeDeletion, or NULL if there are
+  // none.  The iterator must not outlive the table.
+  Iterator* NewRangeDeletionIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -21,11 +21,13 @@
 #ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 #define STORAGE_LEVELDB_INCLUDE_WRITE_BATCH_H_
 
+#include <stdint.h>
 #include <string>
 #include "leveldb/status.h"
 
 namespace leveldb {
 
+class ColumnFamilyHandle;
 class Slice;
 
 class WriteBatch {
@@ -39,6 +41,26 @@ class WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Record "value" as a merge operand for "key".  Reads of "key" return
+  // the result of applying the operand to the previous value with
+  // Options::merge_operator.  The DB must have a merge operator.
+  void Merge(const Slice& key, const Slice& value);
+
+  // Erase the mappings of all keys in [begin,end), if any.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
+  // Variants of Put, Delete, Merge and DeleteRange that apply to the
+  // specified column family.  A NULL "column_family" denotes the default
+  // family.  All updates in a batch are applied atomically, even when
+  // they span several column families.
+  void Put(ColumnFamilyHandle* column_family,
+           const Slice& key, const Slice& value);
+  void Delete(ColumnFamilyHandle* column_family, const Slice& key);
+  void Merge(ColumnFamilyHandle* column_family,
+             const Slice& key, const Slice& value);
+  void DeleteRange(ColumnFamilyHandle* column_family,
+                   const Slice& begin, const Slice& end);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -48,6 +70,26 @@ class WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+
+    // Called for merge operands.  The default implementation returns
+    // a NotSupported status, which stops the iteration.
+    virtual Status Merge(const Slice& key, const Slice& value);
+
+    // Called for range deletions.  The default implementation returns
+    // a NotSupported status, which stops the iteration.
+    virtual Status DeleteRange(const Slice& begin, const Slice& end);
+
+    // Called for updates to a column family other than the default
+    // one.  The default implementations forward updates to the default
+    // family (id zero) to Put/Delete/Merge/DeleteRange and reject all
+    // other families.
+    virtual Status PutCF(uint32_t column_family_id,
+                         const Slice& key, const Slice& value);
+    virtual Status DeleteCF(uint32_t column_family_id, const Slice& key);
+    virtual Status MergeCF(uint32_t column_family_id,
+                           const Slice& key, const Slice& value);
+    virtual Status DeleteRangeCF(uint32_t column_family_id,
+                                 const Slice& begin, const Slice& end);
   };
   Status Iterate(Handler* handler) const;
 
@@ -0,0 +1,85 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A WriteBufferManager bounds the total memory used by the memtables of
+// all DBs that share it (see Options::write_buffer_manager).  When the
+// combined usage exceeds the budget, the largest active memtable among
+// those DBs is flushed.  Optionally, memtable memory is charged against
+// a Cache so that memtables and cached blocks share a single budget.
+//
+// A WriteBufferManager has internal synchronization and may be shared
+// by DBs that are used concurrently from multiple threads.  It must
+// outlive every DB that uses it.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
+#define STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
+
+#include <stddef.h>
+
+namespace leveldb {
+
+class Cache;
+
+class WriteBufferManager {
+ public:
+  // "buffer_size" is the number of bytes the memtables of all DBs
+  // sharing this manager may use before a flush is forced.  Zero means
+  // no limit.  If "cache" is non-NULL, memtable memory is charged
+  // against it by pinning placeholder entries; pass the same cache as
+  // Options::block_cache to make it the single memory budget of the
+  // DBs.  "cache" must outlive the manager.
+  explicit WriteBufferManager(size_t buffer_size, Cache* cache = NULL);
+  ~WriteBufferManager();
+
+  // Return the budget passed to the constructor.
+  size_t buffer_size() const;
+
+  // Return the memtable memory currently used by all DBs sharing this
+  // manager, including memtables that are being flushed.
+  size_t memory_usage() const;
+
+  // Returns true iff a memtable should be flushed to stay within a
+  // non-zero buffer_size().
+  bool ShouldFlush() const;
+
+  // ---- The methods below are used by the DB implementation ----
+
+  // A DB that shares this manager.
+  class Consumer {
+   public:
+    virtual ~Consumer();
+
+    // Switch to a new memtable and schedule the flush of the current
+    // one.  Called without any locks of the manager held.
+    virtual void FlushMemTable() = 0;
+  };
+
+  // Add "consumer" to the set of DBs sharing this manager.
+  void Register(Consumer* consumer);
+
+  // Remove "consumer", releasing the memory charged for it.  Waits for
+  // any FlushMemTable() call on "consumer" that is in progress.
+  void Unregister(Consumer* consumer);
+
+  // Record that "consumer" uses "active_bytes" in its mutable memtable
+  // and "total_bytes" in all of its memtables.
+  void SetUsage(Consumer* consumer, size_t active_bytes, size_t total_bytes);
+
+  // Flush the registered consumer with the largest mutable memtable.
+  // Returns true without flushing anything if that consumer is "self",
+  // in which case the caller should flush its own memtable.
+  bool FlushLargest(Consumer* self);
+
+ private:
+  struct Rep;
+  Rep* rep_;
+
+  // No copying allowed
+  WriteBufferManager(const WriteBufferManager&);
+  void operator=(const WriteBufferManager&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
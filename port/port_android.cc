@@ -60,5 +60,9 @@ void CondVar::SignalAll() {
   PthreadCall("broadcast", pthread_cond_broadcast(&cv_));
 }
 
+int PhysicalCoreID() {
+  return -1;
+}
+
 }
 }
@@ -150,6 +150,8 @@ inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   return false;
 }
 
+extern int PhysicalCoreID();
+
 }
 }
 
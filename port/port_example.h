@@ -119,6 +119,11 @@ extern bool Snappy_Uncompress(const char* input_data, size_t input_length,
 // The concatenation of all "data[0,n-1]" fragments is the heap profile.
 extern bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg);
 
+// Return the index of the processor core that the calling thread is
+// currently running on, or -1 if that cannot be determined.  The result
+// is only a hint: the thread may be moved to another core at any time.
+extern int PhysicalCoreID();
+
 }
 }
 
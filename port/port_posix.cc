@@ -5,6 +5,7 @@
 #include "port/port_posix.h"
 
 #include <cstdlib>
+#include <sched.h>
 #include <stdio.h>
 #include <string.h>
 #include "util/logging.h"
@@ -46,5 +47,13 @@ void CondVar::SignalAll() {
   PthreadCall("broadcast", pthread_cond_broadcast(&cv_));
 }
 
+int PhysicalCoreID() {
+#if defined(OS_LINUX)
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
 }
 }
@@ -178,5 +178,9 @@ void InitOnce(OnceType* once, void (*initializer)()) {
   assert(*once == Initialized);
 }
 
+int PhysicalCoreID() {
+  return static_cast<int>(GetCurrentProcessorNumber());
+}
+
 }
 }
@@ -9,6 +9,7 @@
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/perf_context.h"
 
 namespace leveldb {
 
@@ -74,7 +75,11 @@ Status ReadBlock(RandomAccessFile* file,
   size_t n = static_cast<size_t>(handle.size());
   char* buf = new char[n + kBlockTrailerSize];
   Slice contents;
+  PerfTimer read_timer(&PerfContext::block_read_nanos);
   Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  read_timer.Stop();
+  PerfCount(&PerfContext::block_read_count);
+  PerfCount(&PerfContext::block_read_byte, n + kBlockTrailerSize);
   if (!s.ok()) {
     delete[] buf;
     return s;
@@ -87,6 +92,7 @@ Status ReadBlock(RandomAccessFile* file,
   // Check the crc of the type and the block contents
   const char* data = contents.data();    // Pointer to where Read put the data
   if (options.verify_checksums) {
+    PerfTimer checksum_timer(&PerfContext::block_checksum_nanos);
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
@@ -107,6 +113,7 @@ Status ReadBlock(RandomAccessFile* file,
       // Ok
       break;
     case kSnappyCompression: {
+      PerfTimer decompress_timer(&PerfContext::block_decompress_nanos);
       size_t ulength = 0;
       if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
         delete[] buf;
@@ -80,6 +80,10 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Name in the metaindex block of the meta block that holds the range
+// deletions of a table (see TableBuilder::AddRangeDeletion).
+static const char kRangeDeletionBlockName[] = "leveldb.range_del";
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
@@ -5,17 +5,21 @@
 #include "leveldb/table.h"
 
 #include "leveldb/cache.h"
+#include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "table/block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/perf_context.h"
+#include "util/statistics.h"
 
 namespace leveldb {
 
 struct Table::Rep {
   ~Rep() {
     delete index_block;
+    delete range_del_block;
   }
 
   Options options;
@@ -25,8 +29,41 @@ struct Table::Rep {
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  Block* range_del_block;       // NULL if the table has no range deletions
 };
 
+// Read the meta blocks of the table that are listed in the metaindex
+// block at "handle".
+static Status ReadMetaBlocks(RandomAccessFile* file, const BlockHandle& handle,
+                             Block** range_del_block) {
+  if (handle.size() <= 2 * sizeof(uint32_t)) {
+    // The block holds nothing but its restart array: save the read
+    return Status::OK();
+  }
+  Block* metaindex_block = NULL;
+  Status s = ReadBlock(file, ReadOptions(), handle, &metaindex_block);
+  if (!s.ok()) {
+    return s;
+  }
+  Iterator* iter = metaindex_block->NewIterator(BytewiseComparator());
+  for (iter->SeekToFirst(); s.ok() && iter->Valid(); iter->Next()) {
+    if (iter->key() == Slice(kRangeDeletionBlockName)) {
+      BlockHandle range_del_handle;
+      Slice v = iter->value();
+      s = range_del_handle.DecodeFrom(&v);
+      if (s.ok()) {
+        s = ReadBlock(file, ReadOptions(), range_del_handle, range_del_block);
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  delete iter;
+  delete metaindex_block;
+  return s;
+}
+
 Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
@@ -49,9 +86,17 @@ Status Table::Open(const Options& options,
   // Read the index block
   Block* index_block = NULL;
   if (s.ok()) {
+    PerfTimer timer(&PerfContext::index_block_read_nanos);
+    PerfCount(&PerfContext::index_block_read_count);
     s = ReadBlock(file, ReadOptions(), footer.index_handle(), &index_block);
   }
 
+  // Read the range deletions, which are needed to serve any request
+  Block* range_del_block = NULL;
+  if (s.ok()) {
+    s = ReadMetaBlocks(file, footer.metaindex_handle(), &range_del_block);
+  }
+
   if (s.ok()) {
     // We've successfully read the footer and the index block: we're
     // ready to serve requests.
@@ -60,10 +105,12 @@ Status Table::Open(const Options& options,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
+    rep->range_del_block = range_del_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     *table = new Table(rep);
   } else {
-    if (index_block) delete index_block;
+    delete index_block;
+    delete range_del_block;
   }
 
   return s;
@@ -112,8 +159,13 @@ Iterator* Table::BlockReader(void* arg,
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
+        RecordTick(table->rep_->options.statistics, kBlockCacheDataHit);
+        PerfCount(&PerfContext::block_cache_hit_count);
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
+        RecordTick(table->rep_->options.statistics, kBlockCacheDataMiss);
+        PerfTimer timer(&PerfContext::data_block_read_nanos);
+        PerfCount(&PerfContext::data_block_read_count);
         s = ReadBlock(table->rep_->file, options, handle, &block);
         if (s.ok() && options.fill_cache) {
           cache_handle = block_cache->Insert(
@@ -121,6 +173,8 @@ Iterator* Table::BlockReader(void* arg,
         }
       }
     } else {
+      PerfTimer timer(&PerfContext::data_block_read_nanos);
+      PerfCount(&PerfContext::data_block_read_count);
       s = ReadBlock(table->rep_->file, options, handle, &block);
     }
   }
@@ -145,6 +199,13 @@ Iterator* Table::NewIterator(const ReadOptions& options) const {
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
+Iterator* Table::NewRangeDeletionIterator() const {
+  if (rep_->range_del_block == NULL) {
+    return NULL;
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   Iterator* index_iter =
       rep_->index_block->NewIterator(rep_->options.comparator);
@@ -24,8 +24,10 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
   int64_t num_entries;
+  int64_t num_range_deletions;
   bool closed;          // Either Finish() or Abandon() has been called.
 
   // We do not emit the index entry for a block until we have seen the
@@ -49,7 +51,9 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        range_del_block(&index_block_options),
         num_entries(0),
+        num_range_deletions(0),
         closed(false),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
@@ -108,6 +112,14 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeDeletion(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->num_range_deletions++;
+  r->range_del_block.Add(key, value);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -183,8 +195,17 @@ Status TableBuilder::Finish() {
   BlockHandle index_block_handle;
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
+    if (r->num_range_deletions > 0) {
+      BlockHandle range_del_handle;
+      WriteBlock(&r->range_del_block, &range_del_handle);
+      std::string handle_encoding;
+      range_del_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDeletionBlockName, handle_encoding);
+    }
     // TODO(postrelease): Add stats and other meta blocks
-    WriteBlock(&meta_index_block, &metaindex_block_handle);
+    if (ok()) {
+      WriteBlock(&meta_index_block, &metaindex_block_handle);
+    }
   }
   if (ok()) {
     if (r->pending_index_entry) {
@@ -220,6 +241,10 @@ uint64_t TableBuilder::NumEntries() const {
   return rep_->num_entries;
 }
 
+uint64_t TableBuilder::NumRangeDeletions() const {
+  return rep_->num_range_deletions;
+}
+
 uint64_t TableBuilder::FileSize() const {
   return rep_->offset;
 }
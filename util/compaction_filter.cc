@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/compaction_filter.h"
+
+#include "leveldb/env.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+CompactionFilter::~CompactionFilter() { }
+
+namespace {
+
+static const size_t kTimestampSize = 4;
+
+static uint32_t NowSeconds(Env* env) {
+  return static_cast<uint32_t>(env->NowMicros() / 1000000);
+}
+
+class TTLCompactionFilter : public CompactionFilter {
+ private:
+  const int32_t ttl_;
+  Env* const env_;
+
+ public:
+  TTLCompactionFilter(int32_t ttl, Env* env) : ttl_(ttl), env_(env) { }
+
+  virtual Decision Filter(int level, const Slice& key, const Slice& value,
+                          std::string* new_value) const {
+    Slice v = value;
+    uint32_t timestamp;
+    if (!StripTTLTimestamp(&v, &timestamp)) {
+      return kKeep;
+    }
+    const uint32_t now = NowSeconds(env_);
+    if (timestamp < now && now - timestamp > static_cast<uint32_t>(ttl_)) {
+      return kRemove;
+    }
+    return kKeep;
+  }
+
+  virtual const char* Name() const {
+    return "leveldb.TTLCompactionFilter";
+  }
+};
+
+}
+
+const CompactionFilter* NewTTLCompactionFilter(int32_t ttl_seconds, Env* env) {
+  return new TTLCompactionFilter(ttl_seconds,
+                                 env != NULL ? env : Env::Default());
+}
+
+void AppendTTLTimestamp(std::string* value, Env* env) {
+  PutFixed32(value, NowSeconds(env != NULL ? env : Env::Default()));
+}
+
+bool StripTTLTimestamp(Slice* value, uint32_t* timestamp) {
+  if (value->size() < kTimestampSize) {
+    return false;
+  }
+  const size_t n = value->size() - kTimestampSize;
+  if (timestamp != NULL) {
+    *timestamp = DecodeFixed32(value->data() + n);
+  }
+  *value = Slice(value->data(), n);
+  return true;
+}
+
+}
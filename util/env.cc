@@ -33,6 +33,21 @@ void Log(Logger* info_log, const char* format, ...) {
   }
 }
 
+Status Env::ReuseWritableFile(const std::string& fname,
+                              const std::string& old_fname,
+                              WritableFile** result) {
+  Status s = RenameFile(old_fname, fname);
+  if (!s.ok()) {
+    *result = NULL;
+    return s;
+  }
+  return NewWritableFile(fname, result);
+}
+
+Status Env::LinkFile(const std::string& src, const std::string& target) {
+  return Status::NotSupported("LinkFile", src);
+}
+
 Status WriteStringToFile(Env* env, const Slice& data,
                          const std::string& fname) {
   WritableFile* file;
@@ -76,6 +91,58 @@ Status ReadFileToString(Env* env, const std::string& fname, std::string* data) {
   return s;
 }
 
+static Status DoCopyFile(Env* env, const std::string& src,
+                         const std::string& target, uint64_t size) {
+  SequentialFile* src_file;
+  Status s = env->NewSequentialFile(src, &src_file);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* target_file;
+  s = env->NewWritableFile(target, &target_file);
+  if (!s.ok()) {
+    delete src_file;
+    return s;
+  }
+  static const int kBufferSize = 65536;
+  char* space = new char[kBufferSize];
+  while (size > 0) {
+    Slice fragment;
+    const size_t n = (size < kBufferSize) ? size : kBufferSize;
+    s = src_file->Read(n, &fragment, space);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = target_file->Append(fragment);
+    if (!s.ok()) {
+      break;
+    }
+    size -= fragment.size();
+  }
+  delete[] space;
+  if (s.ok()) {
+    s = target_file->Sync();
+  }
+  if (s.ok()) {
+    s = target_file->Close();
+  }
+  delete target_file;
+  delete src_file;
+  if (!s.ok()) {
+    env->DeleteFile(target);
+  }
+  return s;
+}
+
+Status CopyFile(Env* env, const std::string& src, const std::string& target) {
+  return DoCopyFile(env, src, target, ~static_cast<uint64_t>(0));
+}
+
+Status CopyFilePrefix(Env* env, const std::string& src,
+                      const std::string& target, uint64_t size) {
+  return DoCopyFile(env, src, target, size);
+}
+
 EnvWrapper::~EnvWrapper() {
 }
 
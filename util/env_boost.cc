@@ -418,6 +418,20 @@ class PosixEnv : public Env {
     return result;
   }
 
+  virtual Status LinkFile(const std::string& src, const std::string& target) {
+    boost::system::error_code ec;
+
+    boost::filesystem::create_hard_link(src, target, ec);
+
+    Status result;
+
+    if (ec != 0) {
+      result = Status::NotSupported(src, ec.message());
+    }
+
+    return result;
+  }
+
 
   virtual Status LockFile(const std::string& fname, FileLock** lock) {
     *lock = nullptr;
@@ -104,6 +104,8 @@ class PosixMmapFile : public WritableFile {
   char* dst_;             // Where to write next  (in range [base_,limit_])
   char* last_sync_;       // Where have we synced up to
   uint64_t file_offset_;  // Offset of base_ in file
+  uint64_t file_size_;    // Size of the file, including mapped regions
+  uint64_t reused_size_;  // Size of a reused file, which is never shrunk
 
   // Have we done an munmap of unsynced data?
   bool pending_sync_;
@@ -145,8 +147,11 @@ class PosixMmapFile : public WritableFile {
 
   bool MapNewRegion() {
     assert(base_ == NULL);
-    if (ftruncate(fd_, file_offset_ + map_size_) < 0) {
-      return false;
+    if (file_offset_ + map_size_ > file_size_) {
+      if (ftruncate(fd_, file_offset_ + map_size_) < 0) {
+        return false;
+      }
+      file_size_ = file_offset_ + map_size_;
     }
     void* ptr = mmap(NULL, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
                      fd_, file_offset_);
@@ -161,7 +166,9 @@ class PosixMmapFile : public WritableFile {
   }
 
  public:
-  PosixMmapFile(const std::string& fname, int fd, size_t page_size)
+  // "size" is the size of the file when it is reused, and zero otherwise
+  PosixMmapFile(const std::string& fname, int fd, size_t page_size,
+                uint64_t size)
       : filename_(fname),
         fd_(fd),
         page_size_(page_size),
@@ -171,6 +178,8 @@ class PosixMmapFile : public WritableFile {
         dst_(NULL),
         last_sync_(NULL),
         file_offset_(0),
+        file_size_(size),
+        reused_size_(size),
         pending_sync_(false) {
     assert((page_size & (page_size - 1)) == 0);
   }
@@ -210,9 +219,14 @@ class PosixMmapFile : public WritableFile {
     size_t unused = limit_ - dst_;
     if (!UnmapCurrentRegion()) {
       s = IOError(filename_, errno);
-    } else if (unused > 0) {
-      // Trim the extra space at the end of the file
-      if (ftruncate(fd_, file_offset_ - unused) < 0) {
+    } else {
+      // Trim the extra space at the end of the file, but never shrink a
+      // reused file below the size it had
+      uint64_t size = file_offset_ - unused;
+      if (size < reused_size_) {
+        size = reused_size_;
+      }
+      if (size < file_size_ && ftruncate(fd_, size) < 0) {
         s = IOError(filename_, errno);
       }
     }
@@ -233,6 +247,14 @@ class PosixMmapFile : public WritableFile {
     return Status::OK();
   }
 
+  virtual void Preallocate(uint64_t size) {
+#if defined(OS_LINUX)
+    // Allocate the blocks without changing the size of the file, which
+    // the mapped regions extend as they are written
+    fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, size);
+#endif
+  }
+
   virtual Status Sync() {
     Status s;
 
@@ -314,7 +336,28 @@ class PosixEnv : public Env {
       *result = NULL;
       s = IOError(fname, errno);
     } else {
-      *result = new PosixMmapFile(fname, fd, page_size_);
+      *result = new PosixMmapFile(fname, fd, page_size_, 0);
+    }
+    return s;
+  }
+
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result) {
+    Status s;
+    *result = NULL;
+    if (rename(old_fname.c_str(), fname.c_str()) != 0) {
+      return IOError(old_fname, errno);
+    }
+    const int fd = open(fname.c_str(), O_RDWR, 0644);
+    struct stat sbuf;
+    if (fd < 0) {
+      s = IOError(fname, errno);
+    } else if (fstat(fd, &sbuf) != 0) {
+      s = IOError(fname, errno);
+      close(fd);
+    } else {
+      *result = new PosixMmapFile(fname, fd, page_size_, sbuf.st_size);
     }
     return s;
   }
@@ -382,6 +425,18 @@ class PosixEnv : public Env {
     return result;
   }
 
+  virtual Status LinkFile(const std::string& src, const std::string& target) {
+    Status result;
+    if (link(src.c_str(), target.c_str()) != 0) {
+      if (errno == EXDEV || errno == EPERM) {
+        result = Status::NotSupported("cross-device link", src);
+      } else {
+        result = IOError(src, errno);
+      }
+    }
+    return result;
+  }
+
   virtual Status LockFile(const std::string& fname, FileLock** lock) {
     *lock = NULL;
     Status result;
@@ -452,6 +507,14 @@ class PosixEnv : public Env {
     return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
   }
 
+#if defined(OS_LINUX)
+  virtual uint64_t NowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+#endif
+
   virtual void SleepForMicroseconds(int micros) {
     usleep(micros);
   }
@@ -16,13 +16,47 @@ Options::Options()
       paranoid_checks(false),
       env(Env::Default()),
       info_log(NULL),
+      use_column_families(false),
+      compaction_filter(NULL),
+      merge_operator(NULL),
+      num_levels(7),
+      level0_file_num_compaction_trigger(4),
+      level0_slowdown_writes_trigger(8),
+      level0_stop_writes_trigger(12),
+      max_mem_compaction_level(2),
+      max_bytes_for_level_base(10 << 20),
+      max_bytes_for_level_multiplier(10),
+      level_compaction_dynamic_level_bytes(false),
+      compaction_pri(kCompactionPriRoundRobin),
+      deletion_compaction_percent(0),
+      compaction_style(kCompactionStyleLevel),
+      universal_size_ratio(1),
+      universal_min_merge_width(2),
+      universal_max_size_amplification_percent(200),
+      disable_auto_compactions(false),
       write_buffer_size(4<<20),
+      write_buffer_manager(NULL),
+      delayed_write_rate(16 << 20),
+      soft_pending_compaction_bytes_limit(1 << 30),
+      rate_limiter(NULL),
+      statistics(NULL),
       max_open_files(1000),
+      max_manifest_file_size(64 << 20),
+      preload_table_files(false),
+      max_file_opening_threads(16),
+      recycle_log_file_num(0),
       block_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
-      compression(kSnappyCompression) {
+      compression(kSnappyCompression),
+      min_blob_size(0),
+      blob_garbage_collection_ratio(0.5) {
 }
 
+Options* Options::PrepareForBulkLoad() {
+  disable_auto_compactions = true;
+  write_buffer_size = 128 << 20;
+  return this;
+}
 
 }
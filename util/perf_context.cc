@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/perf_context.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace leveldb {
+
+// PerfContext and PerfLevel are plain data, so the compilers' native
+// thread-local storage can hold them without any initialization.
+#if defined(_MSC_VER)
+#define LEVELDB_THREAD_LOCAL __declspec(thread)
+#else
+#define LEVELDB_THREAD_LOCAL __thread
+#endif
+
+static LEVELDB_THREAD_LOCAL PerfLevel perf_level = kPerfDisabled;
+static LEVELDB_THREAD_LOCAL PerfContext perf_context;
+
+void SetPerfLevel(PerfLevel level) {
+  perf_level = level;
+}
+
+PerfLevel GetPerfLevel() {
+  return perf_level;
+}
+
+PerfContext* GetPerfContext() {
+  return &perf_context;
+}
+
+void PerfContext::Reset() {
+  memset(this, 0, sizeof(*this));
+}
+
+std::string PerfContext::ToString() const {
+  struct Field {
+    const char* name;
+    uint64_t value;
+  };
+  const Field fields[] = {
+    { "db_mutex_lock_nanos", db_mutex_lock_nanos },
+    { "get_from_memtable_count", get_from_memtable_count },
+    { "get_from_memtable_nanos", get_from_memtable_nanos },
+    { "get_from_output_files_nanos", get_from_output_files_nanos },
+    { "get_files_probed_count", get_files_probed_count },
+    { "find_table_nanos", find_table_nanos },
+    { "table_open_count", table_open_count },
+    { "index_block_read_count", index_block_read_count },
+    { "index_block_read_nanos", index_block_read_nanos },
+    { "block_cache_hit_count", block_cache_hit_count },
+    { "data_block_read_count", data_block_read_count },
+    { "data_block_read_nanos", data_block_read_nanos },
+    { "block_read_count", block_read_count },
+    { "block_read_byte", block_read_byte },
+    { "block_read_nanos", block_read_nanos },
+    { "block_checksum_nanos", block_checksum_nanos },
+    { "block_decompress_nanos", block_decompress_nanos },
+  };
+  std::string result;
+  char buf[100];
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    if (fields[i].value != 0) {
+      snprintf(buf, sizeof(buf), "%s = %llu, ", fields[i].name,
+               static_cast<unsigned long long>(fields[i].value));
+      result.append(buf);
+    }
+  }
+  return result;
+}
+
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_UTIL_PERF_CONTEXT_H_
+
+#include "leveldb/env.h"
+#include "leveldb/perf_context.h"
+
+namespace leveldb {
+
+// Helpers for updating the PerfContext of the calling thread.  Each
+// costs a single check of the thread's perf level when it is below the
+// level they record at.
+
+inline void PerfCount(uint64_t PerfContext::*field, uint64_t n = 1) {
+  if (GetPerfLevel() >= kPerfCounts) {
+    GetPerfContext()->*field += n;
+  }
+}
+
+// Adds the nanoseconds between its construction and Stop() (or its
+// destruction) to a field.
+class PerfTimer {
+ public:
+  explicit PerfTimer(uint64_t PerfContext::*field)
+      : field_(field),
+        start_(GetPerfLevel() >= kPerfTimings
+               ? Env::Default()->NowNanos() : 0) {
+  }
+
+  ~PerfTimer() { Stop(); }
+
+  void Stop() {
+    if (start_ != 0) {
+      GetPerfContext()->*field_ += Env::Default()->NowNanos() - start_;
+      start_ = 0;
+    }
+  }
+
+ private:
+  uint64_t PerfContext::*field_;
+  uint64_t start_;
+
+  // No copying allowed
+  PerfTimer(const PerfTimer&);
+  void operator=(const PerfTimer&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_CONTEXT_H_
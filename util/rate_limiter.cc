@@ -0,0 +1,286 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <assert.h>
+#include <deque>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() { }
+
+namespace {
+
+// An auto-tuned limiter reconsiders its rate after this many refill
+// periods.
+static const int kTunePeriods = 100;
+
+// The rate is lowered when fewer than kLowWatermarkPct percent of the
+// refills left requests waiting and raised when more than
+// kHighWatermarkPct percent did, by kAdjustPct percent each time.
+static const int kLowWatermarkPct = 50;
+static const int kHighWatermarkPct = 90;
+static const int kAdjustPct = 5;
+
+// Auto-tuning never lowers the rate below 1/kAllowedRangeFactor of the
+// configured bound.
+static const int kAllowedRangeFactor = 20;
+
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(int64_t rate_bytes_per_sec, int64_t refill_period_us,
+                     int32_t fairness, bool auto_tuned, Env* env)
+      : env_(env),
+        refill_period_us_(refill_period_us),
+        fairness_(fairness > 0 ? fairness : 1),
+        auto_tuned_(auto_tuned),
+        max_bytes_per_sec_(rate_bytes_per_sec),
+        cv_(&mu_),
+        rnd_(301),
+        refilling_(false),
+        num_drains_(0) {
+    assert(rate_bytes_per_sec > 0);
+    assert(refill_period_us > 0);
+    SetRate(rate_bytes_per_sec);
+    available_bytes_ = refill_bytes_per_period_;
+    next_refill_us_ = env_->NowMicros() + refill_period_us_;
+    tuned_time_us_ = next_refill_us_;
+    for (int i = 0; i < IO_TOTAL; i++) {
+      total_bytes_through_[i] = 0;
+      total_requests_[i] = 0;
+    }
+  }
+
+  virtual ~GenericRateLimiter() {
+    MutexLock l(&mu_);
+    assert(queue_[IO_LOW].empty() && queue_[IO_HIGH].empty());
+  }
+
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) {
+    assert(bytes_per_second > 0);
+    MutexLock l(&mu_);
+    SetRate(bytes_per_second);
+  }
+
+  virtual int64_t GetBytesPerSecond() const {
+    MutexLock l(&mu_);
+    return rate_bytes_per_sec_;
+  }
+
+  virtual int64_t GetSingleBurstBytes() const {
+    MutexLock l(&mu_);
+    return refill_bytes_per_period_;
+  }
+
+  virtual int64_t GetTotalBytesThrough(IOPriority pri) const {
+    MutexLock l(&mu_);
+    if (pri == IO_TOTAL) {
+      return total_bytes_through_[IO_LOW] + total_bytes_through_[IO_HIGH];
+    }
+    return total_bytes_through_[pri];
+  }
+
+  virtual int64_t GetTotalRequests(IOPriority pri) const {
+    MutexLock l(&mu_);
+    if (pri == IO_TOTAL) {
+      return total_requests_[IO_LOW] + total_requests_[IO_HIGH];
+    }
+    return total_requests_[pri];
+  }
+
+  virtual void Request(int64_t bytes, IOPriority pri) {
+    assert(pri == IO_LOW || pri == IO_HIGH);
+    if (bytes <= 0) {
+      return;
+    }
+    MutexLock l(&mu_);
+    total_requests_[pri]++;
+    total_bytes_through_[pri] += bytes;
+
+    if (queue_[IO_LOW].empty() && queue_[IO_HIGH].empty() &&
+        available_bytes_ >= bytes) {
+      available_bytes_ -= bytes;
+      return;
+    }
+
+    // Wait in line.  The first waiter to find nobody refilling sleeps
+    // until the next refill and hands out the new bytes; the others
+    // wait on cv_.  A request larger than a single refill is granted
+    // piecewise over several refills.
+    Req r(bytes);
+    queue_[pri].push_back(&r);
+    while (!r.granted) {
+      if (refilling_) {
+        cv_.Wait();
+        continue;
+      }
+      refilling_ = true;
+      const uint64_t now = env_->NowMicros();
+      if (now < next_refill_us_) {
+        mu_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(next_refill_us_ - now));
+        mu_.Lock();
+      }
+      Refill();
+      refilling_ = false;
+      cv_.SignalAll();
+    }
+  }
+
+ private:
+  struct Req {
+    int64_t remaining;
+    bool granted;
+    explicit Req(int64_t bytes) : remaining(bytes), granted(false) { }
+  };
+
+  // REQUIRES: mu_ is held
+  void SetRate(int64_t bytes_per_second) {
+    rate_bytes_per_sec_ = bytes_per_second;
+    refill_bytes_per_period_ =
+        bytes_per_second * refill_period_us_ / 1000000;
+    if (refill_bytes_per_period_ < 1) {
+      refill_bytes_per_period_ = 1;
+    }
+  }
+
+  // REQUIRES: mu_ is held
+  void Refill() {
+    const uint64_t now = env_->NowMicros();
+    next_refill_us_ = now + refill_period_us_;
+    if (auto_tuned_ &&
+        now >= tuned_time_us_ + kTunePeriods * refill_period_us_) {
+      Tune(now);
+    }
+    if (available_bytes_ < refill_bytes_per_period_) {
+      available_bytes_ += refill_bytes_per_period_;
+    }
+
+    const bool low_first = rnd_.OneIn(fairness_);
+    for (int i = 0; i < IO_TOTAL; i++) {
+      std::deque<Req*>* queue = &queue_[low_first ? i : IO_TOTAL - 1 - i];
+      while (!queue->empty()) {
+        Req* next = queue->front();
+        if (available_bytes_ < next->remaining) {
+          next->remaining -= available_bytes_;
+          available_bytes_ = 0;
+          break;
+        }
+        available_bytes_ -= next->remaining;
+        next->remaining = 0;
+        next->granted = true;
+        queue->pop_front();
+      }
+    }
+    if (!queue_[IO_LOW].empty() || !queue_[IO_HIGH].empty()) {
+      num_drains_++;
+    }
+  }
+
+  // REQUIRES: mu_ is held
+  void Tune(uint64_t now) {
+    const int64_t periods = (now - tuned_time_us_) / refill_period_us_;
+    const int64_t drained_pct = num_drains_ * 100 / periods;
+    int64_t rate = rate_bytes_per_sec_;
+    if (drained_pct < kLowWatermarkPct) {
+      rate = rate * 100 / (100 + kAdjustPct);
+      const int64_t min_rate = max_bytes_per_sec_ / kAllowedRangeFactor;
+      if (rate < min_rate) rate = min_rate;
+    } else if (drained_pct > kHighWatermarkPct) {
+      rate = rate * (100 + kAdjustPct) / 100;
+      if (rate > max_bytes_per_sec_) rate = max_bytes_per_sec_;
+    }
+    if (rate > 0 && rate != rate_bytes_per_sec_) {
+      SetRate(rate);
+    }
+    num_drains_ = 0;
+    tuned_time_us_ = now;
+  }
+
+  Env* const env_;
+  const int64_t refill_period_us_;
+  const int32_t fairness_;
+  const bool auto_tuned_;
+  const int64_t max_bytes_per_sec_;
+
+  mutable port::Mutex mu_;
+  port::CondVar cv_;           // Signalled after every refill
+  Random rnd_;
+  int64_t rate_bytes_per_sec_;
+  int64_t refill_bytes_per_period_;
+  int64_t available_bytes_;
+  uint64_t next_refill_us_;
+  bool refilling_;             // Some waiter is sleeping until the refill
+  std::deque<Req*> queue_[IO_TOTAL];
+
+  // Auto-tuning state
+  uint64_t tuned_time_us_;
+  int64_t num_drains_;         // Refills that left requests waiting
+
+  int64_t total_bytes_through_[IO_TOTAL];
+  int64_t total_requests_[IO_TOTAL];
+};
+
+class RateLimitedFile : public WritableFile {
+ public:
+  RateLimitedFile(WritableFile* base, RateLimiter* limiter,
+                  RateLimiter::IOPriority pri)
+      : base_(base), limiter_(limiter), pri_(pri) { }
+  virtual ~RateLimitedFile() { delete base_; }
+
+  virtual Status Append(const Slice& data) {
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+      size_t n = left;
+      const int64_t burst = limiter_->GetSingleBurstBytes();
+      if (static_cast<int64_t>(n) > burst) {
+        n = static_cast<size_t>(burst);
+      }
+      limiter_->Request(n, pri_);
+      Status s = base_->Append(Slice(p, n));
+      if (!s.ok()) {
+        return s;
+      }
+      p += n;
+      left -= n;
+    }
+    return Status::OK();
+  }
+  virtual Status Close() { return base_->Close(); }
+  virtual Status Flush() { return base_->Flush(); }
+  virtual Status Sync() { return base_->Sync(); }
+
+ private:
+  WritableFile* base_;
+  RateLimiter* limiter_;
+  RateLimiter::IOPriority pri_;
+};
+
+}
+
+WritableFile* NewRateLimitedFile(WritableFile* base, RateLimiter* limiter,
+                                 RateLimiter::IOPriority pri) {
+  if (limiter == NULL) {
+    return base;
+  }
+  return new RateLimitedFile(base, limiter, pri);
+}
+
+RateLimiter* NewGenericRateLimiter(int64_t rate_bytes_per_sec,
+                                   int64_t refill_period_us,
+                                   int32_t fairness,
+                                   bool auto_tuned,
+                                   Env* env) {
+  return new GenericRateLimiter(rate_bytes_per_sec, refill_period_us,
+                                fairness, auto_tuned,
+                                env != NULL ? env : Env::Default());
+}
+
+}
@@ -0,0 +1,23 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+
+#include "leveldb/rate_limiter.h"
+
+namespace leveldb {
+
+class WritableFile;
+
+// Return a file that requests every append from "limiter" at priority
+// "pri" before passing it on to "base".  The result owns "base".
+// Returns "base" itself if "limiter" is NULL.
+extern WritableFile* NewRateLimitedFile(WritableFile* base,
+                                        RateLimiter* limiter,
+                                        RateLimiter::IOPriority pri);
+
+}
+
+#endif  // STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
@@ -0,0 +1,67 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include "leveldb/env.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class RateLimiterTest { };
+
+TEST(RateLimiterTest, Accounting) {
+  RateLimiter* limiter = NewGenericRateLimiter(1 << 20);
+  ASSERT_EQ(1 << 20, limiter->GetBytesPerSecond());
+  ASSERT_EQ((1 << 20) / 10, limiter->GetSingleBurstBytes());
+  limiter->Request(100, RateLimiter::IO_LOW);
+  limiter->Request(200, RateLimiter::IO_HIGH);
+  limiter->Request(300, RateLimiter::IO_HIGH);
+  ASSERT_EQ(100, limiter->GetTotalBytesThrough(RateLimiter::IO_LOW));
+  ASSERT_EQ(500, limiter->GetTotalBytesThrough(RateLimiter::IO_HIGH));
+  ASSERT_EQ(600, limiter->GetTotalBytesThrough());
+  ASSERT_EQ(1, limiter->GetTotalRequests(RateLimiter::IO_LOW));
+  ASSERT_EQ(3, limiter->GetTotalRequests());
+
+  limiter->SetBytesPerSecond(2 << 20);
+  ASSERT_EQ(2 << 20, limiter->GetBytesPerSecond());
+  delete limiter;
+}
+
+TEST(RateLimiterTest, Rate) {
+  const int64_t kRate = 1 << 20;
+  RateLimiter* limiter = NewGenericRateLimiter(kRate, 10000);
+  Env* env = Env::Default();
+
+  // 256KB at 1MB/s takes about a quarter of a second, less the bytes
+  // granted up front.
+  const uint64_t start = env->NowMicros();
+  for (int i = 0; i < 128; i++) {
+    limiter->Request(2048, RateLimiter::IO_LOW);
+  }
+  const uint64_t elapsed = env->NowMicros() - start;
+  ASSERT_GE(elapsed, 200000);
+  ASSERT_LE(elapsed, 1000000);
+  delete limiter;
+}
+
+TEST(RateLimiterTest, AutoTuneLowersIdleRate) {
+  const int64_t kRate = 1 << 20;
+  RateLimiter* limiter = NewGenericRateLimiter(kRate, 1000, 10, true);
+  Env* env = Env::Default();
+
+  // Nothing waited during the last hundred refill periods, so the next
+  // refill lowers the rate.
+  env->SleepForMicroseconds(200000);
+  limiter->Request(2 * limiter->GetSingleBurstBytes(), RateLimiter::IO_HIGH);
+  ASSERT_LT(limiter->GetBytesPerSecond(), kRate);
+  ASSERT_GE(limiter->GetBytesPerSecond(), kRate / 20);
+  delete limiter;
+}
+
+}
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
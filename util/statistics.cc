@@ -0,0 +1,192 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/statistics.h"
+
+#include <stdio.h>
+#include "port/port.h"
+#include "util/histogram.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+static const char* kTickerNames[kTickerMax] = {
+  "leveldb.index.block.hit",
+  "leveldb.index.block.miss",
+  "leveldb.block.cache.data.hit",
+  "leveldb.block.cache.data.miss",
+  "leveldb.number.keys.written",
+  "leveldb.bytes.written",
+  "leveldb.number.keys.read",
+  "leveldb.bytes.read",
+  "leveldb.wal.bytes",
+  "leveldb.wal.synced",
+  "leveldb.stall.micros",
+  "leveldb.compact.read.bytes",
+  "leveldb.compact.write.bytes",
+  "leveldb.flush.write.bytes",
+  "leveldb.seek.compactions",
+};
+
+static const char* kHistogramNames[kHistogramMax] = {
+  "leveldb.db.get.micros",
+  "leveldb.db.write.micros",
+  "leveldb.wal.sync.micros",
+  "leveldb.compaction.micros",
+  "leveldb.flush.micros",
+};
+
+const char* TickerName(Ticker ticker) {
+  return (ticker >= 0 && ticker < kTickerMax) ? kTickerNames[ticker] : "";
+}
+
+const char* HistogramName(HistogramType type) {
+  return (type >= 0 && type < kHistogramMax) ? kHistogramNames[type] : "";
+}
+
+Statistics::~Statistics() { }
+
+namespace {
+
+// Updates go to the shard of the core the thread runs on.  Each shard
+// has its own lock, which is uncontended unless a thread is moved to
+// another core while it records.
+static const int kNumShards = 32;
+
+class StatisticsImpl : public Statistics {
+ public:
+  StatisticsImpl() {
+    for (int i = 0; i < kNumShards; i++) {
+      shards_[i].Clear();
+    }
+  }
+
+  virtual void RecordTick(Ticker ticker, uint64_t count) {
+    Shard* shard = CurrentShard();
+    MutexLock l(&shard->mu);
+    shard->tickers[ticker] += count;
+  }
+
+  virtual void MeasureTime(HistogramType type, uint64_t value) {
+    Shard* shard = CurrentShard();
+    MutexLock l(&shard->mu);
+    shard->histograms[type].Add(static_cast<double>(value));
+  }
+
+  virtual uint64_t GetTickerCount(Ticker ticker) const {
+    uint64_t sum = 0;
+    for (int i = 0; i < kNumShards; i++) {
+      MutexLock l(&shards_[i].mu);
+      sum += shards_[i].tickers[ticker];
+    }
+    return sum;
+  }
+
+  virtual void GetSnapshot(StatisticsSnapshot* snapshot) const {
+    Histogram merged[kHistogramMax];
+    for (int t = 0; t < kTickerMax; t++) {
+      snapshot->tickers[t] = 0;
+    }
+    for (int h = 0; h < kHistogramMax; h++) {
+      merged[h].Clear();
+    }
+    for (int i = 0; i < kNumShards; i++) {
+      MutexLock l(&shards_[i].mu);
+      for (int t = 0; t < kTickerMax; t++) {
+        snapshot->tickers[t] += shards_[i].tickers[t];
+      }
+      for (int h = 0; h < kHistogramMax; h++) {
+        merged[h].Merge(shards_[i].histograms[h]);
+      }
+    }
+    for (int h = 0; h < kHistogramMax; h++) {
+      const Histogram& hist = merged[h];
+      HistogramData* data = &snapshot->histograms[h];
+      data->count = static_cast<uint64_t>(hist.Count());
+      if (data->count == 0) {
+        data->sum = data->min = data->max = data->average = 0;
+        data->standard_deviation = data->median = 0;
+        data->percentile95 = data->percentile99 = 0;
+        continue;
+      }
+      data->sum = hist.Sum();
+      data->min = hist.Min();
+      data->max = hist.Max();
+      data->average = hist.Average();
+      data->standard_deviation = hist.StandardDeviation();
+      data->median = hist.Median();
+      data->percentile95 = hist.Percentile(95);
+      data->percentile99 = hist.Percentile(99);
+    }
+  }
+
+  virtual void Reset() {
+    for (int i = 0; i < kNumShards; i++) {
+      MutexLock l(&shards_[i].mu);
+      shards_[i].Clear();
+    }
+  }
+
+  virtual std::string ToString() const {
+    StatisticsSnapshot snapshot;
+    GetSnapshot(&snapshot);
+    std::string result;
+    char buf[200];
+    for (int t = 0; t < kTickerMax; t++) {
+      snprintf(buf, sizeof(buf), "%s COUNT : %llu\n",
+               kTickerNames[t],
+               static_cast<unsigned long long>(snapshot.tickers[t]));
+      result.append(buf);
+    }
+    for (int h = 0; h < kHistogramMax; h++) {
+      const HistogramData& data = snapshot.histograms[h];
+      snprintf(buf, sizeof(buf),
+               "%s P50 : %.2f P95 : %.2f P99 : %.2f MAX : %.0f "
+               "COUNT : %llu SUM : %.0f\n",
+               kHistogramNames[h],
+               data.median, data.percentile95, data.percentile99, data.max,
+               static_cast<unsigned long long>(data.count), data.sum);
+      result.append(buf);
+    }
+    return result;
+  }
+
+ private:
+  struct Shard {
+    port::Mutex mu;
+    uint64_t tickers[kTickerMax];
+    Histogram histograms[kHistogramMax];
+    // Keep the hot counters of neighbouring shards in different cache
+    // lines.
+    char padding[64];
+
+    void Clear() {
+      for (int t = 0; t < kTickerMax; t++) {
+        tickers[t] = 0;
+      }
+      for (int h = 0; h < kHistogramMax; h++) {
+        histograms[h].Clear();
+      }
+    }
+  };
+
+  Shard* CurrentShard() {
+    int core = port::PhysicalCoreID();
+    if (core < 0) {
+      // Unknown core: spread threads by the address of their stack
+      core = static_cast<int>(reinterpret_cast<uintptr_t>(&core) >> 12);
+    }
+    return &shards_[static_cast<unsigned int>(core) % kNumShards];
+  }
+
+  mutable Shard shards_[kNumShards];
+};
+
+}
+
+Statistics* CreateDBStatistics() {
+  return new StatisticsImpl;
+}
+
+}
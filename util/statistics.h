@@ -0,0 +1,57 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_STATISTICS_H_
+#define STORAGE_LEVELDB_UTIL_STATISTICS_H_
+
+#include <stddef.h>
+#include "leveldb/env.h"
+#include "leveldb/statistics.h"
+
+namespace leveldb {
+
+// Helpers for recording into an optional Statistics object.  They do
+// nothing if "stats" is NULL.
+
+inline void RecordTick(Statistics* stats, Ticker ticker, uint64_t count = 1) {
+  if (stats != NULL) {
+    stats->RecordTick(ticker, count);
+  }
+}
+
+// Records the lifetime of a StopWatch in a histogram.  The clock is only
+// read if "stats" is non-NULL.
+class StopWatch {
+ public:
+  StopWatch(Env* env, Statistics* stats, HistogramType type)
+      : env_(env),
+        stats_(stats),
+        type_(type),
+        start_(stats != NULL ? env->NowMicros() : 0) {
+  }
+
+  ~StopWatch() {
+    if (stats_ != NULL) {
+      stats_->MeasureTime(type_, ElapsedMicros());
+    }
+  }
+
+  uint64_t ElapsedMicros() const {
+    return stats_ != NULL ? env_->NowMicros() - start_ : 0;
+  }
+
+ private:
+  Env* const env_;
+  Statistics* const stats_;
+  const HistogramType type_;
+  const uint64_t start_;
+
+  // No copying allowed
+  StopWatch(const StopWatch&);
+  void operator=(const StopWatch&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_UTIL_STATISTICS_H_
@@ -0,0 +1,188 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/write_buffer_manager.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+// Memory is charged to the cache in units of this many bytes.
+static const size_t kPlaceholderSize = 256 << 10;
+
+static void DeletePlaceholder(const Slice& key, void* value) {
+}
+
+struct WriteBufferManager::Rep {
+  struct Usage {
+    size_t active;    // Bytes in the mutable memtable
+    size_t total;     // Bytes in all memtables
+    int flushing;     // Number of FlushMemTable() calls in progress
+
+    Usage() : active(0), total(0), flushing(0) { }
+  };
+  typedef std::map<Consumer*, Usage> ConsumerMap;
+
+  const size_t buffer_size;
+  Cache* const cache;
+  uint64_t cache_id;
+
+  port::Mutex mu;
+  port::CondVar flush_cv;     // Signalled when a FlushMemTable() returns
+  size_t memory_usage;        // Sum of Usage::total
+  size_t active_usage;        // Sum of Usage::active
+  ConsumerMap consumers;
+
+  // Pinned entries of "cache" that account for memory_usage
+  std::vector<std::pair<std::string, Cache::Handle*> > placeholders;
+  uint64_t next_placeholder;
+
+  Rep(size_t size, Cache* c)
+      : buffer_size(size),
+        cache(c),
+        cache_id(0),
+        flush_cv(&mu),
+        memory_usage(0),
+        active_usage(0),
+        next_placeholder(0) {
+  }
+
+  // REQUIRES: mu is held
+  void UpdateCacheCharge() {
+    if (cache == NULL) {
+      return;
+    }
+    const size_t target =
+        (memory_usage + kPlaceholderSize - 1) / kPlaceholderSize;
+    while (placeholders.size() < target) {
+      std::string key;
+      PutFixed64(&key, cache_id);
+      PutFixed64(&key, next_placeholder++);
+      Cache::Handle* h = cache->Insert(key, NULL, kPlaceholderSize,
+                                       &DeletePlaceholder);
+      placeholders.push_back(std::make_pair(key, h));
+    }
+    while (placeholders.size() > target) {
+      cache->Erase(placeholders.back().first);
+      cache->Release(placeholders.back().second);
+      placeholders.pop_back();
+    }
+  }
+};
+
+WriteBufferManager::Consumer::~Consumer() { }
+
+WriteBufferManager::WriteBufferManager(size_t buffer_size, Cache* cache)
+    : rep_(new Rep(buffer_size, cache)) {
+  if (cache != NULL) {
+    rep_->cache_id = cache->NewId();
+  }
+}
+
+WriteBufferManager::~WriteBufferManager() {
+  {
+    MutexLock l(&rep_->mu);
+    assert(rep_->consumers.empty());
+    rep_->memory_usage = 0;
+    rep_->UpdateCacheCharge();
+  }
+  delete rep_;
+}
+
+size_t WriteBufferManager::buffer_size() const {
+  return rep_->buffer_size;
+}
+
+size_t WriteBufferManager::memory_usage() const {
+  MutexLock l(&rep_->mu);
+  return rep_->memory_usage;
+}
+
+bool WriteBufferManager::ShouldFlush() const {
+  MutexLock l(&rep_->mu);
+  const size_t limit = rep_->buffer_size;
+  if (limit == 0) {
+    return false;
+  }
+  // Flush early if the mutable memtables alone approach the budget.
+  // Otherwise only flush once the budget is exceeded and the mutable
+  // memtables hold a good part of it; if most of the memory is in
+  // memtables that are already being flushed, another flush would only
+  // produce tiny tables.
+  return rep_->active_usage > limit - limit / 8 ||
+      (rep_->memory_usage > limit && rep_->active_usage >= limit / 2);
+}
+
+void WriteBufferManager::Register(Consumer* consumer) {
+  MutexLock l(&rep_->mu);
+  assert(rep_->consumers.find(consumer) == rep_->consumers.end());
+  rep_->consumers[consumer] = Rep::Usage();
+}
+
+void WriteBufferManager::Unregister(Consumer* consumer) {
+  MutexLock l(&rep_->mu);
+  Rep::ConsumerMap::iterator iter = rep_->consumers.find(consumer);
+  assert(iter != rep_->consumers.end());
+  while (iter->second.flushing > 0) {
+    rep_->flush_cv.Wait();
+  }
+  rep_->memory_usage -= iter->second.total;
+  rep_->active_usage -= iter->second.active;
+  rep_->consumers.erase(iter);
+  rep_->UpdateCacheCharge();
+}
+
+void WriteBufferManager::SetUsage(Consumer* consumer,
+                                  size_t active_bytes,
+                                  size_t total_bytes) {
+  MutexLock l(&rep_->mu);
+  Rep::ConsumerMap::iterator iter = rep_->consumers.find(consumer);
+  assert(iter != rep_->consumers.end());
+  rep_->memory_usage -= iter->second.total;
+  rep_->memory_usage += total_bytes;
+  rep_->active_usage -= iter->second.active;
+  rep_->active_usage += active_bytes;
+  iter->second.active = active_bytes;
+  iter->second.total = total_bytes;
+  rep_->UpdateCacheCharge();
+}
+
+bool WriteBufferManager::FlushLargest(Consumer* self) {
+  Consumer* victim = NULL;
+  {
+    MutexLock l(&rep_->mu);
+    size_t largest = 0;
+    for (Rep::ConsumerMap::iterator iter = rep_->consumers.begin();
+         iter != rep_->consumers.end();
+         ++iter) {
+      if (iter->second.active > largest) {
+        victim = iter->first;
+        largest = iter->second.active;
+      }
+    }
+    if (victim == NULL) {
+      // Only memtables that are already being flushed use memory
+      return false;
+    } else if (victim == self) {
+      return true;
+    }
+    // Keep "victim" registered until the flush request returns.
+    rep_->consumers[victim].flushing++;
+  }
+
+  victim->FlushMemTable();
+
+  MutexLock l(&rep_->mu);
+  rep_->consumers[victim].flushing--;
+  rep_->flush_cv.SignalAll();
+  return false;
+}
+
+}